@@ -0,0 +1,943 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "cambrian/data/btree.h"
+#include "ediacaran/core/address.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace cambrian
+{
+    namespace
+    {
+        // layout of the meta page of a tree
+        struct MetaHeader
+        {
+            uint64_t     m_key_count;
+            page_address m_root;
+            uint32_t     m_height;
+        };
+
+        // layout of a node page
+        struct NodeHeader
+        {
+            uint32_t     m_level; // 0 for the leaves
+            uint32_t     m_count; // number of keys
+            uint32_t     m_prefix_length;
+            page_address m_link; // leaves: next leaf, interior nodes: leftmost child
+            page_address m_prev; // leaves: previous leaf
+            // followed by the prefix, by the uint32_t offsets of the records, and by the records
+        };
+
+        // layout of a key in a node
+        struct RecordHeader
+        {
+            page_address m_value; // leaves: value, interior nodes: child right of the key
+            uint32_t     m_suffix_length;
+            // followed by the suffix of the key, padded to alignof(RecordHeader)
+        };
+
+        using offset_t = uint32_t;
+
+        constexpr size_t record_size(size_t i_suffix_length) noexcept
+        {
+            return uint_upper_align(sizeof(RecordHeader) + i_suffix_length, alignof(RecordHeader));
+        }
+
+        constexpr size_t offsets_position(size_t i_prefix_length) noexcept
+        {
+            return uint_upper_align(sizeof(NodeHeader) + i_prefix_length, alignof(offset_t));
+        }
+
+        constexpr size_t records_position(size_t i_prefix_length, size_t i_count) noexcept
+        {
+            return uint_upper_align(
+              offsets_position(i_prefix_length) + i_count * sizeof(offset_t),
+              alignof(RecordHeader));
+        }
+
+        // lexicographical comparison of unsigned chars
+        int compare_keys(
+          const char * i_first,
+          size_t       i_first_length,
+          const char * i_second,
+          size_t       i_second_length)
+        {
+            auto const common = std::min(i_first_length, i_second_length);
+            if (common != 0)
+            {
+                auto const result = memcmp(i_first, i_second, common);
+                if (result != 0)
+                    return result;
+            }
+            if (i_first_length != i_second_length)
+                return i_first_length < i_second_length ? -1 : 1;
+            return 0;
+        }
+
+        int compare_keys(const string_view & i_first, const string_view & i_second)
+        {
+            return compare_keys(i_first.data(), i_first.size(), i_second.data(), i_second.size());
+        }
+
+        size_t common_prefix_length(const string_view & i_first, const string_view & i_second)
+        {
+            auto const max_length = std::min(i_first.size(), i_second.size());
+            size_t     length     = 0;
+            while (length < max_length && i_first[length] == i_second[length])
+                length++;
+            return length;
+        }
+
+        bool starts_with(const string_view & i_string, const string_view & i_prefix)
+        {
+            if (i_string.size() < i_prefix.size())
+                return false;
+            return i_prefix.empty() ||
+                   memcmp(i_string.data(), i_prefix.data(), i_prefix.size()) == 0;
+        }
+
+        MetaHeader & meta_of(const scoped_page & i_page) noexcept
+        {
+            return *static_cast<MetaHeader *>(i_page.mem_address());
+        }
+
+        NodeHeader & node_of(const scoped_page & i_page) noexcept
+        {
+            return *static_cast<NodeHeader *>(i_page.mem_address());
+        }
+
+        // read-only view on an encoded node
+        class NodeView
+        {
+          public:
+            NodeView(const void * i_page) noexcept : m_page(i_page) {}
+
+            const NodeHeader & header() const noexcept
+            {
+                return *static_cast<const NodeHeader *>(m_page);
+            }
+
+            uint32_t count() const noexcept { return header().m_count; }
+
+            bool is_leaf() const noexcept { return header().m_level == 0; }
+
+            string_view prefix() const noexcept
+            {
+                return string_view(
+                  static_cast<const char *>(address_add(m_page, sizeof(NodeHeader))),
+                  header().m_prefix_length);
+            }
+
+            string_view suffix(uint32_t i_index) const noexcept
+            {
+                auto const record = record_at(i_index);
+                return string_view(
+                  reinterpret_cast<const char *>(record + 1), record->m_suffix_length);
+            }
+
+            page_address value(uint32_t i_index) const noexcept
+            {
+                return record_at(i_index)->m_value;
+            }
+
+            page_address child(uint32_t i_index) const noexcept
+            {
+                CAMBRIAN_ASSERT(!is_leaf() && i_index <= count());
+                return i_index == 0 ? header().m_link : value(i_index - 1);
+            }
+
+            std::string key(uint32_t i_index) const
+            {
+                std::string result(prefix());
+                result += suffix(i_index);
+                return result;
+            }
+
+            bool key_equals(uint32_t i_index, const string_view & i_key) const noexcept
+            {
+                auto const key_prefix = prefix();
+                auto const key_suffix = suffix(i_index);
+                return i_key.size() == key_prefix.size() + key_suffix.size() &&
+                       starts_with(i_key, key_prefix) &&
+                       compare_keys(
+                         i_key.data() + key_prefix.size(),
+                         key_suffix.size(),
+                         key_suffix.data(),
+                         key_suffix.size()) == 0;
+            }
+
+            /* Returns the index of the first key not less than i_key, or (if i_upper is true) the
+               index of the first key greater than i_key. */
+            uint32_t bound(const string_view & i_key, bool i_upper) const noexcept
+            {
+                auto const key_prefix = prefix();
+                auto const common     = std::min(i_key.size(), key_prefix.size());
+                auto const prefix_cmp =
+                  compare_keys(i_key.data(), common, key_prefix.data(), common);
+                if (prefix_cmp < 0 || (prefix_cmp == 0 && i_key.size() < key_prefix.size()))
+                    return 0; // i_key is less than all the keys
+                if (prefix_cmp > 0)
+                    return count(); // i_key is greater than all the keys
+
+                string_view const key_suffix(
+                  i_key.data() + key_prefix.size(), i_key.size() - key_prefix.size());
+                uint32_t   first = 0, last = count();
+                while (first < last)
+                {
+                    auto const middle = first + (last - first) / 2;
+                    auto const cmp    = compare_keys(suffix(middle), key_suffix);
+                    if (cmp < 0 || (i_upper && cmp == 0))
+                        first = middle + 1;
+                    else
+                        last = middle;
+                }
+                return first;
+            }
+
+          private:
+            const RecordHeader * record_at(uint32_t i_index) const noexcept
+            {
+                CAMBRIAN_ASSERT(i_index < count());
+                auto const offsets = static_cast<const offset_t *>(
+                  address_add(m_page, offsets_position(header().m_prefix_length)));
+                return static_cast<const RecordHeader *>(address_add(m_page, offsets[i_index]));
+            }
+
+          private:
+            const void * m_page;
+        };
+
+        /* Inserts a key in an encoded node without decoding it, if the key starts with the
+           prefix of the node and the page has room for its record. The record is appended after
+           the last one, so only the offsets are sorted by key. Returns false if the node must
+           be rebuilt. */
+        bool insert_in_place(
+          void *              io_page,
+          page_size           i_page_size,
+          uint32_t            i_index,
+          const string_view & i_key,
+          page_address        i_value) noexcept
+        {
+            auto &     header = *static_cast<NodeHeader *>(io_page);
+            auto const prefix = header.m_prefix_length;
+            auto const count  = header.m_count;
+            string_view const node_prefix(
+              static_cast<const char *>(address_add(io_page, sizeof(NodeHeader))), prefix);
+            if (!starts_with(i_key, node_prefix))
+                return false;
+
+            auto const offsets =
+              static_cast<offset_t *>(address_add(io_page, offsets_position(prefix)));
+            auto const old_records = records_position(prefix, count);
+            auto const new_records = records_position(prefix, count + 1);
+            size_t     end         = old_records;
+            for (uint32_t index = 0; index < count; index++)
+            {
+                auto const record =
+                  static_cast<const RecordHeader *>(address_add(io_page, offsets[index]));
+                end = std::max(end, offsets[index] + record_size(record->m_suffix_length));
+            }
+
+            auto const shift         = new_records - old_records;
+            auto const suffix_length = i_key.size() - prefix;
+            if (end + shift + record_size(suffix_length) > i_page_size)
+                return false;
+
+            // the offsets grow by one, so the records may have to move to keep their alignment
+            if (shift != 0)
+            {
+                memmove(
+                  address_add(io_page, new_records),
+                  address_add(io_page, old_records),
+                  end - old_records);
+                for (uint32_t index = 0; index < count; index++)
+                    offsets[index] += static_cast<offset_t>(shift);
+                end += shift;
+            }
+            memmove(offsets + i_index + 1, offsets + i_index, (count - i_index) * sizeof(offset_t));
+
+            auto const record       = static_cast<RecordHeader *>(address_add(io_page, end));
+            record->m_value         = i_value;
+            record->m_suffix_length = static_cast<uint32_t>(suffix_length);
+            memcpy(record + 1, i_key.data() + prefix, suffix_length);
+            offsets[i_index] = static_cast<offset_t>(end);
+            header.m_count   = count + 1;
+            return true;
+        }
+
+        // decoded node, used to modify a node
+        struct NodeData
+        {
+            uint32_t                  m_level = 0;
+            page_address              m_link  = invalid_page_address;
+            page_address              m_prev  = invalid_page_address;
+            std::vector<std::string>  m_keys;
+            std::vector<page_address> m_values;
+
+            NodeData() = default;
+
+            NodeData(const NodeView & i_view)
+                : m_level(i_view.header().m_level), m_link(i_view.header().m_link),
+                  m_prev(i_view.header().m_prev)
+            {
+                auto const count = i_view.count();
+                m_keys.reserve(count + 1);
+                m_values.reserve(count + 1);
+                for (uint32_t index = 0; index < count; index++)
+                {
+                    m_keys.push_back(i_view.key(index));
+                    m_values.push_back(i_view.value(index));
+                }
+            }
+
+            size_t prefix_length(size_t i_begin, size_t i_end) const
+            {
+                // the keys are sorted, so the first and the last share the common prefix
+                if (i_end - i_begin < 2)
+                    return i_end == i_begin ? 0 : m_keys[i_begin].size();
+                return common_prefix_length(m_keys[i_begin], m_keys[i_end - 1]);
+            }
+
+            size_t encoded_size(size_t i_begin, size_t i_end) const
+            {
+                auto const prefix = prefix_length(i_begin, i_end);
+                auto       result = records_position(prefix, i_end - i_begin);
+                for (auto index = i_begin; index < i_end; index++)
+                    result += record_size(m_keys[index].size() - prefix);
+                return result;
+            }
+
+            size_t encoded_size() const { return encoded_size(0, m_keys.size()); }
+
+            void encode(void * i_page, page_size i_page_size) const
+            {
+                CAMBRIAN_ASSERT(encoded_size() <= i_page_size);
+                (void)i_page_size;
+
+                auto const count  = m_keys.size();
+                auto const prefix = prefix_length(0, count);
+
+                auto & header           = *static_cast<NodeHeader *>(i_page);
+                header.m_level          = m_level;
+                header.m_count          = static_cast<uint32_t>(count);
+                header.m_prefix_length  = static_cast<uint32_t>(prefix);
+                header.m_link           = m_link;
+                header.m_prev           = m_prev;
+                if (count != 0)
+                    memcpy(address_add(i_page, sizeof(NodeHeader)), m_keys[0].data(), prefix);
+
+                auto const offsets =
+                  static_cast<offset_t *>(address_add(i_page, offsets_position(prefix)));
+                auto position = records_position(prefix, count);
+                for (size_t index = 0; index < count; index++)
+                {
+                    auto const suffix_length = m_keys[index].size() - prefix;
+                    auto const record =
+                      static_cast<RecordHeader *>(address_add(i_page, position));
+                    record->m_value         = m_values[index];
+                    record->m_suffix_length = static_cast<uint32_t>(suffix_length);
+                    memcpy(record + 1, m_keys[index].data() + prefix, suffix_length);
+                    offsets[index] = static_cast<offset_t>(position);
+                    position += record_size(suffix_length);
+                }
+            }
+        };
+
+        // returns the shortest key that is greater than i_left and not greater than i_right
+        std::string shortest_separator(const std::string & i_left, const std::string & i_right)
+        {
+            CAMBRIAN_ASSERT(i_left < i_right);
+            return i_right.substr(0, common_prefix_length(i_left, i_right) + 1);
+        }
+
+        /* Returns the end of every group of keys in which a node that does not fit in a page is
+           split. The keys of an interior node between two groups move to the parent. The size of
+           a group is computed with its own prefix, that may be longer than the prefix of the
+           node. Two groups of similar size are preferred, but when a key has shrunk the prefix of
+           the node more groups may be needed. */
+        std::vector<size_t> split_points(const NodeData & i_node, page_size i_page_size)
+        {
+            auto const   count = i_node.m_keys.size();
+            size_t const gap   = i_node.m_level == 0 ? 0 : 1;
+
+            size_t best_split = 0, best_size = i_page_size + size_t(1);
+            for (size_t split = 1; split + gap < count; split++)
+            {
+                auto const size = std::max(
+                  i_node.encoded_size(0, split), i_node.encoded_size(split + gap, count));
+                if (size < best_size)
+                {
+                    best_split = split;
+                    best_size  = size;
+                }
+            }
+            if (best_split != 0)
+                return {best_split, count};
+
+            // every group takes as many keys as fit (a single key always fits)
+            std::vector<size_t> ends;
+            for (size_t begin = 0;;)
+            {
+                auto end = begin;
+                while (end < count &&
+                       (end == begin || i_node.encoded_size(begin, end + 1) <= i_page_size))
+                    end++;
+                ends.push_back(end);
+                if (end == count)
+                    return ends;
+                begin = end + gap;
+            }
+        }
+
+        // a node created by a split, and the key that separates it from the previous one
+        struct NewNode
+        {
+            std::string  m_separator;
+            page_address m_node;
+        };
+
+        /* Writes a node in its page. If the node does not fit, it is split, the keys on the right
+           are moved to new pages, and the separators and the new pages are returned. */
+        void write_node(
+          storage_device &       i_device,
+          page_size              i_page_size,
+          scoped_page &          i_page,
+          NodeData &             io_node,
+          std::vector<NewNode> & o_new_nodes)
+        {
+            o_new_nodes.clear();
+            if (io_node.encoded_size() <= i_page_size)
+            {
+                io_node.encode(i_page.mem_address(), i_page_size);
+                return;
+            }
+
+            auto const ends    = split_points(io_node, i_page_size);
+            auto const is_leaf = io_node.m_level == 0;
+            size_t const gap   = is_leaf ? 0 : 1;
+
+            std::vector<scoped_page> pages;
+            std::vector<NodeData>    nodes(ends.size() - 1);
+            for (size_t group = 1; group < ends.size(); group++)
+            {
+                auto const begin = ends[group - 1] + gap;
+                auto &     node  = nodes[group - 1];
+                pages.push_back(allocate_scoped_page(i_device));
+                node.m_level = io_node.m_level;
+                node.m_keys.assign(
+                  io_node.m_keys.begin() + begin, io_node.m_keys.begin() + ends[group]);
+                node.m_values.assign(
+                  io_node.m_values.begin() + begin, io_node.m_values.begin() + ends[group]);
+                if (is_leaf)
+                {
+                    o_new_nodes.push_back(
+                      {shortest_separator(io_node.m_keys[begin - 1], io_node.m_keys[begin]),
+                       pages.back().storage_address()});
+                }
+                else
+                {
+                    // the key before the group moves to the parent
+                    node.m_link = io_node.m_values[begin - 1];
+                    o_new_nodes.push_back(
+                      {io_node.m_keys[begin - 1], pages.back().storage_address()});
+                }
+            }
+
+            if (is_leaf)
+            {
+                // link the new leaves
+                auto prev = i_page.storage_address();
+                for (size_t index = 0; index < nodes.size(); index++)
+                {
+                    nodes[index].m_prev = prev;
+                    nodes[index].m_link = index + 1 < nodes.size()
+                                            ? pages[index + 1].storage_address()
+                                            : io_node.m_link;
+                    prev = pages[index].storage_address();
+                }
+                if (io_node.m_link != invalid_page_address)
+                {
+                    auto const next = map_scoped_page(
+                      i_device, io_node.m_link, storage_device::access_flags::read_write);
+                    node_of(next).m_prev = prev;
+                }
+                io_node.m_link = pages.front().storage_address();
+            }
+            io_node.m_keys.resize(ends.front());
+            io_node.m_values.resize(ends.front());
+
+            io_node.encode(i_page.mem_address(), i_page_size);
+            for (size_t index = 0; index < nodes.size(); index++)
+                nodes[index].encode(pages[index].mem_address(), i_page_size);
+        }
+
+        void format_empty_leaf(const scoped_page & i_page, page_size i_page_size)
+        {
+            NodeData().encode(i_page.mem_address(), i_page_size);
+        }
+
+    } // namespace
+
+    struct btree::RangeDeletion
+    {
+        string_view  m_first;
+        string_view  m_last;
+        bool         m_has_last      = false;
+        uint64_t     m_removed_count = 0;
+        bool         m_freed_leaves  = false;
+        page_address m_prev_of_freed = invalid_page_address; // leaf before the first freed leaf
+        page_address m_next_of_freed = invalid_page_address; // leaf after the last freed leaf
+    };
+
+    btree::btree(storage_device & i_device, page_address i_meta_page) noexcept
+        : m_device(&i_device), m_meta_page(i_meta_page),
+          m_page_size(i_device.get_info().m_page_size)
+    {
+    }
+
+    page_address btree::create(storage_device & i_device)
+    {
+        auto const page_size = i_device.get_info().m_page_size;
+        auto       root      = allocate_scoped_page(i_device);
+        format_empty_leaf(root, page_size);
+
+        auto meta                  = allocate_scoped_page(i_device);
+        meta_of(meta).m_key_count  = 0;
+        meta_of(meta).m_root       = root.storage_address();
+        meta_of(meta).m_height     = 0;
+        return meta.storage_address();
+    }
+
+    size_t btree::max_key_length() const noexcept
+    {
+        // guarantees that both the halves of a split node fit in a page
+        return m_page_size / 4 - 64;
+    }
+
+    page_address btree::lookup(const string_view & i_key) const
+    {
+        auto node =
+          meta_of(map_scoped_page(*m_device, m_meta_page, storage_device::access_flags::read))
+            .m_root;
+        for (;;)
+        {
+            auto const page = map_scoped_page(*m_device, node, storage_device::access_flags::read);
+            NodeView const view(page.mem_address());
+            if (view.is_leaf())
+            {
+                auto const index = view.bound(i_key, false);
+                if (index < view.count() && view.key_equals(index, i_key))
+                    return view.value(index);
+                return invalid_page_address;
+            }
+            node = view.child(view.bound(i_key, true));
+        }
+    }
+
+    bool btree::insert(const string_view & i_key, page_address i_value)
+    {
+        if (i_key.size() > max_key_length())
+            except<std::invalid_argument>("btree: the key is too long for the page size");
+
+        auto meta =
+          map_scoped_page(*m_device, m_meta_page, storage_device::access_flags::read_write);
+        auto & meta_header = meta_of(meta);
+
+        // descend to the leaf, recording the path
+        struct Step
+        {
+            page_address m_node;
+            uint32_t     m_child_index;
+        };
+        std::vector<Step> path;
+        path.reserve(meta_header.m_height);
+        auto node = meta_header.m_root;
+        for (;;)
+        {
+            auto const page = map_scoped_page(*m_device, node, storage_device::access_flags::read);
+            NodeView const view(page.mem_address());
+            if (view.is_leaf())
+                break;
+            auto const child_index = view.bound(i_key, true);
+            path.push_back({node, child_index});
+            node = view.child(child_index);
+        }
+
+        // insert in the leaf
+        std::vector<NewNode> new_nodes;
+        {
+            auto page = map_scoped_page(*m_device, node, storage_device::access_flags::read_write);
+            NodeView const view(page.mem_address());
+            auto const     index = view.bound(i_key, false);
+            if (index < view.count() && view.key_equals(index, i_key))
+                return false;
+
+            // the node is decoded only if it has to be split, or if the prefix changes
+            if (!insert_in_place(page.mem_address(), m_page_size, index, i_key, i_value))
+            {
+                NodeData leaf(view);
+                leaf.m_keys.emplace(leaf.m_keys.begin() + index, i_key);
+                leaf.m_values.insert(leaf.m_values.begin() + index, i_value);
+                write_node(*m_device, m_page_size, page, leaf, new_nodes);
+            }
+        }
+
+        // propagate the splits upward
+        for (auto step = path.rbegin(); step != path.rend() && !new_nodes.empty(); ++step)
+        {
+            auto page =
+              map_scoped_page(*m_device, step->m_node, storage_device::access_flags::read_write);
+            auto const & first = new_nodes.front();
+            if (new_nodes.size() == 1 &&
+                insert_in_place(
+                  page.mem_address(),
+                  m_page_size,
+                  step->m_child_index,
+                  first.m_separator,
+                  first.m_node))
+            {
+                new_nodes.clear();
+                break;
+            }
+            NodeData interior{NodeView(page.mem_address())};
+            auto     index = step->m_child_index;
+            for (auto & new_node : new_nodes)
+            {
+                interior.m_keys.insert(
+                  interior.m_keys.begin() + index, std::move(new_node.m_separator));
+                interior.m_values.insert(interior.m_values.begin() + index, new_node.m_node);
+                index++;
+            }
+            write_node(*m_device, m_page_size, page, interior, new_nodes);
+        }
+
+        // the root has been split: a new root is added, that may be split too
+        while (!new_nodes.empty())
+        {
+            auto     root_page = allocate_scoped_page(*m_device);
+            NodeData root;
+            root.m_level = meta_header.m_height + 1;
+            root.m_link  = meta_header.m_root;
+            for (auto & new_node : new_nodes)
+            {
+                root.m_keys.push_back(std::move(new_node.m_separator));
+                root.m_values.push_back(new_node.m_node);
+            }
+            meta_header.m_root = root_page.storage_address();
+            meta_header.m_height++;
+            write_node(*m_device, m_page_size, root_page, root, new_nodes);
+        }
+
+        meta_header.m_key_count++;
+        return true;
+    }
+
+    bool btree::remove(const string_view & i_key)
+    {
+        // [i_key, i_key + '\0') contains only i_key
+        std::string last(i_key);
+        last.push_back('\0');
+        string_view const last_view(last);
+        return remove_range(i_key, &last_view) == 1;
+    }
+
+    uint64_t btree::remove_range(const string_view & i_first, const string_view & i_last)
+    {
+        return remove_range(i_first, &i_last);
+    }
+
+    uint64_t btree::remove_prefix(const string_view & i_prefix)
+    {
+        // the first key greater than all the keys with the prefix
+        std::string last(i_prefix);
+        while (!last.empty() && static_cast<unsigned char>(last.back()) == 0xFF)
+            last.pop_back();
+        if (last.empty())
+            return remove_range(i_prefix, nullptr);
+        last.back() = static_cast<char>(static_cast<unsigned char>(last.back()) + 1);
+        string_view const last_view(last);
+        return remove_range(i_prefix, &last_view);
+    }
+
+    uint64_t btree::remove_range(const string_view & i_first, const string_view * i_last)
+    {
+        if (i_last != nullptr && compare_keys(*i_last, i_first) <= 0)
+            return 0;
+
+        auto meta =
+          map_scoped_page(*m_device, m_meta_page, storage_device::access_flags::read_write);
+        auto & meta_header = meta_of(meta);
+
+        RangeDeletion deletion;
+        deletion.m_first    = i_first;
+        deletion.m_has_last = i_last != nullptr;
+        if (i_last != nullptr)
+            deletion.m_last = *i_last;
+
+        bool const root_freed = erase_range(meta_header.m_root, deletion);
+
+        // the freed leaves are a contiguous run, so the chain is fixed by joining its ends
+        if (deletion.m_freed_leaves)
+        {
+            if (deletion.m_prev_of_freed != invalid_page_address)
+            {
+                auto const prev = map_scoped_page(
+                  *m_device, deletion.m_prev_of_freed, storage_device::access_flags::read_write);
+                node_of(prev).m_link = deletion.m_next_of_freed;
+            }
+            if (deletion.m_next_of_freed != invalid_page_address)
+            {
+                auto const next = map_scoped_page(
+                  *m_device, deletion.m_next_of_freed, storage_device::access_flags::read_write);
+                node_of(next).m_prev = deletion.m_prev_of_freed;
+            }
+        }
+
+        if (root_freed)
+        {
+            auto const root = allocate_scoped_page(*m_device);
+            format_empty_leaf(root, m_page_size);
+            meta_header.m_root   = root.storage_address();
+            meta_header.m_height = 0;
+        }
+        else
+        {
+            // remove the roots with a single child
+            while (meta_header.m_height > 0)
+            {
+                auto root = map_scoped_page(
+                  *m_device, meta_header.m_root, storage_device::access_flags::read);
+                if (node_of(root).m_count != 0)
+                    break;
+                auto const old_root = meta_header.m_root;
+                meta_header.m_root  = node_of(root).m_link;
+                meta_header.m_height--;
+                root.release();
+                m_device->deallocate_page(old_root);
+            }
+        }
+
+        CAMBRIAN_ASSERT(meta_header.m_key_count >= deletion.m_removed_count);
+        meta_header.m_key_count -= deletion.m_removed_count;
+        return deletion.m_removed_count;
+    }
+
+    // removes the keys in the range from a subtree, returning true if the node has been freed
+    bool btree::erase_range(page_address i_node, RangeDeletion & io_deletion)
+    {
+        auto page = map_scoped_page(*m_device, i_node, storage_device::access_flags::read_write);
+        NodeView const view(page.mem_address());
+
+        if (view.is_leaf())
+        {
+            auto const first = view.bound(io_deletion.m_first, false);
+            auto const last =
+              io_deletion.m_has_last ? view.bound(io_deletion.m_last, false) : view.count();
+            if (first >= last)
+                return false;
+
+            io_deletion.m_removed_count += last - first;
+            if (first == 0 && last == view.count())
+            {
+                page.release();
+                free_leaf(i_node, io_deletion);
+                return true;
+            }
+
+            NodeData leaf(view);
+            leaf.m_keys.erase(leaf.m_keys.begin() + first, leaf.m_keys.begin() + last);
+            leaf.m_values.erase(leaf.m_values.begin() + first, leaf.m_values.begin() + last);
+            leaf.encode(page.mem_address(), m_page_size);
+            return false;
+        }
+
+        NodeData const node(view);
+        auto const     key_count = node.m_keys.size();
+        auto const     child_at  = [&node](size_t i_index) {
+            return i_index == 0 ? node.m_link : node.m_values[i_index - 1];
+        };
+
+        // the children from first to last (inclusive) overlap the range
+        auto const first = view.bound(io_deletion.m_first, true);
+        auto const last =
+          io_deletion.m_has_last ? view.bound(io_deletion.m_last, false) : key_count;
+
+        std::vector<bool> freed(key_count + 1, false);
+        for (size_t index = first; index <= last; index++)
+        {
+            // check whether all the keys of the child are in the range
+            bool const covered_left =
+              index == 0 ? io_deletion.m_first.empty()
+                         : compare_keys(node.m_keys[index - 1], io_deletion.m_first) >= 0;
+            bool const covered_right =
+              index == key_count
+                ? !io_deletion.m_has_last
+                : !io_deletion.m_has_last ||
+                    compare_keys(node.m_keys[index], io_deletion.m_last) <= 0;
+            if (covered_left && covered_right)
+            {
+                free_subtree(child_at(index), io_deletion);
+                freed[index] = true;
+            }
+            else
+            {
+                freed[index] = erase_range(child_at(index), io_deletion);
+            }
+        }
+
+        // rebuild the node with the remaining children
+        NodeData remaining;
+        remaining.m_level = node.m_level;
+        bool any_child    = false;
+        for (size_t index = 0; index <= key_count; index++)
+        {
+            if (!freed[index])
+            {
+                if (!any_child)
+                {
+                    remaining.m_link = child_at(index);
+                    any_child        = true;
+                }
+                else
+                {
+                    remaining.m_keys.push_back(node.m_keys[index - 1]);
+                    remaining.m_values.push_back(child_at(index));
+                }
+            }
+        }
+
+        if (!any_child)
+        {
+            page.release();
+            m_device->deallocate_page(i_node);
+            return true;
+        }
+        remaining.encode(page.mem_address(), m_page_size);
+        return false;
+    }
+
+    // frees a subtree visiting the leaves in order, without decoding them
+    void btree::free_subtree(page_address i_node, RangeDeletion & io_deletion)
+    {
+        auto page = map_scoped_page(*m_device, i_node, storage_device::access_flags::read);
+        NodeView const view(page.mem_address());
+        if (view.is_leaf())
+        {
+            io_deletion.m_removed_count += view.count();
+            page.release();
+            free_leaf(i_node, io_deletion);
+        }
+        else
+        {
+            for (uint32_t index = 0; index <= view.count(); index++)
+                free_subtree(view.child(index), io_deletion);
+            page.release();
+            m_device->deallocate_page(i_node);
+        }
+    }
+
+    void btree::free_leaf(page_address i_leaf, RangeDeletion & io_deletion)
+    {
+        {
+            auto const page =
+              map_scoped_page(*m_device, i_leaf, storage_device::access_flags::read);
+            auto const & header = node_of(page);
+            if (!io_deletion.m_freed_leaves)
+            {
+                io_deletion.m_prev_of_freed = header.m_prev;
+                io_deletion.m_freed_leaves  = true;
+            }
+            io_deletion.m_next_of_freed = header.m_link;
+        }
+        m_device->deallocate_page(i_leaf);
+    }
+
+    uint64_t btree::size() const
+    {
+        return meta_of(map_scoped_page(*m_device, m_meta_page, storage_device::access_flags::read))
+          .m_key_count;
+    }
+
+    uint32_t btree::height() const
+    {
+        return meta_of(map_scoped_page(*m_device, m_meta_page, storage_device::access_flags::read))
+          .m_height;
+    }
+
+    btree::iterator btree::lower_bound(const string_view & i_key) const
+    {
+        auto node =
+          meta_of(map_scoped_page(*m_device, m_meta_page, storage_device::access_flags::read))
+            .m_root;
+        for (;;)
+        {
+            auto page = map_scoped_page(*m_device, node, storage_device::access_flags::read);
+            NodeView const view(page.mem_address());
+            if (view.is_leaf())
+            {
+                auto const index = view.bound(i_key, false);
+                return iterator(*m_device, std::move(page), index, string_view());
+            }
+            node = view.child(view.bound(i_key, true));
+        }
+    }
+
+    btree::iterator btree::scan_prefix(const string_view & i_prefix) const
+    {
+        auto result          = lower_bound(i_prefix);
+        result.m_scan_prefix = i_prefix;
+        result.settle();
+        return result;
+    }
+
+    btree::iterator::iterator(
+      storage_device &    i_device,
+      scoped_page &&      i_leaf,
+      uint32_t            i_index,
+      const string_view & i_scan_prefix)
+        : m_device(&i_device), m_leaf(std::move(i_leaf)), m_index(i_index),
+          m_scan_prefix(i_scan_prefix)
+    {
+        settle();
+    }
+
+    // moves to the first entry starting from m_index, skipping to the next leaves if needed
+    void btree::iterator::settle()
+    {
+        while (!m_leaf.empty())
+        {
+            NodeView const view(m_leaf.mem_address());
+            if (m_index < view.count())
+            {
+                m_key.assign(view.prefix().data(), view.prefix().size());
+                m_key += view.suffix(m_index);
+                m_value = view.value(m_index);
+                if (!starts_with(m_key, m_scan_prefix))
+                    m_leaf.release();
+                return;
+            }
+
+            auto const next = view.header().m_link;
+            if (next == invalid_page_address)
+            {
+                m_leaf.release();
+                return;
+            }
+            m_leaf  = map_scoped_page(*m_device, next, storage_device::access_flags::read);
+            m_index = 0;
+        }
+    }
+
+    btree::iterator & btree::iterator::operator++()
+    {
+        CAMBRIAN_ASSERT(!is_over());
+        m_index++;
+        settle();
+        return *this;
+    }
+
+} // namespace cambrian
@@ -0,0 +1,129 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "cambrian/cambrian_common.h"
+#include "cambrian/storage/storage_device.h"
+#include <string>
+
+namespace cambrian
+{
+    /** B+tree stored in the pages of a storage_device, that maps keys (usually full paths) to
+        page addresses in lexicographical order. Unlike the directory, it supports ordered
+        iteration, prefix scans and range deletes.
+        Every node stores once the prefix shared by all its keys, followed by a sorted array of
+        offsets to the suffixes, so that a node is searched with a binary search without decoding
+        it. A key that starts with the prefix of its node is inserted in place, appending its
+        suffix and shifting the offsets: a node is rebuilt only when it is split or its prefix
+        shrinks. Leaves are linked in both directions. Underfull nodes are not merged: only
+        nodes that become empty are freed, so a range delete touches only the nodes on the
+        boundaries of the range, and deallocates the pages in between without decoding them. */
+    class btree
+    {
+      public:
+        btree(storage_device & i_device, page_address i_meta_page) noexcept;
+
+        /** Allocates and formats a new empty tree, returning the address of its meta page */
+        static page_address create(storage_device & i_device);
+
+        storage_device & device() const noexcept { return *m_device; }
+
+        page_address meta_page() const noexcept { return m_meta_page; }
+
+        /** Returns the maximum length of a key, that depends on the page size */
+        size_t max_key_length() const noexcept;
+
+        /** Returns the value associated to a key, or invalid_page_address */
+        page_address lookup(const string_view & i_key) const;
+
+        /** Adds an entry. If the key is already present returns false and leaves the tree
+            unchanged. */
+        bool insert(const string_view & i_key, page_address i_value);
+
+        /** Removes an entry. Returns false if the key is not present. */
+        bool remove(const string_view & i_key);
+
+        /** Removes all the keys in the range [i_first, i_last), returning their number */
+        uint64_t remove_range(const string_view & i_first, const string_view & i_last);
+
+        /** Removes all the keys starting with the given prefix, returning their number */
+        uint64_t remove_prefix(const string_view & i_prefix);
+
+        uint64_t size() const;
+
+        /** Returns the number of levels of interior nodes above the leaves */
+        uint32_t height() const;
+
+        /** Forward iterator on the entries of the tree. The iterator keeps the current leaf
+            mapped. The tree must not be modified during the iteration. */
+        class iterator
+        {
+          public:
+            const std::string & key() const noexcept
+            {
+                CAMBRIAN_ASSERT(!is_over());
+                return m_key;
+            }
+
+            page_address value() const noexcept
+            {
+                CAMBRIAN_ASSERT(!is_over());
+                return m_value;
+            }
+
+            iterator & operator++();
+
+            bool is_over() const noexcept { return m_leaf.empty(); }
+
+            bool operator==(end_marker_t) const noexcept { return is_over(); }
+            bool operator!=(end_marker_t) const noexcept { return !is_over(); }
+
+          private:
+            friend class btree;
+
+            iterator(
+              storage_device &    i_device,
+              scoped_page &&      i_leaf,
+              uint32_t            i_index,
+              const string_view & i_scan_prefix);
+
+            void settle();
+
+          private:
+            storage_device * m_device;
+            scoped_page      m_leaf;
+            uint32_t         m_index = 0;
+            std::string      m_key;
+            page_address     m_value = invalid_page_address;
+            std::string      m_scan_prefix;
+        };
+
+        /** Returns an iterator to the first entry */
+        iterator begin() const { return lower_bound(string_view()); }
+
+        /** Returns an iterator to the first entry whose key is not less than i_key */
+        iterator lower_bound(const string_view & i_key) const;
+
+        /** Returns an iterator on the entries whose key starts with i_prefix */
+        iterator scan_prefix(const string_view & i_prefix) const;
+
+      private:
+        struct RangeDeletion;
+
+        bool erase_range(page_address i_node, RangeDeletion & io_deletion);
+
+        void free_subtree(page_address i_node, RangeDeletion & io_deletion);
+
+        void free_leaf(page_address i_leaf, RangeDeletion & io_deletion);
+
+        uint64_t remove_range(const string_view & i_first, const string_view * i_last);
+
+      private:
+        storage_device * m_device;
+        page_address     m_meta_page;
+        page_size        m_page_size;
+    };
+
+} // namespace cambrian
@@ -0,0 +1,433 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "cambrian/data/columnar_format.h"
+#include "cambrian/data/deserializer.h"
+#include "cambrian/data/serializer.h"
+#include "ediacaran/core/byte_reader.h"
+#include "ediacaran/utils/dyn_value.h"
+#include "ediacaran/utils/universal_iterator.h"
+#include <limits>
+#include <string>
+
+namespace cambrian
+{
+    namespace
+    {
+        constexpr size_t not_inplace = std::numeric_limits<size_t>::max();
+
+        struct Column
+        {
+            std::string      m_name;
+            const type *     m_type;
+            const property * m_property;
+            size_t           m_object_offset; /**< of the subobject that owns the property */
+            size_t           m_value_offset;  /**< or not_inplace */
+            bool             m_fixed;         /**< fundamental or enum */
+        };
+
+        void add_columns(
+          std::vector<Column> & io_columns,
+          const class_type &    i_class,
+          const std::string &   i_prefix,
+          size_t                i_offset);
+
+        void add_property_columns(
+          std::vector<Column> &              io_columns,
+          const array_view<const property> & i_properties,
+          const void *                       i_probe,
+          const std::string &                i_prefix,
+          size_t                             i_offset)
+        {
+            for (auto const & prop : i_properties)
+            {
+                auto const & qualified_type = prop.qualified_type();
+                if (qualified_type.indirection_levels() != 0)
+                    except<std::runtime_error>("columnar format: pointers are not supported");
+
+                auto const final_type = qualified_type.final_type();
+                auto const name = i_prefix + std::string(prop.name().data(), prop.name().size());
+                auto const value_offset =
+                  prop.is_inplace() ? i_offset + address_diff(prop.get_inplace(i_probe), i_probe)
+                                    : not_inplace;
+
+                // inplace classes that are not containers are split in columns
+                if (
+                  final_type->is_class() && prop.is_inplace() && prop.is_settable() &&
+                  static_cast<const class_type *>(final_type)->container() == nullptr)
+                {
+                    add_columns(
+                      io_columns,
+                      static_cast<const class_type &>(*final_type),
+                      name + ".",
+                      value_offset);
+                    continue;
+                }
+
+                io_columns.push_back(
+                  {name, final_type, &prop, i_offset, value_offset, !final_type->is_class()});
+            }
+        }
+
+        void add_columns(
+          std::vector<Column> & io_columns,
+          const class_type &    i_class,
+          const std::string &   i_prefix,
+          size_t                i_offset)
+        {
+            /* the offsets of the inplace properties are computed on an uninitialized buffer, as
+               get_inplace only adds an offset to the address of the object */
+            std::vector<std::max_align_t> probe(
+              (i_class.size() + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t) + 1);
+            auto const object = static_cast<void *>(probe.data());
+
+            add_property_columns(io_columns, i_class.properties(), object, i_prefix, i_offset);
+            auto const offsets = base_offsets(i_class);
+            for (size_t index = 0; index < offsets.size(); index++)
+            {
+                add_property_columns(
+                  io_columns,
+                  i_class.bases()[index].get_class().properties(),
+                  address_add(object, offsets[index]),
+                  i_prefix,
+                  i_offset + offsets[index]);
+            }
+        }
+
+        /** Returns the class of the elements of a homogeneous container of classes */
+        const class_type & element_class_of(const raw_ptr & i_container)
+        {
+            auto const & qualified_type = i_container.qualified_type();
+            auto const   final_type     = qualified_type.final_type();
+            auto const   container =
+              qualified_type.indirection_levels() == 0 && final_type->is_class()
+                ? static_cast<const class_type *>(final_type)->container()
+                : nullptr;
+            if (
+              container == nullptr ||
+              (container->capabilities() & container::capability::heterogeneous) !=
+                container::capability::none ||
+              container->elements_type().indirection_levels() != 0 ||
+              !container->elements_type().final_type()->is_class())
+            {
+                except<std::invalid_argument>(
+                  "columnar format: the object is not a homogeneous container of classes");
+            }
+            return static_cast<const class_type &>(*container->elements_type().final_type());
+        }
+
+        uint32_t checked_uint32(size_t i_value)
+        {
+            if (i_value > std::numeric_limits<uint32_t>::max())
+                except<std::runtime_error>("write_columnar: the object is too big");
+            return static_cast<uint32_t>(i_value);
+        }
+
+        void append_serialized(
+          type_registry &              io_type_registry,
+          const raw_ptr &              i_value,
+          std::vector<unsigned char> & io_buffer)
+        {
+            constexpr size_t chunk_size = 4096;
+            binary_writer    writer(io_type_registry, i_value);
+            bool             finished = false;
+            while (!finished)
+            {
+                auto const used_size = io_buffer.size();
+                io_buffer.resize(used_size + chunk_size);
+                byte_writer dest(io_buffer.data() + used_size, chunk_size);
+                finished = writer.step(dest) == binary_writer::finished;
+                io_buffer.resize(io_buffer.size() - static_cast<size_t>(dest.remaining_size()));
+            }
+        }
+    } // namespace
+
+    std::vector<unsigned char>
+      write_columnar(type_registry & io_type_registry, const raw_ptr & i_source_container)
+    {
+        auto const & element_class = element_class_of(i_source_container);
+        std::vector<Column> columns;
+        add_columns(columns, element_class, std::string(), 0);
+
+        std::vector<const void *> rows;
+        for (universal_iterator it(i_source_container); it != end_marker; ++it)
+            rows.push_back((*it).object());
+
+        // header, directory and names
+        std::vector<unsigned char> buffer(
+          sizeof(columnar_header) + columns.size() * sizeof(columnar_column));
+        std::vector<columnar_column> directory(columns.size());
+        auto const                   append_string = [&](const string_view & i_string) {
+            auto const offset = checked_uint32(buffer.size());
+            buffer.insert(buffer.end(), i_string.begin(), i_string.end());
+            buffer.push_back(0);
+            return offset;
+        };
+        for (size_t index = 0; index < columns.size(); index++)
+        {
+            directory[index].m_name_offset      = append_string(columns[index].m_name);
+            directory[index].m_type_name_offset = append_string(columns[index].m_type->name());
+        }
+
+        for (size_t index = 0; index < columns.size(); index++)
+        {
+            auto const & column = columns[index];
+            auto &       entry  = directory[index];
+            entry.m_offset      = uint_upper_align(buffer.size(), columnar_alignment);
+            buffer.resize(static_cast<size_t>(entry.m_offset));
+
+            if (column.m_fixed)
+            {
+                auto const element_size = column.m_type->size();
+                entry.m_element_size    = checked_uint32(element_size);
+                buffer.resize(buffer.size() + rows.size() * element_size);
+                auto const dest = buffer.data() + entry.m_offset;
+                if (column.m_value_offset != not_inplace)
+                {
+                    for (size_t row = 0; row < rows.size(); row++)
+                    {
+                        memcpy(
+                          dest + row * element_size,
+                          address_add(rows[row], column.m_value_offset),
+                          element_size);
+                    }
+                }
+                else
+                {
+                    for (size_t row = 0; row < rows.size(); row++)
+                    {
+                        column.m_property->get(
+                          address_add(rows[row], column.m_object_offset),
+                          dest + row * element_size);
+                    }
+                }
+            }
+            else
+            {
+                auto const & qualified_type = column.m_property->qualified_type();
+                for (auto const row : rows)
+                {
+                    auto const object = address_add(row, column.m_object_offset);
+                    if (column.m_value_offset != not_inplace)
+                    {
+                        auto const value = address_add(row, column.m_value_offset);
+                        append_serialized(
+                          io_type_registry,
+                          raw_ptr(const_cast<void *>(value), qualified_type),
+                          buffer);
+                    }
+                    else
+                    {
+                        dyn_value value;
+                        value.manual_construct(qualified_type, [&](void * i_value_dest) {
+                            column.m_property->get(object, i_value_dest);
+                        });
+                        append_serialized(io_type_registry, value, buffer);
+                    }
+                }
+            }
+            entry.m_size = buffer.size() - entry.m_offset;
+        }
+
+        columnar_header header;
+        header.m_row_count    = rows.size();
+        header.m_column_count = checked_uint32(columns.size());
+        memcpy(buffer.data(), &header, sizeof(header));
+        if (!directory.empty())
+        {
+            memcpy(
+              buffer.data() + sizeof(header),
+              directory.data(),
+              directory.size() * sizeof(columnar_column));
+        }
+        return buffer;
+    }
+
+    void read_columnar(
+      type_registry & io_type_registry,
+      const void *    i_data,
+      size_t          i_size,
+      const raw_ptr & o_dest_container)
+    {
+        columnar_view const view(i_data, i_size);
+        auto const &        element_class = element_class_of(o_dest_container);
+        std::vector<Column> columns;
+        add_columns(columns, element_class, std::string(), 0);
+
+        // the content of the container is replaced
+        auto const & container_class =
+          static_cast<const class_type &>(*o_dest_container.qualified_type().final_type());
+        auto const   container    = container_class.container();
+        auto const   object       = o_dest_container.editable_object();
+        auto const   emplace_back = container->emplace_back_function();
+        auto const   resize       = container->resize_function();
+        if (container->clear_function() == nullptr || emplace_back == nullptr)
+            except<std::runtime_error>("read_columnar: the container can't be resized");
+        container->clear_function()(object);
+        std::vector<void *> rows(view.row_count());
+        if (resize != nullptr)
+        {
+            auto const elements = resize(object, rows.size());
+            for (size_t row = 0; row < rows.size(); row++)
+                rows[row] = address_add(elements, row * element_class.size());
+        }
+        else
+        {
+            for (auto & row : rows)
+                row = emplace_back(object);
+        }
+
+        auto const data = static_cast<const unsigned char *>(i_data);
+        for (auto const & column : columns)
+        {
+            auto const index = view.find_column(column.m_name);
+            if (index == view.column_count() || !column.m_property->is_settable())
+                continue;
+            auto const entry = view.column(index);
+            if (
+              view.column_type_name(index) != column.m_type->name() ||
+              column.m_fixed != (entry.m_element_size != 0))
+            {
+                except<std::runtime_error>("read_columnar: a column has a different type");
+            }
+
+            auto const source = data + entry.m_offset;
+            if (column.m_fixed)
+            {
+                auto const element_size = column.m_type->size();
+                for (size_t row = 0; row < rows.size(); row++)
+                {
+                    if (column.m_value_offset != not_inplace)
+                    {
+                        memcpy(
+                          address_add(rows[row], column.m_value_offset),
+                          source + row * element_size,
+                          element_size);
+                    }
+                    else
+                    {
+                        column.m_property->set(
+                          address_add(rows[row], column.m_object_offset),
+                          source + row * element_size);
+                    }
+                }
+                continue;
+            }
+
+            // every value ends where the next one starts
+            auto const & qualified_type = column.m_property->qualified_type();
+            byte_reader  values(source, static_cast<size_t>(entry.m_size));
+            bool const   inplace        = column.m_value_offset != not_inplace;
+            for (auto const row : rows)
+            {
+                // values of properties with a setter are read in a temporary
+                dyn_value value;
+                if (!inplace)
+                    value.assign(qualified_type);
+                raw_ptr const dest =
+                  inplace ? raw_ptr(address_add(row, column.m_value_offset), qualified_type)
+                          : raw_ptr(value);
+
+                binary_reader reader(io_type_registry, dest);
+                if (reader.step(values) != binary_reader::finished)
+                    except<std::runtime_error>("read_columnar: corrupted data");
+                if (!inplace)
+                {
+                    column.m_property->set(
+                      address_add(row, column.m_object_offset), value.object());
+                }
+            }
+            if (values.remaining_size() != 0)
+                except<std::runtime_error>("read_columnar: corrupted data");
+        }
+    }
+
+    columnar_view::columnar_view(const void * i_data, size_t i_size)
+        : m_data(static_cast<const unsigned char *>(i_data)), m_size(i_size)
+    {
+        if (i_size < sizeof(m_header))
+            except<std::runtime_error>("columnar_view: corrupted data");
+        memcpy(&m_header, i_data, sizeof(m_header));
+        if (m_header.m_column_count > (i_size - sizeof(m_header)) / sizeof(columnar_column))
+            except<std::runtime_error>("columnar_view: corrupted data");
+
+        // all the accessors can rely on a consistent directory
+        for (size_t index = 0; index < column_count(); index++)
+        {
+            auto const entry = column(index);
+            (void)string_at(entry.m_name_offset);
+            (void)string_at(entry.m_type_name_offset);
+            if (entry.m_offset > i_size || entry.m_size > i_size - entry.m_offset)
+                except<std::runtime_error>("columnar_view: corrupted data");
+            if (
+              entry.m_element_size != 0 &&
+              (entry.m_size % entry.m_element_size != 0 ||
+               entry.m_size / entry.m_element_size != m_header.m_row_count ||
+               entry.m_offset % columnar_alignment != 0))
+            {
+                except<std::runtime_error>("columnar_view: corrupted data");
+            }
+        }
+    }
+
+    columnar_column columnar_view::column(size_t i_index) const
+    {
+        CAMBRIAN_ASSERT(i_index < column_count());
+        columnar_column result;
+        memcpy(
+          &result,
+          m_data + sizeof(columnar_header) + i_index * sizeof(columnar_column),
+          sizeof(result));
+        return result;
+    }
+
+    string_view columnar_view::string_at(uint32_t i_offset) const
+    {
+        if (i_offset >= m_size)
+            except<std::runtime_error>("columnar_view: corrupted data");
+        auto const string = reinterpret_cast<const char *>(m_data + i_offset);
+        auto const end    = static_cast<const char *>(memchr(string, 0, m_size - i_offset));
+        if (end == nullptr)
+            except<std::runtime_error>("columnar_view: corrupted data");
+        return string_view(string, static_cast<size_t>(end - string));
+    }
+
+    string_view columnar_view::column_name(size_t i_index) const
+    {
+        return string_at(column(i_index).m_name_offset);
+    }
+
+    string_view columnar_view::column_type_name(size_t i_index) const
+    {
+        return string_at(column(i_index).m_type_name_offset);
+    }
+
+    size_t columnar_view::find_column(const string_view & i_name) const
+    {
+        for (size_t index = 0; index < column_count(); index++)
+        {
+            if (column_name(index) == i_name)
+                return index;
+        }
+        return column_count();
+    }
+
+    const void *
+      columnar_view::column_values(const string_view & i_name, const type & i_type) const
+    {
+        auto const index = find_column(i_name);
+        if (index == column_count())
+            except<std::invalid_argument>("columnar_view: column not found");
+        auto const entry = column(index);
+        if (
+          entry.m_element_size != i_type.size() ||
+          string_at(entry.m_type_name_offset) != i_type.name())
+        {
+            except<std::invalid_argument>("columnar_view: type mismatch");
+        }
+        return m_data + entry.m_offset;
+    }
+
+} // namespace cambrian
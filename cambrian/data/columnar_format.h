@@ -0,0 +1,108 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "cambrian/cambrian_common.h"
+#include "cambrian/data/type_registry.h"
+#include "ediacaran/core/array_view.h"
+#include "ediacaran/reflection/reflection.h"
+#include "ediacaran/utils/raw_ptr.h"
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+namespace cambrian
+{
+    /** Alignment of the columns, relative to the start of the buffer. Readers should align the
+        buffer at least to alignof(std::max_align_t). */
+    constexpr size_t columnar_alignment = 64;
+
+    struct columnar_header
+    {
+        uint64_t m_row_count    = 0;
+        uint32_t m_column_count = 0;
+        uint32_t m_reserved     = 0;
+    };
+
+    /** Entry of the column directory, that follows the header. The names are null-terminated
+        strings, and all the offsets are relative to the start of the buffer. */
+    struct columnar_column
+    {
+        uint64_t m_offset           = 0;
+        uint64_t m_size             = 0;
+        uint32_t m_name_offset      = 0;
+        uint32_t m_type_name_offset = 0;
+        uint32_t m_element_size     = 0; /**< zero for columns of serialized values */
+        uint32_t m_reserved         = 0;
+    };
+
+    /** Writes a container of classes in the columnar format (struct of arrays): every property
+        of the elements is stored contiguously in its own column, so that a column can be
+        scanned or compressed without touching the others.
+        The columns are the properties of the elements (including the ones of the direct and
+        indirect base classes, in the order of the serialization_plan). The properties of
+        inplace settable classes that are not containers are split in a column for each of
+        their properties, named like "point.x". Properties of fundamental or enum type are
+        stored as arrays of raw values, aligned to columnar_alignment. Any other property is a
+        column of values serialized by binary_writer (with the fixed wire_format), one after
+        the other.
+        Throws std::invalid_argument if the object is not a homogeneous container of classes,
+        and std::runtime_error if a property is a pointer. */
+    std::vector<unsigned char>
+      write_columnar(type_registry & io_type_registry, const raw_ptr & i_source_container);
+
+    /** Replaces the content of a container with the elements stored in the columnar format.
+        Columns are matched by name: properties with no column keep the value assigned by the
+        default constructor, and columns with no property are ignored. Throws
+        std::runtime_error if the data is corrupted, or a column has a different type. */
+    void read_columnar(
+      type_registry & io_type_registry,
+      const void *    i_data,
+      size_t          i_size,
+      const raw_ptr & o_dest_container);
+
+    /** Read only view on a buffer in the columnar format, that accesses the columns in place */
+    class columnar_view
+    {
+      public:
+        /** Throws std::runtime_error if the header or the directory are corrupted */
+        columnar_view(const void * i_data, size_t i_size);
+
+        size_t row_count() const noexcept { return static_cast<size_t>(m_header.m_row_count); }
+
+        size_t column_count() const noexcept { return m_header.m_column_count; }
+
+        columnar_column column(size_t i_index) const;
+
+        string_view column_name(size_t i_index) const;
+
+        /** Returns the name of the type of the values of a column */
+        string_view column_type_name(size_t i_index) const;
+
+        /** Returns the index of a column, or column_count() if there is no such column */
+        size_t find_column(const string_view & i_name) const;
+
+        /** Returns the values of a column of a fundamental or enum type. Throws
+            std::invalid_argument if there is no such column, or if it has a different
+            type. */
+        template <typename TYPE> array_view<const TYPE> values(const string_view & i_name) const
+        {
+            static_assert(std::is_arithmetic_v<TYPE> || std::is_enum_v<TYPE>);
+            auto const data = column_values(i_name, get_type<TYPE>());
+            return array_view<const TYPE>(static_cast<const TYPE *>(data), row_count());
+        }
+
+      private:
+        const void * column_values(const string_view & i_name, const type & i_type) const;
+
+        string_view string_at(uint32_t i_offset) const;
+
+      private:
+        const unsigned char * m_data;
+        size_t                m_size;
+        columnar_header       m_header;
+    };
+
+} // namespace cambrian
@@ -0,0 +1,547 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "cambrian/data/delta_serializer.h"
+#include "cambrian/data/deserializer.h"
+#include "cambrian/data/varint.h"
+#include "ediacaran/core/byte_reader.h"
+#include "ediacaran/utils/dyn_value.h"
+#include "ediacaran/utils/universal_iterator.h"
+#include <algorithm>
+
+namespace cambrian
+{
+    namespace
+    {
+        /** Returns the class of an object reachable without indirections, or null */
+        const class_type * class_of(const qualified_type_ptr & i_qualified_type)
+        {
+            if (i_qualified_type.is_empty() || i_qualified_type.indirection_levels() != 0)
+                return nullptr;
+            auto const final_type = i_qualified_type.final_type();
+            return final_type->is_class() ? static_cast<const class_type *>(final_type) : nullptr;
+        }
+
+        class DeltaWriter
+        {
+          public:
+            DeltaWriter(type_registry & i_type_registry, wire_format i_format)
+                : m_type_registry(i_type_registry), m_format(i_format)
+            {
+            }
+
+            void write_entry(
+              const std::vector<uint64_t> & i_path,
+              const void *                  i_object,
+              const property &              i_property)
+            {
+                if (i_property.qualified_type().indirection_levels() != 0)
+                    except<std::runtime_error>("write_delta: a changed property is a pointer");
+
+                append_varint(i_path.size());
+                for (auto const step : i_path)
+                    append_varint(step);
+
+                dyn_value value;
+                value.manual_construct(i_property.qualified_type(), [&](void * i_value_dest) {
+                    i_property.get(i_object, i_value_dest);
+                });
+
+                // the value is written in chunks, and then prefixed by its size
+                constexpr size_t chunk_size = 4096;
+                binary_writer    writer(m_type_registry, value, m_format);
+                m_value.clear();
+                bool finished = false;
+                while (!finished)
+                {
+                    auto const used_size = m_value.size();
+                    m_value.resize(used_size + chunk_size);
+                    byte_writer dest(m_value.data() + used_size, chunk_size);
+                    finished = writer.step(dest) == binary_writer::finished;
+                    m_value.resize(m_value.size() - static_cast<size_t>(dest.remaining_size()));
+                }
+                append_varint(m_value.size());
+                m_delta.insert(m_delta.end(), m_value.begin(), m_value.end());
+            }
+
+            std::vector<unsigned char> & delta() noexcept { return m_delta; }
+
+          private:
+            void append_varint(uint64_t i_value)
+            {
+                unsigned char buffer[max_varint_size];
+                m_delta.insert(m_delta.end(), buffer, buffer + write_varint(buffer, i_value));
+            }
+
+          private:
+            type_registry &            m_type_registry;
+            wire_format const          m_format;
+            std::vector<unsigned char> m_value;
+            std::vector<unsigned char> m_delta;
+        };
+
+        uint64_t read_delta_varint(byte_reader & i_source)
+        {
+            uint64_t   value;
+            auto const size = read_varint(
+              i_source.next_byte(), static_cast<size_t>(i_source.remaining_size()), value);
+            if (size == 0)
+                except<std::runtime_error>("apply_delta: corrupted delta");
+            i_source.skip(size);
+            return value;
+        }
+
+        /** Finds the property with the given index, in the order of the serialization_plan,
+            adjusting the object to the base subobject that owns it */
+        const property &
+          property_at(void *& io_object, const class_type & i_class, uint64_t i_index)
+        {
+            auto const & properties = i_class.properties();
+            if (i_index < properties.size())
+                return properties[static_cast<size_t>(i_index)];
+            i_index -= properties.size();
+            for (auto const & base : i_class.bases())
+            {
+                auto const & base_properties = base.get_class().properties();
+                if (i_index < base_properties.size())
+                {
+                    io_object = base.up_cast(io_object);
+                    return base_properties[static_cast<size_t>(i_index)];
+                }
+                i_index -= base_properties.size();
+            }
+            except<std::runtime_error>("apply_delta: the delta does not match the base");
+        }
+
+        /** Finds an element skipping whole segments, so that the element of a contiguous
+            container is found in constant time */
+        void * element_at(void * i_object, const class_type & i_class, uint64_t i_index)
+        {
+            universal_iterator it(raw_ptr(i_object, qualified_type_ptr(&i_class)));
+            while (it != end_marker && i_index >= it.segment().m_element_count)
+            {
+                i_index -= it.segment().m_element_count;
+                it.advance_in_segment(it.segment().m_element_count);
+            }
+            if (it == end_marker)
+                except<std::runtime_error>("apply_delta: the delta does not match the base");
+            if (i_index > 0)
+                it.advance_in_segment(i_index);
+            return const_cast<void *>((*it).object());
+        }
+
+    } // namespace
+
+    change_tracker::change_tracker()
+    {
+        auto const previous = set_property_observer(this);
+        if (previous != nullptr)
+        {
+            set_property_observer(previous);
+            except<std::runtime_error>("change_tracker: another property observer is installed");
+        }
+    }
+
+    change_tracker::~change_tracker() { set_property_observer(nullptr); }
+
+    void change_tracker::track(const raw_ptr & i_root)
+    {
+        auto const root_class = class_of(i_root.qualified_type());
+        if (root_class == nullptr)
+            except<std::invalid_argument>("change_tracker: the root is not a class");
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (find_root(i_root.object(), *root_class) != no_node)
+            except<std::invalid_argument>("change_tracker: the root is already tracked");
+        index_object(i_root.editable_object(), *root_class, no_node, 0, 0);
+    }
+
+    void change_tracker::mark_dirty(const void * i_object, const property & i_property)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t   node;
+        uint64_t property_index;
+        if (find_owner(i_object, i_property, node, property_index))
+            m_changes.insert({i_object, &i_property});
+    }
+
+    change_tracker::change_set change_tracker::take_changes()
+    {
+        change_set                  result;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        result.swap(m_changes);
+        return result;
+    }
+
+    size_t change_tracker::change_count() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_changes.size();
+    }
+
+    void change_tracker::on_property_set(const property & i_property, void * i_object)
+    {
+        mark_dirty(i_object, i_property);
+    }
+
+    size_t change_tracker::add_node(
+      void *             i_object,
+      const class_type & i_class,
+      size_t             i_parent,
+      uint64_t           i_step,
+      bool               i_is_base)
+    {
+        size_t index;
+        if (!m_free_nodes.empty())
+        {
+            index = m_free_nodes.back();
+            m_free_nodes.pop_back();
+            m_nodes[index] = Node{i_object, &i_class, i_parent, i_step, i_is_base};
+        }
+        else
+        {
+            index = m_nodes.size();
+            m_nodes.push_back(Node{i_object, &i_class, i_parent, i_step, i_is_base});
+        }
+
+        // the last node at an address comes first, so that a live object hides a stale one
+        auto & last_at_address = m_addresses.emplace(i_object, no_node).first->second;
+        m_nodes[index].m_next_at_address = last_at_address;
+        last_at_address                  = index;
+
+        if (i_parent != no_node)
+        {
+            m_nodes[index].m_next_sibling  = m_nodes[i_parent].m_first_child;
+            m_nodes[i_parent].m_first_child = index;
+        }
+        return index;
+    }
+
+    void change_tracker::remove_node(size_t i_node) noexcept
+    {
+        while (m_nodes[i_node].m_first_child != no_node)
+            remove_node(m_nodes[i_node].m_first_child);
+
+        auto const & node   = m_nodes[i_node];
+        auto const   parent = node.m_parent;
+        if (parent != no_node)
+        {
+            auto * link = &m_nodes[parent].m_first_child;
+            while (*link != i_node)
+                link = &m_nodes[*link].m_next_sibling;
+            *link = node.m_next_sibling;
+        }
+
+        auto const address = m_addresses.find(node.m_object);
+        auto *     link    = &address->second;
+        while (*link != i_node)
+            link = &m_nodes[*link].m_next_at_address;
+        *link = node.m_next_at_address;
+        if (address->second == no_node)
+            m_addresses.erase(address);
+
+        m_free_nodes.push_back(i_node);
+    }
+
+    void change_tracker::index_object(
+      void *             i_object,
+      const class_type & i_class,
+      size_t             i_parent,
+      uint64_t           i_step,
+      size_t             i_depth)
+    {
+        if (i_depth > binary_writer::max_depth)
+            except<std::runtime_error>("change_tracker: the object is too deep");
+
+        // the properties are indexed in the order of the serialization_plan
+        auto const node           = add_node(i_object, i_class, i_parent, i_step, false);
+        uint64_t   property_index = 0;
+        index_properties(i_object, i_class.properties(), node, property_index, i_depth);
+        for (auto const & base : i_class.bases())
+        {
+            auto const base_object = const_cast<void *>(base.up_cast(i_object));
+            add_node(base_object, base.get_class(), node, property_index, true);
+            index_properties(
+              base_object, base.get_class().properties(), node, property_index, i_depth);
+        }
+
+        auto const container = i_class.container();
+        if (container == nullptr)
+            return;
+        uint64_t element_index = 0;
+        for (universal_iterator it(raw_ptr(i_object, qualified_type_ptr(&i_class)));
+             it != end_marker;
+             ++it)
+        {
+            auto const element       = *it;
+            auto const element_class = class_of(element.qualified_type());
+            if (element_class == nullptr)
+                break; // a container of fundamentals or pointers
+            index_object(
+              const_cast<void *>(element.object()),
+              *element_class,
+              node,
+              (element_index << 1) | 1,
+              i_depth + 1);
+            element_index++;
+        }
+    }
+
+    void change_tracker::index_properties(
+      void *                             i_object,
+      const array_view<const property> & i_properties,
+      size_t                             i_node,
+      uint64_t &                         io_property_index,
+      size_t                             i_depth)
+    {
+        for (auto const & prop : i_properties)
+        {
+            if (prop.is_inplace())
+            {
+                if (auto const prop_class = class_of(prop.qualified_type()))
+                {
+                    index_object(
+                      const_cast<void *>(prop.get_inplace(i_object)),
+                      *prop_class,
+                      i_node,
+                      io_property_index << 1,
+                      i_depth + 1);
+                }
+            }
+            io_property_index++;
+        }
+    }
+
+    bool change_tracker::find_owner(
+      const void *     i_object,
+      const property & i_property,
+      size_t &         o_node,
+      uint64_t &       o_property_index) const noexcept
+    {
+        auto const address = m_addresses.find(i_object);
+        if (address == m_addresses.end())
+            return false;
+
+        std::less<const property *> const less;
+        for (auto index = address->second; index != no_node;
+             index      = m_nodes[index].m_next_at_address)
+        {
+            auto const & node       = m_nodes[index];
+            auto const & properties = node.m_class->properties();
+            if (
+              less(&i_property, properties.data()) ||
+              !less(&i_property, properties.data() + properties.size()))
+            {
+                continue;
+            }
+
+            // the properties of a base are indexed after the ones of the derived class
+            auto const property_index = static_cast<uint64_t>(&i_property - properties.data());
+            o_node           = node.m_is_base ? node.m_parent : index;
+            o_property_index = node.m_is_base ? node.m_step + property_index : property_index;
+            return true;
+        }
+        return false;
+    }
+
+    size_t change_tracker::find_root(const void * i_object, const class_type & i_class) const
+      noexcept
+    {
+        auto const address = m_addresses.find(i_object);
+        if (address == m_addresses.end())
+            return no_node;
+        for (auto index = address->second; index != no_node;
+             index      = m_nodes[index].m_next_at_address)
+        {
+            if (m_nodes[index].m_parent == no_node && m_nodes[index].m_class == &i_class)
+                return index;
+        }
+        return no_node;
+    }
+
+    size_t change_tracker::depth_of(size_t i_node) const noexcept
+    {
+        size_t depth = 0;
+        for (; m_nodes[i_node].m_parent != no_node; i_node = m_nodes[i_node].m_parent)
+            depth++;
+        return depth;
+    }
+
+    std::vector<change_tracker::Entry> change_tracker::take_entries(size_t i_root)
+    {
+        std::vector<Entry> entries;
+        for (auto it = m_changes.begin(); it != m_changes.end();)
+        {
+            size_t   node;
+            uint64_t property_index;
+            if (!find_owner(it->m_object, *it->m_property, node, property_index))
+            {
+                it = m_changes.erase(it); // the object has been removed from the index
+                continue;
+            }
+
+            // the path is built from the property to the root
+            std::vector<uint64_t> path{property_index << 1};
+            bool                  inside_change = false;
+            for (; m_nodes[node].m_parent != no_node; node = m_nodes[node].m_parent)
+            {
+                auto const   step   = m_nodes[node].m_step;
+                auto const & parent = m_nodes[m_nodes[node].m_parent];
+                if ((step & 1) == 0)
+                {
+                    void *     object = parent.m_object;
+                    auto const prop   = &property_at(object, *parent.m_class, step >> 1);
+                    inside_change     = inside_change || m_changes.count({object, prop}) != 0;
+                }
+                path.push_back(step);
+            }
+            if (node != i_root)
+            {
+                ++it; // a change of another root
+                continue;
+            }
+
+            if (!inside_change)
+            {
+                std::reverse(path.begin(), path.end());
+                entries.push_back(Entry{std::move(path), *it});
+            }
+            it = m_changes.erase(it);
+        }
+
+        std::sort(
+          entries.begin(), entries.end(), [](const Entry & i_first, const Entry & i_second) {
+              return i_first.m_path < i_second.m_path;
+          });
+        return entries;
+    }
+
+    void change_tracker::reindex(const change & i_change)
+    {
+        auto const & prop = *i_change.m_property;
+        if (!prop.is_inplace())
+            return;
+        auto const prop_class = class_of(prop.qualified_type());
+        size_t     owner;
+        uint64_t   property_index;
+        if (prop_class == nullptr || !find_owner(i_change.m_object, prop, owner, property_index))
+            return;
+
+        auto const step = property_index << 1;
+        for (auto child = m_nodes[owner].m_first_child; child != no_node;)
+        {
+            auto const next = m_nodes[child].m_next_sibling;
+            if (!m_nodes[child].m_is_base && m_nodes[child].m_step == step)
+                remove_node(child);
+            child = next;
+        }
+        index_object(
+          const_cast<void *>(prop.get_inplace(i_change.m_object)),
+          *prop_class,
+          owner,
+          step,
+          depth_of(owner) + 1);
+    }
+
+    std::vector<unsigned char> write_delta(
+      type_registry &  io_type_registry,
+      const raw_ptr &  i_root,
+      change_tracker & io_tracker,
+      wire_format      i_format)
+    {
+        auto const root_class = class_of(i_root.qualified_type());
+        if (root_class == nullptr)
+            except<std::invalid_argument>("write_delta: the root is not a class");
+
+        std::vector<change_tracker::Entry> entries;
+        {
+            std::lock_guard<std::mutex> lock(io_tracker.m_mutex);
+            auto const root = io_tracker.find_root(i_root.object(), *root_class);
+            if (root == change_tracker::no_node)
+                except<std::invalid_argument>("write_delta: the root is not tracked");
+            entries = io_tracker.take_entries(root);
+        }
+
+        // the values are read without the lock, as a getter may assign other properties
+        DeltaWriter writer(io_type_registry, i_format);
+        for (auto const & entry : entries)
+            writer.write_entry(entry.m_path, entry.m_change.m_object, *entry.m_change.m_property);
+
+        std::lock_guard<std::mutex> lock(io_tracker.m_mutex);
+        for (auto const & entry : entries)
+            io_tracker.reindex(entry.m_change);
+        return std::move(writer.delta());
+    }
+
+    void apply_delta(
+      type_registry & io_type_registry,
+      const raw_ptr & io_base,
+      const void *    i_delta,
+      size_t          i_delta_size,
+      wire_format     i_format)
+    {
+        auto const root_class = class_of(io_base.qualified_type());
+        if (root_class == nullptr)
+            except<std::invalid_argument>("apply_delta: the base is not a class");
+
+        byte_reader source(i_delta, i_delta_size);
+        while (source.remaining_size() > 0)
+        {
+            auto const step_count = read_delta_varint(source);
+            if (step_count == 0 || step_count > binary_writer::max_depth + 1)
+                except<std::runtime_error>("apply_delta: corrupted delta");
+
+            // all the steps but the last one lead to an object
+            void *             object       = io_base.editable_object();
+            const class_type * object_class = root_class;
+            const property *   target       = nullptr;
+            for (uint64_t step_index = 0; step_index < step_count; step_index++)
+            {
+                auto const step  = read_delta_varint(source);
+                auto const index = step >> 1;
+                if ((step & 1) != 0)
+                {
+                    if (object_class->container() == nullptr || step_index + 1 == step_count)
+                        except<std::runtime_error>("apply_delta: corrupted delta");
+                    object       = element_at(object, *object_class, index);
+                    object_class = class_of(object_class->container()->elements_type());
+                }
+                else
+                {
+                    target = &property_at(object, *object_class, index);
+                    if (step_index + 1 < step_count)
+                    {
+                        if (!target->is_inplace())
+                            except<std::runtime_error>("apply_delta: corrupted delta");
+                        object_class = class_of(target->qualified_type());
+                        object       = const_cast<void *>(target->get_inplace(object));
+                    }
+                }
+                if (object_class == nullptr)
+                    except<std::runtime_error>("apply_delta: the delta does not match the base");
+            }
+            if (!target->is_settable())
+                except<std::runtime_error>("apply_delta: the property is not settable");
+
+            // the value is read in a temporary and assigned with the setter
+            auto const value_size = read_delta_varint(source);
+            if (value_size > static_cast<uint64_t>(source.remaining_size()))
+                except<std::runtime_error>("apply_delta: corrupted delta");
+            dyn_value value(target->qualified_type());
+            {
+                binary_reader reader(io_type_registry, value, i_format);
+                byte_reader   value_source(source.next_byte(), static_cast<size_t>(value_size));
+                if (reader.step(value_source) != binary_reader::finished ||
+                    value_source.remaining_size() != 0)
+                {
+                    except<std::runtime_error>("apply_delta: corrupted delta");
+                }
+            }
+            source.skip(static_cast<size_t>(value_size));
+            target->set(object, value.object());
+        }
+    }
+
+} // namespace cambrian
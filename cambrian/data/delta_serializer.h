@@ -0,0 +1,194 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "cambrian/cambrian_common.h"
+#include "cambrian/data/serializer.h"
+#include "cambrian/data/type_registry.h"
+#include "ediacaran/reflection/property.h"
+#include "ediacaran/utils/raw_ptr.h"
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace cambrian
+{
+    /** Records the properties assigned with property::set (including the setters of
+        property_inspector, binary_reader and apply_delta) on the objects reachable from the
+        tracked roots. Objects are reached through the elements of containers, the inplace
+        properties of class type and the direct and indirect base classes, but not through
+        pointers or getters. The assignments of other objects, like the temporaries of
+        binary_reader, are discarded when they happen. Assignments that do not go through the
+        reflection, like the direct assignment of a data member or adding an element to a
+        container, must be reported with mark_dirty on the property that contains them.
+        The tracker indexes the objects reachable from a root when the root is tracked, and
+        indexes again the value of a changed property of class type when write_delta writes
+        it, so recording a change and writing a delta don't depend on the size of the graph.
+        The roots must outlive the tracker. The tracker is the global property_observer, so
+        only one tracker can exist at a time. The tracker is thread safe. */
+    class change_tracker : private property_observer
+    {
+      public:
+        /** A property of an object. For properties of a base class, m_object is the address of
+            the base subobject. */
+        struct change
+        {
+            const void *     m_object;
+            const property * m_property;
+
+            bool operator==(const change & i_other) const noexcept
+            {
+                return m_object == i_other.m_object && m_property == i_other.m_property;
+            }
+        };
+
+        struct change_hash
+        {
+            size_t operator()(const change & i_change) const noexcept
+            {
+                auto const object = reinterpret_cast<uintptr_t>(i_change.m_object);
+                return static_cast<size_t>((object * UINT64_C(0x9E3779B97F4A7C15)) >> 16) ^
+                       reinterpret_cast<uintptr_t>(i_change.m_property);
+            }
+        };
+
+        using change_set = std::unordered_set<change, change_hash>;
+
+        /** Installs the tracker as property_observer. Throws std::runtime_error if another
+            observer is installed. */
+        change_tracker();
+
+        change_tracker(const change_tracker &) = delete;
+        change_tracker & operator=(const change_tracker &) = delete;
+
+        /** Uninstalls the tracker, waiting for the notifications in progress */
+        ~change_tracker();
+
+        /** Starts recording the changes of the objects reachable from a root. Throws
+            std::invalid_argument if the root is not a class or is already tracked, and
+            std::runtime_error if the graph is too deep. */
+        void track(const raw_ptr & i_root);
+
+        /** Records a change, if the object is reachable from a tracked root */
+        void mark_dirty(const void * i_object, const property & i_property);
+
+        /** Returns the changes recorded since the previous call (the last checkpoint), and
+            starts recording a new set of changes. */
+        change_set take_changes();
+
+        size_t change_count() const;
+
+      private:
+        friend std::vector<unsigned char> write_delta(
+          type_registry &, const raw_ptr &, change_tracker &, wire_format);
+
+        static constexpr size_t no_node = std::numeric_limits<size_t>::max();
+
+        /** An object reachable from a root, or the subobject of a base class of it */
+        struct Node
+        {
+            void *             m_object;
+            const class_type * m_class;
+            size_t             m_parent; /**< the object that contains this one, or no_node */
+            uint64_t           m_step;   /**< the step of the path, or the first base property */
+            bool               m_is_base;
+            size_t             m_first_child     = no_node;
+            size_t             m_next_sibling    = no_node;
+            size_t             m_next_at_address = no_node;
+        };
+
+        /** A change reachable from a root */
+        struct Entry
+        {
+            std::vector<uint64_t> m_path;
+            change                m_change;
+        };
+
+        void on_property_set(const property & i_property, void * i_object) override;
+
+        size_t add_node(
+          void *             i_object,
+          const class_type & i_class,
+          size_t             i_parent,
+          uint64_t           i_step,
+          bool               i_is_base);
+
+        void remove_node(size_t i_node) noexcept;
+
+        void index_object(
+          void *             i_object,
+          const class_type & i_class,
+          size_t             i_parent,
+          uint64_t           i_step,
+          size_t             i_depth);
+
+        void index_properties(
+          void *                             i_object,
+          const array_view<const property> & i_properties,
+          size_t                             i_node,
+          uint64_t &                         io_property_index,
+          size_t                             i_depth);
+
+        /** Finds the node that owns a property, and the index of the property in the order of
+            the serialization_plan. Returns false if the object is not reachable. */
+        bool find_owner(
+          const void *     i_object,
+          const property & i_property,
+          size_t &         o_node,
+          uint64_t &       o_property_index) const noexcept;
+
+        size_t find_root(const void * i_object, const class_type & i_class) const noexcept;
+
+        size_t depth_of(size_t i_node) const noexcept;
+
+        /** Removes the changes of a root from the recorded ones, returning the changes to
+            write, sorted by path. A change inside a changed property is not returned. */
+        std::vector<Entry> take_entries(size_t i_root);
+
+        /** Indexes again the value of a written property */
+        void reindex(const change & i_change);
+
+      private:
+        mutable std::mutex                       m_mutex;
+        change_set                               m_changes;
+        std::vector<Node>                        m_nodes;
+        std::vector<size_t>                      m_free_nodes;
+        std::unordered_map<const void *, size_t> m_addresses; /**< the last node at an address */
+    };
+
+    /** Writes the properties changed since the last checkpoint of a root tracked by the
+        tracker, and starts a new checkpoint of the root. The delta is a sequence of entries,
+        each of them assigning a property of an object reachable from the root:
+            - the number of steps of the path from the root to the property, as a varint
+            - the steps as varints: (i << 1) for the property with index i (the properties of
+              a class are indexed in the order used by binary_writer, including the ones of the
+              base classes), (i << 1) | 1 for the element with index i of a container
+            - the size of the value as a varint, followed by the value, as written by
+              binary_writer with the given wire_format
+        A changed property is written with its whole value, so the changes inside it are not
+        written separately. The path of a change is found from the index of the tracker, so
+        the objects that are not changed are not visited. The objects must not be modified during the call. Throws
+        std::invalid_argument if the root is not tracked, and std::runtime_error if a changed
+        property is a pointer. */
+    std::vector<unsigned char> write_delta(
+      type_registry &  io_type_registry,
+      const raw_ptr &  i_root,
+      change_tracker & io_tracker,
+      wire_format      i_format = wire_format::fixed);
+
+    /** Assigns to a base image the properties written by write_delta. The base must be
+        equivalent to the source of the delta at the previous checkpoint, so that the paths
+        are still valid. Throws std::runtime_error if the delta is not consistent with the
+        base. */
+    void apply_delta(
+      type_registry & io_type_registry,
+      const raw_ptr & io_base,
+      const void *    i_delta,
+      size_t          i_delta_size,
+      wire_format     i_format = wire_format::fixed);
+
+} // namespace cambrian
@@ -0,0 +1,651 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "cambrian/data/deserializer.h"
+#include <algorithm>
+#include <new>
+
+namespace cambrian
+{
+    namespace
+    {
+        const type & final_type_of(const qualified_type_ptr & i_qualified_type)
+        {
+            if (i_qualified_type.indirection_levels() != 0)
+            {
+                except<std::runtime_error>("attempt to deserialize a pointer");
+            }
+            CAMBRIAN_ASSERT(i_qualified_type.final_type() != nullptr);
+            return *i_qualified_type.final_type();
+        }
+
+        const type & pointed_type_of(const qualified_type_ptr & i_qualified_type)
+        {
+            if (i_qualified_type.indirection_levels() != 1)
+                except<std::runtime_error>("binary_reader: pointers to pointers are not supported");
+            auto const & pointed_type = *i_qualified_type.final_type();
+            if (!pointed_type.is_constructible())
+            {
+                except<std::runtime_error>(
+                  "binary_reader: the pointed type is not default constructible");
+            }
+            return pointed_type;
+        }
+
+        // some fundamental types have an instance in every translation unit
+        bool same_type(const type & i_first, const type & i_second)
+        {
+            return &i_first == &i_second ||
+                   (!i_first.is_class() && i_first.name() == i_second.name());
+        }
+
+        void deallocate(void * i_object, const type & i_type) noexcept
+        {
+            if (i_type.alignment() > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+                operator delete(i_object, std::align_val_t(i_type.alignment()));
+            else
+                operator delete(i_object);
+        }
+
+        const container * checked_container(const serialization_plan & i_plan)
+        {
+            auto const result = i_plan.m_container;
+            if (result != nullptr)
+            {
+                if (
+                  (result->capabilities() & container::capability::heterogeneous) !=
+                  container::capability::none)
+                {
+                    except<std::runtime_error>(
+                      "binary_reader: heterogeneous containers are not supported");
+                }
+                if (
+                  result->clear_function() == nullptr ||
+                  result->emplace_back_function() == nullptr)
+                {
+                    except<std::runtime_error>("binary_reader: the container can't be resized");
+                }
+            }
+            return result;
+        }
+    } // namespace
+
+    binary_reader::Level::Level(const raw_ptr & i_object, const serialization_plan & i_plan)
+        : m_object(const_cast<void *>(i_object.object())),
+          m_type(i_object.qualified_type().final_type()), m_plan(&i_plan),
+          m_container(checked_container(i_plan))
+    {
+        // the content of the container is replaced
+        if (m_container != nullptr)
+            m_container->clear_function()(m_object);
+    }
+
+    void * binary_reader::identity_table::create(const type & i_type)
+    {
+        // allocated like a new expression would do, so that the object can be deleted
+        m_objects.emplace_back();
+        void * object = nullptr;
+        try
+        {
+            if (i_type.alignment() > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+                object = operator new(i_type.size(), std::align_val_t(i_type.alignment()));
+            else
+                object = operator new(i_type.size());
+            i_type.construct(object);
+        }
+        catch (...)
+        {
+            if (object != nullptr)
+                deallocate(object, i_type);
+            m_objects.pop_back();
+            throw;
+        }
+        m_objects.back() = raw_ptr(object, qualified_type_ptr(&i_type));
+        return object;
+    }
+
+    void * binary_reader::identity_table::find(uint64_t i_tag, const type & i_type) const
+    {
+        if (i_tag < 2 || i_tag - 2 >= m_objects.size())
+            except<std::runtime_error>("binary_reader: corrupted stream");
+        auto const & object = m_objects[static_cast<size_t>(i_tag - 2)];
+        if (!same_type(*object.qualified_type().final_type(), i_type))
+            except<std::runtime_error>("binary_reader: unexpected type in the stream");
+        return const_cast<void *>(object.object());
+    }
+
+    binary_reader::binary_reader(
+      type_registry & i_type_registry, const raw_ptr & i_dest_object, wire_format i_format)
+        : m_type_registry(i_type_registry), m_root(i_dest_object), m_format(i_format),
+          m_identities(m_own_identities)
+    {
+        // throws if the object is const
+        (void)i_dest_object.editable_object();
+    }
+
+    binary_reader::binary_reader(
+      type_registry &  i_type_registry,
+      const raw_ptr &  i_dest_object,
+      identity_table & io_identities,
+      wire_format      i_format)
+        : m_type_registry(i_type_registry), m_root(i_dest_object), m_format(i_format),
+          m_identities(io_identities)
+    {
+        (void)i_dest_object.editable_object();
+    }
+
+    binary_reader::~binary_reader()
+    {
+        while (m_depth > 0)
+            pop_level();
+    }
+
+    void binary_reader::enable_interning(size_t i_max_size)
+    {
+        CAMBRIAN_ASSERT(m_root && m_depth == 0 && i_max_size > 0);
+        m_max_interned_size = i_max_size;
+    }
+
+    void binary_reader::push_level(const raw_ptr & i_object, const serialization_plan & i_plan)
+    {
+        if (m_depth >= max_depth)
+            except<std::runtime_error>("binary_reader: the object is too deep");
+        new (&m_stack[m_depth]) Level(i_object, i_plan);
+        m_depth++;
+    }
+
+    void binary_reader::pop_level() noexcept
+    {
+        top().~Level();
+        m_depth--;
+    }
+
+    bool binary_reader::read_object(byte_reader & i_source, const raw_ptr & i_object)
+    {
+        auto const & object_type = final_type_of(i_object.qualified_type());
+        if (object_type.is_class())
+        {
+            // the content of the object is read by the next iterations of step
+            push_level(i_object, *m_type_registry.get_type_data(object_type).m_plan);
+            return true;
+        }
+        else
+        {
+            return read_value(
+              i_source,
+              const_cast<void *>(i_object.object()),
+              object_type.size(),
+              type_registry::compact_encoding_of(object_type));
+        }
+    }
+
+    bool binary_reader::read_value(
+      byte_reader & i_source, void * o_value, size_t i_size, value_encoding i_encoding) const
+    {
+        if (m_format == wire_format::fixed || i_encoding == value_encoding::raw)
+            return i_source.read_all_or_none(o_value, i_size);
+
+        uint64_t   value;
+        auto const size = read_varint(
+          i_source.next_byte(), static_cast<size_t>(i_source.remaining_size()), value);
+        if (size == 0)
+            return false;
+        i_source.skip(size);
+        if (i_encoding == value_encoding::zigzag_varint)
+            value = static_cast<uint64_t>(zigzag_decode(value));
+        store_integer(o_value, i_size, value);
+        return true;
+    }
+
+    bool binary_reader::execute_operation(byte_reader & i_source, Level & i_level)
+    {
+        using kind        = serialization_plan::operation::kind;
+        auto const & op   = i_level.m_plan->m_operations[i_level.m_operation_index];
+        auto const object = address_add(i_level.m_object, op.m_offset);
+        switch (op.m_kind)
+        {
+        case kind::copy:
+        {
+            if (m_format == wire_format::compact)
+            {
+                for (; i_level.m_copied_size < op.m_field_count; i_level.m_copied_size++)
+                {
+                    auto const & field =
+                      i_level.m_plan->m_fields[op.m_first_field + i_level.m_copied_size];
+                    auto const value = address_add(i_level.m_object, field.m_offset);
+                    if (!read_value(i_source, value, field.m_size, field.m_encoding))
+                        return false;
+                }
+                i_level.m_copied_size = 0;
+                return true;
+            }
+
+            // a copy can be split between buffers
+            auto const size = std::min(
+              op.m_size - i_level.m_copied_size, static_cast<size_t>(i_source.remaining_size()));
+            i_source.read(address_add(object, i_level.m_copied_size), size);
+            i_level.m_copied_size += size;
+            if (i_level.m_copied_size < op.m_size)
+                return false;
+            i_level.m_copied_size = 0;
+            return true;
+        }
+
+        case kind::object:
+            push_level(raw_ptr(object, qualified_type_ptr(op.m_class)), *op.m_plan);
+            return true;
+
+        case kind::property:
+        default:
+        {
+            auto const & qualified_type = op.m_property->qualified_type();
+            if (qualified_type.indirection_levels() != 0)
+            {
+                /* the pointer is assigned before reading the pointed object, so that the object
+                   is reachable even if the stream is incomplete */
+                auto const & pointed_type = pointed_type_of(qualified_type);
+                void *       pointed;
+                bool         new_object;
+                if (!read_pointer(i_source, pointed_type, pointed, new_object))
+                    return false;
+                if (op.m_property->is_settable())
+                    op.m_property->set(object, &pointed);
+                if (new_object && pointed_type.is_class())
+                    read_pointed_class(pointed, pointed_type);
+                return true;
+            }
+
+            /* the value is read in a temporary, that is assigned to the property when complete.
+               Values of properties that are not settable are discarded. */
+            auto const & final_type = final_type_of(qualified_type);
+            i_level.m_value.assign(qualified_type_ptr(&final_type));
+            return read_object(i_source, i_level.m_value);
+        }
+        }
+    }
+
+    void binary_reader::complete_operation(Level & i_level)
+    {
+        using kind      = serialization_plan::operation::kind;
+        auto const & op = i_level.m_plan->m_operations[i_level.m_operation_index];
+        if (
+          op.m_kind == kind::property && op.m_property->is_settable() &&
+          op.m_property->qualified_type().indirection_levels() == 0)
+        {
+            auto const object = address_add(i_level.m_object, op.m_offset);
+            op.m_property->set(object, i_level.m_value.object());
+        }
+    }
+
+    bool binary_reader::read_marker(byte_reader & i_source, Level & i_level)
+    {
+        data_marker marker;
+        uint64_t    interned_id = 0;
+        if (m_format == wire_format::compact)
+        {
+            auto const next_byte = static_cast<const unsigned char *>(i_source.next_byte());
+            auto const available = static_cast<size_t>(i_source.remaining_size());
+            uint64_t   head = 0, count = 0;
+            auto const head_size = read_varint(next_byte, available, head);
+            if (head_size == 0)
+                return false;
+            if ((head >> 3) > std::numeric_limits<type_id>::max())
+                except<std::runtime_error>("binary_reader: corrupted stream");
+            marker.m_type_id = static_cast<type_id>(head >> 3);
+            marker.m_flags   = static_cast<uint16_t>(head & 7);
+
+            // the count, or the id of an interned value
+            size_t count_size = 0;
+            if (
+              (marker.m_flags & data_marker::flag_end_comtainer) == 0 ||
+              marker.m_flags == data_marker::flags_interned)
+            {
+                count_size = read_varint(next_byte + head_size, available - head_size, count);
+                if (count_size == 0)
+                    return false;
+                if (marker.m_flags == data_marker::flags_interned)
+                    interned_id = count;
+                else if (count > data_marker::s_max_count)
+                    except<std::runtime_error>("binary_reader: corrupted stream");
+                else
+                    marker.m_count = static_cast<uint16_t>(count);
+            }
+            i_source.skip(head_size + count_size);
+        }
+        else
+        {
+            // the marker of an interned value and its id are read together
+            if (i_source.remaining_size() < static_cast<ptrdiff_t>(sizeof(marker)))
+                return false;
+            memcpy(&marker, i_source.next_byte(), sizeof(marker));
+            size_t size = sizeof(marker);
+            if (marker.m_flags == data_marker::flags_interned)
+            {
+                uint32_t fixed_id;
+                size += sizeof(fixed_id);
+                if (i_source.remaining_size() < static_cast<ptrdiff_t>(size))
+                    return false;
+                memcpy(
+                  &fixed_id,
+                  address_add(i_source.next_byte(), sizeof(marker)),
+                  sizeof(fixed_id));
+                interned_id = fixed_id;
+            }
+            i_source.skip(size);
+        }
+
+        if (marker.m_flags == data_marker::flags_interned)
+        {
+            if (!i_level.m_first_run || m_max_interned_size == 0)
+                except<std::runtime_error>("binary_reader: corrupted stream");
+            i_level.m_first_run = false;
+            read_interned(i_level, interned_id);
+            return true;
+        }
+
+        bool const begin = (marker.m_flags & data_marker::flag_begin_comtainer) != 0;
+        bool const end   = (marker.m_flags & data_marker::flag_end_comtainer) != 0;
+        if (begin != i_level.m_first_run || end != (marker.m_count == 0))
+            except<std::runtime_error>("binary_reader: corrupted stream");
+        i_level.m_first_run = false;
+
+        if (!end)
+        {
+            // runs of pointers have the type of the pointed objects
+            auto const & elements_type = i_level.m_container->elements_type();
+            bool const   pointers      = elements_type.indirection_levels() != 0;
+            auto const   type_data     = m_type_registry.get_type_data(
+              pointers ? pointed_type_of(elements_type) : final_type_of(elements_type));
+            if (type_data.m_id != marker.m_type_id)
+                except<std::runtime_error>("binary_reader: unexpected type in the stream");
+            if (
+              (marker.m_flags & data_marker::flag_delta_encoded) != 0 &&
+              (m_format != wire_format::compact || pointers ||
+               type_data.m_compact_encoding == value_encoding::raw))
+            {
+                except<std::runtime_error>("binary_reader: corrupted stream");
+            }
+            i_level.m_remaining_in_run = marker.m_count;
+            i_level.m_run_flags        = marker.m_flags;
+            i_level.m_run_first_value  = true;
+            i_level.m_run_plan         = type_data.m_plan;
+        }
+        else if (m_max_interned_size != 0)
+        {
+            intern(i_level);
+        }
+        return true;
+    }
+
+    void binary_reader::intern(const Level & i_level)
+    {
+        detail::interned_value value;
+        if (detail::get_interned_value(
+              raw_ptr(i_level.m_object, qualified_type_ptr(i_level.m_type)),
+              *i_level.m_plan,
+              m_max_interned_size,
+              value))
+        {
+            m_interned_values.push_back(std::move(value));
+        }
+    }
+
+    void binary_reader::read_interned(Level & i_level, uint64_t i_id) const
+    {
+        if (i_id >= m_interned_values.size())
+            except<std::runtime_error>("binary_reader: corrupted stream");
+        auto const & value = m_interned_values[static_cast<size_t>(i_id)];
+        if (value.m_plan != i_level.m_plan)
+            except<std::runtime_error>("binary_reader: unexpected type in the stream");
+
+        // the raw bytes are copied, like a run of fundamental elements
+        auto const element_size = i_level.m_container->elements_type().final_type()->size();
+        auto const count  = static_cast<container::index>(value.m_bytes.size() / element_size);
+        auto const resize = i_level.m_container->resize_function();
+        if (resize != nullptr)
+        {
+            memcpy(resize(i_level.m_object, count), value.m_bytes.data(), value.m_bytes.size());
+        }
+        else
+        {
+            auto const emplace_back = i_level.m_container->emplace_back_function();
+            for (container::index index = 0; index < count; index++)
+            {
+                memcpy(
+                  emplace_back(i_level.m_object),
+                  value.m_bytes.data() + index * element_size,
+                  element_size);
+            }
+        }
+        i_level.m_element_count = count;
+    }
+
+    bool binary_reader::read_elements(byte_reader & i_source, Level & i_level)
+    {
+        auto const & elements_type = i_level.m_container->elements_type();
+        if (elements_type.indirection_levels() != 0)
+            return read_pointer_elements(i_source, i_level, pointed_type_of(elements_type));
+
+        auto const & element_type = final_type_of(elements_type);
+        auto const   emplace_back = i_level.m_container->emplace_back_function();
+        if (m_format == wire_format::compact)
+        {
+            auto const encoding = type_registry::compact_encoding_of(element_type);
+            if (encoding != value_encoding::raw)
+                return read_integer_elements(i_source, i_level, element_type, encoding);
+        }
+        if (element_type.is_class())
+        {
+            auto const element = emplace_back(i_level.m_object);
+            i_level.m_element_count++;
+            i_level.m_remaining_in_run--;
+            push_level(raw_ptr(element, elements_type), *i_level.m_run_plan);
+            return true;
+        }
+
+        /* fundamentals and enums are read in bulk, as many as available in the buffer. The
+           elements are added only if the values are available. */
+        auto const element_size  = element_type.size();
+        auto const max_in_buffer = static_cast<size_t>(i_source.remaining_size()) / element_size;
+        auto const count =
+          std::min<container::index>(i_level.m_remaining_in_run, max_in_buffer);
+        if (count == 0)
+            return false;
+
+        auto const resize = i_level.m_container->resize_function();
+        if (resize != nullptr)
+        {
+            auto const elements = resize(i_level.m_object, i_level.m_element_count + count);
+            i_source.read(
+              address_add(elements, static_cast<size_t>(i_level.m_element_count * element_size)),
+              static_cast<size_t>(count * element_size));
+        }
+        else
+        {
+            for (container::index index = 0; index < count; index++)
+                i_source.read(emplace_back(i_level.m_object), element_size);
+        }
+        i_level.m_element_count += count;
+        i_level.m_remaining_in_run = static_cast<uint16_t>(i_level.m_remaining_in_run - count);
+        return true;
+    }
+
+    bool binary_reader::read_integer_elements(
+      byte_reader & i_source, Level & i_level, const type & i_type, value_encoding i_encoding)
+    {
+        // the varints are decoded in chunks, as many as available in the buffer
+        constexpr size_t chunk_size = 256;
+        uint64_t         values[chunk_size];
+        size_t           read_size = 0;
+        auto const       count     = read_varints(
+          i_source.next_byte(),
+          static_cast<size_t>(i_source.remaining_size()),
+          values,
+          std::min<size_t>(i_level.m_remaining_in_run, chunk_size),
+          read_size);
+        if (count == 0)
+            return false;
+        i_source.skip(read_size);
+
+        auto const     element_size = i_type.size();
+        bool const     is_signed    = i_encoding == value_encoding::zigzag_varint;
+        uint64_t const sign_offset  = is_signed ? uint64_t(1) << 63 : 0;
+        bool const     delta = (i_level.m_run_flags & data_marker::flag_delta_encoded) != 0;
+        auto const     resize       = i_level.m_container->resize_function();
+        void * const   elements =
+          resize != nullptr ? resize(i_level.m_object, i_level.m_element_count + count) : nullptr;
+        for (size_t index = 0; index < count; index++)
+        {
+            // the first element of a run is encoded like a single value (see binary_writer)
+            if (delta && !i_level.m_run_first_value)
+            {
+                i_level.m_run_last += values[index];
+            }
+            else
+            {
+                auto const value =
+                  is_signed ? static_cast<uint64_t>(zigzag_decode(values[index])) : values[index];
+                i_level.m_run_last = value + sign_offset;
+                i_level.m_run_first_value = false;
+            }
+
+            auto const dest =
+              elements != nullptr
+                ? address_add(elements, (i_level.m_element_count + index) * element_size)
+                : i_level.m_container->emplace_back_function()(i_level.m_object);
+            store_integer(dest, element_size, i_level.m_run_last - sign_offset);
+        }
+        i_level.m_element_count += count;
+        i_level.m_remaining_in_run = static_cast<uint16_t>(i_level.m_remaining_in_run - count);
+        return true;
+    }
+
+    bool binary_reader::read_pointer(
+      byte_reader & i_source, const type & i_type, void *& o_pointed, bool & o_new_object)
+    {
+        uint64_t tag;
+        if (m_format == wire_format::compact)
+        {
+            auto const size = read_varint(
+              i_source.next_byte(), static_cast<size_t>(i_source.remaining_size()), tag);
+            if (size == 0)
+                return false;
+            i_source.skip(size);
+        }
+        else
+        {
+            uint32_t fixed_tag;
+            if (!i_source.read_all_or_none(&fixed_tag, sizeof(fixed_tag)))
+                return false;
+            tag = fixed_tag;
+        }
+
+        o_new_object = tag == 1;
+        if (tag == 0)
+        {
+            o_pointed = nullptr;
+        }
+        else if (tag == 1)
+        {
+            // the value of a fundamental or an enum follows the tag in the same buffer
+            o_pointed = m_identities.create(i_type);
+            if (
+              !i_type.is_class() &&
+              !read_value(
+                i_source, o_pointed, i_type.size(), type_registry::compact_encoding_of(i_type)))
+            {
+                except<std::runtime_error>("binary_reader: a value is split between two buffers");
+            }
+        }
+        else
+        {
+            o_pointed = m_identities.find(tag, i_type);
+        }
+        return true;
+    }
+
+    void binary_reader::read_pointed_class(void * i_pointed, const type & i_type)
+    {
+        // the content of the object is read by the next iterations of step
+        push_level(
+          raw_ptr(i_pointed, qualified_type_ptr(&i_type)),
+          *m_type_registry.get_type_data(i_type).m_plan);
+    }
+
+    bool binary_reader::read_pointer_elements(
+      byte_reader & i_source, Level & i_level, const type & i_type)
+    {
+        void * pointed;
+        bool   new_object;
+        if (!read_pointer(i_source, i_type, pointed, new_object))
+            return false;
+
+        auto const element = i_level.m_container->emplace_back_function()(i_level.m_object);
+        memcpy(element, &pointed, sizeof(pointed));
+        i_level.m_element_count++;
+        i_level.m_remaining_in_run--;
+        if (new_object && i_type.is_class())
+            read_pointed_class(pointed, i_type);
+        return true;
+    }
+
+    binary_reader::result binary_reader::step(byte_reader & i_source)
+    {
+        auto const out_of_data = [&] {
+            if (i_source.remaining_size() != 0)
+                except<std::runtime_error>("binary_reader: a value is split between two buffers");
+            return more_data;
+        };
+
+        if (m_root)
+        {
+            // the root has the id 0, unless the identity table is shared
+            if (m_identities.empty())
+                m_identities.add(m_root);
+            if (!read_object(i_source, m_root))
+                return out_of_data();
+            m_root = {};
+        }
+
+        while (m_depth > 0)
+        {
+            auto & level = top();
+
+            // see binary_writer::step
+            if (level.m_advance)
+            {
+                level.m_advance = false;
+                complete_operation(level);
+                level.m_operation_index++;
+            }
+
+            if (level.m_operation_index < level.m_plan->m_operations.size())
+            {
+                if (!execute_operation(i_source, level))
+                    return out_of_data();
+                level.m_advance = true;
+            }
+            else if (level.m_container == nullptr)
+            {
+                pop_level();
+            }
+            else if (level.m_remaining_in_run > 0)
+            {
+                if (!read_elements(i_source, level))
+                    return out_of_data();
+            }
+            else
+            {
+                if (!read_marker(i_source, level))
+                    return out_of_data();
+                if (level.m_remaining_in_run == 0)
+                    pop_level(); // end of the container
+            }
+        }
+
+        return finished;
+    }
+
+} // namespace cambrian
@@ -0,0 +1,197 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "cambrian/cambrian_common.h"
+#include "cambrian/data/serializer.h"
+#include "cambrian/data/type_registry.h"
+#include "ediacaran/core/array_view.h"
+#include "ediacaran/core/byte_reader.h"
+#include "ediacaran/utils/dyn_value.h"
+#include "ediacaran/utils/raw_ptr.h"
+#include <type_traits>
+#include <vector>
+
+namespace cambrian
+{
+    /** Reads an object from a sequence of buffers written by binary_writer (see the format in
+        serializer.h). The buffers must be split at the same points of the stream, or at least
+        never in the middle of a marker or of a value that the writer does not split.
+        The destination object must be already constructed: its properties are overwritten, and
+        the content of the containers is replaced. The properties are read executing the
+        serialization_plan of the class, so fundamental values and inplace properties are
+        copied directly in the destination object. Properties with a setter are read in a
+        temporary value constructed by the special functions of its type, and then assigned.
+        The elements of containers are added with the emplace_back function of the container
+        reflection. Runs of fundamental or enum elements are copied in bulk, after resizing the
+        container if it is contiguous. The type ids of the markers must match the ones of the
+        type_registry, so the registry must be in the same state of the one used by the
+        writer. The wire_format must be the one used by the writer.
+        Every object written through a pointer for the first time is allocated like a new
+        expression of its type would do, default constructed, and then read. Pointers that
+        refer to objects already read (including the root) are set to them, so the shared
+        objects and the cycles of the source are restored. Pointers are assigned as soon as
+        they are read, so the created objects are reachable from the destination object even if
+        the stream is incomplete, unless they are pointed only by properties that are not
+        settable. The reader never destroys the objects it creates: they are owned by the
+        caller, and are listed by created_objects().
+        If interning is enabled, an interned container is filled copying the raw bytes of its
+        first occurrence, that are kept by the reader, without decoding them again. Being
+        values, the containers are not shared, so every occurrence is a distinct copy. */
+    class binary_reader
+    {
+      public:
+        /** Maximum nesting depth of objects. Deeper objects cause a std::runtime_error. */
+        constexpr static size_t max_depth = binary_writer::max_depth;
+
+        binary_reader(
+          type_registry & i_type_registry,
+          const raw_ptr & i_dest_object,
+          wire_format     i_format = wire_format::fixed);
+
+        /** The objects read through pointers, indexed by id. A table can be shared by readers
+            of streams written by writers that shared an identity table: a reader assigns the id
+            0 to its root only if the table is empty. deserialize (see static_serializer.h)
+            shares a table with the readers it uses. */
+        class identity_table
+        {
+          public:
+            /** Assigns the next id to an object that already exists, like the root */
+            void add(const raw_ptr & i_object) { m_objects.push_back(i_object); }
+
+            /** Allocates an object like a new expression of its type would do, default
+                constructs it, and assigns it the next id */
+            void * create(const type & i_type);
+
+            /** Returns the object with the id k referred by the tag k + 2. Throws
+                std::runtime_error if there is no such object, or if it has another type. */
+            void * find(uint64_t i_tag, const type & i_type) const;
+
+            bool empty() const noexcept { return m_objects.empty(); }
+
+            /** Returns the objects with the ids from 1 on */
+            array_view<const raw_ptr> created_objects() const noexcept
+            {
+                return m_objects.empty() ? array_view<const raw_ptr>()
+                                         : array_view<const raw_ptr>(
+                                             m_objects.data() + 1, m_objects.size() - 1);
+            }
+
+          private:
+            std::vector<raw_ptr> m_objects;
+        };
+
+        /** Constructs a reader that uses an identity table shared with other readers. The
+            table must outlive the reader. */
+        binary_reader(
+          type_registry &  i_type_registry,
+          const raw_ptr &  i_dest_object,
+          identity_table & io_identities,
+          wire_format      i_format = wire_format::fixed);
+
+        binary_reader(const binary_reader &) = delete;
+        binary_reader & operator=(const binary_reader &) = delete;
+
+        ~binary_reader();
+
+        /** Enables the interning of small containers of values, with the maximum size used
+            by the writer (see binary_writer::enable_interning). Must be called before the
+            first step. */
+        void enable_interning(size_t i_max_size = binary_writer::default_max_interned_size);
+
+        enum result
+        {
+            finished,
+            more_data
+        };
+
+        /** Reads from the buffer as much as possible. If the result is more_data, all the
+            buffer has been consumed, and the caller should call step again with the next
+            buffer. When the object is complete, the rest of the buffer is left unread.
+            Throws std::runtime_error if the stream is not consistent with the object. */
+        EDI_NODISCARD result step(byte_reader & i_source);
+
+        /** Returns the objects created for the pointers read so far, in the order they have
+            been read. If the identity table is shared, the objects created by the other readers
+            are included. */
+        array_view<const raw_ptr> created_objects() const noexcept
+        {
+            return m_identities.created_objects();
+        }
+
+      private:
+        struct Level
+        {
+            void * const                     m_object;
+            const type * const               m_type;
+            const serialization_plan * const m_plan;
+            const container * const          m_container;
+            size_t                           m_operation_index  = 0;
+            size_t                           m_copied_size      = 0; /**< or fields */
+            bool                             m_advance          = false;
+            bool                             m_first_run        = true;
+            uint16_t                         m_remaining_in_run = 0;
+            uint16_t                         m_run_flags        = 0;
+            bool                             m_run_first_value  = false;
+            uint64_t                         m_run_last         = 0;
+            const serialization_plan *       m_run_plan         = nullptr;
+            container::index                 m_element_count    = 0;
+            dyn_value                        m_value;
+
+            Level(const raw_ptr & i_object, const serialization_plan & i_plan);
+        };
+
+        using LevelStorage = std::aligned_storage_t<sizeof(Level), alignof(Level)>;
+
+        Level & top() noexcept
+        {
+            CAMBRIAN_ASSERT(m_depth > 0);
+            return reinterpret_cast<Level &>(m_stack[m_depth - 1]);
+        }
+
+        void push_level(const raw_ptr & i_object, const serialization_plan & i_plan);
+
+        void pop_level() noexcept;
+
+        bool read_object(byte_reader & i_source, const raw_ptr & i_object);
+
+        bool read_value(
+          byte_reader & i_source, void * o_value, size_t i_size, value_encoding i_encoding) const;
+
+        bool execute_operation(byte_reader & i_source, Level & i_level);
+
+        void complete_operation(Level & i_level);
+
+        bool read_elements(byte_reader & i_source, Level & i_level);
+
+        bool read_integer_elements(
+          byte_reader & i_source, Level & i_level, const type & i_type, value_encoding i_encoding);
+
+        bool read_marker(byte_reader & i_source, Level & i_level);
+
+        void intern(const Level & i_level);
+
+        void read_interned(Level & i_level, uint64_t i_id) const;
+
+        bool read_pointer(
+          byte_reader & i_source, const type & i_type, void *& o_pointed, bool & o_new_object);
+
+        void read_pointed_class(void * i_pointed, const type & i_type);
+
+        bool read_pointer_elements(byte_reader & i_source, Level & i_level, const type & i_type);
+
+      private:
+        type_registry &                     m_type_registry;
+        raw_ptr                             m_root;
+        wire_format const                   m_format;
+        size_t                              m_depth = 0;
+        LevelStorage                        m_stack[max_depth];
+        identity_table                      m_own_identities;
+        identity_table &                    m_identities;
+        size_t                              m_max_interned_size = 0;
+        std::vector<detail::interned_value> m_interned_values; /**< indexed by id */
+    };
+
+} // namespace cambrian
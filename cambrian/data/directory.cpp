@@ -1,68 +1,1093 @@
-
 //   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
 // Distributed under the Boost Software License, Version 1.0.
 //    (See accompanying file LICENSE_1_0.txt or copy at
 //          http://www.boost.org/LICENSE_1_0.txt)
 
 #include "cambrian/data/directory.h"
-#include "ediacaran/core/string_utils.h"
+#include "cambrian/data/path_cache.h"
+#include "ediacaran/core/address.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
 
 namespace cambrian
 {
-    /*obj_ref::obj_ref(storage_device * i_device, const string_view & i_path) : m_device(i_device)
+    namespace
     {
-        auto const device_info = m_device->get_info();
-        auto const slot_count  = device_info.m_page_size / sizeof(page_address);
+        /* layout of the header page of a directory. The table is a radix tree: m_table_root
+           is the only table page if m_table_levels is zero, otherwise an index page. */
+        struct DirectoryHeader
+        {
+            uint32_t     m_global_depth;
+            uint32_t     m_table_levels; // levels of index pages above the table pages
+            uint64_t     m_entry_count;
+            page_address m_table_root;
+        };
+
+        // layout of a bucket page
+        struct BucketHeader
+        {
+            page_address m_overflow_page; // invalid_page_address if the bucket is not chained
+            uint32_t     m_local_depth;
+            uint32_t     m_entry_count;
+            uint32_t     m_used_size; // bytes used by the entries following the header
+        };
+
+        // layout of an entry in a bucket
+        struct EntryHeader
+        {
+            page_address m_value;
+            hash_t       m_hash;
+            uint32_t     m_name_length;
+            /* followed by the chars of the name and, if the value is inline, by the inline data,
+               padded to alignof(EntryHeader) */
+        };
+
+        constexpr uint32_t log2_of_pow2(uint64_t i_value) noexcept
+        {
+            uint32_t result = 0;
+            while ((static_cast<uint64_t>(1) << result) < i_value)
+                result++;
+            return result;
+        }
+
+        constexpr uint64_t pow2(uint32_t i_exponent) noexcept
+        {
+            return static_cast<uint64_t>(1) << i_exponent;
+        }
+
+        constexpr size_t inline_size_of(page_address i_value) noexcept
+        {
+            return (i_value & inline_value_mask) != 0
+                     ? static_cast<size_t>(i_value & ~inline_value_mask)
+                     : 0;
+        }
+
+        constexpr size_t entry_size(size_t i_name_length, size_t i_inline_size) noexcept
+        {
+            return uint_upper_align(
+              sizeof(EntryHeader) + i_name_length + i_inline_size, alignof(EntryHeader));
+        }
+
+        size_t entry_size(const EntryHeader * i_entry) noexcept
+        {
+            return entry_size(i_entry->m_name_length, inline_size_of(i_entry->m_value));
+        }
+
+        // copies the inline data of an entry, if any, to a buffer of max_inline_size bytes
+        void copy_inline_data(const EntryHeader * i_entry, void * o_buffer) noexcept
+        {
+            memcpy(
+              o_buffer,
+              address_add(i_entry + 1, i_entry->m_name_length),
+              inline_size_of(i_entry->m_value));
+        }
+
+        // shape of the table, that depends only on the page size
+        struct Geometry
+        {
+            /* log2 of the number of slots in a table page, and of the number of children of
+               an index page */
+            uint32_t m_slot_bits;
+
+            // maximum global depth: all the bits of the hash
+            constexpr static uint32_t max_depth = std::numeric_limits<hash_t>::digits;
+
+            Geometry(page_size i_page_size) noexcept
+            {
+                CAMBRIAN_ASSERT(is_power_of_2(i_page_size));
+                m_slot_bits = log2_of_pow2(i_page_size / sizeof(page_address));
+            }
+        };
+
+        DirectoryHeader & header_of(const scoped_page & i_page) noexcept
+        {
+            return *static_cast<DirectoryHeader *>(i_page.mem_address());
+        }
+
+        page_address * slots_of(const scoped_page & i_table_page) noexcept
+        {
+            return static_cast<page_address *>(i_table_page.mem_address());
+        }
 
-        auto page = device_info.m_root_page;
+        // index of the child of an index page at the given level (1 is above the table pages)
+        uint64_t child_index(
+          const Geometry & i_geometry, uint64_t i_table_page_index, uint32_t i_level) noexcept
+        {
+            auto const shift = i_geometry.m_slot_bits * (i_level - 1);
+            return (i_table_page_index >> shift) & (pow2(i_geometry.m_slot_bits) - 1);
+        }
+
+        // maps a table page, walking the index pages from the root
+        scoped_page map_table_page(
+          storage_device &             i_device,
+          const DirectoryHeader &      i_header,
+          const Geometry &             i_geometry,
+          uint64_t                     i_table_page_index,
+          storage_device::access_flags i_flags)
+        {
+            auto address = i_header.m_table_root;
+            for (auto level = i_header.m_table_levels; level > 0; level--)
+            {
+                auto const index_page =
+                  map_scoped_page(i_device, address, storage_device::access_flags::read);
+                address = slots_of(index_page)[child_index(i_geometry, i_table_page_index, level)];
+                CAMBRIAN_ASSERT(address != invalid_page_address);
+            }
+            return map_scoped_page(i_device, address, i_flags);
+        }
+
+        scoped_page allocate_index_page(storage_device & i_device, const Geometry & i_geometry)
+        {
+            auto page = allocate_scoped_page(i_device);
+            std::fill_n(slots_of(page), pow2(i_geometry.m_slot_bits), invalid_page_address);
+            return page;
+        }
 
-        for (auto & token : split(i_path, '/'))
+        // stores the address of a table page, allocating the missing index pages
+        void set_table_page(
+          storage_device &        i_device,
+          const DirectoryHeader & i_header,
+          const Geometry &        i_geometry,
+          uint64_t                i_table_page_index,
+          page_address            i_table_page)
         {
-            auto mapping =
-              i_device->map_page(page, storage_device::access_flags::read_write).value();
-            m_mapped_pages.push_back(std::move(mapping));
+            CAMBRIAN_ASSERT(i_header.m_table_levels > 0);
+            auto index_page = map_scoped_page(
+              i_device, i_header.m_table_root, storage_device::access_flags::read_write);
+            for (auto level = i_header.m_table_levels;; level--)
+            {
+                auto & child =
+                  slots_of(index_page)[child_index(i_geometry, i_table_page_index, level)];
+                if (level == 1)
+                {
+                    child = i_table_page;
+                    return;
+                }
+                if (child == invalid_page_address)
+                {
+                    auto new_page = allocate_index_page(i_device, i_geometry);
+                    child         = new_page.storage_address();
+                    index_page    = std::move(new_page);
+                }
+                else
+                {
+                    index_page =
+                      map_scoped_page(i_device, child, storage_device::access_flags::read_write);
+                }
+            }
         }
-    }*/
+
+        // view on a mapped bucket page
+        class Bucket
+        {
+          public:
+            Bucket(const scoped_page & i_page, page_size i_page_size) noexcept
+                : m_header(static_cast<BucketHeader *>(i_page.mem_address())),
+                  m_page_size(i_page_size)
+            {
+            }
+
+            BucketHeader & header() const noexcept { return *m_header; }
+
+            EntryHeader * begin() const noexcept
+            {
+                return static_cast<EntryHeader *>(address_add(m_header, sizeof(BucketHeader)));
+            }
+
+            EntryHeader * end() const noexcept
+            {
+                return static_cast<EntryHeader *>(
+                  address_add(m_header, sizeof(BucketHeader) + m_header->m_used_size));
+            }
+
+            static EntryHeader * next(EntryHeader * i_entry) noexcept
+            {
+                return static_cast<EntryHeader *>(address_add(i_entry, entry_size(i_entry)));
+            }
+
+            static string_view name(const EntryHeader * i_entry) noexcept
+            {
+                return string_view(
+                  reinterpret_cast<const char *>(i_entry + 1), i_entry->m_name_length);
+            }
+
+            static const void * inline_data(const EntryHeader * i_entry) noexcept
+            {
+                return address_add(i_entry + 1, i_entry->m_name_length);
+            }
+
+            EntryHeader * find(hash_t i_hash, const string_view & i_name) const noexcept
+            {
+                for (auto entry = begin(); entry < end(); entry = next(entry))
+                {
+                    if (entry->m_hash == i_hash && name(entry) == i_name)
+                        return entry;
+                }
+                return nullptr;
+            }
+
+            // returns whether all the entries have the given hash
+            bool all_have_hash(hash_t i_hash) const noexcept
+            {
+                for (auto entry = begin(); entry < end(); entry = next(entry))
+                {
+                    if (entry->m_hash != i_hash)
+                        return false;
+                }
+                return true;
+            }
+
+            bool can_fit(size_t i_entry_size) const noexcept
+            {
+                return sizeof(BucketHeader) + m_header->m_used_size + i_entry_size <= m_page_size;
+            }
+
+            void append(
+              hash_t              i_hash,
+              const string_view & i_name,
+              page_address        i_value,
+              const void *        i_inline_data) noexcept
+            {
+                auto const inline_size = inline_size_of(i_value);
+                auto const size        = entry_size(i_name.size(), inline_size);
+                CAMBRIAN_ASSERT(can_fit(size));
+                auto const entry     = end();
+                entry->m_value       = i_value;
+                entry->m_hash        = i_hash;
+                entry->m_name_length = static_cast<uint32_t>(i_name.size());
+                memcpy(entry + 1, i_name.data(), i_name.size());
+                if (inline_size != 0)
+                    memcpy(address_add(entry + 1, i_name.size()), i_inline_data, inline_size);
+                m_header->m_used_size += static_cast<uint32_t>(size);
+                m_header->m_entry_count++;
+            }
+
+            void erase(EntryHeader * i_entry) noexcept
+            {
+                auto const size      = entry_size(i_entry);
+                auto const following = address_add(i_entry, size);
+                memmove(i_entry, following, address_diff(end(), following));
+                m_header->m_used_size -= static_cast<uint32_t>(size);
+                m_header->m_entry_count--;
+            }
+
+            static void format(const scoped_page & i_page, uint32_t i_local_depth) noexcept
+            {
+                auto & header          = *static_cast<BucketHeader *>(i_page.mem_address());
+                header.m_overflow_page = invalid_page_address;
+                header.m_local_depth   = i_local_depth;
+                header.m_entry_count   = 0;
+                header.m_used_size     = 0;
+            }
+
+          private:
+            BucketHeader * m_header;
+            page_size      m_page_size;
+        };
+
+        // the pages involved in the access to a slot of the table
+        struct SlotLocation
+        {
+            scoped_page m_header;
+            scoped_page m_table;
+            scoped_page m_bucket;
+            uint64_t    m_slot_index;
+        };
+
+        SlotLocation locate_slot(
+          storage_device &             i_device,
+          page_address                 i_header_page,
+          const Geometry &             i_geometry,
+          hash_t                       i_hash,
+          storage_device::access_flags i_flags)
+        {
+            SlotLocation result;
+            result.m_header = map_scoped_page(i_device, i_header_page, i_flags);
+
+            auto const & header = header_of(result.m_header);
+            result.m_slot_index = i_hash & (pow2(header.m_global_depth) - 1);
+
+            result.m_table = map_table_page(
+              i_device, header, i_geometry, result.m_slot_index >> i_geometry.m_slot_bits, i_flags);
+
+            auto const slot_in_page = result.m_slot_index & (pow2(i_geometry.m_slot_bits) - 1);
+            result.m_bucket =
+              map_scoped_page(i_device, slots_of(result.m_table)[slot_in_page], i_flags);
+            return result;
+        }
+
+        void set_slots(
+          storage_device &    i_device,
+          const scoped_page & i_header,
+          const Geometry &    i_geometry,
+          uint64_t            i_first_slot,
+          uint64_t            i_stride,
+          page_address        i_bucket)
+        {
+            auto const & header     = header_of(i_header);
+            auto const   slot_count = pow2(header.m_global_depth);
+            auto const   slot_mask  = pow2(i_geometry.m_slot_bits) - 1;
+
+            scoped_page table;
+            uint64_t    mapped_table_index = 0;
+            for (uint64_t slot = i_first_slot; slot < slot_count; slot += i_stride)
+            {
+                auto const table_index = slot >> i_geometry.m_slot_bits;
+                if (table.empty() || table_index != mapped_table_index)
+                {
+                    table = map_table_page(
+                      i_device,
+                      header,
+                      i_geometry,
+                      table_index,
+                      storage_device::access_flags::read_write);
+                    mapped_table_index = table_index;
+                }
+                slots_of(table)[slot & slot_mask] = i_bucket;
+            }
+        }
+
+        /* appends an entry to the first page of a chain that has enough space, allocating an
+           overflow page if none has */
+        void append_to_chain(
+          storage_device &    i_device,
+          page_size           i_page_size,
+          const scoped_page & i_first_page,
+          hash_t              i_hash,
+          const string_view & i_name,
+          page_address        i_value,
+          const void *        i_inline_data)
+        {
+            auto const  size = entry_size(i_name.size(), inline_size_of(i_value));
+            scoped_page chained;
+            for (;;)
+            {
+                Bucket bucket(chained.empty() ? i_first_page : chained, i_page_size);
+                if (bucket.can_fit(size))
+                {
+                    bucket.append(i_hash, i_name, i_value, i_inline_data);
+                    return;
+                }
+                auto const overflow_page = bucket.header().m_overflow_page;
+                if (overflow_page == invalid_page_address)
+                {
+                    auto new_page = allocate_scoped_page(i_device);
+                    Bucket::format(new_page, bucket.header().m_local_depth);
+                    bucket.header().m_overflow_page = new_page.storage_address();
+                    chained                         = std::move(new_page);
+                }
+                else
+                {
+                    chained = map_scoped_page(
+                      i_device, overflow_page, storage_device::access_flags::read_write);
+                }
+            }
+        }
+
+        // splits the bucket of a slot, so that its local depth is incremented
+        void split_bucket(
+          storage_device &     i_device,
+          page_size            i_page_size,
+          const Geometry &     i_geometry,
+          const SlotLocation & i_location)
+        {
+            Bucket     bucket(i_location.m_bucket, i_page_size);
+            auto const old_depth = bucket.header().m_local_depth;
+            CAMBRIAN_ASSERT(old_depth < header_of(i_location.m_header).m_global_depth);
+
+            auto const new_page = allocate_scoped_page(i_device);
+            Bucket::format(new_page, old_depth + 1);
+            Bucket new_bucket(new_page, i_page_size);
+            bucket.header().m_local_depth = old_depth + 1;
+
+            // move the entries whose hash has the bit old_depth set
+            auto entry = bucket.begin();
+            while (entry < bucket.end())
+            {
+                if ((entry->m_hash >> old_depth) & 1)
+                {
+                    new_bucket.append(
+                      entry->m_hash,
+                      Bucket::name(entry),
+                      entry->m_value,
+                      Bucket::inline_data(entry));
+                    bucket.erase(entry);
+                }
+                else
+                {
+                    entry = Bucket::next(entry);
+                }
+            }
+
+            // the entries of the overflow pages are distributed in the two chains
+            auto overflow_page              = bucket.header().m_overflow_page;
+            bucket.header().m_overflow_page = invalid_page_address;
+            while (overflow_page != invalid_page_address)
+            {
+                auto chained = map_scoped_page(
+                  i_device, overflow_page, storage_device::access_flags::read);
+                Bucket const chained_bucket(chained, i_page_size);
+                for (auto chained_entry = chained_bucket.begin();
+                     chained_entry < chained_bucket.end();
+                     chained_entry = Bucket::next(chained_entry))
+                {
+                    append_to_chain(
+                      i_device,
+                      i_page_size,
+                      (chained_entry->m_hash >> old_depth) & 1 ? new_page : i_location.m_bucket,
+                      chained_entry->m_hash,
+                      Bucket::name(chained_entry),
+                      chained_entry->m_value,
+                      Bucket::inline_data(chained_entry));
+                }
+                auto const address = overflow_page;
+                overflow_page      = chained_bucket.header().m_overflow_page;
+                chained.release();
+                i_device.deallocate_page(address);
+            }
+
+            // redirect to the new bucket the slots with the bit old_depth set
+            auto const first_slot =
+              (i_location.m_slot_index & (pow2(old_depth) - 1)) | pow2(old_depth);
+            set_slots(
+              i_device,
+              i_location.m_header,
+              i_geometry,
+              first_slot,
+              pow2(old_depth + 1),
+              new_page.storage_address());
+        }
+
+        // doubles the table, incrementing the global depth
+        void double_table(
+          storage_device & i_device, const Geometry & i_geometry, const scoped_page & i_header)
+        {
+            auto &     header     = header_of(i_header);
+            auto const slot_count = pow2(header.m_global_depth);
+            CAMBRIAN_ASSERT(header.m_global_depth < Geometry::max_depth);
+
+            if (slot_count * 2 <= pow2(i_geometry.m_slot_bits))
+            {
+                // the table fits in a single page
+                CAMBRIAN_ASSERT(header.m_table_levels == 0);
+                auto const table = map_table_page(
+                  i_device, header, i_geometry, 0, storage_device::access_flags::read_write);
+                auto const slots = slots_of(table);
+                std::copy(slots, slots + slot_count, slots + slot_count);
+            }
+            else
+            {
+                // a level of index pages is added when the current levels are full
+                auto const page_count = slot_count >> i_geometry.m_slot_bits;
+                if (page_count * 2 > pow2(i_geometry.m_slot_bits * header.m_table_levels))
+                {
+                    auto const root     = allocate_index_page(i_device, i_geometry);
+                    slots_of(root)[0]   = header.m_table_root;
+                    header.m_table_root = root.storage_address();
+                    header.m_table_levels++;
+                }
+
+                // every table page is duplicated
+                auto const table_size = pow2(i_geometry.m_slot_bits) * sizeof(page_address);
+                for (uint64_t page_index = 0; page_index < page_count; page_index++)
+                {
+                    auto const source = map_table_page(
+                      i_device, header, i_geometry, page_index, storage_device::access_flags::read);
+                    auto const copy = allocate_scoped_page(i_device);
+                    memcpy(copy.mem_address(), source.mem_address(), table_size);
+                    set_table_page(
+                      i_device,
+                      header,
+                      i_geometry,
+                      page_count + page_index,
+                      copy.storage_address());
+                }
+            }
+            header.m_global_depth++;
+        }
+
+    } // namespace
+
+    directory::directory(
+      storage_device & i_device, page_address i_header_page, path_cache * i_cache) noexcept
+        : m_device(&i_device), m_header_page(i_header_page),
+          m_page_size(i_device.get_info().m_page_size), m_cache(i_cache)
+    {
+        CAMBRIAN_ASSERT((i_header_page & dictionary_page_mask) == 0);
+    }
+
+    page_address directory::create(storage_device & i_device)
+    {
+        auto const header_page = allocate_scoped_page(i_device).storage_address();
+        try
+        {
+            format(i_device, header_page);
+        }
+        catch (...)
+        {
+            i_device.deallocate_page(header_page);
+            throw;
+        }
+        return header_page;
+    }
+
+    void directory::format(storage_device & i_device, page_address i_header_page)
+    {
+        auto const bucket = allocate_scoped_page(i_device);
+        Bucket::format(bucket, 0);
+
+        auto const table   = allocate_scoped_page(i_device);
+        slots_of(table)[0] = bucket.storage_address();
+
+        auto const header_page =
+          map_scoped_page(i_device, i_header_page, storage_device::access_flags::read_write);
+        auto & header          = header_of(header_page);
+        header.m_global_depth = 0;
+        header.m_table_levels = 0;
+        header.m_entry_count  = 0;
+        header.m_table_root   = table.storage_address();
+    }
+
+    page_address directory::lookup(const string_view & i_name, void * o_inline_data) const
+    {
+        Geometry const geometry(m_page_size);
+        auto const     name_hash = hash(i_name);
+        auto           location  = locate_slot(
+          *m_device, m_header_page, geometry, name_hash, storage_device::access_flags::read);
+
+        scoped_page bucket_page = std::move(location.m_bucket);
+        for (;;)
+        {
+            Bucket const bucket(bucket_page, m_page_size);
+            if (auto const entry = bucket.find(name_hash, i_name))
+            {
+                if (o_inline_data != nullptr)
+                    copy_inline_data(entry, o_inline_data);
+                return entry->m_value;
+            }
+
+            auto const overflow_page = bucket.header().m_overflow_page;
+            if (overflow_page == invalid_page_address)
+                return invalid_page_address;
+            bucket_page =
+              map_scoped_page(*m_device, overflow_page, storage_device::access_flags::read);
+        }
+    }
+
+    void directory::lookup(
+      const array_view<const string_view> & i_names,
+      page_address *                        o_values,
+      void *                                o_inline_data) const
+    {
+        auto const count = i_names.size();
+        if (count == 0)
+            return;
+
+        Geometry const geometry(m_page_size);
+        auto const     header_page =
+          map_scoped_page(*m_device, m_header_page, storage_device::access_flags::read);
+        auto const & header = header_of(header_page);
+
+        struct Item
+        {
+            size_t       m_index;
+            hash_t       m_hash;
+            uint64_t     m_slot;
+            page_address m_bucket;
+        };
+        std::vector<Item> items(count);
+        for (size_t index = 0; index < count; index++)
+        {
+            auto const name_hash = hash(i_names[index]);
+            items[index] = {index, name_hash, name_hash & (pow2(header.m_global_depth) - 1), 0};
+        }
+
+        // read the slots in order, so that every table page is mapped once
+        std::sort(items.begin(), items.end(), [](const Item & i_first, const Item & i_second) {
+            return i_first.m_slot < i_second.m_slot;
+        });
+        scoped_page table;
+        uint64_t    mapped_table_index = 0;
+        for (auto & item : items)
+        {
+            auto const table_index = item.m_slot >> geometry.m_slot_bits;
+            if (table.empty() || table_index != mapped_table_index)
+            {
+                table = map_table_page(
+                  *m_device, header, geometry, table_index, storage_device::access_flags::read);
+                mapped_table_index = table_index;
+            }
+            item.m_bucket = slots_of(table)[item.m_slot & (pow2(geometry.m_slot_bits) - 1)];
+        }
+        table.release();
+
+        // search the buckets in order, so that every bucket (and its chain) is mapped once
+        std::sort(items.begin(), items.end(), [](const Item & i_first, const Item & i_second) {
+            return i_first.m_bucket < i_second.m_bucket;
+        });
+        std::vector<scoped_page> chain;
+        page_address             mapped_bucket = invalid_page_address;
+        for (auto const & item : items)
+        {
+            if (item.m_bucket != mapped_bucket)
+            {
+                chain.clear();
+                for (auto address = item.m_bucket; address != invalid_page_address;)
+                {
+                    chain.push_back(
+                      map_scoped_page(*m_device, address, storage_device::access_flags::read));
+                    address = Bucket(chain.back(), m_page_size).header().m_overflow_page;
+                }
+                mapped_bucket = item.m_bucket;
+            }
+
+            o_values[item.m_index] = invalid_page_address;
+            for (auto const & page : chain)
+            {
+                if (auto const entry =
+                      Bucket(page, m_page_size).find(item.m_hash, i_names[item.m_index]))
+                {
+                    o_values[item.m_index] = entry->m_value;
+                    if (o_inline_data != nullptr)
+                    {
+                        copy_inline_data(
+                          entry,
+                          address_add(o_inline_data, item.m_index * max_inline_size));
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    bool directory::insert(const string_view & i_name, page_address i_value)
+    {
+        CAMBRIAN_ASSERT((i_value & ~dictionary_page_mask) != invalid_page_address);
+        CAMBRIAN_ASSERT((i_value & inline_value_mask) == 0);
+        return insert_entry(i_name, i_value, nullptr);
+    }
+
+    bool directory::insert_inline(const string_view & i_name, const void * i_data, size_t i_size)
+    {
+        if (i_size > max_inline_size)
+            except<std::invalid_argument>("directory: the inline value is too big");
+        return insert_entry(i_name, inline_value_mask | i_size, i_data);
+    }
+
+    bool directory::insert_entry(
+      const string_view & i_name, page_address i_value, const void * i_inline_data)
+    {
+        auto const size = entry_size(i_name.size(), inline_size_of(i_value));
+        if (sizeof(BucketHeader) + size > m_page_size)
+            except<std::invalid_argument>("directory: the name is too long for the page size");
+
+        Geometry const geometry(m_page_size);
+        auto const     name_hash = hash(i_name);
+        for (;;)
+        {
+            auto location = locate_slot(
+              *m_device,
+              m_header_page,
+              geometry,
+              name_hash,
+              storage_device::access_flags::read_write);
+            auto & header = header_of(location.m_header);
+
+            // check for duplicates in the whole chain
+            {
+                Bucket bucket(location.m_bucket, m_page_size);
+                if (bucket.find(name_hash, i_name) != nullptr)
+                    return false;
+                for (auto overflow_page = bucket.header().m_overflow_page;
+                     overflow_page != invalid_page_address;)
+                {
+                    auto const chained = map_scoped_page(
+                      *m_device, overflow_page, storage_device::access_flags::read);
+                    Bucket const chained_bucket(chained, m_page_size);
+                    if (chained_bucket.find(name_hash, i_name) != nullptr)
+                        return false;
+                    overflow_page = chained_bucket.header().m_overflow_page;
+                }
+
+                if (bucket.can_fit(size))
+                {
+                    bucket.append(name_hash, i_name, i_value, i_inline_data);
+                    header.m_entry_count++;
+                    notify_modified(i_name);
+                    return true;
+                }
+            }
+
+            /* a bucket full of entries with the same hash can't be split, so it is chained.
+               Otherwise the bucket is split, doubling the table if needed. At the maximum
+               depth all the entries of a bucket have the same hash. */
+            Bucket const bucket(location.m_bucket, m_page_size);
+            if (bucket.all_have_hash(name_hash))
+            {
+                append_to_chain(
+                  *m_device,
+                  m_page_size,
+                  location.m_bucket,
+                  name_hash,
+                  i_name,
+                  i_value,
+                  i_inline_data);
+                header.m_entry_count++;
+                notify_modified(i_name);
+                return true;
+            }
+            else if (bucket.header().m_local_depth < header.m_global_depth)
+            {
+                split_bucket(*m_device, m_page_size, geometry, location);
+            }
+            else
+            {
+                double_table(*m_device, geometry, location.m_header);
+            }
+        }
+    }
+
+    bool directory::remove(const string_view & i_name)
+    {
+        Geometry const geometry(m_page_size);
+        auto const     name_hash = hash(i_name);
+        auto           location  = locate_slot(
+          *m_device, m_header_page, geometry, name_hash, storage_device::access_flags::read_write);
+
+        scoped_page prev_page;
+        scoped_page bucket_page = std::move(location.m_bucket);
+        for (;;)
+        {
+            Bucket bucket(bucket_page, m_page_size);
+            if (auto const entry = bucket.find(name_hash, i_name))
+            {
+                bucket.erase(entry);
+                header_of(location.m_header).m_entry_count--;
+
+                // empty overflow pages are unlinked from the chain
+                if (!prev_page.empty() && bucket.header().m_entry_count == 0)
+                {
+                    auto const address = bucket_page.storage_address();
+                    Bucket(prev_page, m_page_size).header().m_overflow_page =
+                      bucket.header().m_overflow_page;
+                    bucket_page.release();
+                    m_device->deallocate_page(address);
+                }
+                notify_modified(i_name);
+                return true;
+            }
+
+            auto const overflow_page = bucket.header().m_overflow_page;
+            if (overflow_page == invalid_page_address)
+                return false;
+            prev_page = std::move(bucket_page);
+            bucket_page =
+              map_scoped_page(*m_device, overflow_page, storage_device::access_flags::read_write);
+        }
+    }
+
+    directory directory::make_subdirectory(const string_view & i_name)
+    {
+        auto const existing = lookup(i_name);
+        if (existing != invalid_page_address)
+        {
+            if ((existing & dictionary_page_mask) == 0)
+                except<std::runtime_error>("directory: the name is already used by an object");
+            return directory(*m_device, existing & ~dictionary_page_mask, m_cache);
+        }
+
+        auto const child = create(*m_device);
+        insert(i_name, child | dictionary_page_mask);
+        return directory(*m_device, child, m_cache);
+    }
+
+    void directory::notify_modified(const string_view & i_name) noexcept
+    {
+        if (m_cache != nullptr)
+            m_cache->notify_modified(m_header_page, i_name);
+    }
+
+    uint64_t directory::entry_count() const
+    {
+        auto const header =
+          map_scoped_page(*m_device, m_header_page, storage_device::access_flags::read);
+        return header_of(header).m_entry_count;
+    }
+
+    uint32_t directory::global_depth() const
+    {
+        auto const header =
+          map_scoped_page(*m_device, m_header_page, storage_device::access_flags::read);
+        return header_of(header).m_global_depth;
+    }
+
+    uint32_t directory::table_levels() const
+    {
+        auto const header =
+          map_scoped_page(*m_device, m_header_page, storage_device::access_flags::read);
+        return header_of(header).m_table_levels;
+    }
+
+    obj_ref::obj_ref(storage_device * i_device, const string_view & i_path) : m_device(i_device)
+    {
+        auto curr = m_device->get_info().m_root_page | dictionary_page_mask;
+        for (auto const & token : path(i_path))
+        {
+            if ((curr & dictionary_page_mask) == 0)
+                return; // an object has no children
+            curr = directory(*m_device, curr & ~dictionary_page_mask).lookup(token, m_inline_data);
+            if (curr == invalid_page_address)
+                return;
+        }
+        m_address = curr;
+    }
+
+    obj_ref::obj_ref(path_cache & i_cache, const string_view & i_path)
+        : m_device(&i_cache.device())
+    {
+        m_address = i_cache.resolve(i_path, m_inline_data);
+    }
+
+    obj_ref::obj_ref(
+      storage_device * i_device, page_address i_address, const void * i_inline_data) noexcept
+        : m_device(i_device), m_address(i_address)
+    {
+        if (is_inline())
+            memcpy(m_inline_data, i_inline_data, inline_size());
+    }
+
+    namespace
+    {
+        // state of a batched resolve
+        class BatchResolve
+        {
+          public:
+            BatchResolve(storage_device * i_device, const array_view<const string_view> & i_paths)
+                : m_device(i_device), m_values(i_paths.size(), invalid_page_address),
+                  m_inline_data(i_paths.size() * max_inline_size)
+            {
+                m_first_token.reserve(i_paths.size() + 1);
+                for (auto const & source : i_paths)
+                {
+                    m_first_token.push_back(m_tokens.size());
+                    for (auto const & token : path(source))
+                        m_tokens.push_back(token);
+                }
+                m_first_token.push_back(m_tokens.size());
+
+                // sort the paths by components, so that paths sharing a prefix are adjacent
+                m_order.resize(i_paths.size());
+                for (size_t index = 0; index < m_order.size(); index++)
+                    m_order[index] = index;
+                std::sort(m_order.begin(), m_order.end(), [this](size_t i_first, size_t i_second) {
+                    return std::lexicographical_compare(
+                      m_tokens.begin() + m_first_token[i_first],
+                      m_tokens.begin() + m_first_token[i_first + 1],
+                      m_tokens.begin() + m_first_token[i_second],
+                      m_tokens.begin() + m_first_token[i_second + 1]);
+                });
+            }
+
+            void run()
+            {
+                auto const root = m_device->get_info().m_root_page | dictionary_page_mask;
+                resolve(0, m_order.size(), 0, root, nullptr);
+            }
+
+            page_address value(size_t i_path) const noexcept { return m_values[i_path]; }
+
+            const void * inline_data(size_t i_path) const noexcept
+            {
+                return m_inline_data.data() + i_path * max_inline_size;
+            }
+
+          private:
+            size_t component_count(size_t i_path) const noexcept
+            {
+                return m_first_token[i_path + 1] - m_first_token[i_path];
+            }
+
+            const string_view & component(size_t i_path, size_t i_depth) const noexcept
+            {
+                return m_tokens[m_first_token[i_path] + i_depth];
+            }
+
+            // resolves the paths m_order[i_begin, i_end), that share the first i_depth components
+            void resolve(
+              size_t       i_begin,
+              size_t       i_end,
+              size_t       i_depth,
+              page_address i_value,
+              const void * i_inline_data)
+            {
+                // the paths ending here come first, since they are a prefix of the others
+                for (; i_begin < i_end && component_count(m_order[i_begin]) == i_depth; i_begin++)
+                {
+                    auto const path_index = m_order[i_begin];
+                    m_values[path_index]  = i_value;
+                    if ((i_value & inline_value_mask) != 0)
+                    {
+                        memcpy(
+                          &m_inline_data[path_index * max_inline_size],
+                          i_inline_data,
+                          max_inline_size);
+                    }
+                }
+
+                if (i_begin == i_end || i_value == invalid_page_address ||
+                    (i_value & dictionary_page_mask) == 0)
+                    return; // missing parent, or an object (that has no children)
+
+                // every distinct name is looked up once
+                std::vector<string_view> names;
+                std::vector<size_t>      run_begins;
+                for (auto index = i_begin; index < i_end; index++)
+                {
+                    auto const & name = component(m_order[index], i_depth);
+                    if (names.empty() || names.back() != name)
+                    {
+                        names.push_back(name);
+                        run_begins.push_back(index);
+                    }
+                }
+                run_begins.push_back(i_end);
+
+                std::vector<page_address>  children(names.size());
+                std::vector<unsigned char> children_inline_data(names.size() * max_inline_size);
+                directory(*m_device, i_value & ~dictionary_page_mask)
+                  .lookup(names, children.data(), children_inline_data.data());
+                for (size_t run = 0; run < names.size(); run++)
+                {
+                    resolve(
+                      run_begins[run],
+                      run_begins[run + 1],
+                      i_depth + 1,
+                      children[run],
+                      &children_inline_data[run * max_inline_size]);
+                }
+            }
+
+          private:
+            storage_device *           m_device;
+            std::vector<string_view>   m_tokens;      // components of all the paths
+            std::vector<size_t>        m_first_token; // first component of every path, and the end
+            std::vector<size_t>        m_order;
+            std::vector<page_address>  m_values;
+            std::vector<unsigned char> m_inline_data; // max_inline_size bytes for every path
+        };
+
+    } // namespace
+
+    std::vector<obj_ref>
+      resolve(storage_device * i_device, const array_view<const string_view> & i_paths)
+    {
+        BatchResolve batch(i_device, i_paths);
+        batch.run();
+
+        std::vector<obj_ref> result;
+        result.reserve(i_paths.size());
+        for (size_t index = 0; index < i_paths.size(); index++)
+            result.push_back(obj_ref(i_device, batch.value(index), batch.inline_data(index)));
+        return result;
+    }
 
     directory_iterator::directory_iterator(storage_device * i_device, const string_view & i_path)
-        : m_device(i_device), m_path(i_path)
+        : m_device(i_device)
     {
+        obj_ref const ref(i_device, i_path);
+        if (ref.exists() && ref.is_directory())
+            start(ref.address());
     }
 
-    /*void directory_iterator::lookup(const string_view & i_path)
+    directory_iterator::directory_iterator(const directory & i_directory)
+        : m_device(&i_directory.device())
     {
-        auto const device_info = m_device->get_info();
-        auto const slot_count  = device_info.m_page_size / sizeof(page_address);
+        start(i_directory.header_page());
+    }
 
-        void * current_content =
-          m_device
-            ->begin_access_page(device_info.m_root_page, storage_device::access_flags::read_write)
-            .value();
+    void directory_iterator::start(page_address i_header_page)
+    {
+        m_header = map_scoped_page(*m_device, i_header_page, storage_device::access_flags::read);
 
-        for (auto & token : split(i_path, '/'))
+        Geometry const geometry(m_device->get_info().m_page_size);
+        m_slot_bits  = geometry.m_slot_bits;
+        m_slot_count = pow2(header_of(m_header).m_global_depth);
+        m_slot_index = 0;
+        load_slot();
+        settle();
+    }
+
+    // maps the bucket of the first slot starting from m_slot_index that is the first slot
+    // pointing to its bucket, so that every bucket is visited once
+    void directory_iterator::load_slot()
+    {
+        m_bucket.release();
+        for (; m_slot_index < m_slot_count; m_slot_index++)
         {
-            auto const slot_index = hash(token) % slot_count;
-            auto const next_page  = static_cast<page_address *>(current_content)[slot_index];
-            auto       is_dictionary_page = (next_page & dictionary_page_mask) != 0;
-            void *     next_content =
-              m_device
-                ->begin_access_page(
-                  next_page & ~dictionary_page_mask, storage_device::access_flags::read_write)
-                .value();
-            ;
-            if (is_dictionary_page)
+            auto const table_page_index = m_slot_index >> m_slot_bits;
+            if (m_table.empty() || table_page_index != m_table_page_index)
+            {
+                m_table = map_table_page(
+                  *m_device,
+                  header_of(m_header),
+                  Geometry(m_device->get_info().m_page_size),
+                  table_page_index,
+                  storage_device::access_flags::read);
+                m_table_page_index = table_page_index;
+            }
+
+            auto const bucket_address = slots_of(m_table)[m_slot_index & (pow2(m_slot_bits) - 1)];
+            auto       bucket =
+              map_scoped_page(*m_device, bucket_address, storage_device::access_flags::read);
+            auto const local_depth =
+              static_cast<const BucketHeader *>(bucket.mem_address())->m_local_depth;
+            if (m_slot_index < pow2(local_depth))
             {
+                m_bucket       = std::move(bucket);
+                m_entry_offset = 0;
+                return;
             }
-            m_device->end_access_page(current_content);
-            current_content = next_content;
         }
+    }
 
-        auto token_it = split(i_path, '/').begin();
-        bool is_dictionary_page;
-        do
+    // moves to the first entry starting from m_entry_offset
+    void directory_iterator::settle()
+    {
+        while (!m_bucket.empty())
         {
+            auto const & header = *static_cast<BucketHeader *>(m_bucket.mem_address());
+            if (m_entry_offset < header.m_used_size)
+            {
+                auto const entry = static_cast<const EntryHeader *>(
+                  address_add(m_bucket.mem_address(), sizeof(BucketHeader) + m_entry_offset));
+                m_entry.m_name        = Bucket::name(entry);
+                m_entry.m_value       = entry->m_value;
+                m_entry.m_inline_data = Bucket::inline_data(entry);
+                m_entry_size          = entry_size(entry);
+                return;
+            }
+            else if (header.m_overflow_page != invalid_page_address)
+            {
+                m_bucket = map_scoped_page(
+                  *m_device, header.m_overflow_page, storage_device::access_flags::read);
+                m_entry_offset = 0;
+            }
+            else
+            {
+                m_slot_index++;
+                load_slot();
+            }
+        }
+        m_entry = {};
+    }
 
-        } while (token_it != end_marker);
-    }*/
+    directory_iterator & directory_iterator::operator++()
+    {
+        CAMBRIAN_ASSERT(!is_over());
+        m_entry_offset += m_entry_size;
+        settle();
+        return *this;
+    }
 
 } // namespace cambrian
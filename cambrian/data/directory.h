@@ -1,4 +1,3 @@
-
 //   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
 // Distributed under the Boost Software License, Version 1.0.
 //    (See accompanying file LICENSE_1_0.txt or copy at
@@ -6,36 +5,244 @@
 
 #pragma once
 #include "cambrian/cambrian_common.h"
+#include "cambrian/data/path.h"
 #include "cambrian/storage/storage_device.h"
+#include "ediacaran/core/array_view.h"
 #include <vector>
 
 namespace cambrian
 {
+    /** User bit set in the page address stored in a directory entry when the entry refers to a
+        child directory (rather than to an object). */
     constexpr page_address dictionary_page_mask = uint_mask_rev<page_address>(0);
     static_assert(page_address_user_bits >= 0 && invalid_page_address < dictionary_page_mask);
 
+    /** User bit set in the value of a directory entry when the object is stored inline in the
+        entry, after the name, rather than in a separate page. The other bits of the value are
+        the size of the object. An inline object costs no page, and is read without any page
+        access besides the lookup. */
+    constexpr page_address inline_value_mask = uint_mask_rev<page_address>(1);
+    static_assert(page_address_user_bits >= 2 && invalid_page_address < inline_value_mask);
+
+    /** Maximum size of an object stored inline in a directory entry */
+    constexpr size_t max_inline_size = 64;
+
+    class path_cache;
+
+    /** Extendible hash table stored in the pages of a storage_device, that maps names to page
+        addresses. The table is an array of 2^global_depth bucket addresses, indexed by the low
+        bits of the hash of the name. When a bucket overflows it is split, and when its local
+        depth is already the global depth the table is doubled first, up to a global depth
+        equal to the bits of the hash. Only a bucket whose entries all have the same hash (that
+        no split can separate) is chained to overflow pages.
+        The table is stored in table pages of P = page_size / sizeof(page_address) slots, and
+        the table pages are the leaves of a radix tree of index pages with P children, whose
+        root is referenced by the header page. A lookup maps the header, an index page for every
+        level of the tree (see table_levels), a table page and a bucket page. The tree has no
+        levels up to P slots, and every level multiplies the slots by P: with 4 KiB pages one
+        level addresses 2^18 buckets, two levels 2^27, three levels all the 2^32 hashes. */
+    class directory
+    {
+      public:
+        /** If i_cache is not null, the directory notifies it after every mutation. The
+            subdirectories share the same cache. */
+        directory(
+          storage_device & i_device,
+          page_address     i_header_page,
+          path_cache *     i_cache = nullptr) noexcept;
+
+        /** Allocates and formats a new empty directory, returning the address of its header page */
+        static page_address create(storage_device & i_device);
+
+        /** Formats an already allocated page as the header page of an empty directory */
+        static void format(storage_device & i_device, page_address i_header_page);
+
+        storage_device & device() const noexcept { return *m_device; }
+
+        page_address header_page() const noexcept { return m_header_page; }
+
+        /** Returns the value associated to a name, or invalid_page_address. If the entry is
+            inline and o_inline_data is not null, the object is copied to o_inline_data, that
+            must be at least max_inline_size bytes. */
+        page_address lookup(const string_view & i_name, void * o_inline_data = nullptr) const;
+
+        /** Looks up many names, mapping the header, every table page and every bucket only
+            once. o_values must have the same size of i_names. If o_inline_data is not null, it
+            must have max_inline_size bytes for every name, and receives the inline objects. */
+        void lookup(
+          const array_view<const string_view> & i_names,
+          page_address *                        o_values,
+          void *                                o_inline_data = nullptr) const;
+
+        /** Adds an entry. If the name is already present returns false and leaves the directory
+            unchanged. */
+        bool insert(const string_view & i_name, page_address i_value);
+
+        /** Adds an entry whose object is stored inline. i_size can't exceed max_inline_size. If
+            the name is already present returns false and leaves the directory unchanged. */
+        bool insert_inline(const string_view & i_name, const void * i_data, size_t i_size);
+
+        /** Removes an entry. Returns false if the name is not present. */
+        bool remove(const string_view & i_name);
+
+        /** Returns the child directory with the given name, creating it if it does not exist.
+            Throws an exception if the name is used by an object. */
+        directory make_subdirectory(const string_view & i_name);
+
+        uint64_t entry_count() const;
+
+        uint32_t global_depth() const;
+
+        /** Returns the number of levels of index pages above the table pages */
+        uint32_t table_levels() const;
+
+      private:
+        bool insert_entry(
+          const string_view & i_name, page_address i_value, const void * i_inline_data);
+
+        void notify_modified(const string_view & i_name) noexcept;
+
+      private:
+        storage_device * m_device;
+        page_address     m_header_page;
+        page_size        m_page_size;
+        path_cache *     m_cache;
+    };
+
+    /** Node of the directory tree of a storage_device, identified by a path. The root of the
+        tree is the directory whose header is the root page of the device. */
     class obj_ref
     {
       public:
         obj_ref(storage_device * i_device, const string_view & i_path);
 
+        /** Resolves the path using a cache, without walking the tree if the path is cached */
+        obj_ref(path_cache & i_cache, const string_view & i_path);
+
+        bool exists() const noexcept { return m_address != invalid_page_address; }
+
+        explicit operator bool() const noexcept { return exists(); }
+
+        bool is_directory() const noexcept { return (m_address & dictionary_page_mask) != 0; }
+
+        bool is_inline() const noexcept { return exists() && (m_address & inline_value_mask) != 0; }
+
+        /** Returns the page address of the object, or the header page of the directory */
+        page_address address() const noexcept
+        {
+            CAMBRIAN_ASSERT(!is_inline());
+            return m_address & ~dictionary_page_mask;
+        }
+
+        /** Returns the size of an inline object */
+        size_t inline_size() const noexcept
+        {
+            CAMBRIAN_ASSERT(is_inline());
+            return static_cast<size_t>(m_address & ~inline_value_mask);
+        }
+
+        /** Returns the content of an inline object */
+        const void * inline_data() const noexcept
+        {
+            CAMBRIAN_ASSERT(is_inline());
+            return m_inline_data;
+        }
+
+        storage_device * device() const noexcept { return m_device; }
+
       private:
-        storage_device *         m_device;
-        std::vector<mapped_page> m_mapped_pages;
+        friend std::vector<obj_ref>
+          resolve(storage_device * i_device, const array_view<const string_view> & i_paths);
+
+        obj_ref(
+          storage_device * i_device, page_address i_address, const void * i_inline_data) noexcept;
+
+      private:
+        storage_device * m_device;
+        page_address     m_address = invalid_page_address;
+        unsigned char    m_inline_data[max_inline_size]{};
     };
 
+    /** Resolves many paths at once, returning the results in the same order. The paths are
+        sorted, so that a prefix shared by many paths is walked once, and all the names looked
+        up in the same directory are resolved with a single batched lookup. */
+    std::vector<obj_ref>
+      resolve(storage_device * i_device, const array_view<const string_view> & i_paths);
+
+    struct directory_entry
+    {
+        string_view  m_name;
+        page_address m_value = invalid_page_address;
+
+        const void * m_inline_data = nullptr; // content of an inline object
+
+        bool is_directory() const noexcept { return (m_value & dictionary_page_mask) != 0; }
+
+        bool is_inline() const noexcept { return (m_value & inline_value_mask) != 0; }
+
+        page_address address() const noexcept
+        {
+            CAMBRIAN_ASSERT(!is_inline());
+            return m_value & ~dictionary_page_mask;
+        }
+
+        size_t inline_size() const noexcept
+        {
+            CAMBRIAN_ASSERT(is_inline());
+            return static_cast<size_t>(m_value & ~inline_value_mask);
+        }
+    };
+
+    /** Iterates the entries of a directory, in no particular order. The name of the current
+        entry refers to the memory of a mapped page, so it is valid only until the iterator is
+        incremented. The directory must not be modified during the iteration. */
     class directory_iterator
     {
       public:
+        /** Iterates the directory with the given path. If the path does not refer to a directory
+            the iteration is empty. */
         directory_iterator(storage_device * i_device, const string_view & i_path);
 
+        directory_iterator(const directory & i_directory);
+
+        const directory_entry & operator*() const noexcept
+        {
+            CAMBRIAN_ASSERT(!is_over());
+            return m_entry;
+        }
+
+        const directory_entry * operator->() const noexcept
+        {
+            CAMBRIAN_ASSERT(!is_over());
+            return &m_entry;
+        }
+
+        directory_iterator & operator++();
+
+        bool is_over() const noexcept { return m_bucket.empty(); }
+
+        bool operator==(end_marker_t) const noexcept { return is_over(); }
+        bool operator!=(end_marker_t) const noexcept { return !is_over(); }
+
       private:
-        void lookup(const string_view & i_path);
+        void start(page_address i_header_page);
+
+        void load_slot();
+
+        void settle();
 
       private:
         storage_device * m_device;
-        string_view      m_path;
+        scoped_page      m_header;
+        scoped_page      m_table;
+        scoped_page      m_bucket;
+        uint64_t         m_slot_index       = 0;
+        uint64_t         m_slot_count       = 0;
+        uint64_t         m_table_page_index = 0;
+        uint32_t         m_slot_bits        = 0;
+        size_t           m_entry_offset     = 0;
+        size_t           m_entry_size       = 0;
+        directory_entry  m_entry;
     };
 
-
 } // namespace cambrian
@@ -0,0 +1,264 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "cambrian/data/flat_format.h"
+#include "cambrian/data/serializer.h"
+#include "ediacaran/utils/dyn_value.h"
+#include "ediacaran/utils/universal_iterator.h"
+#include <limits>
+
+namespace cambrian
+{
+    namespace
+    {
+        const type & final_type_of(const qualified_type_ptr & i_qualified_type)
+        {
+            if (i_qualified_type.indirection_levels() != 0)
+            {
+                except<std::runtime_error>("attempt to serialize a pointer");
+            }
+            CAMBRIAN_ASSERT(i_qualified_type.final_type() != nullptr);
+            return *i_qualified_type.final_type();
+        }
+
+        uint32_t checked_uint32(size_t i_value)
+        {
+            if (i_value > std::numeric_limits<uint32_t>::max())
+                except<std::runtime_error>("write_flat: the object is too big");
+            return static_cast<uint32_t>(i_value);
+        }
+
+        class FlatWriter
+        {
+          public:
+            FlatWriter(type_registry & i_type_registry, std::vector<unsigned char> & o_buffer)
+                : m_type_registry(i_type_registry), m_buffer(o_buffer)
+            {
+            }
+
+            /** Reserves zeroed space at the end of the buffer, returning its offset */
+            size_t allocate(const type & i_flat_type, size_t i_count = 1)
+            {
+                if (i_flat_type.alignment() > flat_alignment)
+                    except<std::runtime_error>("write_flat: unsupported alignment");
+                auto const offset = uint_upper_align(m_buffer.size(), i_flat_type.alignment());
+                m_buffer.resize(offset + i_flat_type.size() * i_count);
+                return offset;
+            }
+
+            /* The buffer may be reallocated while the content of an object is written, so
+               objects are addressed by offset */
+            void write_value(const void * i_source, const type & i_source_type, size_t i_dest)
+            {
+                if (!i_source_type.is_class())
+                {
+                    memcpy(m_buffer.data() + i_dest, i_source, i_source_type.size());
+                    return;
+                }
+
+                if (m_depth >= binary_writer::max_depth)
+                    except<std::runtime_error>("write_flat: the object is too deep");
+                m_depth++;
+
+                auto const & source_class = static_cast<const class_type &>(i_source_type);
+                auto const & layout       = *m_type_registry.get_type_data(source_class).m_layout;
+                size_t       field_index  = 0;
+                write_properties(i_source, source_class.properties(), layout, i_dest, field_index);
+                for (auto const & base : source_class.bases())
+                {
+                    write_properties(
+                      base.up_cast(i_source),
+                      base.get_class().properties(),
+                      layout,
+                      i_dest,
+                      field_index);
+                }
+                CAMBRIAN_ASSERT(field_index == layout.m_fields.size());
+
+                if (layout.m_container != nullptr)
+                    write_elements(i_source, source_class, layout, i_dest);
+
+                m_depth--;
+            }
+
+          private:
+            void write_properties(
+              const void *                       i_source,
+              const array_view<const property> & i_properties,
+              const flat_layout &                i_layout,
+              size_t                             i_dest,
+              size_t &                           io_field_index)
+            {
+                for (auto const & prop : i_properties)
+                {
+                    if (prop.qualified_type().indirection_levels() != 0)
+                        except<std::runtime_error>("attempt to serialize a pointer");
+
+                    auto const & field = i_layout.m_fields[io_field_index++];
+                    auto const   dest  = i_dest + field.m_offset;
+                    if (prop.is_inplace())
+                    {
+                        write_value(prop.get_inplace(i_source), *field.m_source_type, dest);
+                    }
+                    else
+                    {
+                        dyn_value value;
+                        value.manual_construct(prop.qualified_type(), [&](void * i_value_dest) {
+                            prop.get(i_source, i_value_dest);
+                        });
+                        write_value(value.object(), *field.m_source_type, dest);
+                    }
+                }
+            }
+
+            void write_elements(
+              const void *        i_source,
+              const class_type &  i_class,
+              const flat_layout & i_layout,
+              size_t              i_dest)
+            {
+                auto const & container = *i_layout.m_container;
+                if (
+                  (container.capabilities() & container::capability::heterogeneous) !=
+                  container::capability::none)
+                {
+                    except<std::runtime_error>(
+                      "write_flat: heterogeneous containers are not supported");
+                }
+
+                raw_ptr const container_object(
+                  const_cast<void *>(i_source), qualified_type_ptr(&i_class));
+                size_t count = 0;
+                for (universal_iterator it(container_object); it != end_marker;)
+                {
+                    auto const segment_count = it.segment().m_element_count;
+                    count += static_cast<size_t>(segment_count);
+                    it.advance_in_segment(segment_count);
+                }
+
+                auto const & element_type = final_type_of(container.elements_type());
+                auto const & flat_type =
+                  m_type_registry.get_type_data(element_type).m_serialized_type;
+                auto const elements   = allocate(flat_type, count);
+                auto const range_dest = i_dest + i_layout.m_range_offset;
+                flat_range range;
+                range.m_offset = checked_uint32(elements - range_dest);
+                range.m_count  = checked_uint32(count);
+                memcpy(m_buffer.data() + range_dest, &range, sizeof(range));
+
+                size_t index = 0;
+                for (universal_iterator it(container_object); it != end_marker;)
+                {
+                    auto const & segment = it.segment();
+                    if (!element_type.is_class())
+                    {
+                        // fundamentals and enums are copied in bulk
+                        auto const segment_count = segment.m_element_count;
+                        memcpy(
+                          m_buffer.data() + elements + index * flat_type.size(),
+                          segment.m_elements,
+                          static_cast<size_t>(segment_count * flat_type.size()));
+                        index += static_cast<size_t>(segment_count);
+                        it.advance_in_segment(segment_count);
+                    }
+                    else
+                    {
+                        write_value(
+                          segment.m_elements, element_type, elements + index * flat_type.size());
+                        index++;
+                        ++it;
+                    }
+                }
+            }
+
+          private:
+            type_registry &              m_type_registry;
+            std::vector<unsigned char> & m_buffer;
+            size_t                       m_depth = 0;
+        };
+    } // namespace
+
+    std::vector<unsigned char>
+      write_flat(type_registry & io_type_registry, const raw_ptr & i_source_object)
+    {
+        auto const & source_type = final_type_of(i_source_object.qualified_type());
+        auto const & flat_type   = io_type_registry.get_type_data(source_type).m_serialized_type;
+
+        std::vector<unsigned char> buffer;
+        FlatWriter                 writer(io_type_registry, buffer);
+        auto const                 root = writer.allocate(flat_type);
+        writer.write_value(i_source_object.object(), source_type, root);
+        return buffer;
+    }
+
+    flat_view::flat_view(
+      type_registry & i_type_registry, const type & i_source_type, const void * i_data)
+        : m_type_registry(&i_type_registry), m_source_type(&i_source_type), m_data(i_data)
+    {
+        CAMBRIAN_ASSERT(address_is_aligned(
+          i_data, i_type_registry.get_type_data(i_source_type).m_serialized_type.alignment()));
+    }
+
+    const flat_layout * flat_view::layout() const
+    {
+        return m_type_registry->get_type_data(*m_source_type).m_layout;
+    }
+
+    raw_ptr flat_view::object() const
+    {
+        return raw_ptr(
+          const_cast<void *>(m_data),
+          qualified_type_ptr(&m_type_registry->get_type_data(*m_source_type).m_serialized_type));
+    }
+
+    flat_view flat_view::operator[](const string_view & i_property_name) const
+    {
+        if (auto const flat_layout = layout())
+        {
+            auto const & properties = flat_layout->m_class->properties();
+            for (size_t index = 0; index < properties.size(); index++)
+            {
+                if (properties[index].name() == i_property_name)
+                {
+                    auto const & field = flat_layout->m_fields[index];
+                    return flat_view(
+                      *m_type_registry, *field.m_source_type, address_add(m_data, field.m_offset));
+                }
+            }
+        }
+        except<std::invalid_argument>("flat_view: property not found");
+    }
+
+    size_t flat_view::size() const
+    {
+        auto const flat_layout = layout();
+        if (flat_layout == nullptr || flat_layout->m_container == nullptr)
+            return 0;
+        flat_range range;
+        memcpy(&range, address_add(m_data, flat_layout->m_range_offset), sizeof(range));
+        return range.m_count;
+    }
+
+    flat_view flat_view::element(size_t i_index) const
+    {
+        auto const flat_layout = layout();
+        if (flat_layout == nullptr || flat_layout->m_container == nullptr)
+            except<std::invalid_argument>("flat_view: the object is not a container");
+
+        auto const range_address = address_add(m_data, flat_layout->m_range_offset);
+        flat_range range;
+        memcpy(&range, range_address, sizeof(range));
+        if (i_index >= range.m_count)
+            except<std::invalid_argument>("flat_view: index out of range");
+
+        auto const & element_type = final_type_of(flat_layout->m_container->elements_type());
+        auto const   stride = m_type_registry->get_type_data(element_type).m_serialized_type.size();
+        return flat_view(
+          *m_type_registry,
+          element_type,
+          address_add(range_address, range.m_offset + i_index * stride));
+    }
+
+} // namespace cambrian
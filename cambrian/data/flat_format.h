@@ -0,0 +1,86 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "cambrian/cambrian_common.h"
+#include "cambrian/data/type_registry.h"
+#include "ediacaran/reflection/reflection.h"
+#include "ediacaran/utils/raw_ptr.h"
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+namespace cambrian
+{
+    /** Alignment required to the start of a buffer in the flat format. Types with a stricter
+        alignment are not supported. */
+    constexpr size_t flat_alignment = alignof(std::max_align_t);
+
+    /** Writes an object in the flat format, a layout that can be read in place, without
+        deserializing it. The root object is at the start of the buffer, with the layout
+        given by the type_registry (see flat_layout). Fundamentals and enums are stored as
+        their raw bytes. The elements of containers are stored in arrays after the object that
+        owns them, and are referenced by relative offsets, so the buffer can be copied or
+        mapped at any address aligned to flat_alignment. The buffer does not contain type
+        information: it must be read with the source type and an equivalent type_registry.
+        Throws std::runtime_error if the object contains a pointer, or is too deep or too
+        big. */
+    std::vector<unsigned char>
+      write_flat(type_registry & io_type_registry, const raw_ptr & i_source_object);
+
+    /** Read only view on an object in the flat format. A view does not own the buffer, and
+        accessing a property or an element does not copy or allocate anything, except when the
+        layout of a class is requested for the first time to the type_registry. */
+    class flat_view
+    {
+      public:
+        /** Constructs a view on an object written by write_flat. i_data must be aligned to
+            flat_alignment. */
+        flat_view(type_registry & i_type_registry, const type & i_source_type, const void * i_data);
+
+        const type & source_type() const noexcept { return *m_source_type; }
+
+        const void * data() const noexcept { return m_data; }
+
+        /** Returns the object with the type it has in the flat format, so that its properties
+            can be read with inspect_properties. */
+        raw_ptr object() const;
+
+        /** Returns the view of a property of a class. Throws std::invalid_argument if there is
+            no such property. */
+        flat_view operator[](const string_view & i_property_name) const;
+
+        /** Returns the value of a fundamental or an enum. Throws std::invalid_argument if TYPE
+            is not the source type. */
+        template <typename TYPE> const TYPE & get() const
+        {
+            static_assert(std::is_arithmetic_v<TYPE> || std::is_enum_v<TYPE>);
+
+            // some fundamental types have an instance in every translation unit
+            auto const & expected_type = get_type<TYPE>();
+            if (
+              &expected_type != m_source_type && expected_type.name() != m_source_type->name())
+            {
+                except<std::invalid_argument>("flat_view: type mismatch");
+            }
+            return *static_cast<const TYPE *>(m_data);
+        }
+
+        /** Returns the number of elements of a container, or zero if the object is not a
+            container. */
+        size_t size() const;
+
+        flat_view element(size_t i_index) const;
+
+      private:
+        const flat_layout * layout() const;
+
+      private:
+        type_registry * m_type_registry;
+        const type *    m_source_type;
+        const void *    m_data;
+    };
+
+} // namespace cambrian
@@ -0,0 +1,486 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "cambrian/data/lazy_reader.h"
+#include "cambrian/data/deserializer.h"
+#include "cambrian/data/varint.h"
+#include "ediacaran/core/byte_reader.h"
+#include "ediacaran/utils/dyn_value.h"
+#include "ediacaran/utils/inspect.h"
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <shared_mutex>
+#include <thread>
+
+namespace cambrian
+{
+    namespace
+    {
+        [[noreturn]] void corrupted_stream()
+        {
+            except<std::runtime_error>("lazy_reader: corrupted stream");
+        }
+
+        uint64_t read_lazy_varint(byte_reader & i_source)
+        {
+            uint64_t   value;
+            auto const size = read_varint(
+              i_source.next_byte(), static_cast<size_t>(i_source.remaining_size()), value);
+            if (size == 0)
+                corrupted_stream();
+            i_source.skip(size);
+            return value;
+        }
+
+        void read_lazy_value(
+          byte_reader &  i_source,
+          void *         o_value,
+          size_t         i_size,
+          value_encoding i_encoding,
+          wire_format    i_format)
+        {
+            if (i_format == wire_format::fixed || i_encoding == value_encoding::raw)
+            {
+                if (!i_source.read_all_or_none(o_value, i_size))
+                    corrupted_stream();
+                return;
+            }
+            auto value = read_lazy_varint(i_source);
+            if (i_encoding == value_encoding::zigzag_varint)
+                value = static_cast<uint64_t>(zigzag_decode(value));
+            store_integer(o_value, i_size, value);
+        }
+
+        /** Skips the values in a stream, validating only the markers */
+        class StreamSkipper
+        {
+          public:
+            StreamSkipper(
+              type_registry & i_type_registry, wire_format i_format, byte_reader & i_source)
+                : m_type_registry(i_type_registry), m_format(i_format), m_source(i_source)
+            {
+            }
+
+            void skip_object(const qualified_type_ptr & i_qualified_type, size_t i_depth)
+            {
+                if (i_qualified_type.indirection_levels() != 0)
+                    except<std::runtime_error>("lazy_reader: pointers are not supported");
+                auto const & object_type = *i_qualified_type.final_type();
+                if (object_type.is_class())
+                    skip_class(*m_type_registry.get_type_data(object_type).m_plan, i_depth + 1);
+                else
+                    skip_value(object_type.size(), type_registry::compact_encoding_of(object_type));
+            }
+
+            void skip_class(const serialization_plan & i_plan, size_t i_depth)
+            {
+                if (i_depth > binary_writer::max_depth)
+                    except<std::runtime_error>("lazy_reader: the object is too deep");
+
+                using kind = serialization_plan::operation::kind;
+                for (auto const & op : i_plan.m_operations)
+                {
+                    switch (op.m_kind)
+                    {
+                    case kind::copy:
+                        if (m_format == wire_format::fixed)
+                        {
+                            skip_bytes(op.m_size);
+                            break;
+                        }
+                        for (size_t index = 0; index < op.m_field_count; index++)
+                        {
+                            auto const & field = i_plan.m_fields[op.m_first_field + index];
+                            skip_value(field.m_size, field.m_encoding);
+                        }
+                        break;
+
+                    case kind::object:
+                        skip_class(*op.m_plan, i_depth + 1);
+                        break;
+
+                    case kind::property:
+                        skip_object(op.m_property->qualified_type(), i_depth);
+                        break;
+                    }
+                }
+                if (i_plan.m_container != nullptr)
+                    skip_elements(*i_plan.m_container, i_depth);
+            }
+
+          private:
+            void skip_bytes(size_t i_size)
+            {
+                if (m_source.remaining_size() < static_cast<ptrdiff_t>(i_size))
+                    corrupted_stream();
+                m_source.skip(i_size);
+            }
+
+            void skip_value(size_t i_size, value_encoding i_encoding)
+            {
+                if (m_format == wire_format::fixed || i_encoding == value_encoding::raw)
+                    skip_bytes(i_size);
+                else
+                    read_lazy_varint(m_source);
+            }
+
+            data_marker read_marker()
+            {
+                data_marker marker;
+                if (m_format == wire_format::compact)
+                {
+                    auto const head = read_lazy_varint(m_source);
+                    if ((head >> 3) > std::numeric_limits<type_id>::max())
+                        corrupted_stream();
+                    marker.m_type_id = static_cast<type_id>(head >> 3);
+                    marker.m_flags   = static_cast<uint16_t>(head & 7);
+                    if ((marker.m_flags & data_marker::flag_end_comtainer) == 0)
+                    {
+                        auto const count = read_lazy_varint(m_source);
+                        if (count > data_marker::s_max_count)
+                            corrupted_stream();
+                        marker.m_count = static_cast<uint16_t>(count);
+                    }
+                }
+                else if (!m_source.read_all_or_none(&marker, sizeof(marker)))
+                {
+                    corrupted_stream();
+                }
+                if (marker.m_flags == data_marker::flags_interned)
+                    except<std::runtime_error>("lazy_reader: interned values are not supported");
+                return marker;
+            }
+
+            void skip_elements(const container & i_container, size_t i_depth)
+            {
+                auto const & elements_type = i_container.elements_type();
+                if (elements_type.indirection_levels() != 0)
+                    except<std::runtime_error>("lazy_reader: pointers are not supported");
+                auto const & element_type = *elements_type.final_type();
+                auto const   type_data    = m_type_registry.get_type_data(element_type);
+                auto const   encoding     = type_registry::compact_encoding_of(element_type);
+
+                for (bool first_run = true;; first_run = false)
+                {
+                    auto const marker = read_marker();
+                    bool const begin  = (marker.m_flags & data_marker::flag_begin_comtainer) != 0;
+                    bool const end    = (marker.m_flags & data_marker::flag_end_comtainer) != 0;
+                    if (begin != first_run || end != (marker.m_count == 0))
+                        corrupted_stream();
+                    if (end)
+                        break;
+                    if (marker.m_type_id != type_data.m_id)
+                        except<std::runtime_error>("lazy_reader: unexpected type in the stream");
+
+                    // the elements of a delta encoded run are varints too
+                    for (uint16_t index = 0; index < marker.m_count; index++)
+                    {
+                        if (element_type.is_class())
+                            skip_class(*type_data.m_plan, i_depth + 1);
+                        else
+                            skip_value(element_type.size(), encoding);
+                    }
+                }
+            }
+
+          private:
+            type_registry &   m_type_registry;
+            wire_format const m_format;
+            byte_reader &     m_source;
+        };
+
+    } // namespace
+
+    /** The property_loader that loads the stubs of all the readers. The global lock guards only
+        the map of the roots: the stubs are loaded holding the lock of the reader that owns
+        the property. */
+    class lazy_reader::Loader : public property_loader
+    {
+      public:
+        static Loader & instance()
+        {
+            static Loader s_instance;
+            return s_instance;
+        }
+
+        void add(lazy_reader & i_reader)
+        {
+            std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+            // the roots can't overlap, so that every address has at most one owner
+            auto const next = m_readers.lower_bound(i_reader.m_root);
+            if (
+              (next != m_readers.end() && i_reader.contains(next->first)) ||
+              (next != m_readers.begin() && std::prev(next)->second->contains(i_reader.m_root)))
+            {
+                except<std::invalid_argument>(
+                  "lazy_reader: the root overlaps the root of another reader");
+            }
+
+            if (m_readers.empty())
+            {
+                auto const previous = set_property_loader(this);
+                if (previous != nullptr)
+                {
+                    set_property_loader(previous);
+                    except<std::runtime_error>(
+                      "lazy_reader: another property loader is installed");
+                }
+            }
+            m_readers.emplace(i_reader.m_root, &i_reader);
+        }
+
+        void remove(lazy_reader & i_reader) noexcept
+        {
+            {
+                std::unique_lock<std::shared_mutex> lock(m_mutex);
+                m_readers.erase(i_reader.m_root);
+                if (m_readers.empty())
+                    set_property_loader(nullptr);
+            }
+
+            // waits for the loads that have found the reader before it was removed
+            while (i_reader.m_users.load(std::memory_order_acquire) != 0)
+                std::this_thread::yield();
+        }
+
+        void load_property(const property & i_property, const void * i_object) override
+        {
+            // an inplace value is loaded by the reader that contains it
+            auto const begin =
+              i_property.is_inplace() ? i_property.get_inplace(i_object) : i_object;
+            auto const reader = find_owner(begin);
+            if (reader == nullptr)
+                return;
+
+            struct Release
+            {
+                lazy_reader & m_reader;
+                ~Release() { m_reader.m_users.fetch_sub(1, std::memory_order_release); }
+            } const release{*reader};
+
+            std::lock_guard<std::recursive_mutex> lock(reader->m_mutex);
+            if (i_property.is_inplace())
+            {
+                auto const size = i_property.qualified_type().primary_type()->size();
+                reader->load_range(begin, address_add(begin, size));
+            }
+            else
+            {
+                // a getter may read any part of the object
+                reader->load_range(
+                  reader->m_root, address_add(reader->m_root, reader->m_root_type->size()));
+            }
+        }
+
+      private:
+        Loader() = default;
+
+        /** Returns the reader whose root contains the address, after incrementing its users,
+            or null */
+        lazy_reader * find_owner(const void * i_address)
+        {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            auto it = m_readers.upper_bound(i_address);
+            if (it == m_readers.begin())
+                return nullptr;
+            --it;
+            if (!it->second->contains(i_address))
+                return nullptr;
+            it->second->m_users.fetch_add(1, std::memory_order_relaxed);
+            return it->second;
+        }
+
+      private:
+        std::shared_mutex                                              m_mutex;
+        std::map<const void *, lazy_reader *, std::less<const void *>> m_readers;
+    };
+
+    lazy_reader::lazy_reader(
+      type_registry & i_type_registry,
+      const raw_ptr & io_dest_object,
+      const void *    i_stream,
+      size_t          i_stream_size,
+      wire_format     i_format)
+        : m_type_registry(i_type_registry), m_root(io_dest_object.editable_object()),
+          m_root_type(io_dest_object.qualified_type().final_type()),
+          m_stream(static_cast<const unsigned char *>(i_stream)), m_stream_size(i_stream_size),
+          m_format(i_format)
+    {
+        if (
+          io_dest_object.qualified_type().indirection_levels() != 0 || !m_root_type->is_class() ||
+          static_cast<const class_type *>(m_root_type)->container() != nullptr)
+        {
+            except<std::invalid_argument>(
+              "lazy_reader: the root must be a class, but not a container");
+        }
+
+        read_top_level();
+        Loader::instance().add(*this);
+    }
+
+    lazy_reader::~lazy_reader() { Loader::instance().remove(*this); }
+
+    void lazy_reader::read_top_level()
+    {
+        byte_reader   source(m_stream, m_stream_size);
+        StreamSkipper skipper(m_type_registry, m_format, source);
+        auto const    position = [&] {
+            auto const next_byte = static_cast<const unsigned char *>(source.next_byte());
+            return static_cast<size_t>(next_byte - m_stream);
+        };
+
+        using kind        = serialization_plan::operation::kind;
+        auto const & plan = *m_type_registry.get_type_data(*m_root_type).m_plan;
+        for (auto const & op : plan.m_operations)
+        {
+            auto const object = address_add(m_root, op.m_offset);
+            switch (op.m_kind)
+            {
+            case kind::copy:
+                if (m_format == wire_format::fixed)
+                {
+                    if (!source.read_all_or_none(object, op.m_size))
+                        corrupted_stream();
+                    break;
+                }
+                for (size_t index = 0; index < op.m_field_count; index++)
+                {
+                    auto const & field = plan.m_fields[op.m_first_field + index];
+                    read_lazy_value(
+                      source,
+                      address_add(m_root, field.m_offset),
+                      field.m_size,
+                      field.m_encoding,
+                      m_format);
+                }
+                break;
+
+            case kind::object:
+                m_stubs.push_back(Stub{object, op.m_class, nullptr, position()});
+                skipper.skip_class(*op.m_plan, 1);
+                break;
+
+            case kind::property:
+            {
+                auto const & qualified_type = op.m_property->qualified_type();
+                if (qualified_type.indirection_levels() != 0)
+                    except<std::runtime_error>("lazy_reader: pointers are not supported");
+                auto const & final_type = *qualified_type.final_type();
+                if (final_type.is_class())
+                {
+                    m_stubs.push_back(Stub{object, nullptr, op.m_property, position()});
+                    skipper.skip_object(qualified_type, 0);
+                    break;
+                }
+
+                // fundamentals and enums are read in a temporary, and assigned
+                dyn_value value;
+                value.assign(qualified_type_ptr(&final_type));
+                read_lazy_value(
+                  source,
+                  const_cast<void *>(value.object()),
+                  final_type.size(),
+                  type_registry::compact_encoding_of(final_type),
+                  m_format);
+                if (op.m_property->is_settable())
+                    op.m_property->set(object, value.object());
+                break;
+            }
+            }
+        }
+
+        std::stable_sort(
+          m_stubs.begin(), m_stubs.end(), [](const Stub & i_first, const Stub & i_second) {
+              return std::less<const void *>()(i_first.m_object, i_second.m_object);
+          });
+        m_stub_count = m_stubs.size();
+    }
+
+    void lazy_reader::load_all()
+    {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        for (auto & stub : m_stubs)
+        {
+            if (!stub.m_loaded)
+                load(stub);
+        }
+    }
+
+    size_t lazy_reader::stub_count() const
+    {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        return m_stub_count;
+    }
+
+    void lazy_reader::load_range(const void * i_begin, const void * i_end)
+    {
+        std::less<const void *> const less;
+        auto const before = [&](const Stub & i_stub, const void * i_address) {
+            return less(i_stub.m_object, i_address);
+        };
+        auto it = std::lower_bound(m_stubs.begin(), m_stubs.end(), i_begin, before);
+        for (; it != m_stubs.end() && less(it->m_object, i_end); ++it)
+        {
+            if (!it->m_loaded)
+                load(*it);
+        }
+    }
+
+    bool lazy_reader::contains(const void * i_object) const noexcept
+    {
+        std::less<const void *> const less;
+        return !less(i_object, m_root) &&
+               less(i_object, address_add(m_root, m_root_type->size()));
+    }
+
+    void lazy_reader::load(Stub & io_stub)
+    {
+        // the stub is marked as loaded before decoding it, so that a setter that accesses the
+        // property through property_inspector does not load it again
+        io_stub.m_loaded = true;
+        m_stub_count--;
+        try
+        {
+            decode(io_stub);
+        }
+        catch (...)
+        {
+            io_stub.m_loaded = false;
+            m_stub_count++;
+            throw;
+        }
+    }
+
+    void lazy_reader::decode(const Stub & i_stub)
+    {
+        // the object ends before the end of the stream
+        byte_reader source(m_stream + i_stub.m_position, m_stream_size - i_stub.m_position);
+        if (i_stub.m_container != nullptr)
+        {
+            binary_reader reader(
+              m_type_registry,
+              raw_ptr(i_stub.m_object, qualified_type_ptr(i_stub.m_container)),
+              m_format);
+            if (reader.step(source) != binary_reader::finished)
+                corrupted_stream();
+        }
+        else
+        {
+            dyn_value value;
+            value.assign(qualified_type_ptr(i_stub.m_property->qualified_type().final_type()));
+            {
+                binary_reader reader(m_type_registry, value, m_format);
+                if (reader.step(source) != binary_reader::finished)
+                    corrupted_stream();
+            }
+            if (i_stub.m_property->is_settable())
+                i_stub.m_property->set(i_stub.m_object, value.object());
+        }
+    }
+
+} // namespace cambrian
@@ -0,0 +1,94 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "cambrian/cambrian_common.h"
+#include "cambrian/data/serializer.h"
+#include "cambrian/data/type_registry.h"
+#include "ediacaran/utils/raw_ptr.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace cambrian
+{
+    /** Reads an object written by binary_writer on demand. The constructor reads only the
+        top-level fields of the root: the values of fundamental or enum type, including the
+        ones of the inplace properties of class type that are not containers. Every container
+        and every property of class type accessed with a getter is left as a stub, that records
+        the position of its value in the stream, and is skipped without decoding it. A stub is
+        decoded the first time a property that contains it is read or assigned through
+        property_inspector (and so through get_property_value and set_property_value), or by
+        load_all. Reading or assigning a property with a getter loads all the stubs of the
+        root. The members of the root accessed directly are not loaded: in particular a root
+        must be loaded before serializing it.
+        The stream is not copied: it must be contiguous, and it must outlive the reader. The
+        root must not be moved or destroyed while the reader exists, and the roots of two readers
+        can't overlap. The stubs are loaded by a global property_loader, that finds the reader
+        owning a property by the address of the root, and loads it holding a recursive lock of
+        that reader only, so a setter called by the loading can access other properties.
+        Pointers and interned values are not supported, since they refer to other parts of
+        the stream. */
+    class lazy_reader
+    {
+      public:
+        /** Throws std::invalid_argument if the root is not a class or is a container, and
+            std::runtime_error if the stream is corrupted or contains a pointer, or if another
+            property_loader is installed. Throws std::invalid_argument if the root overlaps the
+            root of another reader. */
+        lazy_reader(
+          type_registry & i_type_registry,
+          const raw_ptr & io_dest_object,
+          const void *    i_stream,
+          size_t          i_stream_size,
+          wire_format     i_format = wire_format::fixed);
+
+        lazy_reader(const lazy_reader &) = delete;
+        lazy_reader & operator=(const lazy_reader &) = delete;
+
+        ~lazy_reader();
+
+        /** Loads all the stubs that are not loaded yet */
+        void load_all();
+
+        /** Returns the number of stubs that are not loaded yet */
+        size_t stub_count() const;
+
+      private:
+        class Loader;
+
+        struct Stub
+        {
+            void *             m_object;              /**< the container, or the subobject */
+            const class_type * m_container = nullptr; /**< the class of the container */
+            const property *   m_property  = nullptr; /**< a property with a getter */
+            size_t             m_position  = 0;       /**< the offset of the value in the stream */
+            bool               m_loaded    = false;
+        };
+
+        void read_top_level();
+
+        void load_range(const void * i_begin, const void * i_end);
+
+        bool contains(const void * i_object) const noexcept;
+
+        void load(Stub & io_stub);
+
+        void decode(const Stub & i_stub);
+
+      private:
+        type_registry &              m_type_registry;
+        void * const                 m_root;
+        const type * const           m_root_type;
+        const unsigned char * const  m_stream;
+        size_t const                 m_stream_size;
+        wire_format const            m_format;
+        std::vector<Stub>            m_stubs; /**< sorted by address */
+        size_t                       m_stub_count = 0;
+        mutable std::recursive_mutex m_mutex;
+        std::atomic<size_t>          m_users{0}; /**< loads that have found the reader */
+    };
+
+} // namespace cambrian
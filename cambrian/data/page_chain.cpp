@@ -0,0 +1,127 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "cambrian/data/page_chain.h"
+#include "ediacaran/core/address.h"
+#include <cstring>
+
+namespace cambrian
+{
+    namespace
+    {
+        // layout of the start of a page of a chain
+        struct ChainHeader
+        {
+            page_address m_next;
+            uint32_t     m_used_size; // bytes of the stream following the header
+        };
+
+        ChainHeader header_of(const void * i_page)
+        {
+            ChainHeader header;
+            memcpy(&header, i_page, sizeof(header));
+            return header;
+        }
+
+        void set_header(void * i_page, const ChainHeader & i_header)
+        {
+            memcpy(i_page, &i_header, sizeof(i_header));
+        }
+
+        page_address next_of(storage_device & i_device, page_address i_page)
+        {
+            auto const page = map_scoped_page(i_device, i_page, storage_device::access_flags::read);
+            return header_of(page.mem_address()).m_next;
+        }
+
+        size_t chain_capacity(storage_device & i_device)
+        {
+            auto const page_size = i_device.get_info().m_page_size;
+            CAMBRIAN_ASSERT(page_size > sizeof(ChainHeader));
+            return page_size - sizeof(ChainHeader);
+        }
+    } // namespace
+
+    page_address write_page_chain(storage_device & i_device, binary_writer & i_writer)
+    {
+        auto const capacity = chain_capacity(i_device);
+
+        // the chain is always walkable, so that it can be deallocated on failure
+        auto       page       = allocate_scoped_page(i_device);
+        auto const first_page = page.storage_address();
+        set_header(page.mem_address(), {invalid_page_address, 0});
+        try
+        {
+            for (;;)
+            {
+                byte_writer dest(address_add(page.mem_address(), sizeof(ChainHeader)), capacity);
+                auto const  result = i_writer.step(dest);
+                ChainHeader header{invalid_page_address,
+                                   static_cast<uint32_t>(capacity - dest.remaining_size())};
+                if (result == binary_writer::finished)
+                {
+                    set_header(page.mem_address(), header);
+                    break;
+                }
+
+                auto next_page = allocate_scoped_page(i_device);
+                set_header(next_page.mem_address(), {invalid_page_address, 0});
+                header.m_next = next_page.storage_address();
+                set_header(page.mem_address(), header);
+                page = std::move(next_page);
+            }
+        }
+        catch (...)
+        {
+            page.release();
+            free_page_chain(i_device, first_page);
+            throw;
+        }
+        return first_page;
+    }
+
+    void read_page_chain(
+      storage_device & i_device, page_address i_first_page, binary_reader & i_reader)
+    {
+        auto const capacity = chain_capacity(i_device);
+        for (auto address = i_first_page;;)
+        {
+            if (address == invalid_page_address)
+                except<std::runtime_error>("read_page_chain: the chain ends before the object");
+            auto const page =
+              map_scoped_page(i_device, address, storage_device::access_flags::read);
+            auto const header = header_of(page.mem_address());
+            if (header.m_used_size > capacity)
+                except<std::runtime_error>("read_page_chain: corrupted page");
+
+            byte_reader source(
+              address_add(page.mem_address(), sizeof(ChainHeader)), header.m_used_size);
+            if (i_reader.step(source) == binary_reader::finished)
+                return;
+            address = header.m_next;
+        }
+    }
+
+    void free_page_chain(storage_device & i_device, page_address i_first_page)
+    {
+        for (auto address = i_first_page; address != invalid_page_address;)
+        {
+            auto const next = next_of(i_device, address);
+            i_device.deallocate_page(address);
+            address = next;
+        }
+    }
+
+    size_t page_chain_length(storage_device & i_device, page_address i_first_page)
+    {
+        size_t length = 0;
+        for (auto address = i_first_page; address != invalid_page_address; length++)
+        {
+            address = next_of(i_device, address);
+        }
+        return length;
+    }
+
+} // namespace cambrian
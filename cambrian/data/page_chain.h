@@ -0,0 +1,32 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "cambrian/cambrian_common.h"
+#include "cambrian/data/deserializer.h"
+#include "cambrian/data/serializer.h"
+#include "cambrian/storage/storage_device.h"
+
+namespace cambrian
+{
+    /** Writes the stream of a binary_writer directly in pages allocated from a storage_device,
+        linked in a chain, and returns the address of the first page. Every page starts with a
+        header that stores the used size of the page and the address of the next one. At most
+        two pages are mapped at the same time, and no memory is allocated for the pages. If an
+        exception is thrown, the pages allocated so far are deallocated. */
+    page_address write_page_chain(storage_device & i_device, binary_writer & i_writer);
+
+    /** Reads a chain of pages written by write_page_chain with a binary_reader. Throws
+        std::runtime_error if the chain is corrupted, or if it ends before the object. */
+    void read_page_chain(
+      storage_device & i_device, page_address i_first_page, binary_reader & i_reader);
+
+    /** Deallocates all the pages of a chain */
+    void free_page_chain(storage_device & i_device, page_address i_first_page);
+
+    /** Returns the number of pages of a chain */
+    size_t page_chain_length(storage_device & i_device, page_address i_first_page);
+
+} // namespace cambrian
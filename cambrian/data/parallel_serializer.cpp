@@ -0,0 +1,111 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "cambrian/data/parallel_serializer.h"
+#include "ediacaran/utils/universal_iterator.h"
+#include <algorithm>
+#include <exception>
+#include <iterator>
+#include <thread>
+
+namespace cambrian
+{
+    namespace
+    {
+        using Pages = std::vector<std::vector<unsigned char>>;
+
+        void write_pages(binary_writer & i_writer, size_t i_page_size, Pages & o_pages)
+        {
+            bool finished = false;
+            while (!finished)
+            {
+                std::vector<unsigned char> page(i_page_size);
+                byte_writer                dest(page.data(), page.size());
+                finished = i_writer.step(dest) == binary_writer::finished;
+                page.resize(page.size() - static_cast<size_t>(dest.remaining_size()));
+                if (!page.empty())
+                    o_pages.push_back(std::move(page));
+            }
+        }
+
+        // returns the number of elements of the root if it can be partitioned, otherwise zero
+        container::index partitionable_size(type_registry & i_type_registry, const raw_ptr & i_root)
+        {
+            auto const & root_type = *i_root.qualified_type().final_type();
+            if (i_root.qualified_type().indirection_levels() != 0 || !root_type.is_class())
+                return 0;
+            auto const container = i_type_registry.get_type_data(root_type).m_plan->m_container;
+            if (
+              container == nullptr ||
+              (container->capabilities() & container::capability::contiguous) ==
+                container::capability::none)
+            {
+                return 0;
+            }
+            return universal_iterator(i_root).segment().m_element_count;
+        }
+    } // namespace
+
+    std::vector<std::vector<unsigned char>> write_parallel(
+      type_registry & io_type_registry,
+      const raw_ptr & i_source_object,
+      size_t          i_page_size,
+      size_t          i_thread_count,
+      wire_format     i_format,
+      size_t          i_min_partition_size)
+    {
+        // registers all the types reachable from the root
+        auto const element_count = partitionable_size(io_type_registry, i_source_object);
+
+        auto const max_partitions =
+          static_cast<size_t>(element_count / std::max<size_t>(i_min_partition_size, 1));
+        auto const partition_count =
+          std::max<size_t>(1, std::min<size_t>(i_thread_count, max_partitions));
+
+        Pages result;
+        if (partition_count == 1)
+        {
+            binary_writer writer(io_type_registry, i_source_object, i_format);
+            write_pages(writer, i_page_size, result);
+            return result;
+        }
+
+        std::vector<Pages>              partition_pages(partition_count);
+        std::vector<std::exception_ptr> errors(partition_count);
+        std::vector<std::thread>        threads;
+        threads.reserve(partition_count);
+        for (size_t index = 0; index < partition_count; index++)
+        {
+            binary_writer::partition partition;
+            partition.m_first = element_count * index / partition_count;
+            partition.m_count = element_count * (index + 1) / partition_count - partition.m_first;
+            threads.emplace_back([&, index, partition] {
+                try
+                {
+                    binary_writer writer(io_type_registry, i_source_object, partition, i_format);
+                    write_pages(writer, i_page_size, partition_pages[index]);
+                }
+                catch (...)
+                {
+                    errors[index] = std::current_exception();
+                }
+            });
+        }
+        for (auto & thread : threads)
+            thread.join();
+
+        for (auto const & error : errors)
+        {
+            if (error)
+                std::rethrow_exception(error);
+        }
+        for (auto & pages : partition_pages)
+        {
+            std::move(pages.begin(), pages.end(), std::back_inserter(result));
+        }
+        return result;
+    }
+
+} // namespace cambrian
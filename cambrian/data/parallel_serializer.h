@@ -0,0 +1,31 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "cambrian/cambrian_common.h"
+#include "cambrian/data/serializer.h"
+#include "cambrian/data/type_registry.h"
+#include "ediacaran/utils/raw_ptr.h"
+#include <vector>
+
+namespace cambrian
+{
+    /** Serializes an object with binary_writer using up to i_thread_count threads. If the root
+        is a contiguous container with at least i_min_partition_size elements per thread, its
+        elements are split in partitions of similar size, and every partition is written by a
+        thread to its own sequence of pages. The pages are then joined in order, so the result
+        is a sequence of pages that binary_reader can read one by one, as if they were written
+        by a single writer. Every page is at most i_page_size bytes, and is trimmed to the
+        used size. All the types reachable from the root are registered before the threads
+        start, so the registry is only read concurrently. */
+    std::vector<std::vector<unsigned char>> write_parallel(
+      type_registry & io_type_registry,
+      const raw_ptr & i_source_object,
+      size_t          i_page_size,
+      size_t          i_thread_count,
+      wire_format     i_format             = wire_format::fixed,
+      size_t          i_min_partition_size = 4096);
+
+} // namespace cambrian
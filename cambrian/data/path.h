@@ -1,4 +1,3 @@
-
 //   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
 // Distributed under the Boost Software License, Version 1.0.
 //    (See accompanying file LICENSE_1_0.txt or copy at
@@ -9,11 +8,88 @@
 
 namespace cambrian
 {
-
-
+    /** Sequence of the components of a path. Components are separated by '/'. Empty components
+        (caused by leading, trailing or repeated separators) are skipped, so that "/users//42/"
+        has the components "users" and "42". */
     class path
     {
       public:
+        constexpr static char separator = '/';
+
+        constexpr path() noexcept = default;
+
+        constexpr path(const string_view & i_source) noexcept : m_source(i_source) {}
+
+        constexpr const string_view & source() const noexcept { return m_source; }
+
+        class const_iterator
+        {
+          public:
+            constexpr const_iterator() noexcept = default;
+
+            constexpr const_iterator(const string_view & i_source) noexcept
+                : m_end_of_string(i_source.data() + i_source.size())
+            {
+                m_token = get_next(i_source.data());
+            }
+
+            constexpr const string_view & operator*() const noexcept { return m_token; }
+
+            constexpr const_iterator & operator++() noexcept
+            {
+                m_token = get_next(m_token.data() + m_token.size());
+                return *this;
+            }
+
+            constexpr bool operator==(end_marker_t) const noexcept { return is_over(); }
+
+            constexpr bool operator!=(end_marker_t) const noexcept { return !is_over(); }
+
+            /** Returns the part of the source path following the current component. */
+            constexpr string_view remaining() const noexcept
+            {
+                auto const from = m_token.data() + m_token.size();
+                return string_view(from, static_cast<size_t>(m_end_of_string - from));
+            }
+
+          private:
+            constexpr string_view get_next(const char * i_from) noexcept
+            {
+                auto curr = i_from;
+                while (curr < m_end_of_string && *curr == separator)
+                    curr++;
+                if (curr >= m_end_of_string)
+                    return {};
+                auto const first = curr;
+                while (curr < m_end_of_string && *curr != separator)
+                    curr++;
+                return string_view(first, static_cast<size_t>(curr - first));
+            }
+
+            constexpr bool is_over() const noexcept { return m_token.data() == nullptr; }
+
+          private:
+            string_view  m_token;
+            const char * m_end_of_string{};
+        };
+
+        using iterator = const_iterator;
+
+        constexpr const_iterator begin() const noexcept { return const_iterator(m_source); }
+
+        constexpr end_marker_t end() const noexcept { return end_marker; }
+
+        /** Returns the number of components of the path. */
+        constexpr size_t component_count() const noexcept
+        {
+            size_t count = 0;
+            for (auto it = begin(); it != end_marker; ++it)
+                count++;
+            return count;
+        }
+
+      private:
+        string_view m_source;
     };
 
 
@@ -0,0 +1,199 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "cambrian/data/path_cache.h"
+#include "cambrian/data/directory.h"
+#include "cambrian/data/path.h"
+#include <iterator>
+
+namespace cambrian
+{
+    namespace
+    {
+        // estimated memory used by the list node and the hash map node of an entry
+        constexpr size_t entry_overhead = 8 * sizeof(void *);
+    }
+
+    path_cache::path_cache(storage_device & i_device, size_t i_memory_budget)
+        : m_device(&i_device), m_memory_budget(i_memory_budget),
+          m_versions(new std::atomic<uint32_t>[size_t(1) << version_bucket_bits]),
+          m_shards(new Shard[shard_count])
+    {
+        for (size_t index = 0; index < (size_t(1) << version_bucket_bits); index++)
+            m_versions[index].store(0, std::memory_order_relaxed);
+    }
+
+    uint32_t
+      path_cache::version_bucket(page_address i_directory, const string_view & i_name) noexcept
+    {
+        auto const directory_hash =
+          static_cast<uint32_t>((i_directory * UINT64_C(0x9E3779B97F4A7C15)) >> 32);
+        return (hash(i_name) ^ directory_hash) & ((uint32_t(1) << version_bucket_bits) - 1);
+    }
+
+    path_cache::Shard & path_cache::shard_of(const string_view & i_path) noexcept
+    {
+        /* djb2 changes little in the high bits for paths that differ only in the last
+           characters, like the entries of a directory, so the hash is mixed with a Fibonacci
+           multiplication, whose high bits depend on all the bits of the hash. The buckets of
+           the hash map use the low bits of the unmixed hash. */
+        auto const mixed = hash(i_path) * UINT32_C(0x9E3779B9);
+        return m_shards[mixed >> (32 - shard_bits)];
+    }
+
+    bool path_cache::is_valid(const Entry & i_entry) const noexcept
+    {
+        for (auto const & dependency : i_entry.m_dependencies)
+        {
+            auto const version =
+              m_versions[dependency.m_version_bucket].load(std::memory_order_acquire);
+            if (version != dependency.m_version)
+                return false;
+        }
+        return true;
+    }
+
+    page_address path_cache::resolve(const string_view & i_path, void * o_inline_data)
+    {
+        // equivalent paths (like "/users//42/" and "users/42") share the same entry
+        std::string key;
+        key.reserve(i_path.size() + 1);
+        for (auto const & token : path(i_path))
+        {
+            key += path::separator;
+            key.append(token.data(), token.size());
+        }
+
+        {
+            auto &                      shard = shard_of(key);
+            std::lock_guard<std::mutex> lock(shard.m_mutex);
+            auto const                  it = shard.m_map.find(key);
+            if (it != shard.m_map.end())
+            {
+                auto const & entry = *it->second;
+                if (is_valid(entry))
+                {
+                    if (o_inline_data != nullptr)
+                    {
+                        memcpy(
+                          o_inline_data, entry.m_inline_data.data(), entry.m_inline_data.size());
+                    }
+                    shard.m_lru.splice(shard.m_lru.begin(), shard.m_lru, it->second);
+                    m_hit_count.fetch_add(1, std::memory_order_relaxed);
+                    return entry.m_value;
+                }
+                erase(shard, it->second);
+            }
+        }
+        m_miss_count.fetch_add(1, std::memory_order_relaxed);
+
+        /* walk the tree. The version of every bucket is read before the lookup, so that a
+           concurrent mutation leaves the entry invalid. */
+        std::vector<Dependency> dependencies;
+        unsigned char           inline_data[max_inline_size];
+        auto                    curr = m_device->get_info().m_root_page | dictionary_page_mask;
+        for (auto const & token : path(key))
+        {
+            if ((curr & dictionary_page_mask) == 0)
+                return invalid_page_address; // an object has no children
+            auto const directory_page = curr & ~dictionary_page_mask;
+            auto const bucket         = version_bucket(directory_page, token);
+            dependencies.push_back({bucket, m_versions[bucket].load(std::memory_order_acquire)});
+            curr = directory(*m_device, directory_page).lookup(token, inline_data);
+            if (curr == invalid_page_address)
+                return invalid_page_address;
+        }
+
+        std::string cached_inline_data;
+        if ((curr & inline_value_mask) != 0)
+        {
+            auto const size = static_cast<size_t>(curr & ~inline_value_mask);
+            cached_inline_data.assign(reinterpret_cast<const char *>(inline_data), size);
+            if (o_inline_data != nullptr)
+                memcpy(o_inline_data, inline_data, size);
+        }
+
+        add(std::move(key), curr, std::move(dependencies), std::move(cached_inline_data));
+        return curr;
+    }
+
+    void path_cache::add(
+      std::string &&            i_path,
+      page_address              i_value,
+      std::vector<Dependency> && i_dependencies,
+      std::string &&            i_inline_data)
+    {
+        auto &                      shard = shard_of(i_path);
+        std::lock_guard<std::mutex> lock(shard.m_mutex);
+
+        // another thread may have added the same path in the meanwhile
+        auto const existing = shard.m_map.find(i_path);
+        if (existing != shard.m_map.end())
+            erase(shard, existing->second);
+
+        shard.m_lru.push_front(Entry{
+          std::move(i_path), i_value, std::move(i_dependencies), std::move(i_inline_data), 0});
+        auto & entry         = shard.m_lru.front();
+        entry.m_memory_usage = sizeof(Entry) + entry_overhead + entry.m_path.capacity() +
+                               entry.m_dependencies.capacity() * sizeof(Dependency) +
+                               entry.m_inline_data.capacity();
+        shard.m_map.emplace(entry.m_path, shard.m_lru.begin());
+        shard.m_memory_usage += entry.m_memory_usage;
+
+        // evict the least recently used entries
+        auto const shard_budget = m_memory_budget / shard_count;
+        while (shard.m_memory_usage > shard_budget && !shard.m_lru.empty())
+            erase(shard, std::prev(shard.m_lru.end()));
+    }
+
+    void path_cache::erase(Shard & i_shard, EntryList::iterator i_entry)
+    {
+        i_shard.m_memory_usage -= i_entry->m_memory_usage;
+        i_shard.m_map.erase(i_entry->m_path);
+        i_shard.m_lru.erase(i_entry);
+    }
+
+    void path_cache::notify_modified(page_address i_directory, const string_view & i_name) noexcept
+    {
+        m_versions[version_bucket(i_directory, i_name)].fetch_add(1, std::memory_order_release);
+    }
+
+    void path_cache::clear()
+    {
+        for (uint32_t index = 0; index < shard_count; index++)
+        {
+            auto &                      shard = m_shards[index];
+            std::lock_guard<std::mutex> lock(shard.m_mutex);
+            shard.m_map.clear();
+            shard.m_lru.clear();
+            shard.m_memory_usage = 0;
+        }
+    }
+
+    size_t path_cache::entry_count() const
+    {
+        size_t result = 0;
+        for (uint32_t index = 0; index < shard_count; index++)
+        {
+            auto &                      shard = m_shards[index];
+            std::lock_guard<std::mutex> lock(shard.m_mutex);
+            result += shard.m_lru.size();
+        }
+        return result;
+    }
+
+    size_t path_cache::memory_usage() const
+    {
+        size_t result = 0;
+        for (uint32_t index = 0; index < shard_count; index++)
+        {
+            auto &                      shard = m_shards[index];
+            std::lock_guard<std::mutex> lock(shard.m_mutex);
+            result += shard.m_memory_usage;
+        }
+        return result;
+    }
+
+} // namespace cambrian
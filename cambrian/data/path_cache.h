@@ -0,0 +1,126 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "cambrian/cambrian_common.h"
+#include "cambrian/storage/storage_device.h"
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cambrian
+{
+    /** Thread safe in-memory cache that maps full paths to the values resolved by walking the
+        directory tree of a storage_device (see obj_ref).
+        Every directory entry (identified by the header page of the directory and the name)
+        falls in a version bucket, an atomic counter incremented whenever the directory inserts
+        or removes an entry in that bucket. A cached path stores the versions of the buckets of
+        all its components, so a mutation in any directory along the path invalidates it. The
+        directories notify the cache only if they have been constructed with a pointer to it.
+        The memory used by the entries is limited by a budget: when it is exceeded the least
+        recently used entries are evicted. Paths that do not exist are not cached. */
+    class path_cache
+    {
+      public:
+        constexpr static size_t default_memory_budget = size_t(64) << 20;
+
+        path_cache(storage_device & i_device, size_t i_memory_budget = default_memory_budget);
+
+        path_cache(const path_cache &) = delete;
+        path_cache & operator=(const path_cache &) = delete;
+
+        storage_device & device() const noexcept { return *m_device; }
+
+        /** Returns the value of the entry with the given path (with dictionary_page_mask set if
+            it is a directory), or invalid_page_address. If the object is inline and
+            o_inline_data is not null, the object is copied to o_inline_data, that must be at
+            least max_inline_size bytes. Inline objects are cached together with the path. */
+        page_address resolve(const string_view & i_path, void * o_inline_data = nullptr);
+
+        /** Invalidates the paths that depend on an entry of a directory. Called by the directory
+            after a mutation. */
+        void notify_modified(page_address i_directory, const string_view & i_name) noexcept;
+
+        /** Removes all the entries */
+        void clear();
+
+        uint64_t hit_count() const noexcept { return m_hit_count.load(std::memory_order_relaxed); }
+
+        uint64_t miss_count() const noexcept
+        {
+            return m_miss_count.load(std::memory_order_relaxed);
+        }
+
+        size_t entry_count() const;
+
+        /** Returns the estimated memory used by the entries */
+        size_t memory_usage() const;
+
+        size_t memory_budget() const noexcept { return m_memory_budget; }
+
+      private:
+        constexpr static uint32_t shard_bits          = 4;
+        constexpr static uint32_t shard_count         = uint32_t(1) << shard_bits;
+        constexpr static uint32_t version_bucket_bits = 16;
+
+        struct Dependency
+        {
+            uint32_t m_version_bucket;
+            uint32_t m_version;
+        };
+
+        struct Entry
+        {
+            std::string             m_path;
+            page_address            m_value;
+            std::vector<Dependency> m_dependencies;
+            std::string             m_inline_data;
+            size_t                  m_memory_usage;
+        };
+
+        struct PathHash
+        {
+            size_t operator()(const string_view & i_path) const noexcept { return hash(i_path); }
+        };
+
+        using EntryList = std::list<Entry>; // the most recently used entry is at the front
+
+        struct Shard
+        {
+            std::mutex                                                     m_mutex;
+            EntryList                                                      m_lru;
+            std::unordered_map<string_view, EntryList::iterator, PathHash> m_map;
+            size_t                                                         m_memory_usage = 0;
+        };
+
+        static uint32_t
+          version_bucket(page_address i_directory, const string_view & i_name) noexcept;
+
+        bool is_valid(const Entry & i_entry) const noexcept;
+
+        Shard & shard_of(const string_view & i_path) noexcept;
+
+        void add(
+          std::string &&            i_path,
+          page_address              i_value,
+          std::vector<Dependency> && i_dependencies,
+          std::string &&            i_inline_data);
+
+        static void erase(Shard & i_shard, EntryList::iterator i_entry);
+
+      private:
+        storage_device *                         m_device;
+        size_t                                   m_memory_budget;
+        std::unique_ptr<std::atomic<uint32_t>[]> m_versions;
+        std::unique_ptr<Shard[]>                 m_shards;
+        std::atomic<uint64_t>                    m_hit_count{0};
+        std::atomic<uint64_t>                    m_miss_count{0};
+    };
+
+} // namespace cambrian
@@ -0,0 +1,197 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "cambrian/data/pipelined_serializer.h"
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <thread>
+
+namespace cambrian
+{
+    namespace
+    {
+        using Buffer = std::vector<unsigned char>;
+
+        /** Bounded lock-free queue with a single producer and a single consumer. A null
+            buffer marks the end of the stream. */
+        class BufferQueue
+        {
+          public:
+            explicit BufferQueue(size_t i_capacity)
+                : m_slot_count(i_capacity + 1), m_slots(new Buffer *[i_capacity + 1])
+            {
+            }
+
+            /** The queues are sized so that they never fill up: every buffer and the end
+                marker fit at the same time */
+            void push(Buffer * i_buffer) noexcept
+            {
+                auto const tail = m_tail.load(std::memory_order_relaxed);
+                auto const next = tail + 1 < m_slot_count ? tail + 1 : 0;
+                CAMBRIAN_ASSERT(next != m_head.load(std::memory_order_acquire));
+                m_slots[tail] = i_buffer;
+                m_tail.store(next, std::memory_order_release);
+            }
+
+            /** Waits until a buffer is available, and returns false if the pipeline is aborted
+                in the meantime */
+            bool pop(Buffer *& o_buffer, const std::atomic<bool> & i_abort) noexcept
+            {
+                auto const head = m_head.load(std::memory_order_relaxed);
+                while (head == m_tail.load(std::memory_order_acquire))
+                {
+                    if (i_abort.load(std::memory_order_relaxed))
+                        return false;
+                    std::this_thread::yield();
+                }
+                o_buffer = m_slots[head];
+                m_head.store(head + 1 < m_slot_count ? head + 1 : 0, std::memory_order_release);
+                return true;
+            }
+
+          private:
+            size_t const                      m_slot_count;
+            std::unique_ptr<Buffer *[]> const m_slots;
+            alignas(64) std::atomic<size_t>   m_head{0};
+            alignas(64) std::atomic<size_t>   m_tail{0};
+        };
+
+        class Pipeline
+        {
+          public:
+            explicit Pipeline(size_t i_queue_capacity)
+                : m_pages(i_queue_capacity), m_compressed_pages(i_queue_capacity),
+                  m_full_pages(i_queue_capacity + 1), m_free_pages(i_queue_capacity + 1),
+                  m_full_compressed(i_queue_capacity + 1), m_free_compressed(i_queue_capacity + 1)
+            {
+                for (auto & page : m_pages)
+                    m_free_pages.push(&page);
+                for (auto & page : m_compressed_pages)
+                    m_free_compressed.push(&page);
+            }
+
+            void write(binary_writer & i_writer, size_t i_page_size)
+            {
+                // an empty page is kept for the next step, as only the compressor can recycle it
+                Buffer * page     = nullptr;
+                bool     finished = false;
+                while (!finished)
+                {
+                    if (page == nullptr && !m_free_pages.pop(page, m_abort))
+                        return;
+                    page->resize(i_page_size);
+                    byte_writer dest(page->data(), page->size());
+                    finished = i_writer.step(dest) == binary_writer::finished;
+                    page->resize(page->size() - static_cast<size_t>(dest.remaining_size()));
+                    if (!page->empty())
+                    {
+                        m_full_pages.push(page);
+                        page = nullptr;
+                    }
+                }
+                m_full_pages.push(nullptr);
+            }
+
+            void compress(const page_compressor & i_compressor)
+            {
+                for (;;)
+                {
+                    Buffer * page;
+                    if (!m_full_pages.pop(page, m_abort))
+                        return;
+                    if (page == nullptr)
+                    {
+                        m_full_compressed.push(nullptr);
+                        return;
+                    }
+
+                    Buffer * compressed;
+                    if (!m_free_compressed.pop(compressed, m_abort))
+                        return;
+                    i_compressor(page->data(), page->size(), *compressed);
+                    m_free_pages.push(page);
+                    m_full_compressed.push(compressed);
+                }
+            }
+
+            void consume(const page_sink & i_sink)
+            {
+                Buffer * page;
+                while (m_full_compressed.pop(page, m_abort) && page != nullptr)
+                {
+                    i_sink(page->data(), page->size());
+                    m_free_compressed.push(page);
+                }
+            }
+
+            void abort() noexcept { m_abort.store(true, std::memory_order_relaxed); }
+
+            /** Runs a stage, storing the exception it throws and aborting the other stages */
+            template <typename STAGE> void run(std::exception_ptr & o_error, const STAGE & i_stage)
+            {
+                try
+                {
+                    i_stage();
+                }
+                catch (...)
+                {
+                    o_error = std::current_exception();
+                    abort();
+                }
+            }
+
+          private:
+            std::vector<Buffer> m_pages;
+            std::vector<Buffer> m_compressed_pages;
+            BufferQueue         m_full_pages;
+            BufferQueue         m_free_pages;
+            BufferQueue         m_full_compressed;
+            BufferQueue         m_free_compressed;
+            std::atomic<bool>   m_abort{false};
+        };
+    } // namespace
+
+    void write_pipelined(
+      binary_writer &         i_writer,
+      size_t                  i_page_size,
+      const page_compressor & i_compressor,
+      const page_sink &       i_sink,
+      size_t                  i_queue_capacity)
+    {
+        if (i_page_size == 0 || i_queue_capacity == 0)
+            except<std::invalid_argument>("write_pipelined: zero page size or queue capacity");
+
+        Pipeline           pipeline(i_queue_capacity);
+        std::exception_ptr errors[3];
+        std::thread        compressor([&] {
+            pipeline.run(errors[1], [&] { pipeline.compress(i_compressor); });
+        });
+
+        // if the second thread can't be started, the first one must be stopped and joined
+        std::thread sink;
+        try
+        {
+            sink = std::thread([&] { pipeline.run(errors[2], [&] { pipeline.consume(i_sink); }); });
+        }
+        catch (...)
+        {
+            pipeline.abort();
+            compressor.join();
+            throw;
+        }
+
+        pipeline.run(errors[0], [&] { pipeline.write(i_writer, i_page_size); });
+        compressor.join();
+        sink.join();
+
+        for (auto const & error : errors)
+        {
+            if (error)
+                std::rethrow_exception(error);
+        }
+    }
+
+} // namespace cambrian
@@ -0,0 +1,43 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "cambrian/cambrian_common.h"
+#include "cambrian/data/serializer.h"
+#include <functional>
+#include <vector>
+
+namespace cambrian
+{
+    /** Transforms a page written by binary_writer, typically compressing it. The result must
+        be assigned to o_dest, that holds the result of a previous call, so that its storage
+        can be reused. */
+    using page_compressor = std::function<void(
+      const unsigned char * i_page, size_t i_page_size, std::vector<unsigned char> & o_dest)>;
+
+    /** Consumes a page produced by a page_compressor, typically writing it to a file or a
+        device. The page is recycled after the call returns. */
+    using page_sink = std::function<void(const unsigned char * i_page, size_t i_page_size)>;
+
+    /** Serializes the object of a binary_writer with three stages running concurrently: the
+        calling thread writes pages of at most i_page_size bytes, a second thread compresses
+        them, and a third thread passes the compressed pages to the sink, in order. Empty pages
+        are not passed to the compressor. The stages are connected by bounded lock-free
+        queues of i_queue_capacity pages, and the buffers of the pages are recycled, so no
+        memory is allocated after the first pages, unless the compressor grows its output. A
+        stage that finds its queue empty (or full) yields until the other stage catches up.
+        If a stage throws, the others stop, and the exception is rethrown to the caller once
+        all the threads have been joined; the pages already passed to the sink are not
+        undone. If a thread can't be started, the threads already started are stopped and
+        joined before std::system_error is thrown. Throws std::invalid_argument if i_page_size
+        or i_queue_capacity is zero. */
+    void write_pipelined(
+      binary_writer &         i_writer,
+      size_t                  i_page_size,
+      const page_compressor & i_compressor,
+      const page_sink &       i_sink,
+      size_t                  i_queue_capacity = 4);
+
+} // namespace cambrian
@@ -0,0 +1,448 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "cambrian/data/schema.h"
+#include "ediacaran/core/address.h"
+#include "ediacaran/reflection/reflection.h"
+#include <algorithm>
+#include <cstring>
+
+namespace cambrian
+{
+    namespace
+    {
+        constexpr uint32_t schema_magic     = 0x6d686373; // "schm"
+        constexpr uint32_t container_flag   = 1;
+        constexpr size_t   record_alignment = 8;
+
+        // layout of the start of a page of a schema
+        struct SchemaHeader
+        {
+            page_address m_next;
+            uint32_t     m_magic;
+            uint32_t     m_used_size;    // bytes of the records following the header
+            uint32_t     m_class_count;  // records in this page
+            type_id      m_next_type_id; // the same in all the pages
+        };
+
+        // a string stored in the same record, at an offset from the start of the record
+        struct StringRef
+        {
+            uint32_t m_offset;
+            uint32_t m_size;
+        };
+
+        /* the record of a class is followed by the records of the properties, by the names of
+           the bases, and by the characters of all the strings */
+        struct ClassRecord
+        {
+            uint32_t  m_record_size; // multiple of record_alignment
+            type_id   m_type_id;
+            uint64_t  m_size;
+            uint64_t  m_alignment;
+            uint32_t  m_property_count;
+            uint32_t  m_base_count;
+            uint32_t  m_flags;
+            StringRef m_name;
+            StringRef m_element_type_name;
+        };
+
+        struct PropertyRecord
+        {
+            uint64_t  m_offset;
+            uint64_t  m_size;
+            StringRef m_name;
+            StringRef m_type_name;
+        };
+
+        template <typename TYPE> TYPE load(const void * i_source)
+        {
+            TYPE result;
+            memcpy(&result, i_source, sizeof(result));
+            return result;
+        }
+
+        template <typename TYPE> void store(void * o_dest, const TYPE & i_source)
+        {
+            memcpy(o_dest, &i_source, sizeof(i_source));
+        }
+
+        string_view string_at(const unsigned char * i_record, const StringRef & i_string)
+        {
+            return string_view(
+              reinterpret_cast<const char *>(i_record + i_string.m_offset), i_string.m_size);
+        }
+
+        const unsigned char * property_record(const unsigned char * i_record, size_t i_index)
+        {
+            return i_record + sizeof(ClassRecord) + i_index * sizeof(PropertyRecord);
+        }
+
+        const unsigned char * base_record(const unsigned char * i_record, size_t i_index)
+        {
+            auto const property_count = load<ClassRecord>(i_record).m_property_count;
+            return property_record(i_record, property_count) + i_index * sizeof(StringRef);
+        }
+
+        std::string element_schema_name(const container & i_container)
+        {
+            auto const & elements_type = i_container.elements_type();
+            auto         result        = schema_name(*elements_type.final_type());
+            result.append(elements_type.indirection_levels(), '*');
+            return result;
+        }
+
+        std::vector<unsigned char> make_record(const type_registry::type_data & i_class_data)
+        {
+            auto const & source_class =
+              static_cast<const class_type &>(i_class_data.m_active_type);
+            auto const & layout       = *i_class_data.m_layout;
+            auto const & properties   = layout.m_class->properties();
+            auto const & bases        = source_class.bases();
+            auto const   bases_offset =
+              sizeof(ClassRecord) + properties.size() * sizeof(PropertyRecord);
+
+            std::vector<unsigned char> record(bases_offset + bases.size() * sizeof(StringRef));
+            auto const add_string = [&](const string_view & i_string) {
+                StringRef const result{static_cast<uint32_t>(record.size()),
+                                       static_cast<uint32_t>(i_string.size())};
+                record.insert(record.end(), i_string.begin(), i_string.end());
+                return result;
+            };
+
+            ClassRecord header{};
+            header.m_type_id        = i_class_data.m_id;
+            header.m_size           = i_class_data.m_serialized_size;
+            header.m_alignment      = i_class_data.m_serialized_type.alignment();
+            header.m_property_count = static_cast<uint32_t>(properties.size());
+            header.m_base_count     = static_cast<uint32_t>(bases.size());
+            header.m_name           = add_string(schema_name(source_class));
+            if (layout.m_container != nullptr)
+            {
+                header.m_flags |= container_flag;
+                header.m_element_type_name =
+                  add_string(element_schema_name(*layout.m_container));
+            }
+
+            for (size_t index = 0; index < properties.size(); index++)
+            {
+                auto const &         field = layout.m_fields[index];
+                PropertyRecord const property{
+                  field.m_offset,
+                  properties[index].qualified_type().final_type()->size(),
+                  add_string(properties[index].name()),
+                  add_string(schema_name(*field.m_source_type))};
+                store(
+                  record.data() + sizeof(ClassRecord) + index * sizeof(PropertyRecord), property);
+            }
+            for (size_t index = 0; index < bases.size(); index++)
+            {
+                auto const base_name = add_string(bases[index].get_class().name());
+                store(record.data() + bases_offset + index * sizeof(StringRef), base_name);
+            }
+
+            record.resize(uint_upper_align(record.size(), record_alignment));
+            header.m_record_size = static_cast<uint32_t>(record.size());
+            store(record.data(), header);
+            return record;
+        }
+
+        bool is_valid_record(const unsigned char * i_record, size_t i_available_size)
+        {
+            if (i_available_size < sizeof(ClassRecord))
+                return false;
+            auto const header = load<ClassRecord>(i_record);
+            auto const size   = header.m_record_size;
+            if (
+              size < sizeof(ClassRecord) || size > i_available_size ||
+              size % record_alignment != 0)
+            {
+                return false;
+            }
+
+            auto const tables_size = sizeof(ClassRecord) +
+                                     uint64_t(header.m_property_count) * sizeof(PropertyRecord) +
+                                     uint64_t(header.m_base_count) * sizeof(StringRef);
+            if (tables_size > size)
+                return false;
+
+            auto const is_valid_string = [size](const StringRef & i_string) {
+                return uint64_t(i_string.m_offset) + i_string.m_size <= size;
+            };
+            if (!is_valid_string(header.m_name) || !is_valid_string(header.m_element_type_name))
+                return false;
+            for (uint32_t index = 0; index < header.m_property_count; index++)
+            {
+                auto const property = load<PropertyRecord>(property_record(i_record, index));
+                if (!is_valid_string(property.m_name) || !is_valid_string(property.m_type_name))
+                    return false;
+            }
+            for (uint32_t index = 0; index < header.m_base_count; index++)
+            {
+                if (!is_valid_string(load<StringRef>(base_record(i_record, index))))
+                    return false;
+            }
+            return true;
+        }
+
+        size_t schema_capacity(storage_device & i_device)
+        {
+            auto const page_size = i_device.get_info().m_page_size;
+            CAMBRIAN_ASSERT(page_size > sizeof(SchemaHeader));
+            return page_size - sizeof(SchemaHeader);
+        }
+    } // namespace
+
+    std::string schema_name(const type & i_type)
+    {
+        std::string result(i_type.name());
+        if (i_type.is_class())
+        {
+            if (auto const container = static_cast<const class_type &>(i_type).container())
+            {
+                result += '<' + element_schema_name(*container) + '>';
+            }
+        }
+        return result;
+    }
+
+    page_address write_schema(storage_device & i_device, type_registry & i_type_registry)
+    {
+        auto const capacity = schema_capacity(i_device);
+
+        std::vector<std::vector<unsigned char>> records;
+        type_id                                 next_type_id = 0;
+        for (auto const & class_data : i_type_registry.registered_classes())
+        {
+            records.push_back(make_record(class_data));
+            if (records.back().size() > capacity)
+                except<std::runtime_error>("write_schema: a class does not fit in a page");
+            next_type_id = std::max(next_type_id, class_data.m_id + 1);
+        }
+        auto const name_of = [](const std::vector<unsigned char> & i_record) {
+            return string_at(i_record.data(), load<ClassRecord>(i_record.data()).m_name);
+        };
+        std::sort(
+          records.begin(),
+          records.end(),
+          [&](const std::vector<unsigned char> & i_first,
+              const std::vector<unsigned char> & i_second) {
+              return name_of(i_first) < name_of(i_second);
+          });
+        for (size_t index = 1; index < records.size(); index++)
+        {
+            if (name_of(records[index - 1]) == name_of(records[index]))
+                except<std::runtime_error>("write_schema: two classes have the same name");
+        }
+
+        // the chain is always walkable, so that it can be deallocated on failure
+        SchemaHeader const empty_header{invalid_page_address, schema_magic, 0, 0, next_type_id};
+        auto               page       = allocate_scoped_page(i_device);
+        auto const         first_page = page.storage_address();
+        store(page.mem_address(), empty_header);
+        try
+        {
+            auto header = empty_header;
+            for (auto const & record : records)
+            {
+                if (header.m_used_size + record.size() > capacity)
+                {
+                    auto next_page = allocate_scoped_page(i_device);
+                    store(next_page.mem_address(), empty_header);
+                    header.m_next = next_page.storage_address();
+                    store(page.mem_address(), header);
+                    page   = std::move(next_page);
+                    header = empty_header;
+                }
+                memcpy(
+                  address_add(page.mem_address(), sizeof(SchemaHeader) + header.m_used_size),
+                  record.data(),
+                  record.size());
+                header.m_used_size += static_cast<uint32_t>(record.size());
+                header.m_class_count++;
+            }
+            store(page.mem_address(), header);
+        }
+        catch (...)
+        {
+            page.release();
+            free_schema(i_device, first_page);
+            throw;
+        }
+        return first_page;
+    }
+
+    void free_schema(storage_device & i_device, page_address i_first_page)
+    {
+        for (auto address = i_first_page; address != invalid_page_address;)
+        {
+            page_address next;
+            {
+                auto const page =
+                  map_scoped_page(i_device, address, storage_device::access_flags::read);
+                next = load<SchemaHeader>(page.mem_address()).m_next;
+            }
+            i_device.deallocate_page(address);
+            address = next;
+        }
+    }
+
+    type_id schema_view::class_entry::id() const noexcept
+    {
+        return load<ClassRecord>(m_record).m_type_id;
+    }
+
+    string_view schema_view::class_entry::name() const noexcept
+    {
+        return string_at(m_record, load<ClassRecord>(m_record).m_name);
+    }
+
+    uint64_t schema_view::class_entry::size() const noexcept
+    {
+        return load<ClassRecord>(m_record).m_size;
+    }
+
+    uint64_t schema_view::class_entry::alignment() const noexcept
+    {
+        return load<ClassRecord>(m_record).m_alignment;
+    }
+
+    size_t schema_view::class_entry::property_count() const noexcept
+    {
+        return load<ClassRecord>(m_record).m_property_count;
+    }
+
+    schema_view::property_entry schema_view::class_entry::get_property(size_t i_index) const
+      noexcept
+    {
+        CAMBRIAN_ASSERT(i_index < property_count());
+        auto const     property = load<PropertyRecord>(property_record(m_record, i_index));
+        property_entry result;
+        result.m_name      = string_at(m_record, property.m_name);
+        result.m_type_name = string_at(m_record, property.m_type_name);
+        result.m_offset    = property.m_offset;
+        result.m_size      = property.m_size;
+        return result;
+    }
+
+    size_t schema_view::class_entry::find_property(const string_view & i_name) const noexcept
+    {
+        auto const count = property_count();
+        for (size_t index = 0; index < count; index++)
+        {
+            auto const property = load<PropertyRecord>(property_record(m_record, index));
+            if (string_at(m_record, property.m_name) == i_name)
+                return index;
+        }
+        return count;
+    }
+
+    size_t schema_view::class_entry::base_count() const noexcept
+    {
+        return load<ClassRecord>(m_record).m_base_count;
+    }
+
+    string_view schema_view::class_entry::base_name(size_t i_index) const noexcept
+    {
+        CAMBRIAN_ASSERT(i_index < base_count());
+        return string_at(m_record, load<StringRef>(base_record(m_record, i_index)));
+    }
+
+    bool schema_view::class_entry::is_container() const noexcept
+    {
+        return (load<ClassRecord>(m_record).m_flags & container_flag) != 0;
+    }
+
+    string_view schema_view::class_entry::element_type_name() const noexcept
+    {
+        return is_container() ? string_at(m_record, load<ClassRecord>(m_record).m_element_type_name)
+                              : string_view();
+    }
+
+    bool schema_view::class_entry::same_layout(const type_registry::type_data & i_class_data) const
+    {
+        if (i_class_data.m_layout == nullptr)
+            return false;
+
+        auto const & layout     = *i_class_data.m_layout;
+        auto const & properties = layout.m_class->properties();
+        if (
+          name() != string_view(schema_name(i_class_data.m_active_type)) ||
+          size() != i_class_data.m_serialized_size ||
+          alignment() != i_class_data.m_serialized_type.alignment() ||
+          property_count() != properties.size() ||
+          is_container() != (layout.m_container != nullptr))
+        {
+            return false;
+        }
+
+        for (size_t index = 0; index < properties.size(); index++)
+        {
+            auto const property = get_property(index);
+            if (
+              property.m_name != properties[index].name() ||
+              property.m_type_name !=
+                string_view(schema_name(*layout.m_fields[index].m_source_type)) ||
+              property.m_offset != layout.m_fields[index].m_offset)
+            {
+                return false;
+            }
+        }
+        return !is_container() ||
+               element_type_name() == string_view(element_schema_name(*layout.m_container));
+    }
+
+    schema_view::schema_view(storage_device & i_device, page_address i_first_page)
+    {
+        auto const capacity = schema_capacity(i_device);
+        for (auto address = i_first_page; address != invalid_page_address;)
+        {
+            m_pages.push_back(
+              map_scoped_page(i_device, address, storage_device::access_flags::read));
+            auto const page   = static_cast<const unsigned char *>(m_pages.back().mem_address());
+            auto const header = load<SchemaHeader>(page);
+            if (header.m_magic != schema_magic || header.m_used_size > capacity)
+                except<std::runtime_error>("schema_view: corrupted page");
+            m_next_type_id = header.m_next_type_id;
+
+            auto       record = page + sizeof(SchemaHeader);
+            auto const end    = record + header.m_used_size;
+            for (uint32_t index = 0; index < header.m_class_count; index++)
+            {
+                if (!is_valid_record(record, static_cast<size_t>(end - record)))
+                    except<std::runtime_error>("schema_view: corrupted class");
+                m_classes.emplace_back(record);
+                if (m_classes.back().id() >= m_next_type_id)
+                    except<std::runtime_error>("schema_view: corrupted class");
+                record += load<ClassRecord>(record).m_record_size;
+            }
+            address = header.m_next;
+        }
+
+        if (!std::is_sorted(
+              m_classes.begin(),
+              m_classes.end(),
+              [](const class_entry & i_first, const class_entry & i_second) {
+                  return i_first.name() < i_second.name();
+              }))
+        {
+            except<std::runtime_error>("schema_view: the classes are not sorted");
+        }
+    }
+
+    const schema_view::class_entry * schema_view::find_class(const string_view & i_name) const
+      noexcept
+    {
+        auto const it = std::lower_bound(
+          m_classes.begin(),
+          m_classes.end(),
+          i_name,
+          [](const class_entry & i_entry, const string_view & i_key) {
+              return i_entry.name() < i_key;
+          });
+        return it != m_classes.end() && it->name() == i_name ? &*it : nullptr;
+    }
+
+} // namespace cambrian
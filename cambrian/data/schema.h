@@ -0,0 +1,117 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "cambrian/cambrian_common.h"
+#include "cambrian/data/type_registry.h"
+#include "cambrian/storage/storage_device.h"
+#include <string>
+#include <vector>
+
+namespace cambrian
+{
+    /** Returns the name that identifies a type in a schema: the name of the type followed, for
+        containers, by the schema name of the elements in angle brackets, with an asterisk for
+        every level of indirection, so that the specializations of a container template have
+        different names. */
+    std::string schema_name(const type & i_type);
+
+    /** Writes the schema of the classes registered in a type_registry in a chain of pages
+        allocated from a storage_device, and returns the address of the first page. For every
+        class the schema stores the id, the schema name, the size and the alignment of its flat
+        layout (see flat_layout), the properties of the flat layout with the schema name of
+        their source type, the names of all the bases (direct and indirect, see
+        class_type::bases) and the schema name of the type of the elements. The classes are
+        sorted by name. Throws std::runtime_error if two classes have the same schema name, or
+        if the record of a class does not fit in a page. If an exception is thrown, the pages
+        allocated so far are deallocated. */
+    page_address write_schema(storage_device & i_device, type_registry & i_type_registry);
+
+    /** Deallocates all the pages of a schema */
+    void free_schema(storage_device & i_device, page_address i_first_page);
+
+    /** Read only view on a schema written by write_schema. The pages of the schema are mapped
+        for the whole life of the view, and the classes are read in place: the view only keeps
+        the addresses of their records. A type_registry constructed from a view assigns to the
+        classes the ids they have in the schema, matching them by name. */
+    class schema_view
+    {
+      public:
+        /** A property of the flat layout of a class */
+        struct property_entry
+        {
+            string_view m_name;
+            string_view m_type_name; /**< the schema name of the source type */
+            uint64_t    m_offset = 0;
+            uint64_t    m_size   = 0;
+        };
+
+        /** A class of the schema, pointing to its record in a mapped page */
+        class class_entry
+        {
+          public:
+            explicit class_entry(const unsigned char * i_record) noexcept : m_record(i_record)
+            {
+            }
+
+            type_id id() const noexcept;
+
+            string_view name() const noexcept;
+
+            uint64_t size() const noexcept;
+
+            uint64_t alignment() const noexcept;
+
+            size_t property_count() const noexcept;
+
+            property_entry get_property(size_t i_index) const noexcept;
+
+            /** Returns the index of the property with the given name, or property_count() */
+            size_t find_property(const string_view & i_name) const noexcept;
+
+            size_t base_count() const noexcept;
+
+            string_view base_name(size_t i_index) const noexcept;
+
+            bool is_container() const noexcept;
+
+            /** Returns the schema name of the type of the elements, or an empty string if the
+                class is not a container */
+            string_view element_type_name() const noexcept;
+
+            /** Returns whether a class registered in a type_registry has the same schema name
+                and flat layout of this class: same size and alignment, and the same properties,
+                in the same order, with the same source types and offsets. Objects of a class
+                with the same layout can be read with the plan of the registered class.
+                Otherwise the properties must be matched by name. */
+            bool same_layout(const type_registry::type_data & i_class_data) const;
+
+          private:
+            const unsigned char * m_record;
+        };
+
+        /** Maps all the pages of the schema. Throws std::runtime_error if the schema is
+            corrupted, and storage_device::error if a page can't be mapped. */
+        schema_view(storage_device & i_device, page_address i_first_page);
+
+        schema_view(const schema_view &) = delete;
+        schema_view & operator=(const schema_view &) = delete;
+
+        /** Returns the classes, sorted by name */
+        const std::vector<class_entry> & classes() const noexcept { return m_classes; }
+
+        /** Returns the class with the given schema name, or nullptr */
+        const class_entry * find_class(const string_view & i_name) const noexcept;
+
+        /** Returns the first id not used by the classes of the schema */
+        type_id next_type_id() const noexcept { return m_next_type_id; }
+
+      private:
+        std::vector<scoped_page> m_pages;
+        std::vector<class_entry> m_classes;
+        type_id                  m_next_type_id = 0;
+    };
+
+} // namespace cambrian
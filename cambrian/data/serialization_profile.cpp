@@ -0,0 +1,151 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "cambrian/data/serialization_profile.h"
+#include "ediacaran/core/string_builder.h"
+#include <algorithm>
+
+namespace cambrian
+{
+    namespace
+    {
+        template <typename ENTRY, typename KEY>
+        std::vector<ENTRY> sorted_entries(
+          const std::unordered_map<KEY, ENTRY> & i_entries, uint64_t ENTRY::*i_size)
+        {
+            std::vector<ENTRY> result;
+            result.reserve(i_entries.size());
+            for (auto const & entry : i_entries)
+                result.push_back(entry.second);
+            std::stable_sort(
+              result.begin(), result.end(), [&](const ENTRY & i_first, const ENTRY & i_second) {
+                  return i_first.*i_size > i_second.*i_size;
+              });
+            return result;
+        }
+
+        // percentage of the total size, in tenths
+        void write_share(string_builder & o_dest, uint64_t i_bytes, uint64_t i_total_bytes)
+        {
+            auto const tenths = i_total_bytes != 0 ? i_bytes * 1000 / i_total_bytes : 0;
+            o_dest << i_bytes << " bytes (" << tenths / 10 << '.' << tenths % 10 << "%)";
+        }
+    } // namespace
+
+    std::vector<serialization_profile::type_entry> serialization_profile::types() const
+    {
+        return sorted_entries(m_types, &type_entry::m_bytes);
+    }
+
+    std::vector<serialization_profile::property_entry> serialization_profile::properties() const
+    {
+        // properties of different classes with the same name are merged
+        std::unordered_map<std::string, property_entry> by_name;
+        for (auto const & entry : m_properties)
+        {
+            auto & merged = by_name[std::string(entry.second.m_name)];
+            merged.m_name = entry.second.m_name;
+            merged.m_value_count += entry.second.m_value_count;
+            merged.m_bytes += entry.second.m_bytes;
+        }
+        return sorted_entries(by_name, &property_entry::m_bytes);
+    }
+
+    std::vector<serialization_profile::container_entry> serialization_profile::containers() const
+    {
+        return sorted_entries(m_containers, &container_entry::m_marker_bytes);
+    }
+
+    std::string serialization_profile::report(size_t i_max_rows) const
+    {
+        string_builder result;
+        result << "total: " << m_total_bytes << " bytes, " << m_marker_count << " markers, ";
+        write_share(result, m_marker_bytes, m_total_bytes);
+        result << '\n';
+
+        result << "types, by size excluding nested objects:\n";
+        auto const types = this->types();
+        for (size_t index = 0; index < types.size() && index < i_max_rows; index++)
+        {
+            auto const & entry = types[index];
+            result << "  " << entry.m_type->name() << " (id " << entry.m_type_id
+                   << "): " << entry.m_object_count << " objects, ";
+            write_share(result, entry.m_bytes, m_total_bytes);
+            result << ", " << entry.m_total_bytes << " bytes with nested objects\n";
+        }
+
+        // nested values are counted in every property that contains them
+        result << "properties, by size including nested values:\n";
+        auto const properties = this->properties();
+        for (size_t index = 0; index < properties.size() && index < i_max_rows; index++)
+        {
+            auto const & entry = properties[index];
+            result << "  " << entry.m_name << ": " << entry.m_value_count << " values, "
+                   << entry.m_bytes << " bytes\n";
+        }
+
+        result << "containers, by size of the markers:\n";
+        auto const containers = this->containers();
+        for (size_t index = 0; index < containers.size() && index < i_max_rows; index++)
+        {
+            auto const & entry = containers[index];
+            result << "  " << entry.m_type->name() << " (id " << entry.m_type_id
+                   << "): " << entry.m_container_count << " containers, " << entry.m_element_count
+                   << " elements, " << entry.m_marker_count << " markers, ";
+            write_share(result, entry.m_marker_bytes, m_total_bytes);
+            result << '\n';
+        }
+        return result.to_string();
+    }
+
+    void serialization_profile::clear() noexcept
+    {
+        m_total_bytes  = 0;
+        m_marker_count = 0;
+        m_marker_bytes = 0;
+        m_types.clear();
+        m_properties.clear();
+        m_containers.clear();
+    }
+
+    void serialization_profile::add_object(
+      const type & i_type, type_id i_type_id, uint64_t i_bytes, uint64_t i_total_bytes)
+    {
+        auto & entry    = m_types[&i_type];
+        entry.m_type    = &i_type;
+        entry.m_type_id = i_type_id;
+        entry.m_object_count++;
+        entry.m_bytes += i_bytes;
+        entry.m_total_bytes += i_total_bytes;
+    }
+
+    void serialization_profile::add_container(
+      const type &     i_type,
+      type_id          i_type_id,
+      container::index i_element_count,
+      uint64_t         i_marker_count,
+      uint64_t         i_marker_bytes)
+    {
+        auto & entry    = m_containers[&i_type];
+        entry.m_type    = &i_type;
+        entry.m_type_id = i_type_id;
+        entry.m_container_count++;
+        entry.m_element_count += i_element_count;
+        entry.m_marker_count += i_marker_count;
+        entry.m_marker_bytes += i_marker_bytes;
+        m_marker_count += i_marker_count;
+        m_marker_bytes += i_marker_bytes;
+    }
+
+    void serialization_profile::add_property(
+      const property & i_property, uint64_t i_value_count, uint64_t i_bytes)
+    {
+        auto & entry = m_properties[&i_property];
+        entry.m_name = i_property.name();
+        entry.m_value_count += i_value_count;
+        entry.m_bytes += i_bytes;
+    }
+
+} // namespace cambrian
@@ -0,0 +1,94 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "cambrian/cambrian_common.h"
+#include "cambrian/data/type_registry.h"
+#include "ediacaran/reflection/reflection.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cambrian
+{
+    /** Breakdown of the size of the streams written by the binary_writers that use the profile
+        (see binary_writer::set_profile). The profile accumulates the data of all the streams,
+        and it is not thread safe. */
+    class serialization_profile
+    {
+      public:
+        struct type_entry
+        {
+            const type * m_type         = nullptr;
+            type_id      m_type_id      = 0;
+            uint64_t     m_object_count = 0;
+            uint64_t     m_bytes        = 0; /**< excluding the nested objects */
+            uint64_t     m_total_bytes  = 0; /**< including the nested objects */
+        };
+
+        /** The values of all the properties with the same name */
+        struct property_entry
+        {
+            string_view m_name;
+            uint64_t    m_value_count = 0;
+            uint64_t    m_bytes       = 0; /**< including the nested objects */
+        };
+
+        struct container_entry
+        {
+            const type * m_type            = nullptr;
+            type_id      m_type_id         = 0;
+            uint64_t     m_container_count = 0;
+            uint64_t     m_element_count   = 0;
+            uint64_t     m_marker_count    = 0;
+            uint64_t     m_marker_bytes    = 0;
+        };
+
+        uint64_t total_bytes() const noexcept { return m_total_bytes; }
+
+        uint64_t marker_count() const noexcept { return m_marker_count; }
+
+        uint64_t marker_bytes() const noexcept { return m_marker_bytes; }
+
+        /** Returns the classes, sorted by decreasing m_bytes */
+        std::vector<type_entry> types() const;
+
+        /** Returns the properties, sorted by decreasing m_bytes */
+        std::vector<property_entry> properties() const;
+
+        /** Returns the containers, sorted by decreasing m_marker_bytes */
+        std::vector<container_entry> containers() const;
+
+        /** Returns a human readable report, with at most i_max_rows rows for the types, the
+            properties and the containers */
+        std::string report(size_t i_max_rows = 16) const;
+
+        void clear() noexcept;
+
+      private:
+        friend class binary_writer;
+
+        void add_object(
+          const type & i_type, type_id i_type_id, uint64_t i_bytes, uint64_t i_total_bytes);
+
+        void add_container(
+          const type &     i_type,
+          type_id          i_type_id,
+          container::index i_element_count,
+          uint64_t         i_marker_count,
+          uint64_t         i_marker_bytes);
+
+        void add_property(const property & i_property, uint64_t i_value_count, uint64_t i_bytes);
+
+      private:
+        uint64_t                                             m_total_bytes  = 0;
+        uint64_t                                             m_marker_count = 0;
+        uint64_t                                             m_marker_bytes = 0;
+        std::unordered_map<const type *, type_entry>         m_types;
+        std::unordered_map<const property *, property_entry> m_properties;
+        std::unordered_map<const type *, container_entry>    m_containers;
+    };
+
+} // namespace cambrian
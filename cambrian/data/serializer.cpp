@@ -1,163 +1,850 @@
-
 //   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
 // Distributed under the Boost Software License, Version 1.0.
 //    (See accompanying file LICENSE_1_0.txt or copy at
 //          http://www.boost.org/LICENSE_1_0.txt)
 
 #include "cambrian/data/serializer.h"
+#include "cambrian/data/serialization_profile.h"
+#include <algorithm>
+#include <new>
 
 namespace cambrian
 {
-    binary_writer::Level::Level(const raw_ptr & i_object)
-        : m_prop_iterator(inspect_properties(i_object).begin()), m_element_iterator(i_object)
+    bool detail::get_interned_value(
+      const raw_ptr &            i_container,
+      const serialization_plan & i_plan,
+      size_t                     i_max_size,
+      interned_value &           io_value)
+    {
+        auto const container = i_plan.m_container;
+        if (
+          container == nullptr || !i_plan.m_operations.empty() ||
+          (container->capabilities() & container::capability::heterogeneous) !=
+            container::capability::none)
+        {
+            return false;
+        }
+        auto const & elements_type = container->elements_type();
+        if (elements_type.indirection_levels() != 0 || elements_type.final_type()->is_class())
+            return false;
+
+        auto const element_size = elements_type.final_type()->size();
+        io_value.m_plan         = &i_plan;
+        io_value.m_bytes.clear();
+        for (universal_iterator it(i_container); it != end_marker;)
+        {
+            auto const & segment = it.segment();
+            auto const   size    = static_cast<size_t>(segment.m_element_count * element_size);
+            if (size > i_max_size - io_value.m_bytes.size())
+                return false;
+            io_value.m_bytes.append(static_cast<const char *>(segment.m_elements), size);
+            it.advance_in_segment(segment.m_element_count);
+        }
+        return !io_value.m_bytes.empty();
+    }
+
+    binary_writer::Level::Level(const raw_ptr & i_object, const serialization_plan & i_plan)
+        : m_object(const_cast<void *>(i_object.object())),
+          m_type(i_object.qualified_type().final_type()), m_plan(&i_plan),
+          m_element_iterator(i_object)
+    {
+    }
+
+    uint64_t
+      binary_writer::identity_table::tag_of(const void * i_object, const type & i_type) const
+    {
+        if (i_object == nullptr)
+            return 0;
+        auto const it = m_ids.find({i_object, &i_type});
+        return it == m_ids.end() ? 1 : uint64_t(it->second) + 2;
+    }
+
+    void binary_writer::identity_table::add(const void * i_object, const type & i_type)
+    {
+        auto const id = m_ids.size();
+        if (id > std::numeric_limits<uint32_t>::max() - 2)
+            except<std::runtime_error>("binary_writer: too many objects");
+        m_ids.emplace(ObjectIdentity{i_object, &i_type}, static_cast<uint32_t>(id));
+    }
+
+    binary_writer::binary_writer(
+      type_registry & i_type_registry, const raw_ptr & i_source_object, wire_format i_format)
+        : m_type_registry(i_type_registry), m_root(i_source_object), m_format(i_format),
+          m_identities(m_own_identities)
     {
     }
 
-    binary_writer::binary_writer(type_registry & i_type_registry, const raw_ptr & i_source_object)
-        : m_type_registry(i_type_registry), m_curr_object(i_source_object)
+    binary_writer::binary_writer(
+      type_registry &  i_type_registry,
+      const raw_ptr &  i_source_object,
+      identity_table & io_identities,
+      wire_format      i_format)
+        : m_type_registry(i_type_registry), m_root(i_source_object), m_format(i_format),
+          m_identities(io_identities)
     {
     }
 
-    bool binary_writer::push_level(const raw_ptr & i_source_object)
+    binary_writer::binary_writer(
+      type_registry &   i_type_registry,
+      const raw_ptr &   i_source_object,
+      const partition & i_partition,
+      wire_format       i_format)
+        : m_type_registry(i_type_registry), m_root(i_source_object), m_format(i_format),
+          m_partitioned(true), m_partition(i_partition), m_identities(m_own_identities)
     {
-        auto const & qualified_type = i_source_object.qualified_type();
-        if (qualified_type.indirection_levels() != 0)
+        auto const & root_type = final_type_of(i_source_object.qualified_type());
+        auto const   container =
+          root_type.is_class() ? static_cast<const class_type &>(root_type).container() : nullptr;
+        if (
+          container == nullptr ||
+          (container->capabilities() & container::capability::contiguous) ==
+            container::capability::none)
+        {
+            except<std::invalid_argument>("binary_writer: the root is not a contiguous container");
+        }
+
+        // a partition can be empty only if the container is empty
+        universal_iterator const elements(i_source_object);
+        auto const               element_count = elements.segment().m_element_count;
+        if (
+          i_partition.m_first + i_partition.m_count > element_count ||
+          (i_partition.m_count == 0 && element_count != 0))
+        {
+            except<std::invalid_argument>("binary_writer: invalid partition");
+        }
+    }
+
+    binary_writer::~binary_writer()
+    {
+        while (m_depth > 0)
+            pop_level();
+    }
+
+    void binary_writer::enable_interning(size_t i_max_size)
+    {
+        CAMBRIAN_ASSERT(m_step_index == 0 && i_max_size > 0);
+        if (m_partitioned)
+        {
+            except<std::invalid_argument>(
+              "binary_writer: interning is not supported in partitions");
+        }
+        m_max_interned_size = i_max_size;
+    }
+
+    void binary_writer::set_profile(serialization_profile * io_profile) noexcept
+    {
+        CAMBRIAN_ASSERT(m_step_index == 0);
+        m_profile = io_profile;
+    }
+
+    const type & binary_writer::final_type_of(const qualified_type_ptr & i_qualified_type)
+    {
+        if (i_qualified_type.indirection_levels() != 0)
         {
             except<std::runtime_error>("attempt to serialize a pointer");
         }
+        CAMBRIAN_ASSERT(i_qualified_type.final_type() != nullptr);
+        return *i_qualified_type.final_type();
+    }
+
+    const type & binary_writer::pointed_type_of(const qualified_type_ptr & i_qualified_type)
+    {
+        if (i_qualified_type.indirection_levels() != 1)
+            except<std::runtime_error>("binary_writer: pointers to pointers are not supported");
 
-        auto const & actual_type = *qualified_type.final_type();
-        if (!actual_type.is_fundamental())
+        // the reader has to construct the pointed objects
+        auto const & pointed_type = *i_qualified_type.final_type();
+        if (!pointed_type.is_constructible())
         {
-            return false;
+            except<std::runtime_error>(
+              "binary_writer: the pointed type is not default constructible");
         }
-        else
+        return pointed_type;
+    }
+
+    void binary_writer::push_level(const raw_ptr & i_object, const serialization_plan & i_plan)
+    {
+        if (m_depth >= max_depth)
+            except<std::runtime_error>("binary_writer: the object is too deep");
+        new (&m_stack[m_depth]) Level(i_object, i_plan);
+        m_depth++;
+        if (m_profile != nullptr)
+            top().m_stats.m_start = stream_position();
+        if (m_max_interned_size != 0)
+            intern(top(), i_object);
+    }
+
+    void binary_writer::restrict_to_partition(Level & io_level) const
+    {
+        auto const element_count = io_level.m_element_iterator.segment().m_element_count;
+        if (m_partition.m_first > 0)
         {
-            m_stack.emplace_back(i_source_object);
-            return true;
+            // the properties and the begin flag belong to the first partition
+            io_level.m_operation_index = io_level.m_plan->m_operations.size();
+            io_level.m_first_run       = false;
+            io_level.m_element_iterator.advance_in_segment(m_partition.m_first);
         }
+        io_level.m_element_limit = m_partition.m_count;
+        io_level.m_end_marker    = m_partition.m_first + m_partition.m_count == element_count;
+    }
+
+    void binary_writer::pop_level() noexcept
+    {
+        top().~Level();
+        m_depth--;
     }
 
-    bool binary_writer::write_prop_value(byte_writer & i_dest, const raw_ptr & i_source_object)
+    bool binary_writer::write_object(byte_writer & i_dest, const raw_ptr & i_object)
     {
-        if (push_level(i_source_object))
+        auto const & object_type = final_type_of(i_object.qualified_type());
+        if (object_type.is_class())
         {
+            // the content of the object is written by the next iterations of step
+            push_level(i_object, *m_type_registry.get_type_data(object_type).m_plan);
+            return true;
         }
         else
         {
-            if (!i_dest.write_all_or_none(
-                  i_source_object.object(), i_source_object.qualified_type().final_type()->size()))
-            {
-                return binary_writer::more_space;
-            }
+            return write_value(
+              i_dest,
+              i_object.object(),
+              object_type.size(),
+              type_registry::compact_encoding_of(object_type));
         }
     }
 
-    binary_writer::result binary_writer::step(byte_writer & i_dest)
+    bool binary_writer::write_value(
+      byte_writer &  i_dest,
+      const void *   i_value,
+      size_t         i_size,
+      value_encoding i_encoding) const
     {
-        for (auto prop : inspect_properties(m_curr_object))
+        if (m_format == wire_format::fixed || i_encoding == value_encoding::raw)
+            return i_dest.write_all_or_none(i_value, i_size);
+
+        bool const    is_signed = i_encoding == value_encoding::zigzag_varint;
+        auto const    value     = load_integer(i_value, i_size, is_signed);
+        unsigned char buffer[max_varint_size];
+        auto const    size =
+          write_varint(buffer, is_signed ? zigzag_encode(static_cast<int64_t>(value)) : value);
+        return i_dest.write_all_or_none(buffer, size);
+    }
+
+    bool binary_writer::execute_operation(byte_writer & i_dest, Level & i_level)
+    {
+        using kind        = serialization_plan::operation::kind;
+        auto const & op   = i_level.m_plan->m_operations[i_level.m_operation_index];
+        auto const object = address_add(i_level.m_object, op.m_offset);
+        switch (op.m_kind)
+        {
+        case kind::copy:
         {
-            if (!write_prop_value(i_dest, prop.get_value()))
-                return binary_writer::more_space;
+            if (m_format == wire_format::compact)
+            {
+                // the values are written one by one, and are not split between buffers
+                for (; i_level.m_copied_size < op.m_field_count; i_level.m_copied_size++)
+                {
+                    auto const & field =
+                      i_level.m_plan->m_fields[op.m_first_field + i_level.m_copied_size];
+                    auto const value = address_add(i_level.m_object, field.m_offset);
+                    if (!write_value(i_dest, value, field.m_size, field.m_encoding))
+                        return false;
+                }
+                i_level.m_copied_size = 0;
+                break;
+            }
+
+            // a copy can be split between buffers
+            auto const size = std::min(
+              op.m_size - i_level.m_copied_size, static_cast<size_t>(i_dest.remaining_size()));
+            i_dest.write_unchecked(address_add(object, i_level.m_copied_size), size);
+            i_level.m_copied_size += size;
+            if (i_level.m_copied_size < op.m_size)
+                return false;
+            i_level.m_copied_size = 0;
+            break;
         }
 
-        void *      marker_dest = nullptr;
-        data_marker curr_marker;
-        auto        commit_marker = [&] {
-            if (marker_dest != nullptr)
+        case kind::object:
+            push_level(raw_ptr(object, qualified_type_ptr(op.m_class)), *op.m_plan);
+            break;
+
+        case kind::property:
+        {
+            auto const & qualified_type = op.m_property->qualified_type();
+            if (qualified_type.indirection_levels() != 0)
             {
-                memcpy(marker_dest, &curr_marker, sizeof(curr_marker));
+                auto const & pointed_type = pointed_type_of(qualified_type);
+                void *       pointed      = nullptr;
+                op.m_property->get(object, &pointed);
+                if (!write_pointer(i_dest, pointed, pointed_type))
+                    return false;
+                break;
             }
+            i_level.m_value.manual_construct(qualified_type, [&](void * i_value_dest) {
+                op.m_property->get(object, i_value_dest);
+            });
+            if (!write_object(i_dest, i_level.m_value))
+                return false;
+            break;
+        }
+        }
+        return true;
+    }
+
+    size_t binary_writer::marker_size(const data_marker & i_marker) const noexcept
+    {
+        return m_format == wire_format::compact ? i_marker.compact_size() : sizeof(data_marker);
+    }
+
+    void binary_writer::prepare_run(Level & i_level, const type & i_element_type, uint16_t i_flags)
+    {
+        auto const type_data       = m_type_registry.get_type_data(i_element_type);
+        i_level.m_marker           = data_marker{};
+        i_level.m_marker.m_type_id = type_data.m_id;
+        i_level.m_marker.m_flags   = i_flags;
+        i_level.m_run_plan         = type_data.m_plan;
+        i_level.m_run_type         = &i_element_type;
+        i_level.m_marker_step      = 0; // not written yet
+    }
+
+    void binary_writer::begin_run(byte_writer & i_dest, Level & i_level)
+    {
+        // the flag does not change the size of the marker
+        if (i_level.m_first_run)
+        {
+            i_level.m_marker.m_flags |= data_marker::flag_begin_comtainer;
+            i_level.m_first_run = false;
+        }
+        i_level.m_marker_step = m_step_index;
+        if (m_format == wire_format::compact)
+        {
+            auto const head = i_level.m_marker.compact_head();
+            write_varint(i_dest.skip(varint_size(head)), head);
+            i_level.m_marker_dest = i_dest.skip(data_marker::s_compact_count_size);
+        }
+        else
+        {
+            i_level.m_marker_dest = i_dest.skip(sizeof(data_marker));
+        }
+        i_level.m_stats.m_marker_count++;
+        i_level.m_stats.m_marker_bytes += marker_size(i_level.m_marker);
+    }
+
+    void binary_writer::add_to_run(Level & i_level, container::index i_count) noexcept
+    {
+        auto & marker  = i_level.m_marker;
+        marker.m_count = static_cast<uint16_t>(marker.m_count + i_count);
+        i_level.m_stats.m_element_count += i_count;
+        if (m_format == wire_format::compact)
+        {
+            write_padded_varint(
+              i_level.m_marker_dest, marker.m_count, data_marker::s_compact_count_size);
+        }
+        else
+        {
+            memcpy(i_level.m_marker_dest, &marker, sizeof(data_marker));
+        }
+    }
+
+    bool binary_writer::write_elements(byte_writer & i_dest, Level & i_level)
+    {
+        auto const & segment = i_level.m_element_iterator.segment();
+        auto const   element = *i_level.m_element_iterator;
+        if (element.qualified_type().indirection_levels() != 0)
+        {
+            return write_pointer_elements(
+              i_dest, i_level, pointed_type_of(element.qualified_type()));
+        }
+
+        auto const & element_type = final_type_of(element.qualified_type());
+        if (m_format == wire_format::compact)
+        {
+            auto const encoding = type_registry::compact_encoding_of(element_type);
+            if (encoding != value_encoding::raw)
+                return write_integer_elements(i_dest, i_level, element_type, encoding);
+        }
+
+        /* the marker of the current run can be updated only as long as it is in the buffer
+           of this step */
+        bool const new_run = i_level.m_marker_step != m_step_index ||
+                             i_level.m_run_type != &element_type ||
+                             i_level.m_marker.m_count == data_marker::s_max_count;
+
+        auto available_size = i_dest.remaining_size();
+        if (new_run)
+        {
+            prepare_run(i_level, element_type, data_marker::flag_none);
+            available_size -= static_cast<ptrdiff_t>(marker_size(i_level.m_marker));
+        }
+        if (available_size < 0)
+            return false;
+
+        // the marker and the values must be written together
+        container::index count = 1;
+        if (!element_type.is_class())
+        {
+            /* fundamentals and enums are copied in bulk from the segment, as many as fit in
+               the buffer and in the run */
+            container::index const max_in_run = data_marker::s_max_count - i_level.m_marker.m_count;
+            auto const max_in_buffer = static_cast<size_t>(available_size) / element_type.size();
+            count = std::min<container::index>(segment.m_element_count, max_in_run);
+            count = std::min<container::index>(count, max_in_buffer);
+            count = std::min<container::index>(count, i_level.m_element_limit);
+            if (count == 0)
+                return false;
+        }
+
+        if (new_run)
+            begin_run(i_dest, i_level);
+        add_to_run(i_level, count);
+        i_level.m_element_limit -= count;
+
+        if (element_type.is_class())
+        {
+            push_level(element, *i_level.m_run_plan);
+            i_level.m_advance = true;
+        }
+        else
+        {
+            auto const size = static_cast<size_t>(count * element_type.size());
+            i_dest.write_unchecked(segment.m_elements, size);
+            i_level.m_element_iterator.advance_in_segment(count);
+        }
+        return true;
+    }
+
+    bool binary_writer::write_integer_elements(
+      byte_writer & i_dest, Level & i_level, const type & i_type, value_encoding i_encoding)
+    {
+        auto const & segment      = i_level.m_element_iterator.segment();
+        auto const   element_size = i_type.size();
+        bool const   is_signed    = i_encoding == value_encoding::zigzag_varint;
+
+        /* values are compared and subtracted in an unsigned domain with the same order of the
+           elements: signed values are offset by 2^63 */
+        uint64_t const sign_offset = is_signed ? uint64_t(1) << 63 : 0;
+        auto const     ordered_at  = [&](container::index i_index) {
+            auto const element = address_add(segment.m_elements, i_index * element_size);
+            return load_integer(element, element_size, is_signed) + sign_offset;
         };
 
-        bool         first_element     = true;
-        type * const last_element_type = nullptr;
-        for (universal_iterator it(m_curr_object); it != end_marker; ++it)
+        bool const delta_run = (i_level.m_marker.m_flags & data_marker::flag_delta_encoded) != 0;
+        bool const new_run   = i_level.m_marker_step != m_step_index ||
+                             i_level.m_run_type != &i_type ||
+                             i_level.m_marker.m_count == data_marker::s_max_count ||
+                             (delta_run && ordered_at(0) < i_level.m_run_last);
+
+        container::index const max_in_run = data_marker::s_max_count -
+                                            (new_run ? 0 : i_level.m_marker.m_count);
+        auto const count_limit = std::min(
+          std::min<container::index>(segment.m_element_count, max_in_run),
+          i_level.m_element_limit);
+
+        auto available_size = i_dest.remaining_size();
+        if (new_run)
         {
-            auto const & qualified_type = (*it).qualified_type();
-            CAMBRIAN_ASSERT(qualified_type.final_type() != nullptr);
+            /* the run is delta encoded if the elements that may fit in the buffer are not
+               decreasing (every element takes at least a byte) */
+            auto const scan_count =
+              std::min<container::index>(count_limit, static_cast<size_t>(available_size));
+            bool delta = scan_count >= 2;
+            for (container::index index = 1; delta && index < scan_count; index++)
+                delta = ordered_at(index - 1) <= ordered_at(index);
 
-            if (
-              qualified_type.final_type() != last_element_type ||
-              curr_marker.m_count >= data_marker::s_max_count)
+            prepare_run(
+              i_level, i_type, delta ? data_marker::flag_delta_encoded : data_marker::flag_none);
+            available_size -= static_cast<ptrdiff_t>(marker_size(i_level.m_marker));
+        }
+
+        // the first element of a run is encoded like a single value
+        auto const encode = [&](container::index i_index) {
+            auto const value = ordered_at(i_index) - sign_offset;
+            return is_signed ? zigzag_encode(static_cast<int64_t>(value)) : value;
+        };
+        if (new_run && available_size < static_cast<ptrdiff_t>(varint_size(encode(0))))
+            return false;
+
+        if (new_run)
+            begin_run(i_dest, i_level);
+        bool const       delta = (i_level.m_marker.m_flags & data_marker::flag_delta_encoded) != 0;
+        container::index count = 0;
+        for (; count < count_limit; count++)
+        {
+            uint64_t payload;
+            if (delta && i_level.m_marker.m_count + count > 0)
             {
-                commit_marker();
+                auto const ordered = ordered_at(count);
+                if (ordered < i_level.m_run_last)
+                    break; // the next run will not be delta encoded
+                payload            = ordered - i_level.m_run_last;
+                i_level.m_run_last = ordered;
+            }
+            else
+            {
+                payload            = encode(count);
+                i_level.m_run_last = ordered_at(count);
+            }
 
-                auto const & type_data =
-                  m_type_registry.get_type_data(*qualified_type.final_type());
-                curr_marker           = {};
-                curr_marker.m_type_id = type_data.m_id;
+            if (i_dest.remaining_size() >= static_cast<ptrdiff_t>(max_varint_size))
+            {
+                i_dest.skip(write_varint(i_dest.next_byte(), payload));
+            }
+            else
+            {
+                unsigned char buffer[max_varint_size];
+                if (!i_dest.write_all_or_none(buffer, write_varint(buffer, payload)))
+                    break;
+            }
+        }
+        if (count == 0)
+            return false;
 
-                marker_dest = i_dest.skip(sizeof(data_marker));
+        add_to_run(i_level, count);
+        i_level.m_element_limit -= count;
+        i_level.m_element_iterator.advance_in_segment(count);
+        return true;
+    }
 
-                if (first_element)
-                {
-                    curr_marker.m_flags |= data_marker::flag_begin_comtainer;
-                    first_element = false;
-                }
+    size_t binary_writer::encode_pointer(
+      const void *    i_pointed,
+      const type &    i_pointed_type,
+      unsigned char * o_buffer,
+      bool &          o_new_object) const
+    {
+        // the ids would depend on the other partitions
+        if (m_partitioned)
+            except<std::runtime_error>("binary_writer: pointers are not supported in partitions");
+
+        auto const tag = m_identities.tag_of(i_pointed, i_pointed_type);
+        o_new_object   = tag == 1;
+
+        byte_writer dest(o_buffer, max_pointer_size);
+        if (m_format == wire_format::compact)
+        {
+            dest.skip(write_varint(o_buffer, tag));
+        }
+        else
+        {
+            auto const fixed_tag = static_cast<uint32_t>(tag);
+            dest.write_unchecked(&fixed_tag, sizeof(fixed_tag));
+        }
+
+        // the value of a fundamental or an enum is never split from the tag
+        if (o_new_object && !i_pointed_type.is_class())
+        {
+            CAMBRIAN_ASSERT(i_pointed_type.size() <= max_pointer_size - max_varint_size);
+            bool const written = write_value(
+              dest,
+              i_pointed,
+              i_pointed_type.size(),
+              type_registry::compact_encoding_of(i_pointed_type));
+            CAMBRIAN_ASSERT(written);
+            (void)written;
+        }
+        return max_pointer_size - static_cast<size_t>(dest.remaining_size());
+    }
+
+    void binary_writer::add_pointed_object(const void * i_pointed, const type & i_pointed_type)
+    {
+        m_identities.add(i_pointed, i_pointed_type);
+
+        // the content of a class is written by the next iterations of step
+        if (i_pointed_type.is_class())
+        {
+            push_level(
+              raw_ptr(const_cast<void *>(i_pointed), qualified_type_ptr(&i_pointed_type)),
+              *m_type_registry.get_type_data(i_pointed_type).m_plan);
+        }
+    }
+
+    bool binary_writer::write_pointer(
+      byte_writer & i_dest, const void * i_pointed, const type & i_type)
+    {
+        unsigned char buffer[max_pointer_size];
+        bool          new_object;
+        auto const    size = encode_pointer(i_pointed, i_type, buffer, new_object);
+        if (!i_dest.write_all_or_none(buffer, size))
+            return false;
+        if (new_object)
+            add_pointed_object(i_pointed, i_type);
+        return true;
+    }
+
+    bool binary_writer::write_pointer_elements(
+      byte_writer & i_dest, Level & i_level, const type & i_type)
+    {
+        void * pointed;
+        memcpy(&pointed, (*i_level.m_element_iterator).object(), sizeof(pointed));
+
+        // pointers are written one by one, in runs of the pointed type
+        bool const new_run = i_level.m_marker_step != m_step_index ||
+                             i_level.m_run_type != &i_type ||
+                             i_level.m_marker.m_count == data_marker::s_max_count;
+        auto available_size = i_dest.remaining_size();
+        if (new_run)
+        {
+            prepare_run(i_level, i_type, data_marker::flag_none);
+            available_size -= static_cast<ptrdiff_t>(marker_size(i_level.m_marker));
+        }
+
+        unsigned char buffer[max_pointer_size];
+        bool          new_object;
+        auto const    size = encode_pointer(pointed, i_type, buffer, new_object);
+        if (available_size < static_cast<ptrdiff_t>(size))
+            return false;
+
+        if (new_run)
+            begin_run(i_dest, i_level);
+        add_to_run(i_level, 1);
+        i_level.m_element_limit--;
+        i_dest.write_unchecked(buffer, size);
+
+        if (new_object)
+            add_pointed_object(pointed, i_type);
+
+        // a pointed class is written before advancing to the next element
+        if (new_object && i_type.is_class())
+            i_level.m_advance = true;
+        else
+            ++i_level.m_element_iterator;
+        return true;
+    }
+
+    bool binary_writer::write_end_marker(byte_writer & i_dest, Level & i_level)
+    {
+        data_marker marker;
+        marker.m_flags = data_marker::flag_end_comtainer;
+        if (i_level.m_first_run)
+            marker.m_flags |= data_marker::flag_begin_comtainer; // empty container
+
+        unsigned char buffer[max_varint_size];
+        static_assert(sizeof(data_marker) <= sizeof(buffer));
+        size_t size = sizeof(marker);
+        if (m_format == wire_format::compact)
+            size = write_varint(buffer, marker.compact_head());
+        else
+            memcpy(buffer, &marker, sizeof(marker));
+        if (!i_dest.write_all_or_none(buffer, size))
+            return false;
+        i_level.m_stats.m_marker_count++;
+        i_level.m_stats.m_marker_bytes += size;
+        return true;
+    }
+
+    void binary_writer::intern(Level & io_level, const raw_ptr & i_object)
+    {
+        if (!detail::get_interned_value(
+              i_object, *io_level.m_plan, m_max_interned_size, m_interned_value))
+        {
+            return;
+        }
+
+        auto const it = m_interned_ids.find(m_interned_value);
+        if (it != m_interned_ids.end())
+        {
+            io_level.m_interned    = true;
+            io_level.m_interned_id = it->second;
+        }
+        else
+        {
+            // the first occurrence is written as usual
+            auto const id = m_interned_ids.size();
+            if (id > std::numeric_limits<uint32_t>::max())
+                except<std::runtime_error>("binary_writer: too many interned values");
+            m_interned_ids.emplace(std::move(m_interned_value), static_cast<uint32_t>(id));
+        }
+    }
+
+    bool binary_writer::write_interned_marker(byte_writer & i_dest, Level & io_level)
+    {
+        auto const & element_type = *io_level.m_plan->m_container->elements_type().final_type();
+        data_marker  marker;
+        marker.m_type_id = m_type_registry.get_type_data(element_type).m_id;
+        marker.m_flags   = data_marker::flags_interned;
+
+        // the marker and the id are never split between buffers
+        unsigned char buffer[2 * max_varint_size];
+        static_assert(sizeof(data_marker) + sizeof(uint32_t) <= sizeof(buffer));
+        size_t size;
+        if (m_format == wire_format::compact)
+        {
+            size = write_varint(buffer, marker.compact_head());
+            size += write_varint(buffer + size, io_level.m_interned_id);
+        }
+        else
+        {
+            memcpy(buffer, &marker, sizeof(marker));
+            memcpy(buffer + sizeof(marker), &io_level.m_interned_id, sizeof(uint32_t));
+            size = sizeof(marker) + sizeof(uint32_t);
+        }
+        if (!i_dest.write_all_or_none(buffer, size))
+            return false;
+        io_level.m_stats.m_marker_count++;
+        io_level.m_stats.m_marker_bytes += size;
+        return true;
+    }
+
+    uint64_t binary_writer::stream_position() const noexcept
+    {
+        CAMBRIAN_ASSERT(m_step_dest != nullptr);
+        auto const written = m_step_dest_size - m_step_dest->remaining_size();
+        return m_step_position + static_cast<uint64_t>(written);
+    }
+
+    size_t binary_writer::encoded_size(
+      const void * i_value, size_t i_size, value_encoding i_encoding) const
+    {
+        if (m_format == wire_format::fixed || i_encoding == value_encoding::raw)
+            return i_size;
+        bool const is_signed = i_encoding == value_encoding::zigzag_varint;
+        auto const value     = load_integer(i_value, i_size, is_signed);
+        return varint_size(is_signed ? zigzag_encode(static_cast<int64_t>(value)) : value);
+    }
+
+    void binary_writer::profile_operation(Level & i_level, size_t i_prev_depth, uint64_t i_start)
+    {
+        auto const & op = i_level.m_plan->m_operations[i_level.m_operation_index];
+        if (op.m_kind == serialization_plan::operation::kind::copy)
+        {
+            // a copy may be written in many steps, so the sizes of the fields are computed
+            for (size_t index = 0; index < op.m_field_count; index++)
+            {
+                auto const & field = i_level.m_plan->m_fields[op.m_first_field + index];
+                auto const   value = address_add(i_level.m_object, field.m_offset);
+                m_profile->add_property(
+                  *field.m_property, 1, encoded_size(value, field.m_size, field.m_encoding));
             }
+            return;
+        }
 
-            if (!write_prop_value(i_dest, *it))
-                return binary_writer::more_space;
+        // the content of a nested object is added when its level is popped
+        if (m_depth > i_prev_depth)
+            top().m_stats.m_property = op.m_property;
+        m_profile->add_property(*op.m_property, 1, stream_position() - i_start);
+    }
 
-            curr_marker.m_count++;
+    void binary_writer::profile_pop(const Level & i_level)
+    {
+        auto const & stats       = i_level.m_stats;
+        auto const   total_bytes = stream_position() - stats.m_start;
+        auto const   type_id     = m_type_registry.get_type_data(*i_level.m_type).m_id;
+        m_profile->add_object(
+          *i_level.m_type, type_id, total_bytes - stats.m_nested_bytes, total_bytes);
+        if (i_level.m_plan->m_container != nullptr)
+        {
+            m_profile->add_container(
+              *i_level.m_type,
+              type_id,
+              stats.m_element_count,
+              stats.m_marker_count,
+              stats.m_marker_bytes);
+        }
+        if (stats.m_property != nullptr)
+            m_profile->add_property(*stats.m_property, 0, total_bytes);
+        if (m_depth > 1)
+        {
+            auto & parent = reinterpret_cast<Level &>(m_stack[m_depth - 2]);
+            parent.m_stats.m_nested_bytes += total_bytes;
         }
+    }
 
-        curr_marker.m_flags |= data_marker::flag_end_comtainer;
-        commit_marker();
+    binary_writer::result binary_writer::step(byte_writer & i_dest)
+    {
+        if (m_profile == nullptr)
+            return write_step(i_dest);
 
-        return binary_writer::finished;
+        // the position in the stream is tracked for the profile
+        m_step_dest        = &i_dest;
+        m_step_dest_size   = i_dest.remaining_size();
+        auto const result  = write_step(i_dest);
+        auto const written = static_cast<uint64_t>(m_step_dest_size - i_dest.remaining_size());
+        m_step_position += written;
+        m_profile->m_total_bytes += written;
+        m_step_dest = nullptr;
+        return result;
     }
 
-    /*binary_writer::result binary_writer::step(byte_writer & i_dest)
+    binary_writer::result binary_writer::write_step(byte_writer & i_dest)
     {
-        if (m_curr_object)
+        m_step_index++;
+
+        auto const initial_size = i_dest.remaining_size();
+        auto const out_of_space = [&] {
+            if (i_dest.remaining_size() == initial_size)
+                except<std::invalid_argument>("binary_writer: the buffer is too small");
+            return more_space;
+        };
+
+        if (m_root)
         {
-            if (!write_object(i_dest, m_curr_object, wo_add_marker))
-                return more_space;
-            m_curr_object = {};
+            // the root has the id 0, unless the identity table is shared
+            if (m_identities.empty())
+                m_identities.add(m_root.object(), final_type_of(m_root.qualified_type()));
+            if (!write_object(i_dest, m_root))
+                return out_of_space();
+            if (m_partitioned)
+                restrict_to_partition(top());
+            m_root = {};
         }
 
-        while (!m_stack.empty())
+        while (m_depth > 0)
         {
-            auto & level = m_stack.back();
+            auto & level = top();
 
-            if (level.m_move_next_property)
+            // a container that has already been written is replaced by a reference
+            if (level.m_interned)
             {
-                CAMBRIAN_ASSERT(level.m_prop_iterator != end_marker);
-                ++level.m_prop_iterator;
-                level.m_move_next_property = false;
+                if (!write_interned_marker(i_dest, level))
+                    return out_of_space();
+                if (m_profile != nullptr)
+                    profile_pop(level);
+                pop_level();
+                continue;
             }
 
-            if (level.m_move_next_element)
+            /* the current operation or element is advanced only when the level is on top
+               again, so that a child level can use the value of a property */
+            auto const operation_count = level.m_plan->m_operations.size();
+            if (level.m_advance)
             {
-                CAMBRIAN_ASSERT(level.m_element_iterator != end_marker);
-                ++level.m_element_iterator;
-                level.m_move_next_element = false;
+                level.m_advance = false;
+                if (level.m_operation_index < operation_count)
+                    level.m_operation_index++;
+                else
+                    ++level.m_element_iterator;
             }
 
-            if (level.m_prop_iterator != end_marker)
+            if (level.m_operation_index < operation_count)
             {
-                if (!write_object(i_dest, (*level.m_prop_iterator).get_value(), wo_none))
-                    return more_space;
-                level.m_move_next_property = true;
+                auto const depth = m_depth;
+                auto const start = m_profile != nullptr ? stream_position() : 0;
+                if (!execute_operation(i_dest, level))
+                    return out_of_space();
+                if (m_profile != nullptr)
+                    profile_operation(level, depth, start);
+                level.m_advance = true;
             }
-            else if (level.m_element_iterator != end_marker)
+            else if (level.m_element_iterator != end_marker && level.m_element_limit > 0)
             {
-                if (level.m_first_element)
-                    data_marker::flag_begin_comtainer;
-
-                if (!write_object(i_dest, *level.m_element_iterator, wo_add_marker))
-                    return more_space;
-                level.m_first_element     = false;
-                level.m_move_next_element = true;
+                if (!write_elements(i_dest, level))
+                    return out_of_space();
             }
             else
             {
-                m_stack.pop_back();
+                if (
+                  level.m_plan->m_container != nullptr && level.m_end_marker &&
+                  !write_end_marker(i_dest, level))
+                {
+                    return out_of_space();
+                }
+                if (m_profile != nullptr)
+                    profile_pop(level);
+                pop_level();
             }
         }
+
         return finished;
-    }*/
+    }
 
 } // namespace cambrian
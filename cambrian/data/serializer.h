@@ -1,4 +1,3 @@
-
 //   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
 // Distributed under the Boost Software License, Version 1.0.
 //    (See accompanying file LICENSE_1_0.txt or copy at
@@ -7,17 +6,22 @@
 #pragma once
 #include "cambrian/cambrian_common.h"
 #include "cambrian/data/type_registry.h"
+#include "cambrian/data/varint.h"
 #include "ediacaran/core/array_view.h"
 #include "ediacaran/core/byte_writer.h"
 #include "ediacaran/core/expected.h"
-#include "ediacaran/utils/inspect.h"
+#include "ediacaran/utils/dyn_value.h"
 #include "ediacaran/utils/raw_ptr.h"
 #include "ediacaran/utils/universal_iterator.h"
-#include <deque>
 #include <limits>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
 
 namespace cambrian
 {
+    class serialization_profile;
+
     struct data_marker
     {
         type_id  m_type_id = 0;
@@ -31,15 +35,224 @@ namespace cambrian
             flag_none            = 0,
             flag_begin_comtainer = 1 << 0,
             flag_end_comtainer   = 1 << 1,
+            flag_delta_encoded   = 1 << 2, /**< compact format only, see wire_format */
+
+            /** A container replaced by a reference to an interned value. In both the formats
+                it is the only marker of the container, and it is followed by the id. */
+            flags_interned = flag_begin_comtainer | flag_end_comtainer | flag_delta_encoded,
         };
 
+        /** In the compact format a marker is the varint of compact_head(), followed, unless
+            the marker ends the container, by m_count as a varint padded to
+            s_compact_count_size bytes, so that it can be updated in place. */
+        constexpr static size_t s_compact_count_size = 3;
+        static_assert(varint_max_value(s_compact_count_size) >= s_max_count);
+
+        uint64_t compact_head() const noexcept
+        {
+            return (static_cast<uint64_t>(m_type_id) << 3) | m_flags;
+        }
+
+        size_t compact_size() const noexcept
+        {
+            return varint_size(compact_head()) +
+                   ((m_flags & flag_end_comtainer) != 0 ? 0 : s_compact_count_size);
+        }
+
         data_marker() : m_type_id(0), m_count(0), m_flags(0) {}
     };
 
+    enum class wire_format
+    {
+        /** the format described by binary_writer */
+        fixed,
+
+        /** Like fixed, but integers wider than a byte (see type_registry::compact_encoding_of)
+            are written as varints, using the zigzag encoding for signed types, and markers
+            are written as varints. A run of integer elements that is not decreasing is
+            written with the flag flag_delta_encoded: its first element is encoded as usual,
+            and every other element is written as the varint of its difference from the
+            previous one. Values are never split between buffers. */
+        compact
+    };
+
+    namespace detail
+    {
+        /** The content of a container that can be interned, see binary_writer::enable_interning */
+        struct interned_value
+        {
+            const serialization_plan * m_plan = nullptr;
+            std::string                m_bytes;
+
+            bool operator==(const interned_value & i_other) const noexcept
+            {
+                return m_plan == i_other.m_plan && m_bytes == i_other.m_bytes;
+            }
+        };
+
+        struct interned_value_hash
+        {
+            size_t operator()(const interned_value & i_value) const noexcept
+            {
+                return std::hash<std::string>()(i_value.m_bytes) ^
+                       reinterpret_cast<uintptr_t>(i_value.m_plan);
+            }
+        };
+
+        /** Assigns to io_value the raw bytes of the elements of a container, and returns true,
+            if the container can be interned: it must be not empty, it must have no properties,
+            its elements must be fundamentals or enums, and their total size must not exceed
+            i_max_size. The writer and the reader intern the same containers with this
+            function. */
+        bool get_interned_value(
+          const raw_ptr &            i_container,
+          const serialization_plan & i_plan,
+          size_t                     i_max_size,
+          interned_value &           io_value);
+
+    } // namespace detail
+
+    /** Serializes an object to a sequence of buffers. The stream is the concatenation of the
+        used part of the buffers.
+        Fundamental types and enums are written as their raw bytes. A class is written as the
+        values of its properties (including the ones of the base classes), in the order given by
+        property_inspector. If the class is a container, the properties are followed by the
+        elements, in runs: every run is a data_marker followed by m_count elements of the type
+        m_type_id. The first run has the flag flag_begin_comtainer, and the elements are
+        terminated by a marker with no elements and the flag flag_end_comtainer. An empty
+        container is written as a single marker with both flags.
+        Elements of fundamental or enum type are copied in bulk from the segments of the
+        container, and a segment is split between buffers at the boundary of an element.
+        A marker is completed while the following elements are written, so a run never crosses
+        the boundary of a buffer. Markers and property values are never split between two
+        buffers, except the copies of the serialization_plan of the classes, that are split at
+        any byte.
+        The properties of the classes are written executing the plan provided by the
+        type_registry. The writer does not allocate memory, except for the type registry, for
+        the properties accessed with a getter and for the identity table of the pointers.
+        With wire_format::compact integers and markers are written as varints.
+        Pointers are written through an identity table, so that an object reachable by many
+        pointers is written only once. A pointer is written as a tag (an uint32_t, or a varint
+        with wire_format::compact): 0 for null, 1 if the pointed object follows, k + 2 for a
+        reference to the object with id k. Objects get consecutive ids in the order they are
+        written, starting from the root, that has the id 0. Since an object is registered
+        before its content is written, pointers can form cycles. The pointed object is written
+        according to the static type of the pointer, and objects embedded in other objects are
+        identified only by pointers to them. An element of a container that is a pointer is
+        written like a value of the pointed type, and the markers of its runs have the
+        type_id of the pointed type. Pointers to pointers are not supported, and pointers are
+        not supported by partitioned writers. Every object written through a pointer
+        contributes to the nesting depth.
+        If interning is enabled, the small containers of values that occur more than once in
+        the stream (like strings) are written only the first time, see enable_interning. */
     class binary_writer
     {
       public:
-        binary_writer(type_registry & i_type_registry, const raw_ptr & i_source_object);
+        /** Maximum nesting depth of objects. Deeper objects cause a std::runtime_error. */
+        constexpr static size_t max_depth = 64;
+
+        binary_writer(
+          type_registry & i_type_registry,
+          const raw_ptr & i_source_object,
+          wire_format     i_format = wire_format::fixed);
+
+        /** A range of the elements of the root object */
+        struct partition
+        {
+            container::index m_first = 0;
+            container::index m_count = 0;
+        };
+
+        /** Constructs a writer that writes only a partition of the elements of the root, that
+            must be a contiguous container. The properties of the root are written only if the
+            partition starts at the first element, and the end marker only if it ends at the
+            last one, so the concatenation of the streams of consecutive partitions is the
+            stream of the whole object. Throws std::invalid_argument if the root is not a
+            contiguous container, or if the partition exceeds its size. */
+        binary_writer(
+          type_registry &   i_type_registry,
+          const raw_ptr &   i_source_object,
+          const partition & i_partition,
+          wire_format       i_format = wire_format::fixed);
+
+        /** The ids of the objects written through pointers. A table can be shared by writers
+            whose streams are concatenated, so that a stream can refer to the objects written in
+            the previous ones: a writer assigns the id 0 to its root only if the table is empty.
+            serialize (see static_serializer.h) shares a table with the writers it uses. */
+        class identity_table
+        {
+          public:
+            /** Returns the tag of a pointer to an object: 0 for null, 1 if the object has not
+                been written yet, k + 2 if it has the id k */
+            uint64_t tag_of(const void * i_object, const type & i_type) const;
+
+            /** Assigns the next id to an object. Throws std::runtime_error if there are too many
+                objects. */
+            void add(const void * i_object, const type & i_type);
+
+            bool empty() const noexcept { return m_ids.empty(); }
+
+          private:
+            struct ObjectIdentity
+            {
+                const void * m_address;
+                const type * m_type;
+
+                bool operator==(const ObjectIdentity & i_other) const noexcept
+                {
+                    return m_address == i_other.m_address && m_type == i_other.m_type;
+                }
+            };
+
+            struct ObjectIdentityHash
+            {
+                size_t operator()(const ObjectIdentity & i_identity) const noexcept
+                {
+                    auto const address = reinterpret_cast<uintptr_t>(i_identity.m_address);
+                    return static_cast<size_t>((address * UINT64_C(0x9E3779B97F4A7C15)) >> 16) ^
+                           reinterpret_cast<uintptr_t>(i_identity.m_type);
+                }
+            };
+
+          private:
+            std::unordered_map<ObjectIdentity, uint32_t, ObjectIdentityHash> m_ids;
+        };
+
+        /** Constructs a writer that uses an identity table shared with other writers. The
+            table must outlive the writer. */
+        binary_writer(
+          type_registry &  i_type_registry,
+          const raw_ptr &  i_source_object,
+          identity_table & io_identities,
+          wire_format      i_format = wire_format::fixed);
+
+        binary_writer(const binary_writer &) = delete;
+        binary_writer & operator=(const binary_writer &) = delete;
+
+        ~binary_writer();
+
+        /** Default maximum size of the elements of an interned container, in bytes */
+        constexpr static size_t default_max_interned_size = 256;
+
+        /** Enables the interning of small containers of values, that must be enabled on the
+            reader too. The writer keeps a dictionary of the content of the containers that
+            have no properties, whose elements are fundamentals or enums, and whose elements
+            take at most i_max_size bytes (for example strings). The first occurrence of a
+            content is written as usual, and gets the next id, starting from zero. Every
+            following occurrence with the same type is written as a single marker with the
+            flags flags_interned and the type_id of the elements, followed by the id (an
+            uint32_t, or a varint with wire_format::compact). Must be called before the first
+            step. Throws std::invalid_argument if the writer is partitioned, as the ids would
+            depend on the other partitions. */
+        void enable_interning(size_t i_max_size = default_max_interned_size);
+
+        /** Enables the instrumentation of the writer, that adds to the profile the bytes
+            written for every class, for every property and for the markers of every
+            container. A null profile disables the instrumentation. The size of an object
+            includes the markers of its elements, and the size of a property includes the
+            objects it contains. Must be called before the first step, and the profile must
+            outlive the writer. */
+        void set_profile(serialization_profile * io_profile) noexcept;
 
         enum result
         {
@@ -47,27 +260,145 @@ namespace cambrian
             more_space
         };
 
+        /** Writes to the buffer as much as possible. If the result is more_space, the caller
+            should call step again with a new buffer. Every call resumes from the point where
+            the previous one stopped. Throws std::invalid_argument if the buffer is too small
+            to store even a single value. */
         EDI_NODISCARD result step(byte_writer & i_dest);
 
       private:
-        bool push_level(const raw_ptr & i_source_object);
-
-        bool write_prop_value(byte_writer & i_dest, const raw_ptr & i_source_object);
+        /** Measures of a level, used only by the profile */
+        struct LevelStats
+        {
+            const property * m_property      = nullptr; /**< the property containing the object */
+            uint64_t         m_start         = 0;       /**< the position in the stream */
+            uint64_t         m_nested_bytes  = 0;
+            uint64_t         m_marker_count  = 0;
+            uint64_t         m_marker_bytes  = 0;
+            container::index m_element_count = 0;
+        };
 
-      private:
         struct Level
         {
-            property_inspector::iterator m_prop_iterator;
-            universal_iterator           m_element_iterator;
-            bool                         m_move_next_property = false;
-            bool                         m_move_next_element  = false;
-            bool                         m_first_element      = true;
-            data_marker *                marker               = nullptr;
-            Level(const raw_ptr & i_object);
+            void * const                     m_object;
+            const type * const               m_type;
+            const serialization_plan * const m_plan;
+            universal_iterator               m_element_iterator;
+            size_t                           m_operation_index = 0;
+            size_t                           m_copied_size     = 0; /**< or fields, if compact */
+            bool                             m_advance         = false;
+            bool                             m_first_run       = true;
+            const type *                     m_run_type        = nullptr;
+            const serialization_plan *       m_run_plan        = nullptr;
+            void *                           m_marker_dest     = nullptr;
+            uint64_t                         m_marker_step     = 0;
+            uint64_t                         m_run_last        = 0; /**< for flag_delta_encoded */
+            container::index                 m_element_limit   = ~container::index(0);
+            bool                             m_end_marker      = true;
+            bool                             m_interned        = false;
+            uint32_t                         m_interned_id     = 0;
+            data_marker                      m_marker;
+            dyn_value                        m_value;
+            LevelStats                       m_stats;
+
+            Level(const raw_ptr & i_object, const serialization_plan & i_plan);
         };
-        type_registry &   m_type_registry;
-        std::deque<Level> m_stack;
-        raw_ptr           m_curr_object;
+
+        using LevelStorage = std::aligned_storage_t<sizeof(Level), alignof(Level)>;
+
+        result write_step(byte_writer & i_dest);
+
+        Level & top() noexcept
+        {
+            CAMBRIAN_ASSERT(m_depth > 0);
+            return reinterpret_cast<Level &>(m_stack[m_depth - 1]);
+        }
+
+        static const type & final_type_of(const qualified_type_ptr & i_qualified_type);
+
+        static const type & pointed_type_of(const qualified_type_ptr & i_qualified_type);
+
+        void push_level(const raw_ptr & i_object, const serialization_plan & i_plan);
+
+        void restrict_to_partition(Level & io_level) const;
+
+        void pop_level() noexcept;
+
+        bool write_object(byte_writer & i_dest, const raw_ptr & i_object);
+
+        bool write_value(
+          byte_writer &  i_dest,
+          const void *   i_value,
+          size_t         i_size,
+          value_encoding i_encoding) const;
+
+        size_t marker_size(const data_marker & i_marker) const noexcept;
+
+        void prepare_run(Level & i_level, const type & i_element_type, uint16_t i_flags);
+
+        void begin_run(byte_writer & i_dest, Level & i_level);
+
+        void add_to_run(Level & i_level, container::index i_count) noexcept;
+
+        bool execute_operation(byte_writer & i_dest, Level & i_level);
+
+        bool write_elements(byte_writer & i_dest, Level & i_level);
+
+        bool write_integer_elements(
+          byte_writer & i_dest, Level & i_level, const type & i_type, value_encoding i_encoding);
+
+        /** Maximum size of an encoded pointer: the tag and the value of a fundamental or
+            an enum */
+        constexpr static size_t max_pointer_size = max_varint_size + 16;
+
+        size_t encode_pointer(
+          const void *    i_pointed,
+          const type &    i_pointed_type,
+          unsigned char * o_buffer,
+          bool &          o_new_object) const;
+
+        void add_pointed_object(const void * i_pointed, const type & i_pointed_type);
+
+        bool write_pointer(byte_writer & i_dest, const void * i_pointed, const type & i_type);
+
+        bool write_pointer_elements(byte_writer & i_dest, Level & i_level, const type & i_type);
+
+        bool write_end_marker(byte_writer & i_dest, Level & i_level);
+
+        void intern(Level & io_level, const raw_ptr & i_object);
+
+        bool write_interned_marker(byte_writer & i_dest, Level & io_level);
+
+        uint64_t stream_position() const noexcept;
+
+        size_t encoded_size(const void * i_value, size_t i_size, value_encoding i_encoding) const;
+
+        void profile_operation(Level & i_level, size_t i_prev_depth, uint64_t i_start);
+
+        void profile_pop(const Level & i_level);
+
+      private:
+        using InternedIdMap =
+          std::unordered_map<detail::interned_value, uint32_t, detail::interned_value_hash>;
+
+      private:
+        type_registry &         m_type_registry;
+        raw_ptr                 m_root;
+        wire_format const       m_format;
+        bool const              m_partitioned = false;
+        partition const         m_partition;
+        uint64_t                m_step_index = 0;
+        size_t                  m_depth      = 0;
+        LevelStorage            m_stack[max_depth];
+        identity_table          m_own_identities;
+        identity_table &        m_identities;
+        size_t                  m_max_interned_size = 0; /**< zero if interning is disabled */
+        InternedIdMap           m_interned_ids;
+        detail::interned_value  m_interned_value; /**< to avoid allocations in intern */
+        serialization_profile * m_profile        = nullptr;
+        uint64_t                m_step_position  = 0; /**< at the start of the step */
+        const byte_writer *     m_step_dest      = nullptr;
+        ptrdiff_t               m_step_dest_size = 0;
     };
 
 } // namespace cambrian
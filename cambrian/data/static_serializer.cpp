@@ -0,0 +1,233 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "cambrian/data/static_serializer.h"
+#include "ediacaran/utils/dyn_value.h"
+
+namespace cambrian
+{
+    namespace detail
+    {
+        namespace
+        {
+            // writes an object whose type is known only by the reflection
+            void write_dynamic(
+              static_writer & io_writer, byte_writer & o_dest, const raw_ptr & i_object)
+            {
+                binary_writer writer(io_writer.m_type_registry, i_object, io_writer.m_identities);
+                if (writer.step(o_dest) != binary_writer::finished)
+                    except<std::runtime_error>("byte_writer is out of space");
+            }
+
+            // reads an object whose type is known only by the reflection
+            void read_dynamic(
+              static_reader & io_reader, byte_reader & i_source, const raw_ptr & o_object)
+            {
+                binary_reader reader(io_reader.m_type_registry, o_object, io_reader.m_identities);
+                if (reader.step(i_source) != binary_reader::finished)
+                    except<std::runtime_error>("byte_reader is out of space");
+            }
+
+            const type & pointed_type_of(const qualified_type_ptr & i_qualified_type)
+            {
+                if (i_qualified_type.indirection_levels() != 1)
+                    except<std::runtime_error>("pointers to pointers are not supported");
+                return *i_qualified_type.final_type();
+            }
+        } // namespace
+
+        void write_plan(
+          static_writer &            io_writer,
+          byte_writer &              o_dest,
+          const void *               i_object,
+          const serialization_plan & i_plan)
+        {
+            using kind = serialization_plan::operation::kind;
+            for (auto const & op : i_plan.m_operations)
+            {
+                auto const object = address_add(i_object, op.m_offset);
+                switch (op.m_kind)
+                {
+                case kind::copy:
+                    if (!o_dest.write_all_or_none(object, op.m_size))
+                        except<std::runtime_error>("byte_writer is out of space");
+                    break;
+
+                case kind::object:
+                    write_dynamic(
+                      io_writer,
+                      o_dest,
+                      raw_ptr(const_cast<void *>(object), qualified_type_ptr(op.m_class)));
+                    break;
+
+                case kind::property:
+                {
+                    auto const & qualified_type = op.m_property->qualified_type();
+                    if (qualified_type.indirection_levels() != 0)
+                    {
+                        auto const & pointed_type = pointed_type_of(qualified_type);
+                        void *       pointed      = nullptr;
+                        op.m_property->get(object, &pointed);
+                        if (write_pointer(io_writer, o_dest, pointed, pointed_type))
+                        {
+                            write_dynamic(
+                              io_writer,
+                              o_dest,
+                              raw_ptr(pointed, qualified_type_ptr(&pointed_type)));
+                        }
+                        break;
+                    }
+                    dyn_value value;
+                    value.manual_construct(qualified_type, [&](void * i_value_dest) {
+                        op.m_property->get(object, i_value_dest);
+                    });
+                    write_dynamic(io_writer, o_dest, value);
+                    break;
+                }
+                }
+            }
+        }
+
+        void read_plan(
+          static_reader &            io_reader,
+          byte_reader &              i_source,
+          void *                     o_object,
+          const serialization_plan & i_plan)
+        {
+            using kind = serialization_plan::operation::kind;
+            for (auto const & op : i_plan.m_operations)
+            {
+                auto const object = address_add(o_object, op.m_offset);
+                switch (op.m_kind)
+                {
+                case kind::copy:
+                    if (!i_source.read_all_or_none(object, op.m_size))
+                        except<std::runtime_error>("byte_reader is out of space");
+                    break;
+
+                case kind::object:
+                    read_dynamic(
+                      io_reader, i_source, raw_ptr(object, qualified_type_ptr(op.m_class)));
+                    break;
+
+                case kind::property:
+                {
+                    auto const & qualified_type = op.m_property->qualified_type();
+                    if (qualified_type.indirection_levels() != 0)
+                    {
+                        // the pointer is assigned before reading the pointed object
+                        auto const & pointed_type = pointed_type_of(qualified_type);
+                        void *       pointed      = nullptr;
+                        bool const   is_new_class =
+                          read_pointer(io_reader, i_source, pointed_type, pointed);
+                        if (op.m_property->is_settable())
+                            op.m_property->set(object, &pointed);
+                        if (is_new_class)
+                        {
+                            read_dynamic(
+                              io_reader,
+                              i_source,
+                              raw_ptr(pointed, qualified_type_ptr(&pointed_type)));
+                        }
+                        break;
+                    }
+                    dyn_value value(qualified_type_ptr(qualified_type.final_type()));
+                    read_dynamic(io_reader, i_source, value);
+                    if (op.m_property->is_settable())
+                        op.m_property->set(object, value.object());
+                    break;
+                }
+                }
+            }
+        }
+
+        bool write_pointer(
+          static_writer & io_writer,
+          byte_writer &   o_dest,
+          const void *    i_pointed,
+          const type &    i_pointed_type)
+        {
+            // the reader has to construct the pointed objects
+            if (!i_pointed_type.is_constructible())
+            {
+                except<std::runtime_error>(
+                  "serialize: the pointed type is not default constructible");
+            }
+
+            // the value of a fundamental or an enum is never split from the tag
+            auto const tag =
+              static_cast<uint32_t>(io_writer.m_identities.tag_of(i_pointed, i_pointed_type));
+            bool const new_value = tag == 1 && !i_pointed_type.is_class();
+            auto const size      = sizeof(tag) + (new_value ? i_pointed_type.size() : 0);
+            if (o_dest.remaining_size() < static_cast<ptrdiff_t>(size))
+                except<std::runtime_error>("byte_writer is out of space");
+            o_dest.write_unchecked(&tag, sizeof(tag));
+            if (new_value)
+                o_dest.write_unchecked(i_pointed, i_pointed_type.size());
+
+            if (tag != 1)
+                return false;
+            io_writer.m_identities.add(i_pointed, i_pointed_type);
+            return i_pointed_type.is_class();
+        }
+
+        bool read_pointer(
+          static_reader & io_reader,
+          byte_reader &   i_source,
+          const type &    i_pointed_type,
+          void *&         o_pointed)
+        {
+            if (!i_pointed_type.is_constructible())
+            {
+                except<std::runtime_error>(
+                  "deserialize: the pointed type is not default constructible");
+            }
+
+            uint32_t tag;
+            if (!i_source.read_all_or_none(&tag, sizeof(tag)))
+                except<std::runtime_error>("byte_reader is out of space");
+            if (tag == 0)
+            {
+                o_pointed = nullptr;
+                return false;
+            }
+            if (tag != 1)
+            {
+                o_pointed = io_reader.m_identities.find(tag, i_pointed_type);
+                return false;
+            }
+
+            o_pointed = io_reader.m_identities.create(i_pointed_type);
+            if (
+              !i_pointed_type.is_class() &&
+              !i_source.read_all_or_none(o_pointed, i_pointed_type.size()))
+            {
+                except<std::runtime_error>("byte_reader is out of space");
+            }
+            return i_pointed_type.is_class();
+        }
+
+        void write_marker(
+          byte_writer & o_dest, type_id i_type_id, uint16_t i_count, uint16_t i_flags)
+        {
+            data_marker marker;
+            marker.m_type_id = i_type_id;
+            marker.m_count   = i_count;
+            marker.m_flags   = i_flags;
+            if (!o_dest.write_all_or_none(&marker, sizeof(marker)))
+                except<std::runtime_error>("byte_writer is out of space");
+        }
+
+        data_marker read_marker(byte_reader & i_source)
+        {
+            data_marker marker;
+            if (!i_source.read_all_or_none(&marker, sizeof(marker)))
+                except<std::runtime_error>("byte_reader is out of space");
+            return marker;
+        }
+
+    } // namespace detail
+
+} // namespace cambrian
@@ -0,0 +1,308 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "cambrian/cambrian_common.h"
+#include "cambrian/data/deserializer.h"
+#include "cambrian/data/serializer.h"
+#include "cambrian/data/type_registry.h"
+#include "ediacaran/core/byte_reader.h"
+#include "ediacaran/core/byte_writer.h"
+#include <algorithm>
+#include <iterator>
+#include <type_traits>
+
+namespace cambrian
+{
+    namespace detail
+    {
+        /** The state of serialize. The identity table is shared with the binary_writers of
+            the objects whose type is known only by the reflection, so that the pointed objects
+            get the ids of a single writer. */
+        struct static_writer
+        {
+            type_registry &               m_type_registry;
+            binary_writer::identity_table m_identities;
+        };
+
+        /** The state of deserialize, see static_writer */
+        struct static_reader
+        {
+            type_registry &               m_type_registry;
+            binary_reader::identity_table m_identities;
+        };
+
+        /** Writes the properties of an object executing its plan */
+        void write_plan(
+          static_writer &            io_writer,
+          byte_writer &              o_dest,
+          const void *               i_object,
+          const serialization_plan & i_plan);
+
+        /** Reads the properties of an object executing its plan */
+        void read_plan(
+          static_reader &            io_reader,
+          byte_reader &              i_source,
+          void *                     o_object,
+          const serialization_plan & i_plan);
+
+        /** Writes the tag of a pointer, followed by the value of the pointed object if it is a
+            new fundamental or enum. Returns true if the pointed object is a new class, whose
+            content must be written by the caller. */
+        bool write_pointer(
+          static_writer & io_writer,
+          byte_writer &   o_dest,
+          const void *    i_pointed,
+          const type &    i_pointed_type);
+
+        /** Reads the tag of a pointer, creating the pointed object if it is new. Returns true if
+            the created object is a class, whose content must be read by the caller. */
+        bool read_pointer(
+          static_reader & io_reader,
+          byte_reader &   i_source,
+          const type &    i_pointed_type,
+          void *&         o_pointed);
+
+        void write_marker(
+          byte_writer & o_dest, type_id i_type_id, uint16_t i_count, uint16_t i_flags);
+
+        data_marker read_marker(byte_reader & i_source);
+
+        template <typename TYPE> constexpr bool is_static_container_v()
+        {
+            if constexpr (is_container_v<TYPE>)
+                return edi::detail::HasStdContainerInterface<TYPE>::value;
+            else
+                return false;
+        }
+
+        template <typename TYPE>
+        void write_value(
+          static_writer &            io_writer,
+          byte_writer &              o_dest,
+          const TYPE &               i_object,
+          const serialization_plan * i_plan);
+
+        template <typename TYPE>
+        void read_value(
+          static_reader &            io_reader,
+          byte_reader &              i_source,
+          TYPE &                     o_object,
+          const serialization_plan * i_plan);
+
+        template <typename CONTAINER>
+        void write_elements(
+          static_writer & io_writer, byte_writer & o_dest, const CONTAINER & i_container)
+        {
+            using element_type = std::remove_cv_t<typename CONTAINER::value_type>;
+
+            // runs of pointers have the type of the pointed objects
+            using run_type = std::remove_cv_t<std::remove_pointer_t<element_type>>;
+
+            // non-class types have the id 0 and no plan
+            type_id                    element_type_id = 0;
+            const serialization_plan * element_plan    = nullptr;
+            auto                       remaining       = static_cast<size_t>(i_container.size());
+            if constexpr (std::is_class_v<run_type>)
+            {
+                if (remaining > 0)
+                {
+                    auto const type_data =
+                      io_writer.m_type_registry.get_type_data(get_class_type<run_type>());
+                    element_type_id = type_data.m_id;
+                    element_plan    = type_data.m_plan;
+                }
+            }
+
+            if (remaining == 0)
+            {
+                write_marker(
+                  o_dest,
+                  0,
+                  0,
+                  data_marker::flag_begin_comtainer | data_marker::flag_end_comtainer);
+                return;
+            }
+
+            uint16_t flags   = data_marker::flag_begin_comtainer;
+            auto     element = std::begin(i_container);
+            size_t   offset  = 0;
+            while (remaining > 0)
+            {
+                auto const count = std::min<size_t>(remaining, data_marker::s_max_count);
+                write_marker(o_dest, element_type_id, static_cast<uint16_t>(count), flags);
+                flags = data_marker::flag_none;
+
+                if constexpr (
+                  is_trivially_serializable_v<element_type> &&
+                  is_contiguous_container_v<CONTAINER>)
+                {
+                    o_dest.write(i_container.data() + offset, count * sizeof(element_type));
+                    if (o_dest.remaining_size() < 0)
+                        except<std::runtime_error>("byte_writer is out of space");
+                    offset += count;
+                }
+                else
+                {
+                    for (size_t index = 0; index < count; index++, ++element)
+                        write_value(io_writer, o_dest, *element, element_plan);
+                }
+                remaining -= count;
+            }
+            write_marker(o_dest, 0, 0, data_marker::flag_end_comtainer);
+        }
+
+        template <typename CONTAINER>
+        void read_elements(
+          static_reader & io_reader, byte_reader & i_source, CONTAINER & o_container)
+        {
+            using element_type = std::remove_cv_t<typename CONTAINER::value_type>;
+            using run_type     = std::remove_cv_t<std::remove_pointer_t<element_type>>;
+
+            o_container.clear();
+            const serialization_plan * element_plan = nullptr;
+            for (bool first = true;; first = false)
+            {
+                auto const marker = read_marker(i_source);
+                bool const begin  = (marker.m_flags & data_marker::flag_begin_comtainer) != 0;
+                bool const end    = (marker.m_flags & data_marker::flag_end_comtainer) != 0;
+                if (begin != first || end != (marker.m_count == 0))
+                    except<std::runtime_error>("deserialize: corrupted stream");
+                if (end)
+                    break;
+
+                type_id element_type_id = 0;
+                if constexpr (std::is_class_v<run_type>)
+                {
+                    auto const type_data =
+                      io_reader.m_type_registry.get_type_data(get_class_type<run_type>());
+                    element_type_id = type_data.m_id;
+                    element_plan    = type_data.m_plan;
+                }
+                if (marker.m_type_id != element_type_id)
+                    except<std::runtime_error>("deserialize: unexpected type in the stream");
+
+                if constexpr (
+                  is_trivially_serializable_v<element_type> &&
+                  is_contiguous_container_v<CONTAINER>)
+                {
+                    auto const prev_size = o_container.size();
+                    auto const size      = marker.m_count * sizeof(element_type);
+                    if (i_source.remaining_size() < static_cast<ptrdiff_t>(size))
+                        except<std::runtime_error>("byte_reader is out of space");
+                    o_container.resize(prev_size + marker.m_count);
+                    i_source.read(o_container.data() + prev_size, size);
+                }
+                else
+                {
+                    for (uint16_t index = 0; index < marker.m_count; index++)
+                    {
+                        o_container.emplace_back();
+                        read_value(io_reader, i_source, o_container.back(), element_plan);
+                    }
+                }
+            }
+        }
+
+        template <typename TYPE>
+        void write_value(
+          static_writer &            io_writer,
+          byte_writer &              o_dest,
+          const TYPE &               i_object,
+          const serialization_plan * i_plan)
+        {
+            if constexpr (std::is_pointer_v<TYPE>)
+            {
+                // a new pointed class is written after the tag, with the plan of the elements
+                using pointed_type = std::remove_cv_t<std::remove_pointer_t<TYPE>>;
+                static_assert(!std::is_pointer_v<pointed_type>, "pointer to pointer");
+                if (write_pointer(io_writer, o_dest, i_object, get_type<pointed_type>()))
+                    write_value(io_writer, o_dest, *i_object, i_plan);
+            }
+            else if constexpr (is_trivially_serializable_v<TYPE>)
+            {
+                o_dest << i_object;
+            }
+            else
+            {
+                if (i_plan == nullptr)
+                    i_plan = io_writer.m_type_registry.get_type_data(get_class_type<TYPE>()).m_plan;
+                write_plan(io_writer, o_dest, &i_object, *i_plan);
+                if constexpr (is_static_container_v<TYPE>())
+                {
+                    if (i_plan->m_container != nullptr)
+                        write_elements(io_writer, o_dest, i_object);
+                }
+            }
+        }
+
+        template <typename TYPE>
+        void read_value(
+          static_reader &            io_reader,
+          byte_reader &              i_source,
+          TYPE &                     o_object,
+          const serialization_plan * i_plan)
+        {
+            if constexpr (std::is_pointer_v<TYPE>)
+            {
+                using pointed_type = std::remove_cv_t<std::remove_pointer_t<TYPE>>;
+                static_assert(!std::is_pointer_v<pointed_type>, "pointer to pointer");
+                void *     pointed = nullptr;
+                bool const is_new_class =
+                  read_pointer(io_reader, i_source, get_type<pointed_type>(), pointed);
+                o_object = static_cast<pointed_type *>(pointed);
+                if (is_new_class)
+                    read_value(io_reader, i_source, *static_cast<pointed_type *>(pointed), i_plan);
+            }
+            else if constexpr (is_trivially_serializable_v<TYPE>)
+            {
+                i_source >> o_object;
+            }
+            else
+            {
+                if (i_plan == nullptr)
+                    i_plan = io_reader.m_type_registry.get_type_data(get_class_type<TYPE>()).m_plan;
+                read_plan(io_reader, i_source, &o_object, *i_plan);
+                if constexpr (is_static_container_v<TYPE>())
+                {
+                    if (i_plan->m_container != nullptr)
+                        read_elements(io_reader, i_source, o_object);
+                }
+            }
+        }
+
+    } // namespace detail
+
+    /** Writes an object whose type is known at compile time, producing the same stream of a
+        binary_writer that uses a single buffer. Fundamental types, enums, pointers and the
+        elements of the containers are handled with inlined code. Classes execute the
+        serialization_plan provided by the type_registry: the copies are inlined, while the
+        properties whose type is known only by the reflection (containers and properties with a
+        getter) are written with a binary_writer. All the writers share the identity table of
+        the pointers, so the objects reachable by many pointers are written once, and the tags
+        refer to the same ids. Throws std::runtime_error if the buffer is too small. */
+    template <typename TYPE>
+    void serialize(type_registry & io_type_registry, byte_writer & o_dest, const TYPE & i_object)
+    {
+        static_assert(!std::is_pointer_v<TYPE>, "attempt to serialize a pointer");
+        detail::static_writer writer{io_type_registry, {}};
+        writer.m_identities.add(&i_object, get_type<TYPE>()); // the root has the id 0
+        detail::write_value(writer, o_dest, i_object, nullptr);
+    }
+
+    /** Reads an object written by serialize or by a binary_writer that used a single buffer.
+        The content of the object is replaced, like binary_reader does. The objects created for
+        the pointers are owned by the caller (see binary_reader). Throws std::runtime_error if
+        the stream is truncated or inconsistent with the object. */
+    template <typename TYPE>
+    void deserialize(type_registry & io_type_registry, byte_reader & i_source, TYPE & o_object)
+    {
+        static_assert(!std::is_pointer_v<TYPE>, "attempt to deserialize a pointer");
+        detail::static_reader reader{io_type_registry, {}};
+        reader.m_identities.add(raw_ptr(&o_object)); // the root has the id 0
+        detail::read_value(reader, i_source, o_object, nullptr);
+    }
+
+} // namespace cambrian
@@ -0,0 +1,607 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "cambrian/data/tagged_format.h"
+#include "cambrian/data/deserializer.h"
+#include "cambrian/data/varint.h"
+#include "ediacaran/core/byte_reader.h"
+#include "ediacaran/utils/dyn_value.h"
+#include "ediacaran/utils/universal_iterator.h"
+#include <string>
+#include <unordered_map>
+
+namespace cambrian
+{
+    namespace
+    {
+        /** Returns the class of an object reachable without indirections, or null */
+        const class_type * class_of(const qualified_type_ptr & i_qualified_type)
+        {
+            if (i_qualified_type.is_empty() || i_qualified_type.indirection_levels() != 0)
+                return nullptr;
+            auto const final_type = i_qualified_type.final_type();
+            return final_type->is_class() ? static_cast<const class_type *>(final_type) : nullptr;
+        }
+
+        /** How a value is written. The kind is stored in the low bits of the key of an entry */
+        enum class ValueKind : uint64_t
+        {
+            value    = 0, /**< written by binary_writer */
+            object   = 1, /**< a class that is not a container, written with a skip table */
+            sequence = 2, /**< a container of classes, whose elements are written as entries */
+        };
+
+        constexpr uint64_t kind_bits = 2;
+        constexpr uint64_t kind_mask = (1 << kind_bits) - 1;
+
+        /** Returns how the values of a type are written */
+        ValueKind kind_of(const qualified_type_ptr & i_qualified_type)
+        {
+            auto const value_class = class_of(i_qualified_type);
+            if (value_class == nullptr)
+                return ValueKind::value;
+            auto const container = value_class->container();
+            if (container == nullptr)
+                return ValueKind::object;
+            auto const heterogeneous = (container->capabilities() &
+                                        container::capability::heterogeneous) !=
+                                       container::capability::none;
+            return !heterogeneous && class_of(container->elements_type()) != nullptr
+                     ? ValueKind::sequence
+                     : ValueKind::value;
+        }
+
+        ValueKind kind_of(const tagged_view & i_view, size_t i_index)
+        {
+            if (i_view.is_object(i_index))
+                return ValueKind::object;
+            return i_view.is_sequence(i_index) ? ValueKind::sequence : ValueKind::value;
+        }
+
+        void append_varint(std::vector<unsigned char> & o_dest, uint64_t i_value)
+        {
+            unsigned char buffer[max_varint_size];
+            o_dest.insert(o_dest.end(), buffer, buffer + write_varint(buffer, i_value));
+        }
+
+        uint64_t
+          read_tagged_varint(const unsigned char * i_stream, size_t i_end, size_t & io_offset)
+        {
+            uint64_t   value;
+            auto const size = read_varint(i_stream + io_offset, i_end - io_offset, value);
+            if (size == 0)
+                except<std::runtime_error>("tagged_view: corrupted stream");
+            io_offset += size;
+            return value;
+        }
+
+        class TaggedWriter
+        {
+          public:
+            TaggedWriter(type_registry & i_type_registry, wire_format i_format)
+                : m_type_registry(i_type_registry), m_format(i_format)
+            {
+            }
+
+            void write_object(
+              std::vector<unsigned char> & o_dest,
+              const void *                 i_object,
+              const class_type &           i_class,
+              size_t                       i_depth)
+            {
+                if (i_depth >= binary_writer::max_depth)
+                    except<std::runtime_error>("write_tagged: the object is too deep");
+
+                // the values are written before the skip table, that needs their sizes
+                SkipTable table;
+                write_properties(table, i_object, i_class, i_class.properties(), i_depth);
+                for (auto const & base : i_class.bases())
+                {
+                    write_properties(
+                      table,
+                      base.up_cast(i_object),
+                      base.get_class(),
+                      base.get_class().properties(),
+                      i_depth);
+                }
+                table.append_to(o_dest);
+            }
+
+            /** Returns the keys followed by the root */
+            std::vector<unsigned char> stream(const std::vector<unsigned char> & i_root) const
+            {
+                std::vector<unsigned char> result;
+                append_varint(result, m_keys.size());
+                for (auto const & key : m_keys)
+                {
+                    append_string(result, key.first);
+                    append_string(result, key.second);
+                }
+                result.insert(result.end(), i_root.begin(), i_root.end());
+                return result;
+            }
+
+          private:
+            struct SkipTable
+            {
+                std::vector<uint64_t>      m_entries; /**< the key and the size of every value */
+                std::vector<unsigned char> m_values;
+
+                void append_to(std::vector<unsigned char> & o_dest) const
+                {
+                    append_varint(o_dest, m_entries.size() / 2);
+                    for (auto const entry : m_entries)
+                        append_varint(o_dest, entry);
+                    o_dest.insert(o_dest.end(), m_values.begin(), m_values.end());
+                }
+            };
+
+            static void
+              append_string(std::vector<unsigned char> & o_dest, const std::string & i_string)
+            {
+                append_varint(o_dest, i_string.size());
+                o_dest.insert(o_dest.end(), i_string.begin(), i_string.end());
+            }
+
+            void write_properties(
+              SkipTable &                        io_table,
+              const void *                       i_object,
+              const class_type &                 i_owner,
+              const array_view<const property> & i_properties,
+              size_t                             i_depth)
+            {
+                for (auto const & prop : i_properties)
+                {
+                    auto const & qualified_type = prop.qualified_type();
+                    if (qualified_type.indirection_levels() != 0)
+                        except<std::runtime_error>("write_tagged: pointers are not supported");
+
+                    auto const start = io_table.m_values.size();
+                    ValueKind  kind;
+                    if (prop.is_inplace())
+                    {
+                        auto const object = const_cast<void *>(prop.get_inplace(i_object));
+                        kind              = write_value(
+                          io_table.m_values, raw_ptr(object, qualified_type), i_depth);
+                    }
+                    else
+                    {
+                        dyn_value value;
+                        value.manual_construct(qualified_type, [&](void * i_value_dest) {
+                            prop.get(i_object, i_value_dest);
+                        });
+                        kind = write_value(io_table.m_values, value, i_depth);
+                    }
+
+                    auto const key = key_index(i_owner.name(), prop.name());
+                    io_table.m_entries.push_back((key << kind_bits) | static_cast<uint64_t>(kind));
+                    io_table.m_entries.push_back(io_table.m_values.size() - start);
+                }
+            }
+
+            /** Writes the elements of a container of classes as entries without a name */
+            void write_sequence(
+              std::vector<unsigned char> & o_dest,
+              const void *                 i_object,
+              const class_type &           i_class,
+              size_t                       i_depth)
+            {
+                if (i_depth >= binary_writer::max_depth)
+                    except<std::runtime_error>("write_tagged: the object is too deep");
+
+                SkipTable table;
+                for (universal_iterator it(
+                       raw_ptr(const_cast<void *>(i_object), qualified_type_ptr(&i_class)));
+                     it != end_marker;
+                     ++it)
+                {
+                    auto const start = table.m_values.size();
+                    auto const kind  = write_value(table.m_values, *it, i_depth);
+                    table.m_entries.push_back(static_cast<uint64_t>(kind));
+                    table.m_entries.push_back(table.m_values.size() - start);
+                }
+                table.append_to(o_dest);
+            }
+
+            ValueKind write_value(
+              std::vector<unsigned char> & o_dest, const raw_ptr & i_value, size_t i_depth)
+            {
+                auto const kind = kind_of(i_value.qualified_type());
+                if (kind == ValueKind::object)
+                {
+                    auto const & value_class = *class_of(i_value.qualified_type());
+                    write_object(o_dest, i_value.object(), value_class, i_depth + 1);
+                    return kind;
+                }
+                if (kind == ValueKind::sequence)
+                {
+                    auto const & value_class = *class_of(i_value.qualified_type());
+                    write_sequence(o_dest, i_value.object(), value_class, i_depth + 1);
+                    return kind;
+                }
+
+                constexpr size_t chunk_size = 4096;
+                binary_writer    writer(m_type_registry, i_value, m_format);
+                bool             finished = false;
+                while (!finished)
+                {
+                    auto const used_size = o_dest.size();
+                    o_dest.resize(used_size + chunk_size);
+                    byte_writer dest(o_dest.data() + used_size, chunk_size);
+                    finished = writer.step(dest) == binary_writer::finished;
+                    o_dest.resize(o_dest.size() - static_cast<size_t>(dest.remaining_size()));
+                }
+                return kind;
+            }
+
+            uint64_t key_index(const string_view & i_class_name, const string_view & i_name)
+            {
+                // a class name can't contain a null character
+                std::string key(i_class_name);
+                key += '\0';
+                key.append(i_name.data(), i_name.size());
+                auto const result = m_key_indices.emplace(std::move(key), m_keys.size());
+                if (result.second)
+                    m_keys.emplace_back(std::string(i_class_name), std::string(i_name));
+                return result.first->second;
+            }
+
+          private:
+            type_registry &                                  m_type_registry;
+            wire_format const                                m_format;
+            std::vector<std::pair<std::string, std::string>> m_keys; /**< class and property */
+            std::unordered_map<std::string, uint64_t>        m_key_indices;
+        };
+
+        void read_object(
+          type_registry &     io_type_registry,
+          const tagged_view & i_view,
+          void *              io_object,
+          const class_type &  i_class,
+          wire_format         i_format);
+
+        void read_sequence(
+          type_registry &     io_type_registry,
+          const tagged_view & i_view,
+          void *              io_object,
+          const class_type &  i_class,
+          wire_format         i_format);
+
+        /** Reads an entry of an object or a sequence in a value of the same kind */
+        void read_entry(
+          type_registry &     io_type_registry,
+          const tagged_view & i_view,
+          size_t              i_index,
+          const raw_ptr &     io_dest,
+          wire_format         i_format)
+        {
+            auto const & qualified_type = io_dest.qualified_type();
+            if (qualified_type.indirection_levels() != 0)
+                except<std::runtime_error>("read_tagged: pointers are not supported");
+            auto const kind = kind_of(qualified_type);
+            if (kind != kind_of(i_view, i_index))
+                except<std::runtime_error>("read_tagged: the type of a property has changed");
+
+            switch (kind)
+            {
+            case ValueKind::object:
+                read_object(
+                  io_type_registry,
+                  i_view.get_object(i_index),
+                  io_dest.editable_object(),
+                  *class_of(qualified_type),
+                  i_format);
+                break;
+
+            case ValueKind::sequence:
+                read_sequence(
+                  io_type_registry,
+                  i_view.get_sequence(i_index),
+                  io_dest.editable_object(),
+                  *class_of(qualified_type),
+                  i_format);
+                break;
+
+            case ValueKind::value:
+                i_view.read_value(io_type_registry, i_index, io_dest, i_format);
+                break;
+            }
+        }
+
+        void read_properties(
+          type_registry &                    io_type_registry,
+          const tagged_view &                i_view,
+          void *                             io_object,
+          const class_type &                 i_owner,
+          const array_view<const property> & i_properties,
+          wire_format                        i_format)
+        {
+            for (auto const & prop : i_properties)
+            {
+                // the properties not in the stream are left unchanged
+                auto const index = i_view.find_property(i_owner.name(), prop.name());
+                if (index == i_view.property_count())
+                    continue;
+
+                auto const & qualified_type = prop.qualified_type();
+                if (prop.is_inplace() && prop.is_settable())
+                {
+                    auto const object = const_cast<void *>(prop.get_inplace(io_object));
+                    read_entry(
+                      io_type_registry, i_view, index, raw_ptr(object, qualified_type), i_format);
+                }
+                else if (prop.is_settable())
+                {
+                    // the value starts from the current one, as the stream may not set all of it
+                    dyn_value value;
+                    value.manual_construct(qualified_type, [&](void * i_value_dest) {
+                        prop.get(io_object, i_value_dest);
+                    });
+                    read_entry(io_type_registry, i_view, index, value, i_format);
+                    prop.set(io_object, value.object());
+                }
+            }
+        }
+
+        void read_object(
+          type_registry &     io_type_registry,
+          const tagged_view & i_view,
+          void *              io_object,
+          const class_type &  i_class,
+          wire_format         i_format)
+        {
+            read_properties(
+              io_type_registry, i_view, io_object, i_class, i_class.properties(), i_format);
+            for (auto const & base : i_class.bases())
+            {
+                read_properties(
+                  io_type_registry,
+                  i_view,
+                  base.up_cast(io_object),
+                  base.get_class(),
+                  base.get_class().properties(),
+                  i_format);
+            }
+        }
+
+        /** Replaces the elements of a container with the ones of a sequence */
+        void read_sequence(
+          type_registry &     io_type_registry,
+          const tagged_view & i_view,
+          void *              io_object,
+          const class_type &  i_class,
+          wire_format         i_format)
+        {
+            auto const & container = *i_class.container();
+            if (
+              container.clear_function() == nullptr ||
+              container.emplace_back_function() == nullptr)
+            {
+                except<std::runtime_error>("read_tagged: a container can't be resized");
+            }
+
+            container.clear_function()(io_object);
+            for (size_t index = 0; index < i_view.property_count(); index++)
+            {
+                auto const element = container.emplace_back_function()(io_object);
+                read_entry(
+                  io_type_registry,
+                  i_view,
+                  index,
+                  raw_ptr(element, container.elements_type()),
+                  i_format);
+            }
+        }
+
+    } // namespace
+
+    std::vector<unsigned char> write_tagged(
+      type_registry & io_type_registry, const raw_ptr & i_source_object, wire_format i_format)
+    {
+        if (kind_of(i_source_object.qualified_type()) != ValueKind::object)
+            except<std::invalid_argument>("write_tagged: invalid root type");
+
+        TaggedWriter               writer(io_type_registry, i_format);
+        std::vector<unsigned char> root;
+        writer.write_object(
+          root, i_source_object.object(), *class_of(i_source_object.qualified_type()), 0);
+        return writer.stream(root);
+    }
+
+    void read_tagged(
+      type_registry & io_type_registry,
+      const void *    i_stream,
+      size_t          i_stream_size,
+      const raw_ptr & io_dest_object,
+      wire_format     i_format)
+    {
+        if (kind_of(io_dest_object.qualified_type()) != ValueKind::object)
+            except<std::invalid_argument>("read_tagged: invalid root type");
+
+        tagged_view const view(i_stream, i_stream_size);
+        read_object(
+          io_type_registry,
+          view,
+          io_dest_object.editable_object(),
+          *class_of(io_dest_object.qualified_type()),
+          i_format);
+    }
+
+    tagged_view::tagged_view(const void * i_stream, size_t i_stream_size)
+        : m_stream(static_cast<const unsigned char *>(i_stream))
+    {
+        // every string takes at least a byte
+        size_t     offset    = 0;
+        auto const key_count = read_tagged_varint(m_stream, i_stream_size, offset);
+        if (key_count > i_stream_size / 2)
+            except<std::runtime_error>("tagged_view: corrupted stream");
+
+        auto const read_string = [&] {
+            auto const size = read_tagged_varint(m_stream, i_stream_size, offset);
+            if (size > i_stream_size - offset)
+                except<std::runtime_error>("tagged_view: corrupted stream");
+            string_view const result(
+              reinterpret_cast<const char *>(m_stream + offset), static_cast<size_t>(size));
+            offset += static_cast<size_t>(size);
+            return result;
+        };
+
+        auto keys = std::make_shared<Keys>();
+        keys->reserve(static_cast<size_t>(key_count));
+        for (uint64_t index = 0; index < key_count; index++)
+        {
+            Key key;
+            key.m_class = read_string();
+            key.m_name  = read_string();
+            keys->push_back(key);
+        }
+        m_keys = std::move(keys);
+
+        read_skip_table(offset, i_stream_size - offset);
+    }
+
+    tagged_view::tagged_view(
+      const std::shared_ptr<const Keys> & i_keys,
+      const unsigned char *               i_stream,
+      size_t                              i_offset,
+      size_t                              i_size,
+      bool                                i_is_sequence)
+        : m_keys(i_keys), m_stream(i_stream), m_is_sequence(i_is_sequence)
+    {
+        read_skip_table(i_offset, i_size);
+    }
+
+    void tagged_view::read_skip_table(size_t i_offset, size_t i_size)
+    {
+        // every entry takes at least two bytes
+        auto const end         = i_offset + i_size;
+        size_t     offset      = i_offset;
+        auto const entry_count = read_tagged_varint(m_stream, end, offset);
+        if (entry_count > i_size / 2)
+            except<std::runtime_error>("tagged_view: corrupted stream");
+
+        // the entries of a sequence have no key index
+        m_entries.resize(static_cast<size_t>(entry_count));
+        for (auto & entry : m_entries)
+        {
+            auto const key       = read_tagged_varint(m_stream, end, offset);
+            auto const size      = read_tagged_varint(m_stream, end, offset);
+            auto const key_index = key >> kind_bits;
+            auto const kind      = key & kind_mask;
+            if (
+              (m_is_sequence ? key_index != 0 : key_index >= m_keys->size()) ||
+              kind > static_cast<uint64_t>(ValueKind::sequence) || size > i_size)
+            {
+                except<std::runtime_error>("tagged_view: corrupted stream");
+            }
+            entry.m_key_index = static_cast<size_t>(key_index);
+            entry.m_kind      = static_cast<uint8_t>(kind);
+            entry.m_size      = static_cast<size_t>(size);
+        }
+
+        // the values follow the skip table, and fill the rest of the object
+        for (auto & entry : m_entries)
+        {
+            if (entry.m_size > end - offset)
+                except<std::runtime_error>("tagged_view: corrupted stream");
+            entry.m_offset = offset;
+            offset += entry.m_size;
+        }
+        if (offset != end)
+            except<std::runtime_error>("tagged_view: corrupted stream");
+    }
+
+    const tagged_view::Entry & tagged_view::entry_at(size_t i_index) const
+    {
+        if (i_index >= m_entries.size())
+            except<std::out_of_range>("tagged_view: property index out of range");
+        return m_entries[i_index];
+    }
+
+    const tagged_view::Key & tagged_view::key_at(size_t i_index) const
+    {
+        auto const & entry = entry_at(i_index);
+        if (m_is_sequence)
+            except<std::invalid_argument>("tagged_view: the elements of a sequence have no name");
+        return (*m_keys)[entry.m_key_index];
+    }
+
+    string_view tagged_view::property_name(size_t i_index) const
+    {
+        return key_at(i_index).m_name;
+    }
+
+    string_view tagged_view::property_class(size_t i_index) const
+    {
+        return key_at(i_index).m_class;
+    }
+
+    size_t tagged_view::find_property(const string_view & i_name) const noexcept
+    {
+        for (size_t index = 0; !m_is_sequence && index < m_entries.size(); index++)
+        {
+            if ((*m_keys)[m_entries[index].m_key_index].m_name == i_name)
+                return index;
+        }
+        return m_entries.size();
+    }
+
+    size_t tagged_view::find_property(
+      const string_view & i_class_name, const string_view & i_name) const noexcept
+    {
+        for (size_t index = 0; !m_is_sequence && index < m_entries.size(); index++)
+        {
+            auto const & key = (*m_keys)[m_entries[index].m_key_index];
+            if (key.m_name == i_name && key.m_class == i_class_name)
+                return index;
+        }
+        return m_entries.size();
+    }
+
+    bool tagged_view::is_object(size_t i_index) const
+    {
+        return entry_at(i_index).m_kind == static_cast<uint8_t>(ValueKind::object);
+    }
+
+    bool tagged_view::is_sequence(size_t i_index) const
+    {
+        return entry_at(i_index).m_kind == static_cast<uint8_t>(ValueKind::sequence);
+    }
+
+    size_t tagged_view::value_size(size_t i_index) const { return entry_at(i_index).m_size; }
+
+    tagged_view tagged_view::get_object(size_t i_index) const
+    {
+        auto const & entry = entry_at(i_index);
+        if (entry.m_kind != static_cast<uint8_t>(ValueKind::object))
+            except<std::invalid_argument>("tagged_view: the property is not an object");
+        return tagged_view(m_keys, m_stream, entry.m_offset, entry.m_size, false);
+    }
+
+    tagged_view tagged_view::get_sequence(size_t i_index) const
+    {
+        auto const & entry = entry_at(i_index);
+        if (entry.m_kind != static_cast<uint8_t>(ValueKind::sequence))
+            except<std::invalid_argument>("tagged_view: the property is not a sequence");
+        return tagged_view(m_keys, m_stream, entry.m_offset, entry.m_size, true);
+    }
+
+    void tagged_view::read_value(
+      type_registry & io_type_registry,
+      size_t          i_index,
+      const raw_ptr & io_dest,
+      wire_format     i_format) const
+    {
+        auto const & entry = entry_at(i_index);
+        if (entry.m_kind != static_cast<uint8_t>(ValueKind::value))
+            except<std::invalid_argument>("tagged_view: the property is an object or a sequence");
+
+        binary_reader reader(io_type_registry, io_dest, i_format);
+        byte_reader   source(m_stream + entry.m_offset, entry.m_size);
+        if (reader.step(source) != binary_reader::finished || source.remaining_size() != 0)
+            except<std::runtime_error>("tagged_view: the value does not match the destination");
+    }
+
+} // namespace cambrian
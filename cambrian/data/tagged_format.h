@@ -0,0 +1,149 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "cambrian/cambrian_common.h"
+#include "cambrian/data/serializer.h"
+#include "cambrian/data/type_registry.h"
+#include "ediacaran/utils/raw_ptr.h"
+#include <memory>
+#include <vector>
+
+namespace cambrian
+{
+    /** Writes an object in the tagged format, in which every object carries a skip table, so
+        that a reader can locate a property without decoding the ones that precede it, and can
+        skip the properties it does not know. The stream is:
+            - the number of keys as a varint, followed by the keys. A key identifies a property
+              by the name of the class that declares it and by its name, each of them written
+              as the varint of its size followed by the characters
+            - the root object
+        An object is the number of its properties as a varint, followed by the skip table, and
+        then by the values of the properties, in the same order. The skip table has an entry
+        for every property (including the ones of the base classes, in the order used by
+        binary_writer), made of two varints: (i << 2) | kind for the property whose key has
+        index i, and the size of the value. The kind is 1 if the value is an object, 2 if it
+        is a sequence, and 0 otherwise. A value of a class that is not a container is written
+        as an object, recursively. A container of classes is written as a sequence, that has
+        the same layout of an object, but with an entry for every element, whose key is just
+        the kind of the element. Any other value (including the containers of fundamentals,
+        with their data_marker framing) is written by binary_writer with the given
+        wire_format, so the skip tables cover all the values of class type. Throws
+        std::invalid_argument if the root is not a class or is a container, and
+        std::runtime_error if an object contains a pointer or is too deep. */
+    std::vector<unsigned char> write_tagged(
+      type_registry & io_type_registry,
+      const raw_ptr & i_source_object,
+      wire_format     i_format = wire_format::fixed);
+
+    /** Reads an object written by write_tagged, matching the properties by the name of the
+        class that declares them and by name, so that the class may have changed since the
+        stream was written: the properties of the stream that the class does not have are
+        skipped, and the properties of the class that the stream does not have are left
+        unchanged. This applies to the elements of the containers of classes too, that replace
+        the elements of the destination container. Throws std::runtime_error if the stream is
+        corrupted, if a property has a different kind (object, sequence or value) in the stream
+        and in the class, or if a container can't be cleared or resized. */
+    void read_tagged(
+      type_registry & io_type_registry,
+      const void *    i_stream,
+      size_t          i_stream_size,
+      const raw_ptr & io_dest_object,
+      wire_format     i_format = wire_format::fixed);
+
+    /** Read only view on an object or a sequence in the tagged format. The view decodes only the
+        skip table: the values are decoded on request, one property (or element) at a time. The
+        stream is not copied, and must outlive the view and all the views derived from it. */
+    class tagged_view
+    {
+      public:
+        /** Constructs a view on the root of a stream written by write_tagged. Throws
+            std::runtime_error if the stream is corrupted. */
+        tagged_view(const void * i_stream, size_t i_stream_size);
+
+        /** Returns the number of properties, or of elements if the view is a sequence */
+        size_t property_count() const noexcept { return m_entries.size(); }
+
+        /** Returns the name of a property. Throws std::invalid_argument if the view is a
+            sequence. */
+        string_view property_name(size_t i_index) const;
+
+        /** Returns the name of the class that declares a property. Throws
+            std::invalid_argument if the view is a sequence. */
+        string_view property_class(size_t i_index) const;
+
+        /** Returns the index of the first property with the given name, or property_count() */
+        size_t find_property(const string_view & i_name) const noexcept;
+
+        /** Returns the index of the property with the given name declared by the given class,
+            or property_count() */
+        size_t find_property(const string_view & i_class_name, const string_view & i_name) const
+          noexcept;
+
+        /** Returns whether the value of a property is an object */
+        bool is_object(size_t i_index) const;
+
+        /** Returns whether the value of a property is a sequence */
+        bool is_sequence(size_t i_index) const;
+
+        /** Returns the size in bytes of the value of a property */
+        size_t value_size(size_t i_index) const;
+
+        /** Returns the view of a property that is an object. Throws std::invalid_argument if the
+            value is not an object, and std::runtime_error if it is corrupted. */
+        tagged_view get_object(size_t i_index) const;
+
+        /** Returns the view of a property that is a sequence. Throws std::invalid_argument if
+            the value is not a sequence, and std::runtime_error if it is corrupted. */
+        tagged_view get_sequence(size_t i_index) const;
+
+        /** Reads the value of a property in an object of the same type of the property. Throws
+            std::invalid_argument if the value is an object or a sequence, and
+            std::runtime_error if it is corrupted or does not match the type of the
+            destination. */
+        void read_value(
+          type_registry & io_type_registry,
+          size_t          i_index,
+          const raw_ptr & io_dest,
+          wire_format     i_format = wire_format::fixed) const;
+
+      private:
+        struct Key
+        {
+            string_view m_class;
+            string_view m_name;
+        };
+
+        struct Entry
+        {
+            size_t  m_key_index = 0;
+            uint8_t m_kind      = 0;
+            size_t  m_offset    = 0; /**< relative to the start of the stream */
+            size_t  m_size      = 0;
+        };
+
+        using Keys = std::vector<Key>;
+
+        tagged_view(
+          const std::shared_ptr<const Keys> & i_keys,
+          const unsigned char *               i_stream,
+          size_t                              i_offset,
+          size_t                              i_size,
+          bool                                i_is_sequence);
+
+        void read_skip_table(size_t i_offset, size_t i_size);
+
+        const Entry & entry_at(size_t i_index) const;
+
+        const Key & key_at(size_t i_index) const;
+
+      private:
+        std::shared_ptr<const Keys> m_keys;
+        const unsigned char *       m_stream;
+        std::vector<Entry>          m_entries;
+        bool                        m_is_sequence = false;
+    };
+
+} // namespace cambrian
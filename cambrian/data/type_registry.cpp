@@ -5,7 +5,12 @@
 //          http://www.boost.org/LICENSE_1_0.txt)
 
 #include "cambrian/data/type_registry.h"
+#include "cambrian/data/schema.h"
+#include "ediacaran/reflection/reflection.h"
+#include "ediacaran/utils/dyn_value.h"
 #include <algorithm>
+#include <cstddef>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -15,11 +20,12 @@ namespace cambrian
     {
         type_id                  m_type_id = 0;
         std::string              m_name;
-        size_t                   m_size = 0;
-        std::vector<base_class>  m_base_classes;
+        size_t                   m_size      = 0;
+        size_t                   m_alignment = 1;
         std::vector<property>    m_properties;
         std::vector<function>    m_functions;
         std::vector<std::string> m_property_names;
+        flat_layout              m_layout;
 
         SerializedClassData(
           type_registry * i_type_registry, const class_type & i_source_class, type_id i_type_id)
@@ -35,39 +41,51 @@ namespace cambrian
             }
             m_properties.reserve(property_count);
             m_property_names.reserve(property_count);
+            m_layout.m_fields.reserve(property_count);
 
-            m_base_classes.reserve(i_source_class.bases().size());
-
-            // add the properties of this class and of the base classes
+            /* add the properties of this class and of the base classes. The base classes are
+               flattened, so the passive class has no bases. */
             add_properties(i_type_registry, i_source_class.properties());
             for (auto const base : i_source_class.bases())
             {
-                auto const & passive_base =
-                  i_type_registry->get_type_data(base.get_class()).m_active_type;
-                CAMBRIAN_ASSERT(passive_base.is_class());
-
-                m_base_classes.emplace_back(static_cast<const class_type &>(passive_base), nullptr);
                 add_properties(i_type_registry, base.get_class().properties());
             }
+
+            m_layout.m_container = i_source_class.container();
+            if (m_layout.m_container != nullptr)
+            {
+                m_layout.m_range_offset = add_field(sizeof(flat_range), alignof(flat_range));
+            }
+            m_size = uint_upper_align(m_size, m_alignment);
         }
 
       private:
+        size_t add_field(size_t i_size, size_t i_alignment)
+        {
+            auto const offset = uint_upper_align(m_size, i_alignment);
+            m_size            = offset + i_size;
+            m_alignment       = std::max(m_alignment, i_alignment);
+            return offset;
+        }
+
         void add_properties(
           type_registry * i_type_registry, const array_view<const property> & i_properties)
         {
             for (auto const & prop : i_properties)
             {
-                auto const raw_type = prop.qualified_type().final_type();
-
-                auto const & prop_passive_type =
-                  i_type_registry->get_type_data(*raw_type).m_active_type;
+                // pointers are not part of the flat layout
+                if (prop.qualified_type().indirection_levels() != 0)
+                    continue;
 
-                auto const prop_name = m_property_names.emplace_back(prop.name());
+                auto const & source_type = *prop.qualified_type().final_type();
+                auto const & passive_type =
+                  i_type_registry->get_type_data(source_type).m_serialized_type;
 
+                auto const & prop_name = m_property_names.emplace_back(prop.name());
+                auto const   offset    = add_field(passive_type.size(), passive_type.alignment());
                 m_properties.emplace_back(
-                  prop_name.c_str(), qualified_type_ptr(&prop_passive_type), m_size);
-
-                m_size += prop_passive_type.size();
+                  prop_name.c_str(), qualified_type_ptr(&passive_type), offset);
+                m_layout.m_fields.push_back({&source_type, offset});
             }
         }
     };
@@ -77,47 +95,365 @@ namespace cambrian
       public:
         SerializedClass(
           type_registry * i_type_registry, const class_type & i_source_class, type_id i_type_id)
-            : m_class_data(i_type_registry, i_source_class, i_type_id),
+            : m_source_class(&i_source_class),
+              m_class_data(i_type_registry, i_source_class, i_type_id),
               m_class(
                 m_class_data.m_name.c_str(),
                 m_class_data.m_size,
-                1,
+                m_class_data.m_alignment,
                 edi::special_functions(),
-                m_class_data.m_base_classes,
+                array_view<const base_class>(),
                 m_class_data.m_properties,
                 m_class_data.m_functions,
                 nullptr)
         {
+            m_class_data.m_layout.m_class = &m_class;
+            i_type_registry->compile_plan(m_plan, i_source_class, 0);
+            m_plan.m_container = i_source_class.container();
         }
 
-        SerializedClassData m_class_data;
-        class_type          m_class;
+        type_data data() const noexcept
+        {
+            return {*m_source_class,
+                    m_class_data.m_type_id,
+                    m_class,
+                    m_class_data.m_size,
+                    &m_plan,
+                    &m_class_data.m_layout,
+                    value_encoding::raw};
+        }
+
+        const class_type * const m_source_class;
+        SerializedClassData      m_class_data;
+        class_type               m_class;
+        serialization_plan       m_plan;
     };
 
+    std::vector<size_t> base_offsets(const class_type & i_class)
+    {
+        std::vector<size_t> result;
+        auto const          bases = i_class.bases();
+        if (bases.size() == 0)
+            return result;
+
+        if (!i_class.is_constructible() || !i_class.is_destructible())
+        {
+            except<std::runtime_error>(
+              "base_offsets: a class with bases must be default constructible and destructible");
+        }
+
+        dyn_value object;
+        object.manual_construct(
+          qualified_type_ptr(&i_class), [&](void * i_dest) { i_class.construct(i_dest); });
+        result.reserve(bases.size());
+        for (auto const & base : bases)
+        {
+            auto const base_object = base.up_cast(object.object());
+            result.push_back(static_cast<size_t>(address_diff(base_object, object.object())));
+        }
+        return result;
+    }
+
+    void type_registry::compile_plan(
+      serialization_plan & io_plan, const class_type & i_class, size_t i_offset)
+    {
+        /* the offsets of the inplace properties are computed on an uninitialized buffer, as
+           get_inplace only adds an offset to the address of the object */
+        std::vector<std::max_align_t> probe(
+          (i_class.size() + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t) + 1);
+        auto const object = static_cast<void *>(probe.data());
+
+        add_to_plan(io_plan, i_class.properties(), object, i_offset);
+        auto const offsets = base_offsets(i_class);
+        for (size_t index = 0; index < offsets.size(); index++)
+        {
+            add_to_plan(
+              io_plan,
+              i_class.bases()[index].get_class().properties(),
+              address_add(object, offsets[index]),
+              i_offset + offsets[index]);
+        }
+    }
+
+    void type_registry::add_to_plan(
+      serialization_plan &               io_plan,
+      const array_view<const property> & i_properties,
+      const void *                       i_object,
+      size_t                             i_offset)
+    {
+        using operation = serialization_plan::operation;
+
+        for (auto const & prop : i_properties)
+        {
+            auto const & qualified_type = prop.qualified_type();
+            auto const   final_type     = qualified_type.final_type();
+            if (
+              !prop.is_inplace() || !prop.is_settable() || qualified_type.indirection_levels() != 0)
+            {
+                // accessed with the getter and the setter
+                io_plan.m_operations.push_back({operation::kind::property, i_offset});
+                io_plan.m_operations.back().m_property = &prop;
+
+                // pointed classes are registered later, as they may contain this class
+                if (qualified_type.indirection_levels() != 0 && final_type->is_class())
+                    m_pending_types.push_back(final_type);
+                continue;
+            }
+
+            auto const offset = i_offset + address_diff(prop.get_inplace(i_object), i_object);
+            if (final_type->is_class())
+            {
+                auto const & prop_class = static_cast<const class_type &>(*final_type);
+                if (prop_class.container() == nullptr)
+                {
+                    compile_plan(io_plan, prop_class, offset);
+                }
+                else
+                {
+                    io_plan.m_operations.push_back({operation::kind::object, offset});
+                    io_plan.m_operations.back().m_class    = &prop_class;
+                    io_plan.m_operations.back().m_plan     = get_type_data(prop_class).m_plan;
+                    io_plan.m_operations.back().m_property = &prop;
+                }
+            }
+            else
+            {
+                auto & operations = io_plan.m_operations;
+                if (
+                  !operations.empty() && operations.back().m_kind == operation::kind::copy &&
+                  operations.back().m_offset + operations.back().m_size == offset)
+                {
+                    operations.back().m_size += final_type->size();
+                }
+                else
+                {
+                    operations.push_back({operation::kind::copy, offset, final_type->size()});
+                    operations.back().m_first_field = io_plan.m_fields.size();
+                }
+                io_plan.m_fields.push_back(
+                  {offset, final_type->size(), compact_encoding_of(*final_type), &prop});
+                operations.back().m_field_count++;
+            }
+        }
+    }
+
+
+    uint64_t type_registry::hash_of(const class_type * i_class) noexcept
+    {
+        // Fibonacci hashing: the high bits of the product depend on all the bits of the address
+        return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(i_class)) *
+               UINT64_C(0x9E3779B97F4A7C15);
+    }
+
+    type_registry::Slot & type_registry::find_slot(
+      const Table & i_table, const class_type * i_class, uint64_t i_hash) noexcept
+    {
+        // the table is never full, so the probing always stops
+        auto const mask  = i_table.slot_count() - 1;
+        auto       index = static_cast<size_t>(i_hash >> (64 - i_table.m_slot_bits));
+        for (;;)
+        {
+            auto const key = i_table.m_slots[index].m_key.load(std::memory_order_acquire);
+            if (key == nullptr || key == i_class)
+                return i_table.m_slots[index];
+            index = (index + 1) & mask;
+        }
+    }
+
+    type_registry::Slot & type_registry::insert_slot(const class_type * i_class, uint64_t i_hash)
+    {
+        /* the load factor is kept below 1/2. The slots are copied to a new table, and the
+           previous one is kept for the concurrent lookups that are reading it. */
+        auto table = m_tables.back().get();
+        if ((m_used_slots + 1) * 2 > table->slot_count())
+        {
+            auto new_table = std::make_unique<Table>(table->m_slot_bits + 1);
+            for (size_t index = 0; index < table->slot_count(); index++)
+            {
+                auto const & slot = table->m_slots[index];
+                auto const   key  = slot.m_key.load(std::memory_order_relaxed);
+                if (key != nullptr)
+                {
+                    auto & new_slot = find_slot(*new_table, key, hash_of(key));
+                    new_slot.m_id   = slot.m_id;
+                    new_slot.m_value.store(
+                      slot.m_value.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                    new_slot.m_key.store(key, std::memory_order_relaxed);
+                }
+            }
+            table = new_table.get();
+            m_tables.push_back(std::move(new_table));
+            m_table.store(table, std::memory_order_release);
+        }
+
+        auto & slot = find_slot(*table, i_class, i_hash);
+        if (slot.m_key.load(std::memory_order_relaxed) == nullptr)
+        {
+            slot.m_key.store(i_class, std::memory_order_release);
+            m_used_slots++;
+        }
+        return slot;
+    }
+
+    const type_registry::SerializedClass *
+      type_registry::register_class(const class_type & i_class, uint64_t i_hash)
+    {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        // another thread may have registered the class in the meanwhile
+        auto const & reserved = find_slot(*m_tables.back(), &i_class, i_hash);
+        if (auto const registered = reserved.m_value.load(std::memory_order_relaxed))
+            return registered;
+
+        /* the id is taken before constructing the class, that may register the types of its
+           properties, unless it has been assigned by the registration list or by the schema */
+        auto const persisted =
+          m_schema != nullptr ? m_schema->find_class(schema_name(i_class)) : nullptr;
+        type_id id;
+        if (reserved.m_key.load(std::memory_order_relaxed) != nullptr)
+            id = reserved.m_id;
+        else if (persisted != nullptr)
+            id = persisted->id();
+        else
+            id = m_next_type_id++;
+        m_registration_depth++;
+        try
+        {
+            auto serialized_class = std::make_unique<SerializedClass>(this, i_class, id);
+
+            /* the plans are compiled from the current classes, so the objects written with a
+               different layout can't be read */
+            if (persisted != nullptr && !persisted->same_layout(serialized_class->data()))
+            {
+                except<std::runtime_error>(
+                  "type_registry: the layout of a class is different from the schema");
+            }
+            m_classes.push_back(std::move(serialized_class));
+        }
+        catch (...)
+        {
+            m_registration_depth--;
+            throw;
+        }
+        m_registration_depth--;
+        auto const result = m_classes.back().get();
+
+        /* the constructor may have inserted other slots, so the slot is searched again. Once
+           the value is published, the class is immutable. */
+        auto & slot = insert_slot(&i_class, i_hash);
+        slot.m_id   = id;
+        slot.m_value.store(result, std::memory_order_release);
+
+        /* the types of the elements are registered too, but only after the outermost class,
+           as they may contain it */
+        if (auto const container = i_class.container())
+        {
+            m_pending_types.push_back(container->elements_type().final_type());
+        }
+        if (m_registration_depth == 0)
+        {
+            while (!m_pending_types.empty())
+            {
+                auto const pending = m_pending_types.back();
+                m_pending_types.pop_back();
+                get_type_data(*pending);
+            }
+        }
+        return result;
+    }
+
+    std::vector<type_registry::type_data> type_registry::registered_classes()
+    {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        std::vector<type_data> result;
+        result.reserve(m_classes.size());
+        for (auto const & serialized_class : m_classes)
+            result.push_back(serialized_class->data());
+        return result;
+    }
 
     type_registry::type_data type_registry::get_type_data(const type & i_source_type)
     {
-        if (i_source_type.is_fundamental())
+        if (!i_source_type.is_class())
         {
-            return {i_source_type, 0, i_source_type, i_source_type.size()};
+            return {i_source_type,
+                    0,
+                    i_source_type,
+                    i_source_type.size(),
+                    nullptr,
+                    nullptr,
+                    compact_encoding_of(i_source_type)};
         }
         else
         {
             auto const & source_class = static_cast<const class_type &>(i_source_type);
-            auto &       slot         = m_classes[&source_class];
-            if (!slot)
+            auto const   hash         = hash_of(&source_class);
+
+            /* wait-free lookup: the cache, then the current table. A cache entry may be
+               overwritten concurrently with another class, so the class is checked. */
+            auto & cache_entry      = m_cache[hash >> (64 - cache_bits)];
+            auto   serialized_class = cache_entry.load(std::memory_order_acquire);
+            if (serialized_class == nullptr || serialized_class->m_source_class != &source_class)
             {
-                slot = std::make_unique<SerializedClass>(this, source_class, m_next_type_id);
-                m_next_type_id++;
+                auto const & table = *m_table.load(std::memory_order_acquire);
+                serialized_class =
+                  find_slot(table, &source_class, hash).m_value.load(std::memory_order_acquire);
+                if (serialized_class == nullptr)
+                    serialized_class = register_class(source_class, hash);
+                cache_entry.store(serialized_class, std::memory_order_release);
             }
-            return {i_source_type,
-                    slot->m_class_data.m_type_id,
-                    slot->m_class,
-                    slot->m_class_data.m_size};
+            return serialized_class->data();
         }
     }
 
-    type_registry::type_registry() = default;
+    value_encoding type_registry::compact_encoding_of(const type & i_type) noexcept
+    {
+        auto const is_one_of = [&](auto... i_types) { return ((&i_type == i_types) || ...); };
+        if (is_one_of(
+              &get_type<short>(), &get_type<int>(), &get_type<long>(), &get_type<long long>()))
+        {
+            return value_encoding::zigzag_varint;
+        }
+        else if (is_one_of(
+                   &get_type<unsigned short>(),
+                   &get_type<unsigned int>(),
+                   &get_type<unsigned long>(),
+                   &get_type<unsigned long long>(),
+                   &get_type<char16_t>(),
+                   &get_type<char32_t>()))
+        {
+            return value_encoding::varint;
+        }
+        else
+        {
+            return value_encoding::raw;
+        }
+    }
+
+    type_registry::type_registry()
+    {
+        m_tables.push_back(std::make_unique<Table>(min_slot_bits));
+        m_table.store(m_tables.back().get(), std::memory_order_release);
+    }
+
+    type_registry::type_registry(array_view<const class_type * const> i_registration_list)
+        : type_registry()
+    {
+        for (auto const source_class : i_registration_list)
+        {
+            auto const hash = hash_of(source_class);
+            if (find_slot(*m_tables.back(), source_class, hash).m_key.load() != nullptr)
+                except<std::invalid_argument>("type_registry: duplicate class in the list");
+            insert_slot(source_class, hash).m_id = m_next_type_id++;
+        }
+    }
+
+    type_registry::type_registry(const schema_view & i_schema) : type_registry()
+    {
+        m_schema       = &i_schema;
+        m_next_type_id = i_schema.next_type_id();
+    }
 
     type_registry::~type_registry() = default;
 
@@ -7,17 +7,130 @@
 #pragma once
 #include "cambrian/cambrian_common.h"
 #include "ediacaran/reflection/class_type.h"
+#include <atomic>
 #include <memory>
-#include <unordered_map>
+#include <mutex>
+#include <vector>
 
 namespace cambrian
 {
     using type_id = uint32_t;
 
+    class schema_view;
+
+    /** How a fundamental value is written in the compact wire format */
+    enum class value_encoding : uint8_t
+    {
+        raw,           /**< the bytes of the value */
+        varint,        /**< unsigned integer written as a varint */
+        zigzag_varint, /**< signed integer written as the varint of its zigzag encoding */
+    };
+
+    /** Flat program that writes or reads the properties of a class, in the order of
+        property_inspector. Adjacent inplace properties of fundamental or enum type are merged
+        in a single copy, and inplace objects of classes that are not containers are expanded
+        in place, so that the properties of a plain struct become a single copy. Every copy
+        keeps the list of the fundamental values it covers, used by the compact format. */
+    struct serialization_plan
+    {
+        struct field
+        {
+            size_t           m_offset;
+            size_t           m_size;
+            value_encoding   m_encoding;
+            const property * m_property = nullptr; /**< the property the value belongs to */
+        };
+
+        struct operation
+        {
+            enum class kind
+            {
+                copy,     /**< copies m_size bytes at m_offset */
+                object,   /**< a container of type m_class at m_offset, with the plan m_plan */
+                property, /**< m_property of the subobject at m_offset, accessed by value */
+            };
+
+            kind                       m_kind;
+            size_t                     m_offset;
+            size_t                     m_size     = 0;
+            const class_type *         m_class    = nullptr;
+            const serialization_plan * m_plan     = nullptr;
+            const property *           m_property = nullptr; /**< also set for objects */
+            size_t                     m_first_field = 0; /**< first of the fields of a copy */
+            size_t                     m_field_count = 0;
+        };
+
+        std::vector<operation> m_operations;
+        std::vector<field>     m_fields;
+        const container *      m_container = nullptr;
+    };
+
+    /** Reference from an object in the flat format to the elements of a container. m_offset
+        is relative to the address of the flat_range itself. */
+    struct flat_range
+    {
+        uint32_t m_offset = 0;
+        uint32_t m_count  = 0;
+    };
+
+    /** Layout of the objects of a class in the flat format (see write_flat). m_class is a
+        passive class with an inplace property for every property of the source class
+        (including the ones of all the direct and indirect bases, and excluding pointers), at
+        its natural alignment. Properties of class type embed the layout of their class. If the
+        class is a container, the properties are followed by a flat_range. */
+    struct flat_layout
+    {
+        struct field
+        {
+            const type * m_source_type;
+            size_t       m_offset;
+        };
+
+        const class_type * m_class = nullptr;
+        std::vector<field> m_fields; /**< same order of the properties of m_class */
+        const container *  m_container    = nullptr;
+        size_t             m_range_offset = 0;
+    };
+
+    /** Returns the offsets of the subobjects of all the bases of a class, direct and indirect,
+        in the order of bases(). The offset of a virtual base is stored in the object, so the
+        offsets are measured on a default constructed object of the class, and are exact for
+        complete objects of it. Classes without bases are not constructed. Throws
+        std::runtime_error if the class has bases and is not default constructible or
+        destructible. */
+    std::vector<size_t> base_offsets(const class_type & i_class);
+
+    /** Assigns the ids to the types and keeps the serialization data of the classes. The
+        classes are kept in a flat hash table with linear probing, behind a small direct-mapped
+        cache of the most recently used classes, so that the lookup in the loop of the
+        serializers is usually a single load.
+        The registry is thread safe, and a single registry can be shared by all the threads
+        that serialize, so that the ids are consistent across the streams. The lookup of a
+        class already registered is wait-free. The registration of a new class takes a mutex,
+        and publishes the data of the class, that is immutable afterwards. When the table
+        grows, the previous tables are kept until the registry is destroyed, as concurrent
+        lookups may still read them. */
     class type_registry
     {
       public:
         type_registry();
+
+        /** Assigns the ids 0, 1, 2... to the classes of the list, in order. The other classes
+            take the following ids when they are registered. The ids of the listed classes do
+            not depend on the order in which the objects are serialized, so two registries
+            constructed with the same list agree on them. Throws std::invalid_argument if a
+            class appears twice. */
+        explicit type_registry(array_view<const class_type * const> i_registration_list);
+
+        /** Assigns to the classes of a persisted schema the ids they have in the schema, when
+            they are registered, matching them by name. The other classes take ids not used by
+            the schema. The plans are compiled from the current classes, so the registration of
+            a class whose layout is different from the one in the schema (see
+            schema_view::class_entry::same_layout) throws std::runtime_error: objects written
+            with an older layout must be read matching the properties by name, with the tagged
+            format. The schema must outlive the registry. */
+        explicit type_registry(const schema_view & i_schema);
+
         type_registry(const type_registry &) = delete;
         type_registry & operator=(const type_registry &) = delete;
         ~type_registry();
@@ -28,17 +141,90 @@ namespace cambrian
             type_id const  m_id;
             const type &   m_serialized_type;
             uint64_t const m_serialized_size;
+
+            /** nullptr if the type is not a class */
+            const serialization_plan * const m_plan;
+
+            /** nullptr if the type is not a class. m_serialized_type is its m_class. */
+            const flat_layout * const m_layout;
+
+            /** encoding of the values of the type in the compact wire format */
+            value_encoding const m_compact_encoding;
         };
 
+        /** Returns the data of a type, registering it if necessary. Registering a class
+            registers all the types reachable from it, through properties, elements of
+            containers and pointers. */
         type_data get_type_data(const type & i_source_type);
 
+        /** Returns the data of all the classes registered so far, in order of registration */
+        std::vector<type_data> registered_classes();
+
+        /** Integers wider than a byte are written as varints by the compact wire format. Any
+            other type is written as raw bytes. */
+        static value_encoding compact_encoding_of(const type & i_type) noexcept;
+
       private:
         struct SerializedClassData;
         struct SerializedClass;
 
+        constexpr static size_t min_slot_bits = 4;
+        constexpr static size_t cache_bits    = 4;
+
+        /* the key and the value are written only with the mutex locked, and never change
+           once set. m_id is accessed only with the mutex locked. */
+        struct Slot
+        {
+            std::atomic<const class_type *>      m_key{nullptr};   /**< nullptr if empty */
+            std::atomic<const SerializedClass *> m_value{nullptr}; /**< nullptr if pending */
+            type_id                              m_id = 0;
+        };
+
+        struct Table
+        {
+            explicit Table(size_t i_slot_bits)
+                : m_slot_bits(i_slot_bits), m_slots(new Slot[size_t(1) << i_slot_bits])
+            {
+            }
+
+            size_t slot_count() const noexcept { return size_t(1) << m_slot_bits; }
+
+            size_t const            m_slot_bits;
+            std::unique_ptr<Slot[]> m_slots;
+        };
+
+        static uint64_t hash_of(const class_type * i_class) noexcept;
+
+        static Slot &
+          find_slot(const Table & i_table, const class_type * i_class, uint64_t i_hash) noexcept;
+
+        Slot & insert_slot(const class_type * i_class, uint64_t i_hash);
+
+        const SerializedClass * register_class(const class_type & i_class, uint64_t i_hash);
+
+        void compile_plan(
+          serialization_plan & io_plan, const class_type & i_class, size_t i_offset);
+
+        void add_to_plan(
+          serialization_plan &               io_plan,
+          const array_view<const property> & i_properties,
+          const void *                       i_object,
+          size_t                             i_offset);
+
       private:
-        std::unordered_map<const class_type *, std::unique_ptr<const SerializedClass>> m_classes;
-        type_id m_next_type_id = 0;
+        std::atomic<const SerializedClass *> m_cache[size_t(1) << cache_bits] = {};
+        std::atomic<Table *>                 m_table{nullptr};
+
+        /* the mutex is recursive, as registering a class registers the types it references.
+           The following members are accessed only with the mutex locked. */
+        std::recursive_mutex                                m_mutex;
+        std::vector<std::unique_ptr<Table>>                 m_tables; /**< the last is current */
+        std::vector<std::unique_ptr<const SerializedClass>> m_classes;
+        size_t                                              m_used_slots         = 0;
+        type_id                                             m_next_type_id       = 0;
+        size_t                                              m_registration_depth = 0;
+        std::vector<const type *>                           m_pending_types;
+        const schema_view *                                 m_schema = nullptr;
     };
 
 } // namespace cambrian
@@ -0,0 +1,199 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "cambrian/cambrian_common.h"
+#include <cstring>
+
+namespace cambrian
+{
+    /** Variable length encoding of unsigned integers (LEB128): 7 bits per byte, starting from
+        the least significant ones. The most significant bit of every byte but the last is
+        set. */
+
+    constexpr size_t max_varint_size = 10;
+
+    constexpr size_t varint_size(uint64_t i_value) noexcept
+    {
+        size_t size = 1;
+        while (i_value >= 0x80)
+        {
+            i_value >>= 7;
+            size++;
+        }
+        return size;
+    }
+
+    /** Maps signed integers to unsigned integers, so that values with a small magnitude have
+        a short encoding: 0, -1, 1, -2, 2... become 0, 1, 2, 3, 4... */
+    constexpr uint64_t zigzag_encode(int64_t i_value) noexcept
+    {
+        return (static_cast<uint64_t>(i_value) << 1) ^ static_cast<uint64_t>(i_value >> 63);
+    }
+
+    constexpr int64_t zigzag_decode(uint64_t i_value) noexcept
+    {
+        return static_cast<int64_t>((i_value >> 1) ^ (~(i_value & 1) + 1));
+    }
+
+    /** Writes a varint, returning the number of bytes written. The destination must have
+        room for varint_size(i_value) bytes. */
+    inline size_t write_varint(void * o_dest, uint64_t i_value) noexcept
+    {
+        auto         dest  = static_cast<unsigned char *>(o_dest);
+        size_t const count = varint_size(i_value);
+        for (size_t index = 0; index < count - 1; index++)
+        {
+            dest[index] = static_cast<unsigned char>(i_value | 0x80);
+            i_value >>= 7;
+        }
+        dest[count - 1] = static_cast<unsigned char>(i_value);
+        return count;
+    }
+
+    /** Writes a varint padded to exactly i_size bytes, so that it can be overwritten later
+        with any value not greater than varint_max_value(i_size). */
+    inline void write_padded_varint(void * o_dest, uint64_t i_value, size_t i_size) noexcept
+    {
+        CAMBRIAN_ASSERT(i_size > 0 && varint_size(i_value) <= i_size);
+        auto dest = static_cast<unsigned char *>(o_dest);
+        for (size_t index = 0; index < i_size - 1; index++)
+        {
+            dest[index] = static_cast<unsigned char>(i_value | 0x80);
+            i_value >>= 7;
+        }
+        dest[i_size - 1] = static_cast<unsigned char>(i_value);
+    }
+
+    constexpr uint64_t varint_max_value(size_t i_size) noexcept
+    {
+        return i_size * 7 >= 64 ? ~uint64_t(0) : (uint64_t(1) << (i_size * 7)) - 1;
+    }
+
+    /** Reads a varint from a buffer, returning the number of bytes read, or zero if the buffer
+        ends before the varint. Throws std::runtime_error if the varint is longer than
+        max_varint_size. */
+    inline size_t read_varint(const void * i_source, size_t i_size, uint64_t & o_value)
+    {
+        auto const source = static_cast<const unsigned char *>(i_source);
+        uint64_t   result = 0;
+        for (size_t index = 0; index < i_size; index++)
+        {
+            if (index >= max_varint_size)
+                except<std::runtime_error>("varint: corrupted stream");
+            result |= static_cast<uint64_t>(source[index] & 0x7F) << (index * 7);
+            if ((source[index] & 0x80) == 0)
+            {
+                o_value = result;
+                return index + 1;
+            }
+        }
+        return 0;
+    }
+
+    /** Reads up to i_max_count varints from a buffer, stopping at the first one that is not
+        complete. Returns the number of values read, and assigns to o_read_size the number of
+        bytes consumed. Groups of 8 single-byte varints, common in compact arrays, are decoded
+        without branching on every byte. */
+    inline size_t read_varints(
+      const void * i_source,
+      size_t       i_size,
+      uint64_t *   o_values,
+      size_t       i_max_count,
+      size_t &     o_read_size)
+    {
+        auto const source   = static_cast<const unsigned char *>(i_source);
+        size_t     count    = 0;
+        size_t     position = 0;
+        while (count < i_max_count)
+        {
+            if (i_max_count - count >= 8 && i_size - position >= 8)
+            {
+                uint64_t word;
+                memcpy(&word, source + position, 8);
+                if ((word & UINT64_C(0x8080808080808080)) == 0)
+                {
+                    for (size_t index = 0; index < 8; index++)
+                        o_values[count + index] = source[position + index];
+                    count += 8;
+                    position += 8;
+                    continue;
+                }
+            }
+
+            auto const size = read_varint(source + position, i_size - position, o_values[count]);
+            if (size == 0)
+                break;
+            position += size;
+            count++;
+        }
+        o_read_size = position;
+        return count;
+    }
+
+    /** Loads an integer of 1, 2, 4 or 8 bytes, extending it to 64 bits */
+    inline uint64_t load_integer(const void * i_source, size_t i_size, bool i_signed) noexcept
+    {
+        switch (i_size)
+        {
+        case 1:
+        {
+            uint8_t value;
+            memcpy(&value, i_source, 1);
+            return i_signed ? static_cast<uint64_t>(static_cast<int8_t>(value)) : value;
+        }
+        case 2:
+        {
+            uint16_t value;
+            memcpy(&value, i_source, 2);
+            return i_signed ? static_cast<uint64_t>(static_cast<int16_t>(value)) : value;
+        }
+        case 4:
+        {
+            uint32_t value;
+            memcpy(&value, i_source, 4);
+            return i_signed ? static_cast<uint64_t>(static_cast<int32_t>(value)) : value;
+        }
+        default:
+        {
+            CAMBRIAN_ASSERT(i_size == 8);
+            uint64_t value;
+            memcpy(&value, i_source, 8);
+            return value;
+        }
+        }
+    }
+
+    /** Stores the least significant i_size bytes of an integer */
+    inline void store_integer(void * o_dest, size_t i_size, uint64_t i_value) noexcept
+    {
+        switch (i_size)
+        {
+        case 1:
+        {
+            auto const value = static_cast<uint8_t>(i_value);
+            memcpy(o_dest, &value, 1);
+            break;
+        }
+        case 2:
+        {
+            auto const value = static_cast<uint16_t>(i_value);
+            memcpy(o_dest, &value, 2);
+            break;
+        }
+        case 4:
+        {
+            auto const value = static_cast<uint32_t>(i_value);
+            memcpy(o_dest, &value, 4);
+            break;
+        }
+        default:
+            CAMBRIAN_ASSERT(i_size == 8);
+            memcpy(o_dest, &i_value, 8);
+            break;
+        }
+    }
+
+} // namespace cambrian
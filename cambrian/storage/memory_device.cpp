@@ -1,13 +1,65 @@
-
 //   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
 // Distributed under the Boost Software License, Version 1.0.
 //    (See accompanying file LICENSE_1_0.txt or copy at
 //          http://www.boost.org/LICENSE_1_0.txt)
 
 #include "cambrian/storage/memory_device.h"
+#include "ediacaran/core/address.h"
+#include <cstring>
+#include <new>
 
 namespace cambrian
 {
+    memory_device::memory_device(page_size i_page_size) : m_page_size(i_page_size)
+    {
+        if (!is_power_of_2(i_page_size) || i_page_size < 256)
+            except<std::invalid_argument>(
+              "memory_device: the page size must be a power of 2 not less than 256");
+
+        mapped_page root = allocate_page().value();
+        m_root_page      = root.storage_address();
+        release_page(root);
+    }
+
+    memory_device::~memory_device()
+    {
+        for (auto page : m_pages)
+        {
+            ::operator delete(reinterpret_cast<void *>(page), std::align_val_t(m_page_size));
+        }
+    }
+
+    expected<mapped_page, storage_device::error> memory_device::allocate_page() noexcept
+    {
+        void * const block =
+          ::operator new(m_page_size, std::align_val_t(m_page_size), std::nothrow);
+        if (block == nullptr)
+            return storage_device::error::out_of_space;
+
+        auto const address = reinterpret_cast<page_address>(block);
+        CAMBRIAN_ASSERT((address & ~invalid_page_address) == 0); // the user bits must be free
+
+        try
+        {
+            m_pages.insert(address);
+        }
+        catch (...)
+        {
+            ::operator delete(block, std::align_val_t(m_page_size));
+            return storage_device::error::out_of_space;
+        }
+
+        memset(block, 0, m_page_size);
+        return mapped_page(address, block);
+    }
 
+    void memory_device::deallocate_page(page_address i_address) noexcept
+    {
+        CAMBRIAN_ASSERT(i_address != m_root_page);
+        auto const it = m_pages.find(i_address);
+        CAMBRIAN_ASSERT(it != m_pages.end());
+        m_pages.erase(it);
+        ::operator delete(reinterpret_cast<void *>(i_address), std::align_val_t(m_page_size));
+    }
 
 } // namespace cambrian
@@ -1,4 +1,3 @@
-
 //   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
 // Distributed under the Boost Software License, Version 1.0.
 //    (See accompanying file LICENSE_1_0.txt or copy at
@@ -7,21 +6,51 @@
 #pragma once
 #include "cambrian/cambrian_common.h"
 #include "cambrian/storage/storage_device.h"
+#include <atomic>
+#include <unordered_set>
 
 namespace cambrian
 {
+    /** Volatile storage device whose pages are heap blocks. The address of a page is the address
+        of its memory block, so mapping and unmapping are no-ops. New pages are zero-filled.
+        Pages can be mapped concurrently by many threads, while allocation and deallocation are
+        not thread safe. */
     class memory_device final : public storage_device
     {
       public:
         static_assert(sizeof(page_address) >= sizeof(void *));
 
+        memory_device(page_size i_page_size = 4096);
+
+        ~memory_device();
+
+        info get_info() noexcept override { return info{m_page_size, m_root_page}; }
+
+        expected<mapped_page, error> allocate_page() noexcept override;
+
+        void deallocate_page(page_address i_address) noexcept override;
+
         expected<mapped_page, error>
           map_page(page_address i_address, access_flags /*i_flags*/) noexcept override
         {
+            CAMBRIAN_ASSERT(m_pages.find(i_address) != m_pages.end());
+            m_map_count.fetch_add(1, std::memory_order_relaxed);
             return mapped_page(i_address, reinterpret_cast<void *>(i_address));
         }
 
         void unmap_page(const mapped_page & /*i_page*/) noexcept override {}
+
+        /** Returns the number of pages currently allocated, including the root page. */
+        size_t page_count() const noexcept { return m_pages.size(); }
+
+        /** Returns the number of times map_page has been called since the construction. */
+        uint64_t map_count() const noexcept { return m_map_count.load(std::memory_order_relaxed); }
+
+      private:
+        page_size const                  m_page_size;
+        page_address                     m_root_page = invalid_page_address;
+        std::unordered_set<page_address> m_pages;
+        std::atomic<uint64_t>            m_map_count{0};
     };
 
 
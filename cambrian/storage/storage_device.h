@@ -8,6 +8,7 @@
 #include "cambrian/cambrian_common.h"
 #include "ediacaran/core/expected.h"
 #include <limits>
+#include <utility>
 
 namespace cambrian
 {
@@ -49,6 +50,12 @@ namespace cambrian
         mapped_page(const mapped_page &) = delete;
         mapped_page & operator=(const mapped_page &) = delete;
 
+        page_address storage_address() const noexcept { return m_storage_address; }
+
+        void * mem_address() const noexcept { return m_mem_address; }
+
+        bool empty() const noexcept { return m_mem_address == nullptr; }
+
       private:
         page_address m_storage_address{};
         void *       m_mem_address{};
@@ -63,7 +70,9 @@ namespace cambrian
 
         enum class error
         {
-
+            out_of_space,
+            invalid_address,
+            io_failure
         };
 
         enum class access_flags
@@ -91,8 +100,82 @@ namespace cambrian
         virtual void unmap_page(const mapped_page & i_page) noexcept = 0;
 
         virtual ~storage_device() = default;
+
+        /** Unmaps a page and resets it to the empty state. Does nothing if the page is empty. */
+        void release_page(mapped_page & io_page) noexcept
+        {
+            if (!io_page.empty())
+            {
+                unmap_page(io_page);
+                io_page = mapped_page{};
+            }
+        }
     };
 
+    /** Owning wrapper for a mapped_page, that unmaps the page when destroyed. */
+    class scoped_page
+    {
+      public:
+        scoped_page() noexcept = default;
+
+        scoped_page(storage_device & i_device, mapped_page && i_page) noexcept
+            : m_device(&i_device), m_page(std::move(i_page))
+        {
+        }
+
+        scoped_page(scoped_page && i_source) noexcept
+            : m_device(i_source.m_device), m_page(std::move(i_source.m_page))
+        {
+            i_source.m_device = nullptr;
+        }
+
+        scoped_page & operator=(scoped_page && i_source) noexcept
+        {
+            release();
+            m_device          = i_source.m_device;
+            m_page            = std::move(i_source.m_page);
+            i_source.m_device = nullptr;
+            return *this;
+        }
+
+        scoped_page(const scoped_page &) = delete;
+        scoped_page & operator=(const scoped_page &) = delete;
+
+        ~scoped_page() { release(); }
+
+        page_address storage_address() const noexcept { return m_page.storage_address(); }
+
+        void * mem_address() const noexcept { return m_page.mem_address(); }
+
+        bool empty() const noexcept { return m_page.empty(); }
+
+        void release() noexcept
+        {
+            if (m_device != nullptr)
+            {
+                m_device->release_page(m_page);
+                m_device = nullptr;
+            }
+        }
+
+      private:
+        storage_device * m_device{};
+        mapped_page      m_page;
+    };
+
+    /** Maps a page and wraps it in a scoped_page. Throws storage_device::error on failure. */
+    inline scoped_page map_scoped_page(
+      storage_device & i_device, page_address i_address, storage_device::access_flags i_flags)
+    {
+        return scoped_page(i_device, i_device.map_page(i_address, i_flags).value());
+    }
+
+    /** Allocates a page and wraps it in a scoped_page. Throws storage_device::error on failure. */
+    inline scoped_page allocate_scoped_page(storage_device & i_device)
+    {
+        return scoped_page(i_device, i_device.allocate_page().value());
+    }
+
     constexpr storage_device::access_flags
       operator|(storage_device::access_flags i_first, storage_device::access_flags i_second)
     {
@@ -98,9 +98,30 @@ namespace edi
             m_remaining_size -= static_cast<ptrdiff_t>(i_size);
         }
 
+        bool read_all_or_none(void * i_dest, size_t i_size) noexcept
+        {
+            if (m_remaining_size < static_cast<ptrdiff_t>(i_size))
+                return false;
+            memcpy(i_dest, m_next_byte, i_size);
+            m_next_byte += i_size;
+            m_remaining_size -= static_cast<ptrdiff_t>(i_size);
+            return true;
+        }
+
+        const void * next_byte() const noexcept { return m_next_byte; }
+
+        const void * skip(size_t i_size) noexcept
+        {
+            EDIACARAN_ASSERT(m_remaining_size >= static_cast<ptrdiff_t>(i_size));
+            auto const result = m_next_byte;
+            m_next_byte += i_size;
+            m_remaining_size -= static_cast<ptrdiff_t>(i_size);
+            return result;
+        }
+
         expected<unsigned char> read_byte() noexcept
         {
-            if (m_remaining_size <= 0)
+            if (m_remaining_size > 0)
             {
                 unsigned char result = *m_next_byte;
                 m_next_byte++;
@@ -51,17 +51,32 @@ namespace edi
 
         using destroy_iterator_function_ptr = void (*)(void * i_iterator) noexcept;
 
+        /** Removes all the elements */
+        using clear_function_ptr = void (*)(void * i_container);
+
+        /** Adds a default constructed element at the end, and returns its address */
+        using emplace_back_function_ptr = void * (*)(void * i_container);
+
+        /** Resizes a contiguous container, default constructing the new elements, and returns
+            the address of the first element */
+        using resize_function_ptr = void * (*)(void * i_container, index i_size);
+
         constexpr container(
           capability                      i_capabilities,
           qualified_type_ptr              i_elements_type,
           size_t                          i_iterator_size,
           construct_iterator_function_ptr i_construct_iterator,
           next_segment_function_ptr       i_next_segment,
-          destroy_iterator_function_ptr   i_destroy_iterator_function) noexcept
+          destroy_iterator_function_ptr   i_destroy_iterator_function,
+          clear_function_ptr              i_clear_function        = nullptr,
+          emplace_back_function_ptr       i_emplace_back_function = nullptr,
+          resize_function_ptr             i_resize_function       = nullptr) noexcept
             : m_capabilities(i_capabilities), m_elements_type(i_elements_type),
               m_iterator_size(i_iterator_size), m_construct_iterator(i_construct_iterator),
               m_next_segment(i_next_segment),
-              m_destroy_iterator_function(i_destroy_iterator_function)
+              m_destroy_iterator_function(i_destroy_iterator_function),
+              m_clear_function(i_clear_function), m_emplace_back_function(i_emplace_back_function),
+              m_resize_function(i_resize_function)
 
         {
             EDIACARAN_ASSERT(i_construct_iterator != nullptr);
@@ -83,6 +98,18 @@ namespace edi
             return m_destroy_iterator_function;
         }
 
+        /** Returns nullptr if the container can't be cleared */
+        constexpr clear_function_ptr clear_function() const noexcept { return m_clear_function; }
+
+        /** Returns nullptr if the container does not support adding elements */
+        constexpr emplace_back_function_ptr emplace_back_function() const noexcept
+        {
+            return m_emplace_back_function;
+        }
+
+        /** Returns nullptr if the container is not contiguous or can't be resized */
+        constexpr resize_function_ptr resize_function() const noexcept { return m_resize_function; }
+
       private:
         capability const                      m_capabilities{capability::none};
         qualified_type_ptr const              m_elements_type{};
@@ -90,6 +117,9 @@ namespace edi
         construct_iterator_function_ptr const m_construct_iterator{};
         next_segment_function_ptr const       m_next_segment{};
         destroy_iterator_function_ptr const   m_destroy_iterator_function{};
+        clear_function_ptr const              m_clear_function{};
+        emplace_back_function_ptr const       m_emplace_back_function{};
+        resize_function_ptr const             m_resize_function{};
     };
 
 } // namespace edi
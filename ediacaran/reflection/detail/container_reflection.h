@@ -142,6 +142,97 @@ namespace edi
             }
         };
 
+        template <typename CONTAINER, typename = std::void_t<>>
+        struct HasClear : std::false_type
+        {
+        };
+
+        template <typename CONTAINER>
+        struct HasClear<CONTAINER, std::void_t<decltype(declval_value<CONTAINER>().clear())>>
+            : std::true_type
+        {
+        };
+
+        template <typename CONTAINER, typename = std::void_t<>>
+        struct HasEmplaceBack : std::false_type
+        {
+        };
+
+        template <typename CONTAINER>
+        struct HasEmplaceBack<
+          CONTAINER,
+          std::void_t<
+            decltype(declval_value<CONTAINER>().emplace_back()),
+            decltype(&declval_value<CONTAINER>().back())>> : std::true_type
+        {
+        };
+
+        template <typename CONTAINER, typename = std::void_t<>>
+        struct HasResize : std::false_type
+        {
+        };
+
+        template <typename CONTAINER>
+        struct HasResize<
+          CONTAINER,
+          std::void_t<decltype(declval_value<CONTAINER>().resize(size_t{}))>> : std::true_type
+        {
+        };
+
+        template <typename CONTAINER> struct StdContainerEditing
+        {
+            static void clear(void * i_container)
+            {
+                EDIACARAN_ASSERT(i_container != nullptr);
+                static_cast<CONTAINER *>(i_container)->clear();
+            }
+
+            static void * emplace_back(void * i_container)
+            {
+                EDIACARAN_ASSERT(i_container != nullptr);
+                auto & container = *static_cast<CONTAINER *>(i_container);
+                container.emplace_back();
+                return const_cast<std::remove_cv_t<typename CONTAINER::value_type> *>(
+                  &container.back());
+            }
+
+            static void * resize(void * i_container, container::index i_size)
+            {
+                EDIACARAN_ASSERT(i_container != nullptr);
+                auto & container = *static_cast<CONTAINER *>(i_container);
+                container.resize(static_cast<size_t>(i_size));
+                return const_cast<std::remove_cv_t<typename CONTAINER::value_type> *>(
+                  container.data());
+            }
+        };
+
+        template <typename CONTAINER>
+        constexpr container::clear_function_ptr get_clear_function() noexcept
+        {
+            if constexpr (HasClear<CONTAINER>::value)
+                return &StdContainerEditing<CONTAINER>::clear;
+            else
+                return nullptr;
+        }
+
+        template <typename CONTAINER>
+        constexpr container::emplace_back_function_ptr get_emplace_back_function() noexcept
+        {
+            if constexpr (HasEmplaceBack<CONTAINER>::value)
+                return &StdContainerEditing<CONTAINER>::emplace_back;
+            else
+                return nullptr;
+        }
+
+        template <typename CONTAINER>
+        constexpr container::resize_function_ptr get_resize_function() noexcept
+        {
+            if constexpr (is_contiguous_container_v<CONTAINER> && HasResize<CONTAINER>::value)
+                return &StdContainerEditing<CONTAINER>::resize;
+            else
+                return nullptr;
+        }
+
     } //namespace detail
 
     template <
@@ -156,7 +247,10 @@ namespace edi
                          Cont::iterator_storage_size,
                          &Cont::construct_iterator,
                          &Cont::next_segment,
-                         &Cont::destroy_iterator};
+                         &Cont::destroy_iterator,
+                         detail::get_clear_function<CONTAINER>(),
+                         detail::get_emplace_back_function<CONTAINER>(),
+                         detail::get_resize_function<CONTAINER>()};
     }
 
 } // namespace edi
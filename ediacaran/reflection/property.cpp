@@ -0,0 +1,46 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "ediacaran/reflection/property.h"
+#include <thread>
+
+namespace edi
+{
+    namespace detail
+    {
+        std::atomic<property_observer *> g_property_observer{nullptr};
+
+        /** the notifications in progress */
+        std::atomic<size_t> g_property_observer_users{0};
+
+        void notify_property_set(const property & i_property, void * i_object)
+        {
+            /* the notification is counted before loading the observer, so that
+               set_property_observer, that replaces the observer before waiting for the count,
+               can't miss it */
+            g_property_observer_users.fetch_add(1, std::memory_order_seq_cst);
+            struct Release
+            {
+                ~Release() { g_property_observer_users.fetch_sub(1, std::memory_order_release); }
+            } const release;
+
+            if (auto const observer = g_property_observer.load(std::memory_order_seq_cst))
+                observer->on_property_set(i_property, i_object);
+        }
+    } // namespace detail
+
+    property_observer * set_property_observer(property_observer * i_observer) noexcept
+    {
+        auto const previous =
+          detail::g_property_observer.exchange(i_observer, std::memory_order_seq_cst);
+        if (previous != nullptr)
+        {
+            while (detail::g_property_observer_users.load(std::memory_order_acquire) != 0)
+                std::this_thread::yield();
+        }
+        return previous;
+    }
+
+} // namespace edi
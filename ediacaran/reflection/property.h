@@ -9,10 +9,39 @@
 #include "ediacaran/core/char_writer.h"
 #include "ediacaran/reflection/qualified_type_ptr.h"
 #include "ediacaran/reflection/type.h"
+#include <atomic>
 #include <cstddef>
 
 namespace edi
 {
+    class property;
+
+    /** Receives a notification after a property is assigned by property::set (and so by the
+        setters of property_inspector). See set_property_observer. */
+    class property_observer
+    {
+      public:
+        virtual void on_property_set(const property & i_property, void * i_object) = 0;
+
+      protected:
+        ~property_observer() = default;
+    };
+
+    /** Installs the observer notified by property::set, returning the previous one. A null
+        observer disables the notifications. The observer is global, and can be notified by
+        many threads concurrently. If there is a previous observer, waits until the
+        notifications in progress have returned, so that the previous observer can be
+        destroyed after the call. For this reason an observer must not call this function
+        while it is notified. */
+    property_observer * set_property_observer(property_observer * i_observer) noexcept;
+
+    namespace detail
+    {
+        extern std::atomic<property_observer *> g_property_observer;
+
+        void notify_property_set(const property & i_property, void * i_object);
+    } // namespace detail
+
     class property
     {
       public:
@@ -112,6 +141,9 @@ namespace edi
                 auto const data = address_add(i_dest_object, m_offset);
                 m_qualified_type.primary_type()->copy_assign(data, i_value_source);
             }
+
+            if (detail::g_property_observer.load(std::memory_order_relaxed) != nullptr)
+                detail::notify_property_set(*this, i_dest_object);
         }
 
       private:
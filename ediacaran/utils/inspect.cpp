@@ -13,6 +13,15 @@
 
 namespace edi
 {
+    namespace detail
+    {
+        std::atomic<property_loader *> g_property_loader{nullptr};
+    }
+
+    property_loader * set_property_loader(property_loader * i_loader) noexcept
+    {
+        return detail::g_property_loader.exchange(i_loader, std::memory_order_acq_rel);
+    }
     property_inspector inspect_properties(const raw_ptr & i_target)
     {
         return property_inspector(i_target);
@@ -70,8 +79,17 @@ namespace edi
         }
     }
 
+    void property_inspector::iterator::load_prop() const
+    {
+        if (auto const loader = detail::g_property_loader.load(std::memory_order_acquire))
+        {
+            loader->load_property(*m_property, m_subobject);
+        }
+    }
+
     raw_ptr property_inspector::iterator::get_prop_value()
     {
+        load_prop();
         auto const & property_type = m_property->qualified_type();
         auto         value         = const_cast<void *>(m_property->get_inplace(m_subobject));
         if (value == nullptr)
@@ -105,6 +123,7 @@ namespace edi
         {
             except<std::runtime_error>("Property is not settable");
         }
+        load_prop();
         m_property->set(m_subobject, i_value.object());
     }
 
@@ -121,6 +140,7 @@ namespace edi
             {
                 except<std::runtime_error>("Property is not settable");
             }
+            load_prop();
             m_property->set(m_subobject, m_dyn_value.object());
         }
         else
@@ -7,6 +7,7 @@
 #pragma once
 #include <ediacaran/reflection/class_type.h>
 #include <ediacaran/utils/dyn_value.h>
+#include <atomic>
 #include <vector>
 
 namespace edi
@@ -14,6 +15,28 @@ namespace edi
     class property_inspector;
     class function_inspector;
 
+    /** Notified by property_inspector (and so by get_property_value and set_property_value)
+        before a property is read or assigned, so that its value can be loaded on demand. See
+        set_property_loader. */
+    class property_loader
+    {
+      public:
+        virtual void load_property(const property & i_property, const void * i_object) = 0;
+
+      protected:
+        ~property_loader() = default;
+    };
+
+    /** Installs the loader notified by property_inspector, returning the previous one. A null
+        loader disables the notifications. The loader is global, and can be notified by many
+        threads concurrently. */
+    property_loader * set_property_loader(property_loader * i_loader) noexcept;
+
+    namespace detail
+    {
+        extern std::atomic<property_loader *> g_property_loader;
+    }
+
     property_inspector inspect_properties(const raw_ptr & i_target);
 
     function_inspector inspect_functions(const raw_ptr & i_target);
@@ -135,6 +158,7 @@ namespace edi
           private:
             friend class content;
             void    next_base() noexcept;
+            void    load_prop() const;
             raw_ptr get_prop_value();
             void    set_prop_value(const raw_ptr & i_value);
             void    set_prop_value(char_reader & i_source);
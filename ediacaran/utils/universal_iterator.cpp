@@ -100,6 +100,20 @@ namespace edi
         return *this;
     }
 
+    universal_iterator & universal_iterator::advance_in_segment(container::index i_count)
+    {
+        EDIACARAN_ASSERT(i_count > 0 && i_count <= m_curr_segment.m_element_count);
+        m_curr_segment.m_element_count -= i_count;
+        m_curr_segment.m_elements = address_add(
+          m_curr_segment.m_elements,
+          static_cast<size_t>(i_count * m_curr_segment.element_type.primary_type()->size()));
+        if (m_curr_segment.m_element_count == 0)
+        {
+            m_curr_segment = m_container->next_segment()(m_iterator);
+        }
+        return *this;
+    }
+
     void universal_iterator::destroy_iterator() noexcept
     {
         if (m_iterator != nullptr)
@@ -27,6 +27,13 @@ namespace edi
 
         universal_iterator & operator++();
 
+        /** Advances by i_count elements, that must not exceed the element count of the current
+            segment */
+        universal_iterator & advance_in_segment(container::index i_count);
+
+        /** Returns the remaining elements of the current segment */
+        const container::segment & segment() const noexcept { return m_curr_segment; }
+
         ~universal_iterator();
 
         raw_ptr operator*() const noexcept
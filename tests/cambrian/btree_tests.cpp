@@ -0,0 +1,181 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../common.h"
+#include "cambrian/data/btree.h"
+#include "cambrian/storage/memory_device.h"
+#include <map>
+#include <random>
+#include <string>
+
+namespace cambrian_test
+{
+    using namespace cambrian;
+
+    namespace
+    {
+        std::string make_path(size_t i_user, size_t i_item)
+        {
+            return "/users/" + std::to_string(i_user) + "/items/" + std::to_string(i_item);
+        }
+
+        // checks the content of a tree against a reference map
+        void check_content(const btree & i_tree, const std::map<std::string, page_address> & i_map)
+        {
+            ENCELADO_TEST_ASSERT(i_tree.size() == i_map.size());
+            auto expected = i_map.begin();
+            for (auto it = i_tree.begin(); it != end_marker; ++it, ++expected)
+            {
+                ENCELADO_TEST_ASSERT(expected != i_map.end());
+                ENCELADO_TEST_ASSERT(it.key() == expected->first);
+                ENCELADO_TEST_ASSERT(it.value() == expected->second);
+            }
+            ENCELADO_TEST_ASSERT(expected == i_map.end());
+        }
+
+        void btree_content_test(page_size i_page_size, size_t i_user_count, size_t i_item_count)
+        {
+            memory_device device(i_page_size);
+            auto const    initial_page_count = device.page_count();
+            btree         tree(device, btree::create(device));
+
+            std::map<std::string, page_address> map;
+            std::mt19937                        random;
+            page_address                        value = 0;
+            for (size_t index = 0; index < i_user_count * i_item_count; index++)
+            {
+                auto const key = make_path(random() % i_user_count, random() % i_item_count);
+                value += 64;
+                bool const inserted = map.emplace(key, value).second;
+                ENCELADO_TEST_ASSERT(tree.insert(key, value) == inserted);
+            }
+            ENCELADO_TEST_ASSERT(tree.height() > 0);
+            check_content(tree, map);
+
+            for (auto const & entry : map)
+                ENCELADO_TEST_ASSERT(tree.lookup(entry.first) == entry.second);
+            ENCELADO_TEST_ASSERT(tree.lookup("/users/") == invalid_page_address);
+
+            // lower_bound
+            auto const bound = tree.lower_bound("/users/3");
+            ENCELADO_TEST_ASSERT(bound.key() == map.lower_bound("/users/3")->first);
+
+            // prefix scan
+            std::string const prefix        = "/users/7/";
+            size_t            prefix_count  = 0;
+            auto              expected_iter = map.lower_bound(prefix);
+            for (auto it = tree.scan_prefix(prefix); it != end_marker; ++it, ++expected_iter)
+            {
+                ENCELADO_TEST_ASSERT(it.key() == expected_iter->first);
+                ENCELADO_TEST_ASSERT(it.key().compare(0, prefix.size(), prefix) == 0);
+                prefix_count++;
+            }
+            ENCELADO_TEST_ASSERT(prefix_count > 0);
+            ENCELADO_TEST_ASSERT(tree.scan_prefix("/groups/").is_over());
+
+            // prefix delete
+            ENCELADO_TEST_ASSERT(tree.remove_prefix(prefix) == prefix_count);
+            map.erase(map.lower_bound(prefix), map.lower_bound("/users/70"));
+            check_content(tree, map);
+
+            // range delete
+            auto const range_first = map.lower_bound("/users/2");
+            auto const range_last  = map.lower_bound("/users/5");
+            auto const range_count = static_cast<uint64_t>(std::distance(range_first, range_last));
+            ENCELADO_TEST_ASSERT(tree.remove_range("/users/2", "/users/5") == range_count);
+            map.erase(range_first, range_last);
+            check_content(tree, map);
+
+            // single deletes
+            for (auto it = map.begin(); it != map.end();)
+            {
+                ENCELADO_TEST_ASSERT(tree.remove(it->first));
+                it = map.erase(it);
+                if (it != map.end())
+                    ++it;
+            }
+            ENCELADO_TEST_ASSERT(!tree.remove("/users/"));
+            check_content(tree, map);
+
+            // the tree can be refilled after clearing it
+            ENCELADO_TEST_ASSERT(tree.remove_prefix("") == map.size());
+            map.clear();
+            check_content(tree, map);
+            ENCELADO_TEST_ASSERT(tree.height() == 0);
+            ENCELADO_TEST_ASSERT(tree.insert("/a", 64) && tree.lookup("/a") == 64);
+            ENCELADO_TEST_ASSERT(tree.remove("/a"));
+
+            // no pages are leaked: the meta page and the empty root remain
+            ENCELADO_TEST_ASSERT(device.page_count() == initial_page_count + 2);
+        }
+
+        void btree_key_length_test()
+        {
+            memory_device device(512);
+            btree         tree(device, btree::create(device));
+            std::string   key(tree.max_key_length(), 'k');
+            for (size_t index = 0; index < 200; index++)
+            {
+                key.back() = static_cast<char>('0' + index % 64);
+                key[key.size() / 2] = static_cast<char>('0' + index / 64);
+                ENCELADO_TEST_ASSERT(tree.insert(key, (index + 1) * 64));
+            }
+            ENCELADO_TEST_ASSERT(tree.size() == 200);
+
+            bool thrown = false;
+            try
+            {
+                tree.insert(std::string(tree.max_key_length() + 1, 'k'), 64);
+            }
+            catch (const std::invalid_argument &)
+            {
+                thrown = true;
+            }
+            ENCELADO_TEST_ASSERT(thrown);
+        }
+
+        // a key that shrinks the prefix of a full node makes the records of the node longer
+        void btree_prefix_shrink_test()
+        {
+            memory_device device(4096);
+            btree         tree(device, btree::create(device));
+
+            std::map<std::string, page_address> map;
+            std::string const                   prefix(900, 'p');
+            page_address                        value = 0;
+            for (size_t index = 0; index < 41; index++)
+            {
+                auto key = prefix + std::to_string(index);
+                key.resize(tree.max_key_length(), 's');
+                value += 64;
+                map.emplace(key, value);
+                ENCELADO_TEST_ASSERT(tree.insert(key, value));
+            }
+            for (auto const & key : {"a", "z", "p", "pz"})
+            {
+                value += 64;
+                map.emplace(key, value);
+                ENCELADO_TEST_ASSERT(tree.insert(key, value));
+                check_content(tree, map);
+            }
+            for (auto const & entry : map)
+                ENCELADO_TEST_ASSERT(tree.lookup(entry.first) == entry.second);
+        }
+
+    } // namespace
+
+    void btree_tests()
+    {
+        btree_content_test(4096, 100, 100);
+
+        // with small pages the tree has many levels
+        btree_content_test(512, 40, 50);
+
+        btree_key_length_test();
+
+        btree_prefix_shrink_test();
+    }
+
+} // namespace cambrian_test
@@ -0,0 +1,333 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../common.h"
+#include "cambrian/data/directory.h"
+#include "cambrian/storage/memory_device.h"
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cambrian_test
+{
+    using namespace cambrian;
+
+    namespace
+    {
+        std::string make_name(size_t i_index) { return "item_" + std::to_string(i_index); }
+
+        void directory_content_test(page_size i_page_size, size_t i_entry_count)
+        {
+            memory_device device(i_page_size);
+            directory     dir(device, directory::create(device));
+
+            // fake values: they are never dereferenced
+            auto const value_of = [](size_t i_index) { return (i_index + 1) * 64; };
+
+            for (size_t index = 0; index < i_entry_count; index++)
+                ENCELADO_TEST_ASSERT(dir.insert(make_name(index), value_of(index)));
+            ENCELADO_TEST_ASSERT(!dir.insert(make_name(0), value_of(0)));
+            ENCELADO_TEST_ASSERT(dir.entry_count() == i_entry_count);
+
+            for (size_t index = 0; index < i_entry_count; index++)
+                ENCELADO_TEST_ASSERT(dir.lookup(make_name(index)) == value_of(index));
+            ENCELADO_TEST_ASSERT(dir.lookup("missing") == invalid_page_address);
+
+            // every entry is visited once
+            std::unordered_map<std::string, page_address> visited;
+            for (directory_iterator it(dir); it != end_marker; ++it)
+                ENCELADO_TEST_ASSERT(visited.emplace(it->m_name, it->m_value).second);
+            ENCELADO_TEST_ASSERT(visited.size() == i_entry_count);
+
+            // remove the odd entries
+            for (size_t index = 1; index < i_entry_count; index += 2)
+                ENCELADO_TEST_ASSERT(dir.remove(make_name(index)));
+            ENCELADO_TEST_ASSERT(!dir.remove(make_name(1)));
+            ENCELADO_TEST_ASSERT(dir.entry_count() == (i_entry_count + 1) / 2);
+            for (size_t index = 0; index < i_entry_count; index++)
+            {
+                auto const expected = (index & 1) ? invalid_page_address : value_of(index);
+                ENCELADO_TEST_ASSERT(dir.lookup(make_name(index)) == expected);
+            }
+        }
+
+        void directory_page_access_test()
+        {
+            memory_device device;
+            directory     dir(device, directory::create(device));
+            for (size_t index = 0; index < 100'000; index++)
+                dir.insert(make_name(index), (index + 1) * 64);
+            ENCELADO_TEST_ASSERT(dir.global_depth() > 8);
+
+            // a lookup maps the header, the index pages, a table page and a bucket
+            auto const levels = dir.table_levels();
+            for (size_t index = 0; index < 100'000; index += 997)
+            {
+                auto const maps_before = device.map_count();
+                ENCELADO_TEST_ASSERT(dir.lookup(make_name(index)) != invalid_page_address);
+                ENCELADO_TEST_ASSERT(device.map_count() - maps_before == 3 + levels);
+            }
+        }
+
+        void directory_growth_test()
+        {
+            // with small pages the table grows through many levels of index pages
+            memory_device device(256);
+            directory     dir(device, directory::create(device));
+            for (size_t index = 0; index < 50'000; index++)
+                dir.insert(make_name(index), (index + 1) * 64);
+            ENCELADO_TEST_ASSERT(dir.global_depth() > 12 && dir.table_levels() >= 2);
+
+            // no bucket is chained
+            auto const levels = dir.table_levels();
+            for (size_t index = 0; index < 50'000; index += 101)
+            {
+                auto const maps_before = device.map_count();
+                ENCELADO_TEST_ASSERT(dir.lookup(make_name(index)) == (index + 1) * 64);
+                ENCELADO_TEST_ASSERT(device.map_count() - maps_before == 3 + levels);
+            }
+        }
+
+        void directory_collision_test()
+        {
+            /* "Ab" and "BA" have the same hash, so all the names made of 8 of them have the same
+               hash, and their bucket is chained */
+            std::vector<std::string> names;
+            for (size_t bits = 0; bits < 256; bits++)
+            {
+                std::string name;
+                for (size_t block = 0; block < 8; block++)
+                    name += (bits >> block) & 1 ? "Ab" : "BA";
+                names.push_back(name);
+            }
+
+            memory_device device(256);
+            directory     dir(device, directory::create(device));
+            for (size_t index = 0; index < 1000; index++)
+                ENCELADO_TEST_ASSERT(dir.insert(make_name(index), (index + 1) * 64));
+            for (size_t index = 0; index < names.size(); index++)
+                ENCELADO_TEST_ASSERT(dir.insert(names[index], (index + 1) * 64));
+            ENCELADO_TEST_ASSERT(!dir.insert(names[7], 64));
+
+            // the table is doubled only to separate the other names from the collisions
+            ENCELADO_TEST_ASSERT(dir.global_depth() < 20);
+            for (size_t index = 0; index < names.size(); index++)
+                ENCELADO_TEST_ASSERT(dir.lookup(names[index]) == (index + 1) * 64);
+            for (size_t index = 0; index < 1000; index++)
+                ENCELADO_TEST_ASSERT(dir.lookup(make_name(index)) == (index + 1) * 64);
+
+            size_t count = 0;
+            for (directory_iterator it(dir); it != end_marker; ++it)
+                count++;
+            ENCELADO_TEST_ASSERT(count == names.size() + 1000);
+
+            for (size_t index = 0; index < names.size(); index += 2)
+                ENCELADO_TEST_ASSERT(dir.remove(names[index]));
+            for (size_t index = 0; index < names.size(); index++)
+            {
+                auto const expected = (index & 1) ? (index + 1) * 64 : invalid_page_address;
+                ENCELADO_TEST_ASSERT(dir.lookup(names[index]) == expected);
+            }
+            ENCELADO_TEST_ASSERT(dir.entry_count() == names.size() / 2 + 1000);
+        }
+
+        void directory_tree_test()
+        {
+            memory_device device;
+            directory::format(device, device.get_info().m_root_page);
+
+            directory root(device, device.get_info().m_root_page);
+            auto      users = root.make_subdirectory("users");
+            auto      user  = users.make_subdirectory("42");
+            user.insert("profile", 4096);
+            user.insert("settings", 8192);
+            ENCELADO_TEST_ASSERT(
+              root.make_subdirectory("users").header_page() == users.header_page());
+
+            obj_ref const profile(&device, "/users/42/profile");
+            ENCELADO_TEST_ASSERT(profile.exists() && !profile.is_directory());
+            ENCELADO_TEST_ASSERT(profile.address() == 4096);
+
+            obj_ref const user_ref(&device, "users//42/");
+            ENCELADO_TEST_ASSERT(user_ref.is_directory());
+            ENCELADO_TEST_ASSERT(user_ref.address() == user.header_page());
+
+            ENCELADO_TEST_ASSERT(!obj_ref(&device, "/users/43/profile").exists());
+            ENCELADO_TEST_ASSERT(!obj_ref(&device, "/users/42/profile/x").exists());
+            ENCELADO_TEST_ASSERT(obj_ref(&device, "/").is_directory());
+
+            size_t count = 0;
+            for (directory_iterator it(&device, "/users/42"); it != end_marker; ++it)
+            {
+                ENCELADO_TEST_ASSERT(it->m_name == "profile" || it->m_name == "settings");
+                count++;
+            }
+            ENCELADO_TEST_ASSERT(count == 2);
+            ENCELADO_TEST_ASSERT(directory_iterator(&device, "/users/42/profile").is_over());
+        }
+
+        void directory_batch_resolve_test()
+        {
+            memory_device device;
+            directory::format(device, device.get_info().m_root_page);
+
+            directory                root(device, device.get_info().m_root_page);
+            auto                     users = root.make_subdirectory("users");
+            std::vector<std::string> paths;
+            char const * const       items[] = {"profile", "settings", "photo"};
+            for (size_t user = 0; user < 50; user++)
+            {
+                auto user_dir = users.make_subdirectory(std::to_string(user));
+                for (size_t item = 0; item < 3; item++)
+                {
+                    user_dir.insert(items[item], (user * 3 + item + 1) * 64);
+                    paths.push_back("/users/" + std::to_string(user) + "/" + items[item]);
+                }
+            }
+            paths.push_back("/users/7/missing");
+            paths.push_back("/users/7/profile/child");
+            paths.push_back("/users/7/profile");
+            paths.push_back("/groups/1");
+            paths.push_back("users//3/");
+            paths.push_back("/");
+
+            std::vector<string_view> views(paths.begin(), paths.end());
+
+            auto const maps_before = device.map_count();
+            auto const refs        = resolve(&device, views);
+            auto const batch_maps  = device.map_count() - maps_before;
+            ENCELADO_TEST_ASSERT(refs.size() == paths.size());
+
+            for (size_t index = 0; index < paths.size(); index++)
+            {
+                obj_ref const single(&device, paths[index]);
+                ENCELADO_TEST_ASSERT(refs[index].exists() == single.exists());
+                ENCELADO_TEST_ASSERT(refs[index].is_directory() == single.is_directory());
+                ENCELADO_TEST_ASSERT(refs[index].address() == single.address());
+            }
+            ENCELADO_TEST_ASSERT(refs[0].address() == 64 && refs.back().is_directory());
+
+            // the shared prefixes are walked once
+            auto const single_maps = device.map_count() - maps_before - batch_maps;
+            ENCELADO_TEST_ASSERT(batch_maps * 2 < single_maps);
+        }
+
+        // content of the inline object with the given index
+        std::string make_inline_data(size_t i_index)
+        {
+            auto const size = i_index % (max_inline_size + 1);
+            return std::string(size, static_cast<char>('a' + i_index % 26));
+        }
+
+        void directory_inline_test(page_size i_page_size, size_t i_entry_count)
+        {
+            memory_device device(i_page_size);
+            directory     dir(device, directory::create(device));
+
+            // even entries are inline
+            for (size_t index = 0; index < i_entry_count; index++)
+            {
+                auto const name = make_name(index);
+                if (index & 1)
+                    ENCELADO_TEST_ASSERT(dir.insert(name, (index + 1) * 64));
+                else
+                {
+                    auto const data = make_inline_data(index);
+                    ENCELADO_TEST_ASSERT(dir.insert_inline(name, data.data(), data.size()));
+                }
+            }
+            ENCELADO_TEST_ASSERT(!dir.insert_inline(make_name(0), "x", 1));
+
+            char buffer[max_inline_size];
+            for (size_t index = 0; index < i_entry_count; index++)
+            {
+                auto const value = dir.lookup(make_name(index), buffer);
+                if (index & 1)
+                    ENCELADO_TEST_ASSERT(value == (index + 1) * 64);
+                else
+                {
+                    auto const data = make_inline_data(index);
+                    ENCELADO_TEST_ASSERT(value == (inline_value_mask | data.size()));
+                    ENCELADO_TEST_ASSERT(std::string(buffer, data.size()) == data);
+                }
+            }
+
+            size_t inline_count = 0;
+            for (directory_iterator it(dir); it != end_marker; ++it)
+            {
+                if (it->is_inline())
+                {
+                    auto const name  = std::string(it->m_name.data(), it->m_name.size());
+                    auto const index = std::stoul(name.substr(5)); // skip "item_"
+                    auto const data  = make_inline_data(index);
+                    ENCELADO_TEST_ASSERT(it->inline_size() == data.size());
+                    auto const content = static_cast<const char *>(it->m_inline_data);
+                    ENCELADO_TEST_ASSERT(std::string(content, data.size()) == data);
+                    inline_count++;
+                }
+            }
+            ENCELADO_TEST_ASSERT(inline_count == (i_entry_count + 1) / 2);
+
+            for (size_t index = 0; index < i_entry_count; index += 4)
+                ENCELADO_TEST_ASSERT(dir.remove(make_name(index)));
+            ENCELADO_TEST_ASSERT(dir.lookup(make_name(0)) == invalid_page_address);
+            ENCELADO_TEST_ASSERT(dir.lookup(make_name(2), buffer) != invalid_page_address);
+            ENCELADO_TEST_ASSERT(std::string(buffer, 2) == make_inline_data(2));
+
+            bool thrown = false;
+            try
+            {
+                dir.insert_inline("big", buffer, max_inline_size + 1);
+            }
+            catch (const std::invalid_argument &)
+            {
+                thrown = true;
+            }
+            ENCELADO_TEST_ASSERT(thrown);
+        }
+
+        void directory_inline_ref_test()
+        {
+            memory_device device;
+            directory::format(device, device.get_info().m_root_page);
+            directory root(device, device.get_info().m_root_page);
+            root.make_subdirectory("counters").insert_inline("hits", "\x2A\0\0\0", 4);
+
+            auto const check = [](const obj_ref & i_ref) {
+                ENCELADO_TEST_ASSERT(i_ref.exists() && i_ref.is_inline() && !i_ref.is_directory());
+                ENCELADO_TEST_ASSERT(i_ref.inline_size() == 4);
+                ENCELADO_TEST_ASSERT(memcmp(i_ref.inline_data(), "\x2A\0\0\0", 4) == 0);
+            };
+
+            check(obj_ref(&device, "/counters/hits"));
+            ENCELADO_TEST_ASSERT(!obj_ref(&device, "/counters/hits/x").exists());
+
+            string_view const paths[] = {"/counters/hits", "/counters"};
+            auto const        refs    = resolve(&device, paths);
+            check(refs[0]);
+            ENCELADO_TEST_ASSERT(refs[1].is_directory() && !refs[1].is_inline());
+        }
+
+    } // namespace
+
+    void directory_tests()
+    {
+        directory_content_test(4096, 20'000);
+
+        directory_content_test(256, 20'000);
+
+        directory_page_access_test();
+        directory_growth_test();
+        directory_collision_test();
+        directory_tree_test();
+        directory_batch_resolve_test();
+
+        directory_inline_test(4096, 20'000);
+        directory_inline_test(256, 2'000);
+        directory_inline_ref_test();
+    }
+
+} // namespace cambrian_test
@@ -0,0 +1,180 @@
+//   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../common.h"
+#include "cambrian/data/directory.h"
+#include "cambrian/data/path_cache.h"
+#include "cambrian/storage/memory_device.h"
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cambrian_test
+{
+    using namespace cambrian;
+
+    namespace
+    {
+        constexpr size_t user_count = 1000;
+
+        std::string make_path(size_t i_user)
+        {
+            return "/users/" + std::to_string(i_user) + "/profile";
+        }
+
+        page_address value_of(size_t i_user) { return (i_user + 1) * 64; }
+
+        directory make_tree(memory_device & i_device, path_cache & i_cache)
+        {
+            directory::format(i_device, i_device.get_info().m_root_page);
+            directory root(i_device, i_device.get_info().m_root_page, &i_cache);
+            auto      users = root.make_subdirectory("users");
+            for (size_t user = 0; user < user_count; user++)
+                users.make_subdirectory(std::to_string(user)).insert("profile", value_of(user));
+            return users;
+        }
+
+        void path_cache_hit_test()
+        {
+            memory_device device;
+            path_cache    cache(device);
+            make_tree(device, cache);
+
+            for (size_t user = 0; user < user_count; user++)
+                ENCELADO_TEST_ASSERT(obj_ref(cache, make_path(user)).address() == value_of(user));
+            ENCELADO_TEST_ASSERT(cache.miss_count() == user_count && cache.hit_count() == 0);
+            ENCELADO_TEST_ASSERT(cache.entry_count() == user_count);
+
+            // a hit does not access the device
+            auto const maps_before = device.map_count();
+            for (size_t user = 0; user < user_count; user++)
+                ENCELADO_TEST_ASSERT(cache.resolve(make_path(user)) == value_of(user));
+            ENCELADO_TEST_ASSERT(device.map_count() == maps_before);
+            ENCELADO_TEST_ASSERT(cache.hit_count() == user_count);
+
+            // equivalent paths share the entry
+            ENCELADO_TEST_ASSERT(cache.resolve("users//7/profile/") == value_of(7));
+            ENCELADO_TEST_ASSERT(cache.hit_count() == user_count + 1);
+
+            // missing paths are not cached
+            ENCELADO_TEST_ASSERT(!obj_ref(cache, "/users/7/settings").exists());
+            ENCELADO_TEST_ASSERT(!obj_ref(cache, "/users/7/profile/x").exists());
+            ENCELADO_TEST_ASSERT(cache.entry_count() == user_count);
+        }
+
+        void path_cache_invalidation_test()
+        {
+            memory_device device;
+            path_cache    cache(device);
+            auto          users = make_tree(device, cache);
+            for (size_t user = 0; user < user_count; user++)
+                cache.resolve(make_path(user));
+
+            // mutation of the last component
+            auto user_5 = users.make_subdirectory("5");
+            ENCELADO_TEST_ASSERT(user_5.remove("profile"));
+            ENCELADO_TEST_ASSERT(cache.resolve(make_path(5)) == invalid_page_address);
+            user_5.insert("profile", 4096);
+            ENCELADO_TEST_ASSERT(cache.resolve(make_path(5)) == 4096);
+
+            // mutation of an intermediate component
+            ENCELADO_TEST_ASSERT(users.remove("9"));
+            ENCELADO_TEST_ASSERT(!obj_ref(cache, make_path(9)).exists());
+
+            // the other entries are still valid
+            auto const hits_before = cache.hit_count();
+            ENCELADO_TEST_ASSERT(cache.resolve(make_path(6)) == value_of(6));
+            ENCELADO_TEST_ASSERT(cache.hit_count() == hits_before + 1);
+        }
+
+        void path_cache_budget_test()
+        {
+            memory_device device;
+            size_t const  budget = 16 * 1024;
+            path_cache    cache(device, budget);
+            make_tree(device, cache);
+
+            for (size_t user = 0; user < user_count; user++)
+                ENCELADO_TEST_ASSERT(cache.resolve(make_path(user)) == value_of(user));
+            ENCELADO_TEST_ASSERT(cache.memory_usage() <= budget);
+            ENCELADO_TEST_ASSERT(cache.entry_count() > 0 && cache.entry_count() < user_count);
+
+            // the most recently used paths are still cached
+            auto const hits_before = cache.hit_count();
+            cache.resolve(make_path(user_count - 1));
+            ENCELADO_TEST_ASSERT(cache.hit_count() == hits_before + 1);
+
+            cache.clear();
+            ENCELADO_TEST_ASSERT(cache.entry_count() == 0 && cache.memory_usage() == 0);
+        }
+
+        void path_cache_concurrency_test()
+        {
+            memory_device device;
+            path_cache    cache(device);
+            make_tree(device, cache);
+
+            size_t const             thread_count = 4;
+            size_t const             iterations   = 4;
+            std::vector<int>         results(thread_count, 0);
+            std::vector<std::thread> threads;
+            for (size_t thread_index = 0; thread_index < thread_count; thread_index++)
+            {
+                threads.emplace_back([&, thread_index] {
+                    bool ok = true;
+                    for (size_t iteration = 0; iteration < iterations; iteration++)
+                        for (size_t user = 0; user < user_count; user++)
+                            ok = ok && cache.resolve(make_path(user)) == value_of(user);
+                    results[thread_index] = ok;
+                });
+            }
+            for (auto & thread : threads)
+                thread.join();
+
+            for (auto result : results)
+                ENCELADO_TEST_ASSERT(result);
+            ENCELADO_TEST_ASSERT(
+              cache.hit_count() + cache.miss_count() == thread_count * iterations * user_count);
+            ENCELADO_TEST_ASSERT(cache.entry_count() == user_count);
+        }
+
+        void path_cache_inline_test()
+        {
+            memory_device device;
+            path_cache    cache(device);
+            directory::format(device, device.get_info().m_root_page);
+            directory root(device, device.get_info().m_root_page, &cache);
+            auto      counters = root.make_subdirectory("counters");
+            counters.insert_inline("hits", "abc", 3);
+
+            // the inline object is returned both on a miss and on a hit
+            for (int iteration = 0; iteration < 2; iteration++)
+            {
+                obj_ref const ref(cache, "/counters/hits");
+                ENCELADO_TEST_ASSERT(ref.is_inline() && ref.inline_size() == 3);
+                ENCELADO_TEST_ASSERT(memcmp(ref.inline_data(), "abc", 3) == 0);
+            }
+            ENCELADO_TEST_ASSERT(cache.hit_count() == 1);
+
+            counters.remove("hits");
+            counters.insert_inline("hits", "defg", 4);
+            obj_ref const ref(cache, "/counters/hits");
+            ENCELADO_TEST_ASSERT(ref.inline_size() == 4);
+            ENCELADO_TEST_ASSERT(memcmp(ref.inline_data(), "defg", 4) == 0);
+        }
+
+    } // namespace
+
+    void path_cache_tests()
+    {
+        path_cache_hit_test();
+        path_cache_invalidation_test();
+        path_cache_budget_test();
+        path_cache_concurrency_test();
+        path_cache_inline_test();
+    }
+
+} // namespace cambrian_test
@@ -5,6 +5,7 @@
 //          http://www.boost.org/LICENSE_1_0.txt)
 
 #include "test_types.h"
+#include "ediacaran/utils/inspect.h"
 
 namespace cambrian_test
 {
@@ -18,6 +19,80 @@ namespace cambrian_test
           make_property<decltype(TestClass::m_objects_2), offsetof(TestClass, m_objects_2)>(
             "objects_2"));
 
+        const array<property, 3> numeric_class_props = make_array(
+          make_property<decltype(NumericClass::m_ints), offsetof(NumericClass, m_ints)>("ints"),
+          make_property<decltype(NumericClass::m_byte), offsetof(NumericClass, m_byte)>("byte"),
+          make_property<decltype(NumericClass::m_doubles), offsetof(NumericClass, m_doubles)>(
+            "doubles"));
+
+        const array<property, 2> plain_point_props = make_array(
+          make_property<decltype(PlainPoint::m_x), offsetof(PlainPoint, m_x)>("x"),
+          make_property<decltype(PlainPoint::m_y), offsetof(PlainPoint, m_y)>("y"));
+
+        const array<property, 2> plan_base_props = make_array(
+          make_property<decltype(PlanBase::m_first), offsetof(PlanBase, m_first)>("first"),
+          make_property<decltype(PlanBase::m_second), offsetof(PlanBase, m_second)>("second"));
+
+        const array<property, 3> plan_base_v2_props = make_array(
+          make_property<decltype(PlanBaseV2::m_first), offsetof(PlanBaseV2, m_first)>("first"),
+          make_property<decltype(PlanBaseV2::m_second), offsetof(PlanBaseV2, m_second)>("second"),
+          make_property<decltype(PlanBaseV2::m_third), offsetof(PlanBaseV2, m_third)>("third"));
+
+        const array<const base_class, 1> plan_class_bases =
+          array<const base_class, 1>{base_class::make<PlanClass, PlanBase>()};
+
+        const array<property, 5> plan_class_props = make_array(
+          make_property<decltype(PlanClass::m_id), offsetof(PlanClass, m_id)>("id"),
+          make_property<decltype(PlanClass::m_point), offsetof(PlanClass, m_point)>("point"),
+          make_property<decltype(PlanClass::m_value), offsetof(PlanClass, m_value)>("value"),
+          make_property<decltype(PlanClass::m_points), offsetof(PlanClass, m_points)>("points"),
+          make_property<&PlanClass::get_hidden, &PlanClass::set_hidden>("hidden"));
+
+        const array<property, 2> virtual_base_props = make_array(
+          make_property<decltype(VirtualBase::m_base), offsetof(VirtualBase, m_base)>("base"),
+          make_property<decltype(VirtualBase::m_extra), offsetof(VirtualBase, m_extra)>("extra"));
+
+        const array<const base_class, 1> virtual_derived_bases =
+          array<const base_class, 1>{base_class::make<VirtualDerived, VirtualBase>()};
+
+        const array<property, 1> virtual_derived_props = make_array(
+          make_property<&VirtualDerived::get_derived, &VirtualDerived::set_derived>("derived"));
+
+        // the point is written first, so its setter finds the items not loaded yet
+        const array<property, 2> reentrant_class_props = make_array(
+          make_property<&ReentrantClass::get_point, &ReentrantClass::set_point>("point"),
+          make_property<decltype(ReentrantClass::m_items), offsetof(ReentrantClass, m_items)>(
+            "items"));
+
+        void ReentrantClass::set_point(const PlainPoint & i_point)
+        {
+            auto const items = get_property_value(raw_ptr(this), "items");
+            m_items_seen     = static_cast<const std::vector<int32_t> *>(items.object())->size();
+            m_point          = i_point;
+        }
+
+        const array<property, 1> shadow_base_props = make_array(
+          make_property<decltype(ShadowBase::m_value), offsetof(ShadowBase, m_value)>("value"));
+
+        const array<const base_class, 1> shadowing_bases =
+          array<const base_class, 1>{base_class::make<Shadowing, ShadowBase>()};
+
+        const array<property, 1> shadowing_props = make_array(
+          make_property<decltype(Shadowing::m_value), offsetof(Shadowing, m_value)>("value"));
+
+        const array<property, 1> base_list_props = make_array(
+          make_property<decltype(BaseList::m_items), offsetof(BaseList, m_items)>("items"));
+
+        const array<property, 1> base_list_v2_props = make_array(
+          make_property<decltype(BaseListV2::m_items), offsetof(BaseListV2, m_items)>("items"));
+
+        const array<property, 4> graph_node_props = make_array(
+          make_property<decltype(GraphNode::m_id), offsetof(GraphNode, m_id)>("id"),
+          make_property<decltype(GraphNode::m_next), offsetof(GraphNode, m_next)>("next"),
+          make_property<decltype(GraphNode::m_weight), offsetof(GraphNode, m_weight)>("weight"),
+          make_property<decltype(GraphNode::m_children), offsetof(GraphNode, m_children)>(
+            "children"));
+
         void edit_serialization_test_data(TestClass & i_result, int32_t i_depth)
         {
             i_result.m_int    = i_depth;
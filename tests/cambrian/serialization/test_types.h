@@ -42,6 +42,309 @@ namespace cambrian_test
               nullptr);
         }
 
+        struct NumericClass
+        {
+            std::vector<int32_t> m_ints;
+            uint8_t              m_byte = 0;
+            std::vector<double>  m_doubles;
+        };
+
+        extern const array<property, 3> numeric_class_props;
+
+        constexpr auto reflect(NumericClass ** /*i_ptr*/)
+        {
+            return class_type(
+              "cambrian_test::NumericClass",
+              sizeof(NumericClass),
+              alignof(NumericClass),
+              special_functions::make<NumericClass>(),
+              array<const base_class, 0>{},
+              numeric_class_props,
+              array<const function, 0>{},
+              nullptr);
+        }
+
+        struct PlainPoint
+        {
+            int32_t m_x = 0;
+            int32_t m_y = 0;
+        };
+
+        extern const array<property, 2> plain_point_props;
+
+        constexpr auto reflect(PlainPoint ** /*i_ptr*/)
+        {
+            return class_type(
+              "cambrian_test::PlainPoint",
+              sizeof(PlainPoint),
+              alignof(PlainPoint),
+              special_functions::make<PlainPoint>(),
+              array<const base_class, 0>{},
+              plain_point_props,
+              array<const function, 0>{},
+              nullptr);
+        }
+
+        struct PlanBase
+        {
+            int16_t m_first  = 0;
+            int16_t m_second = 0;
+        };
+
+        extern const array<property, 2> plan_base_props;
+
+        constexpr auto reflect(PlanBase ** /*i_ptr*/)
+        {
+            return class_type(
+              "cambrian_test::PlanBase",
+              sizeof(PlanBase),
+              alignof(PlanBase),
+              special_functions::make<PlanBase>(),
+              array<const base_class, 0>{},
+              plan_base_props,
+              array<const function, 0>{},
+              nullptr);
+        }
+
+        // a later version of PlanBase, with the same name and an added property
+        struct PlanBaseV2
+        {
+            int16_t m_first  = 0;
+            int16_t m_second = 0;
+            int32_t m_third  = 0;
+        };
+
+        extern const array<property, 3> plan_base_v2_props;
+
+        constexpr auto reflect(PlanBaseV2 ** /*i_ptr*/)
+        {
+            return class_type(
+              "cambrian_test::PlanBase",
+              sizeof(PlanBaseV2),
+              alignof(PlanBaseV2),
+              special_functions::make<PlanBaseV2>(),
+              array<const base_class, 0>{},
+              plan_base_v2_props,
+              array<const function, 0>{},
+              nullptr);
+        }
+
+        // a class whose plan has all the kinds of operations
+        struct PlanClass : PlanBase
+        {
+            int32_t                 m_id = 0;
+            PlainPoint              m_point;
+            double                  m_value = 0;
+            std::vector<PlainPoint> m_points;
+
+            int32_t get_hidden() const noexcept { return m_hidden; }
+            void    set_hidden(int32_t i_value) noexcept { m_hidden = i_value; }
+
+          private:
+            int32_t m_hidden = 0;
+        };
+
+        extern const array<const base_class, 1> plan_class_bases;
+
+        extern const array<property, 5> plan_class_props;
+
+        constexpr auto reflect(PlanClass ** /*i_ptr*/)
+        {
+            return class_type(
+              "cambrian_test::PlanClass",
+              sizeof(PlanClass),
+              alignof(PlanClass),
+              special_functions::make<PlanClass>(),
+              plan_class_bases,
+              plan_class_props,
+              array<const function, 0>{},
+              nullptr);
+        }
+
+        // a class whose base subobject is at an offset stored in the object
+        struct VirtualBase
+        {
+            int32_t m_base  = 0;
+            int32_t m_extra = 0;
+        };
+
+        extern const array<property, 2> virtual_base_props;
+
+        constexpr auto reflect(VirtualBase ** /*i_ptr*/)
+        {
+            return class_type(
+              "cambrian_test::VirtualBase",
+              sizeof(VirtualBase),
+              alignof(VirtualBase),
+              special_functions::make<VirtualBase>(),
+              array<const base_class, 0>{},
+              virtual_base_props,
+              array<const function, 0>{},
+              nullptr);
+        }
+
+        struct VirtualDerived : virtual VirtualBase
+        {
+            int32_t get_derived() const noexcept { return m_derived; }
+            void    set_derived(int32_t i_value) noexcept { m_derived = i_value; }
+
+          private:
+            int32_t m_derived = 0;
+        };
+
+        extern const array<const base_class, 1> virtual_derived_bases;
+        extern const array<property, 1>         virtual_derived_props;
+
+        constexpr auto reflect(VirtualDerived ** /*i_ptr*/)
+        {
+            return class_type(
+              "cambrian_test::VirtualDerived",
+              sizeof(VirtualDerived),
+              alignof(VirtualDerived),
+              special_functions::make<VirtualDerived>(),
+              virtual_derived_bases,
+              virtual_derived_props,
+              array<const function, 0>{},
+              nullptr);
+        }
+
+        // a class with a setter that reads another property through property_inspector
+        struct ReentrantClass
+        {
+            std::vector<int32_t> m_items;
+            size_t               m_items_seen = 0; /**< items found by the setter */
+
+            PlainPoint get_point() const noexcept { return m_point; }
+            void       set_point(const PlainPoint & i_point);
+
+          private:
+            PlainPoint m_point;
+        };
+
+        extern const array<property, 2> reentrant_class_props;
+
+        constexpr auto reflect(ReentrantClass ** /*i_ptr*/)
+        {
+            return class_type(
+              "cambrian_test::ReentrantClass",
+              sizeof(ReentrantClass),
+              alignof(ReentrantClass),
+              special_functions::make<ReentrantClass>(),
+              array<const base_class, 0>{},
+              reentrant_class_props,
+              array<const function, 0>{},
+              nullptr);
+        }
+
+        // a class with a property that has the same name of a property of its base
+        struct ShadowBase
+        {
+            int32_t m_value = 0;
+        };
+
+        extern const array<property, 1> shadow_base_props;
+
+        constexpr auto reflect(ShadowBase ** /*i_ptr*/)
+        {
+            return class_type(
+              "cambrian_test::ShadowBase",
+              sizeof(ShadowBase),
+              alignof(ShadowBase),
+              special_functions::make<ShadowBase>(),
+              array<const base_class, 0>{},
+              shadow_base_props,
+              array<const function, 0>{},
+              nullptr);
+        }
+
+        struct Shadowing : ShadowBase
+        {
+            int32_t m_value = 0;
+        };
+
+        extern const array<const base_class, 1> shadowing_bases;
+        extern const array<property, 1>         shadowing_props;
+
+        constexpr auto reflect(Shadowing ** /*i_ptr*/)
+        {
+            return class_type(
+              "cambrian_test::Shadowing",
+              sizeof(Shadowing),
+              alignof(Shadowing),
+              special_functions::make<Shadowing>(),
+              shadowing_bases,
+              shadowing_props,
+              array<const function, 0>{},
+              nullptr);
+        }
+
+        // two versions of a class with a container, whose elements have different versions
+        struct BaseList
+        {
+            std::vector<PlanBase> m_items;
+        };
+
+        extern const array<property, 1> base_list_props;
+
+        constexpr auto reflect(BaseList ** /*i_ptr*/)
+        {
+            return class_type(
+              "cambrian_test::BaseList",
+              sizeof(BaseList),
+              alignof(BaseList),
+              special_functions::make<BaseList>(),
+              array<const base_class, 0>{},
+              base_list_props,
+              array<const function, 0>{},
+              nullptr);
+        }
+
+        struct BaseListV2
+        {
+            std::vector<PlanBaseV2> m_items;
+        };
+
+        extern const array<property, 1> base_list_v2_props;
+
+        constexpr auto reflect(BaseListV2 ** /*i_ptr*/)
+        {
+            return class_type(
+              "cambrian_test::BaseList",
+              sizeof(BaseListV2),
+              alignof(BaseListV2),
+              special_functions::make<BaseListV2>(),
+              array<const base_class, 0>{},
+              base_list_v2_props,
+              array<const function, 0>{},
+              nullptr);
+        }
+
+        // a node of a graph, whose pointers may be shared or form cycles
+        struct GraphNode
+        {
+            int32_t                  m_id     = 0;
+            GraphNode *              m_next   = nullptr;
+            const int32_t *          m_weight = nullptr;
+            std::vector<GraphNode *> m_children;
+        };
+
+        extern const array<property, 4> graph_node_props;
+
+        constexpr auto reflect(GraphNode ** /*i_ptr*/)
+        {
+            return class_type(
+              "cambrian_test::GraphNode",
+              sizeof(GraphNode),
+              alignof(GraphNode),
+              special_functions::make<GraphNode>(),
+              array<const base_class, 0>{},
+              graph_node_props,
+              array<const function, 0>{},
+              nullptr);
+        }
+
+        void edit_serialization_test_data(TestClass & i_result, int32_t i_depth);
+
         dyn_value make_serialization_test_data();
 
     } // namespace serialization
@@ -1,13 +1,30 @@
-
 //   Copyright Giuseppe Campana (giu.campana@gmail.com) 2017-2018.
 // Distributed under the Boost Software License, Version 1.0.
 //    (See accompanying file LICENSE_1_0.txt or copy at
 //          http://www.boost.org/LICENSE_1_0.txt)
 
+#include "cambrian/data/columnar_format.h"
+#include "cambrian/data/delta_serializer.h"
+#include "cambrian/data/deserializer.h"
+#include "cambrian/data/flat_format.h"
+#include "cambrian/data/lazy_reader.h"
+#include "cambrian/data/page_chain.h"
+#include "cambrian/data/parallel_serializer.h"
+#include "cambrian/data/pipelined_serializer.h"
+#include "cambrian/data/schema.h"
+#include "cambrian/data/serialization_profile.h"
 #include "cambrian/data/serializer.h"
+#include "cambrian/data/static_serializer.h"
+#include "cambrian/data/tagged_format.h"
 #include "cambrian/data/type_registry.h"
+#include "cambrian/storage/memory_device.h"
+#include "ediacaran/utils/inspect.h"
 #include "test_types.h"
+#include <algorithm>
+#include <cstring>
 #include <memory>
+#include <set>
+#include <thread>
 #include <vector>
 
 namespace cambrian_test
@@ -16,28 +33,1821 @@ namespace cambrian_test
 
     namespace serialization
     {
-        void tests()
+        namespace
         {
-            dyn_value data = make_serialization_test_data();
+            using Pages = std::vector<std::vector<unsigned char>>;
 
-            std::vector<std::vector<unsigned char>> pages;
+            /* writes an object to pages of the given size, trimmed to the used size. Interning
+               is enabled if i_max_interned_size is not zero. */
+            Pages write_pages(
+              type_registry & i_registry,
+              const raw_ptr & i_object,
+              size_t          i_page_size,
+              wire_format     i_format            = wire_format::fixed,
+              size_t          i_max_interned_size = 0)
+            {
+                Pages         pages;
+                binary_writer writer(i_registry, i_object, i_format);
+                if (i_max_interned_size != 0)
+                    writer.enable_interning(i_max_interned_size);
+                bool finished = false;
+                while (!finished)
+                {
+                    pages.emplace_back(i_page_size, 55);
+                    byte_writer byte_wr(pages.back().data(), pages.back().size());
+                    finished = writer.step(byte_wr) == binary_writer::finished;
+                    ENCELADO_TEST_ASSERT(byte_wr.remaining_size() >= 0);
+                    auto const used_size =
+                      static_cast<size_t>(pages.back().size() - byte_wr.remaining_size());
+                    ENCELADO_TEST_ASSERT(finished || used_size > 0);
+                    pages.back().resize(used_size);
+                }
+                return pages;
+            }
 
-            type_registry registry;
-            binary_writer writer(registry, data);
+            // writes an object to pages of the given size, returning the concatenated stream
+            std::vector<unsigned char> write_to_pages(
+              type_registry & i_registry, const raw_ptr & i_object, size_t i_page_size)
+            {
+                std::vector<unsigned char> stream;
+                for (auto const & page : write_pages(i_registry, i_object, i_page_size))
+                    stream.insert(stream.end(), page.begin(), page.end());
+                return stream;
+            }
+
+            void read_pages(
+              type_registry & i_registry,
+              const Pages &   i_pages,
+              const raw_ptr & o_object,
+              wire_format     i_format            = wire_format::fixed,
+              size_t          i_max_interned_size = 0)
+            {
+                binary_reader reader(i_registry, o_object, i_format);
+                if (i_max_interned_size != 0)
+                    reader.enable_interning(i_max_interned_size);
+                for (size_t index = 0; index < i_pages.size(); index++)
+                {
+                    byte_reader source(i_pages[index].data(), i_pages[index].size());
+                    auto const  result = reader.step(source);
+                    if (index + 1 < i_pages.size())
+                    {
+                        ENCELADO_TEST_ASSERT(result == binary_reader::more_data);
+                    }
+                    else
+                    {
+                        ENCELADO_TEST_ASSERT(result == binary_reader::finished);
+                        ENCELADO_TEST_ASSERT(source.remaining_size() == 0);
+                    }
+                }
+            }
+
+            bool equals(const TestClass & i_first, const TestClass & i_second)
+            {
+                auto const equal_vectors = [](
+                                             const std::vector<TestClass> & i_first_vector,
+                                             const std::vector<TestClass> & i_second_vector) {
+                    return std::equal(
+                      i_first_vector.begin(),
+                      i_first_vector.end(),
+                      i_second_vector.begin(),
+                      i_second_vector.end(),
+                      equals);
+                };
+                return i_first.m_int == i_second.m_int && i_first.m_double == i_second.m_double &&
+                       equal_vectors(i_first.m_objects_1, i_second.m_objects_1) &&
+                       equal_vectors(i_first.m_objects_2, i_second.m_objects_2);
+            }
+
+            class StreamChecker
+            {
+              public:
+                StreamChecker(const std::vector<unsigned char> & i_stream)
+                    : m_curr(i_stream.data()), m_end(i_stream.data() + i_stream.size())
+                {
+                }
+
+                template <typename TYPE> TYPE read()
+                {
+                    ENCELADO_TEST_ASSERT(static_cast<size_t>(m_end - m_curr) >= sizeof(TYPE));
+                    TYPE result;
+                    memcpy(&result, m_curr, sizeof(TYPE));
+                    m_curr += sizeof(TYPE);
+                    return result;
+                }
+
+                void check(const TestClass & i_object)
+                {
+                    ENCELADO_TEST_ASSERT(read<int32_t>() == i_object.m_int);
+                    check(i_object.m_objects_1);
+                    ENCELADO_TEST_ASSERT(read<double>() == i_object.m_double);
+                    check(i_object.m_objects_2);
+                }
+
+                void check(const std::vector<TestClass> & i_objects)
+                {
+                    size_t index = 0;
+                    for (bool first = true;; first = false)
+                    {
+                        auto const marker = read<data_marker>();
+                        bool const begin  = (marker.m_flags & data_marker::flag_begin_comtainer);
+                        ENCELADO_TEST_ASSERT(begin == first);
+                        for (uint16_t i = 0; i < marker.m_count; i++)
+                        {
+                            ENCELADO_TEST_ASSERT(index < i_objects.size());
+                            check(i_objects[index++]);
+                        }
+                        if (marker.m_flags & data_marker::flag_end_comtainer)
+                        {
+                            ENCELADO_TEST_ASSERT(marker.m_count == 0);
+                            break;
+                        }
+                    }
+                    ENCELADO_TEST_ASSERT(index == i_objects.size());
+                }
+
+                bool is_over() const noexcept { return m_curr == m_end; }
+
+              private:
+                const unsigned char * m_curr;
+                const unsigned char * m_end;
+            };
+
+            void write_test(int32_t i_depth, size_t i_page_size)
+            {
+                TestClass object;
+                edit_serialization_test_data(object, i_depth);
+
+                type_registry registry;
+                auto const    stream = write_to_pages(registry, raw_ptr(&object), i_page_size);
+
+                StreamChecker checker(stream);
+                checker.check(object);
+                ENCELADO_TEST_ASSERT(checker.is_over());
+            }
+
+            void read_test(int32_t i_depth, size_t i_page_size)
+            {
+                TestClass object;
+                edit_serialization_test_data(object, i_depth);
+
+                type_registry write_registry;
+                auto const    pages = write_pages(write_registry, raw_ptr(&object), i_page_size);
+
+                // the previous content of the destination is replaced
+                TestClass result;
+                edit_serialization_test_data(result, 2);
+                result.m_int = -1;
+
+                type_registry read_registry;
+                read_pages(read_registry, pages, raw_ptr(&result));
+                ENCELADO_TEST_ASSERT(equals(object, result));
+            }
+
+            void read_errors_test()
+            {
+                TestClass object;
+                edit_serialization_test_data(object, 2);
+                type_registry registry;
+                auto const    stream = write_to_pages(registry, raw_ptr(&object), 4096);
+
+                // a value split between two buffers
+                {
+                    TestClass     result;
+                    binary_reader reader(registry, raw_ptr(&result));
+                    byte_reader   source(stream.data(), 6);
+                    bool          thrown = false;
+                    try
+                    {
+                        (void)reader.step(source);
+                    }
+                    catch (const std::runtime_error &)
+                    {
+                        thrown = true;
+                    }
+                    ENCELADO_TEST_ASSERT(thrown);
+                }
+
+                // a corrupted marker (the first marker follows the int)
+                {
+                    auto corrupted = stream;
+                    corrupted[sizeof(int32_t) + offsetof(data_marker, m_flags)] = 0;
+                    TestClass     result;
+                    binary_reader reader(registry, raw_ptr(&result));
+                    byte_reader   source(corrupted.data(), corrupted.size());
+                    bool          thrown = false;
+                    try
+                    {
+                        (void)reader.step(source);
+                    }
+                    catch (const std::runtime_error &)
+                    {
+                        thrown = true;
+                    }
+                    ENCELADO_TEST_ASSERT(thrown);
+                }
+            }
+
+            void bulk_test(size_t i_int_count, size_t i_page_size)
+            {
+                NumericClass object;
+                object.m_byte = 42;
+                for (size_t index = 0; index < i_int_count; index++)
+                {
+                    object.m_ints.push_back(static_cast<int32_t>(index * 7 - 1000));
+                    if (index % 3 == 0)
+                        object.m_doubles.push_back(static_cast<double>(index) / 3);
+                }
 
-            bool finished = false;
-            while (!finished)
+                type_registry registry;
+                auto const    pages = write_pages(registry, raw_ptr(&object), i_page_size);
+
+                // markers are a small overhead, and the values fill the pages
+                size_t stream_size = 0;
+                for (auto const & page : pages)
+                    stream_size += page.size();
+                auto const data_size = object.m_ints.size() * sizeof(int32_t) + sizeof(uint8_t) +
+                                       object.m_doubles.size() * sizeof(double);
+                auto const max_markers =
+                  2 * (pages.size() + i_int_count / data_marker::s_max_count + 2);
+                ENCELADO_TEST_ASSERT(stream_size >= data_size);
+                ENCELADO_TEST_ASSERT(stream_size - data_size <= max_markers * sizeof(data_marker));
+                for (size_t index = 0; index + 1 < pages.size(); index++)
+                    ENCELADO_TEST_ASSERT(pages[index].size() + 2 * sizeof(double) > i_page_size);
+
+                NumericClass result;
+                result.m_ints.resize(5, -1);
+                read_pages(registry, pages, raw_ptr(&result));
+                ENCELADO_TEST_ASSERT(result.m_ints == object.m_ints);
+                ENCELADO_TEST_ASSERT(result.m_byte == object.m_byte);
+                ENCELADO_TEST_ASSERT(result.m_doubles == object.m_doubles);
+            }
+
+            void registry_test()
             {
-                pages.emplace_back(512, 55);
-                byte_writer byte_wr(pages.back().data(), pages.back().size());
-                finished = writer.step(byte_wr) == binary_writer::finished;
-                ENCELADO_TEST_ASSERT(byte_wr.remaining_size() >= 0);
-                auto const actual_page_size =
-                  static_cast<size_t>(pages.back().size() - byte_wr.remaining_size());
-                pages.back().resize(actual_page_size);
+                auto const & test_class    = get_class_type<TestClass>();
+                auto const & vector_class  = get_class_type<std::vector<TestClass>>();
+                auto const & numeric_class = get_class_type<NumericClass>();
+                auto const & plan_class    = get_class_type<PlanClass>();
+                auto const & graph_class   = get_class_type<GraphNode>();
+
+                // the listed classes take the first ids, whatever is registered first
+                type_registry write_registry({&test_class, &vector_class});
+                auto const    numeric_data = write_registry.get_type_data(numeric_class);
+                auto const    plan_data    = write_registry.get_type_data(plan_class);
+                auto const    graph_data   = write_registry.get_type_data(graph_class);
+                auto const    test_data    = write_registry.get_type_data(test_class);
+                ENCELADO_TEST_ASSERT(test_data.m_id == 0);
+                ENCELADO_TEST_ASSERT(write_registry.get_type_data(vector_class).m_id == 1);
+                ENCELADO_TEST_ASSERT(numeric_data.m_id == 2);
+
+                // every class keeps its data and a distinct id
+                std::vector<type_id> ids;
+                for (auto const source_class :
+                     {&test_class, &vector_class, &numeric_class, &plan_class, &graph_class})
+                {
+                    auto const data = write_registry.get_type_data(*source_class);
+                    ENCELADO_TEST_ASSERT(data.m_plan != nullptr);
+                    ENCELADO_TEST_ASSERT(
+                      write_registry.get_type_data(*source_class).m_plan == data.m_plan);
+                    ids.push_back(data.m_id);
+                }
+                ENCELADO_TEST_ASSERT(ids[3] == plan_data.m_id && ids[4] == graph_data.m_id);
+                std::sort(ids.begin(), ids.end());
+                ENCELADO_TEST_ASSERT(std::unique(ids.begin(), ids.end()) == ids.end());
+
+                // a registry with the same list reads the stream
+                TestClass object;
+                edit_serialization_test_data(object, 3);
+                auto const    pages = write_pages(write_registry, raw_ptr(&object), 256);
+                TestClass     result;
+                type_registry read_registry({&test_class, &vector_class});
+                read_pages(read_registry, pages, raw_ptr(&result));
+                ENCELADO_TEST_ASSERT(equals(object, result));
+
+                bool thrown = false;
+                try
+                {
+                    type_registry registry({&test_class, &numeric_class, &test_class});
+                }
+                catch (const std::invalid_argument &)
+                {
+                    thrown = true;
+                }
+                ENCELADO_TEST_ASSERT(thrown);
+            }
+
+            void concurrent_registry_test(size_t i_thread_count)
+            {
+                // the threads register the same classes at the same time
+                type_registry            registry;
+                std::vector<char>        succeeded(i_thread_count, 0);
+                std::vector<std::thread> threads;
+                for (size_t index = 0; index < i_thread_count; index++)
+                {
+                    threads.emplace_back([&, index] {
+                        TestClass object;
+                        edit_serialization_test_data(object, 3);
+                        object.m_int = static_cast<int32_t>(index);
+
+                        NumericClass numbers;
+                        numbers.m_byte = static_cast<uint8_t>(index);
+                        numbers.m_ints.assign(index * 10, 3);
+
+                        // the order of the writes alternates between the threads
+                        Pages object_pages, numbers_pages;
+                        if (index % 2 == 0)
+                        {
+                            object_pages  = write_pages(registry, raw_ptr(&object), 64);
+                            numbers_pages = write_pages(registry, raw_ptr(&numbers), 64);
+                        }
+                        else
+                        {
+                            numbers_pages = write_pages(registry, raw_ptr(&numbers), 64);
+                            object_pages  = write_pages(registry, raw_ptr(&object), 64);
+                        }
+
+                        TestClass    object_result;
+                        NumericClass numbers_result;
+                        read_pages(registry, object_pages, raw_ptr(&object_result));
+                        read_pages(registry, numbers_pages, raw_ptr(&numbers_result));
+                        succeeded[index] = equals(object, object_result) &&
+                                           numbers_result.m_byte == numbers.m_byte &&
+                                           numbers_result.m_ints == numbers.m_ints;
+                    });
+                }
+                for (auto & thread : threads)
+                    thread.join();
+                for (auto const result : succeeded)
+                    ENCELADO_TEST_ASSERT(result);
+            }
+
+            void plan_test()
+            {
+                using kind = serialization_plan::operation::kind;
+
+                type_registry registry;
+                auto const &  plan = *registry.get_type_data(get_class_type<PlanClass>()).m_plan;
+
+                // id, point and value are merged in a single copy, the base comes last
+                auto const & ops = plan.m_operations;
+                ENCELADO_TEST_ASSERT(ops.size() == 4);
+                ENCELADO_TEST_ASSERT(ops[0].m_kind == kind::copy);
+                ENCELADO_TEST_ASSERT(ops[0].m_offset == offsetof(PlanClass, m_id));
+                ENCELADO_TEST_ASSERT(
+                  ops[0].m_size == sizeof(int32_t) + sizeof(PlainPoint) + sizeof(double));
+                ENCELADO_TEST_ASSERT(ops[1].m_kind == kind::object);
+                ENCELADO_TEST_ASSERT(ops[1].m_offset == offsetof(PlanClass, m_points));
+                ENCELADO_TEST_ASSERT(ops[2].m_kind == kind::property);
+                ENCELADO_TEST_ASSERT(ops[3].m_kind == kind::copy);
+                ENCELADO_TEST_ASSERT(ops[3].m_size == sizeof(PlanBase));
+                ENCELADO_TEST_ASSERT(plan.m_container == nullptr);
+
+                // the plan is compiled once
+                ENCELADO_TEST_ASSERT(
+                  registry.get_type_data(get_class_type<PlanClass>()).m_plan == &plan);
+
+                PlanClass object;
+                object.m_first  = 3;
+                object.m_second = -4;
+                object.m_id     = 42;
+                object.m_point  = {5, 6};
+                object.m_value  = 1.5;
+                object.set_hidden(77);
+                for (int32_t index = 0; index < 1000; index++)
+                    object.m_points.push_back({index, -index});
+
+                for (size_t page_size : {16, 23, 4096})
+                {
+                    auto const pages = write_pages(registry, raw_ptr(&object), page_size);
+
+                    PlanClass     result;
+                    type_registry read_registry;
+                    read_pages(read_registry, pages, raw_ptr(&result));
+                    ENCELADO_TEST_ASSERT(result.m_first == object.m_first);
+                    ENCELADO_TEST_ASSERT(result.m_second == object.m_second);
+                    ENCELADO_TEST_ASSERT(result.m_id == object.m_id);
+                    ENCELADO_TEST_ASSERT(result.m_point.m_x == object.m_point.m_x);
+                    ENCELADO_TEST_ASSERT(result.m_point.m_y == object.m_point.m_y);
+                    ENCELADO_TEST_ASSERT(result.m_value == object.m_value);
+                    ENCELADO_TEST_ASSERT(result.get_hidden() == object.get_hidden());
+                    ENCELADO_TEST_ASSERT(result.m_points.size() == object.m_points.size());
+                    for (size_t index = 0; index < object.m_points.size(); index++)
+                    {
+                        auto const & point = result.m_points[index];
+                        ENCELADO_TEST_ASSERT(point.m_x == object.m_points[index].m_x);
+                        ENCELADO_TEST_ASSERT(point.m_y == object.m_points[index].m_y);
+                    }
+                }
+            }
+
+            void virtual_base_test()
+            {
+                // the offset of the virtual base is measured on a constructed object
+                VirtualDerived probe;
+                auto const     base_offset = static_cast<size_t>(address_diff(
+                  static_cast<VirtualBase *>(&probe), static_cast<void *>(&probe)));
+                auto const offsets = base_offsets(get_class_type<VirtualDerived>());
+                ENCELADO_TEST_ASSERT(offsets.size() == 1 && offsets[0] == base_offset);
+                ENCELADO_TEST_ASSERT(base_offsets(get_class_type<PlainPoint>()).empty());
+
+                std::vector<VirtualDerived> objects(5);
+                for (size_t index = 0; index < objects.size(); index++)
+                {
+                    objects[index].m_base  = static_cast<int32_t>(index);
+                    objects[index].m_extra = static_cast<int32_t>(index * 7);
+                    objects[index].set_derived(-static_cast<int32_t>(index));
+                }
+
+                type_registry registry;
+                auto const    pages = write_pages(registry, raw_ptr(&objects), 64);
+
+                std::vector<VirtualDerived> result;
+                read_pages(registry, pages, raw_ptr(&result));
+                ENCELADO_TEST_ASSERT(result.size() == objects.size());
+                for (size_t index = 0; index < objects.size(); index++)
+                {
+                    ENCELADO_TEST_ASSERT(result[index].m_base == objects[index].m_base);
+                    ENCELADO_TEST_ASSERT(result[index].m_extra == objects[index].m_extra);
+                    ENCELADO_TEST_ASSERT(result[index].get_derived() == -int32_t(index));
+                }
+
+                auto const          buffer = write_columnar(registry, raw_ptr(&objects));
+                columnar_view const view(buffer.data(), buffer.size());
+                auto const          extras = view.values<int32_t>("extra");
+                for (size_t index = 0; index < objects.size(); index++)
+                    ENCELADO_TEST_ASSERT(extras[index] == objects[index].m_extra);
+                result.clear();
+                read_columnar(registry, buffer.data(), buffer.size(), raw_ptr(&result));
+                ENCELADO_TEST_ASSERT(result.size() == objects.size());
+                ENCELADO_TEST_ASSERT(result[4].m_base == 4 && result[4].get_derived() == -4);
+            }
+
+            // the static serializer must produce the same stream of binary_writer
+            template <typename TYPE>
+            std::vector<unsigned char> static_serialize_test(const TYPE & i_object)
+            {
+                type_registry dynamic_registry;
+                auto const    expected =
+                  write_to_pages(dynamic_registry, raw_ptr(&i_object), size_t(1) << 24);
+
+                type_registry              static_registry;
+                std::vector<unsigned char> stream(expected.size() + 64);
+                byte_writer                dest(stream.data(), stream.size());
+                serialize(static_registry, dest, i_object);
+                ENCELADO_TEST_ASSERT(dest.remaining_size() == 64);
+                stream.resize(expected.size());
+                ENCELADO_TEST_ASSERT(stream == expected);
+
+                // a buffer too small
+                byte_writer small_dest(stream.data(), stream.size() - 1);
+                bool        thrown = false;
+                try
+                {
+                    serialize(static_registry, small_dest, i_object);
+                }
+                catch (const std::runtime_error &)
+                {
+                    thrown = true;
+                }
+                ENCELADO_TEST_ASSERT(thrown);
+                return stream;
+            }
+
+            template <typename TYPE>
+            TYPE static_deserialize(const std::vector<unsigned char> & i_stream)
+            {
+                type_registry registry;
+                byte_reader   source(i_stream.data(), i_stream.size());
+                TYPE          result{};
+                deserialize(registry, source, result);
+                ENCELADO_TEST_ASSERT(source.remaining_size() == 0);
+                return result;
+            }
+
+            /* deletes the nodes and the weights reachable from the nodes i_owned, that are
+               not created by the deserialization */
+            void delete_created_objects(const std::vector<const GraphNode *> & i_owned)
+            {
+                std::set<const GraphNode *>    reached(i_owned.begin(), i_owned.end());
+                std::set<const int32_t *>      weights;
+                std::vector<const GraphNode *> created, pending(i_owned);
+                while (!pending.empty())
+                {
+                    auto const node = pending.back();
+                    pending.pop_back();
+                    if (node->m_weight != nullptr)
+                        weights.insert(node->m_weight);
+                    auto const reach = [&](const GraphNode * i_node) {
+                        if (i_node != nullptr && reached.insert(i_node).second)
+                        {
+                            created.push_back(i_node);
+                            pending.push_back(i_node);
+                        }
+                    };
+                    reach(node->m_next);
+                    for (auto const child : node->m_children)
+                        reach(child);
+                }
+                for (auto const node : created)
+                    delete node;
+                for (auto const weight : weights)
+                    delete weight;
+            }
+
+            void static_pointer_test()
+            {
+                /* the nodes are pointed by the root and by the previous node, the weights are
+                   shared, and the last node points back to the root */
+                int32_t const          weights[2] = {10, 20};
+                std::vector<GraphNode> nodes(6);
+                GraphNode              root;
+                root.m_id = 100;
+                for (size_t index = 0; index < nodes.size(); index++)
+                {
+                    auto & node   = nodes[index];
+                    node.m_id     = static_cast<int32_t>(index);
+                    node.m_weight = index % 3 != 2 ? &weights[index % 3] : nullptr;
+                    node.m_next   = index + 1 < nodes.size() ? &nodes[index + 1] : &root;
+                    if (index + 1 < nodes.size())
+                        node.m_children.push_back(&nodes[index + 1]);
+                    root.m_children.push_back(&node);
+                }
+
+                {
+                    auto const stream = static_serialize_test(root);
+                    auto const result = static_deserialize<GraphNode>(stream);
+                    ENCELADO_TEST_ASSERT(result.m_children.size() == nodes.size());
+                    for (size_t index = 0; index < nodes.size(); index++)
+                    {
+                        auto const & node = *result.m_children[index];
+                        ENCELADO_TEST_ASSERT(node.m_id == nodes[index].m_id);
+                        auto const next =
+                          index + 1 < nodes.size() ? result.m_children[index + 1] : &result;
+                        ENCELADO_TEST_ASSERT(node.m_next == next);
+                        if (index >= 3 && index % 3 != 2)
+                        {
+                            ENCELADO_TEST_ASSERT(
+                              node.m_weight == result.m_children[index - 3]->m_weight);
+                        }
+                    }
+                    delete_created_objects({&result});
+                }
+
+                // a container of pointers is written in runs of the pointed type
+                {
+                    std::vector<GraphNode *> pointers = root.m_children;
+                    pointers.push_back(nullptr);
+                    pointers.push_back(&root);
+                    auto const stream = static_serialize_test(pointers);
+                    auto const result = static_deserialize<std::vector<GraphNode *>>(stream);
+                    ENCELADO_TEST_ASSERT(result.size() == pointers.size());
+                    ENCELADO_TEST_ASSERT(result[nodes.size()] == nullptr);
+                    ENCELADO_TEST_ASSERT(result.back()->m_children.front() == result.front());
+                    ENCELADO_TEST_ASSERT(result[nodes.size() - 1]->m_next == result.back());
+                    GraphNode owner;
+                    owner.m_children = result;
+                    delete_created_objects({&owner});
+                }
+
+                // the nested containers share the ids, so they can refer to each other's objects
+                {
+                    auto const stream = static_serialize_test(nodes);
+                    auto const result = static_deserialize<std::vector<GraphNode>>(stream);
+                    ENCELADO_TEST_ASSERT(result.size() == nodes.size());
+                    for (size_t index = 0; index + 1 < nodes.size(); index++)
+                    {
+                        ENCELADO_TEST_ASSERT(result[index].m_id == nodes[index].m_id);
+                        ENCELADO_TEST_ASSERT(result[index].m_next->m_id == nodes[index + 1].m_id);
+                        ENCELADO_TEST_ASSERT(result[index].m_children[0] == result[index].m_next);
+                    }
+                    ENCELADO_TEST_ASSERT(result[3].m_weight == result[0].m_weight);
+                    std::vector<const GraphNode *> owned;
+                    for (auto const & node : result)
+                        owned.push_back(&node);
+                    delete_created_objects(owned);
+                }
+            }
+
+            void static_test()
+            {
+                {
+                    int64_t const value = -123456789;
+                    auto const    stream = static_serialize_test(value);
+                    ENCELADO_TEST_ASSERT(static_deserialize<int64_t>(stream) == value);
+                }
+
+                {
+                    std::vector<int32_t> values(70 * 1000);
+                    for (size_t index = 0; index < values.size(); index++)
+                        values[index] = static_cast<int32_t>(index * 3);
+                    auto const stream = static_serialize_test(values);
+                    auto const result = static_deserialize<std::vector<int32_t>>(stream);
+                    ENCELADO_TEST_ASSERT(result == values);
+                }
+
+                {
+                    TestClass object;
+                    edit_serialization_test_data(object, 4);
+                    auto const stream = static_serialize_test(object);
+                    ENCELADO_TEST_ASSERT(equals(static_deserialize<TestClass>(stream), object));
+                }
+
+                {
+                    NumericClass object;
+                    object.m_byte = 9;
+                    object.m_ints.assign(1000, 5);
+                    object.m_doubles.assign(70 * 1000, 2.5);
+                    auto const stream = static_serialize_test(object);
+                    auto const result = static_deserialize<NumericClass>(stream);
+                    ENCELADO_TEST_ASSERT(result.m_ints == object.m_ints);
+                    ENCELADO_TEST_ASSERT(result.m_byte == object.m_byte);
+                    ENCELADO_TEST_ASSERT(result.m_doubles == object.m_doubles);
+                }
+
+                {
+                    std::vector<PlanClass> objects(3);
+                    for (size_t index = 0; index < objects.size(); index++)
+                    {
+                        objects[index].m_id     = static_cast<int32_t>(index);
+                        objects[index].m_second = static_cast<int16_t>(index + 1);
+                        objects[index].m_points.resize(index * 2, PlainPoint{1, 2});
+                        objects[index].set_hidden(static_cast<int32_t>(index * 10));
+                    }
+                    auto const stream = static_serialize_test(objects);
+                    auto const result = static_deserialize<std::vector<PlanClass>>(stream);
+                    ENCELADO_TEST_ASSERT(result.size() == objects.size());
+                    for (size_t index = 0; index < objects.size(); index++)
+                    {
+                        ENCELADO_TEST_ASSERT(result[index].m_id == objects[index].m_id);
+                        ENCELADO_TEST_ASSERT(result[index].m_second == objects[index].m_second);
+                        ENCELADO_TEST_ASSERT(
+                          result[index].m_points.size() == objects[index].m_points.size());
+                        ENCELADO_TEST_ASSERT(
+                          result[index].get_hidden() == objects[index].get_hidden());
+                    }
+                }
+
+                static_pointer_test();
+            }
+
+            void varint_test()
+            {
+                uint64_t const values[] = {
+                  0, 1, 127, 128, 300, 16383, 16384, uint64_t(1) << 35, ~uint64_t(0)};
+                for (auto const value : values)
+                {
+                    unsigned char buffer[max_varint_size];
+                    auto const    size = write_varint(buffer, value);
+                    ENCELADO_TEST_ASSERT(size == varint_size(value));
+                    uint64_t result = 0;
+                    ENCELADO_TEST_ASSERT(read_varint(buffer, size, result) == size);
+                    ENCELADO_TEST_ASSERT(result == value);
+                    ENCELADO_TEST_ASSERT(read_varint(buffer, size - 1, result) == 0);
+                }
+
+                int64_t const signed_values[] = {0, -1, 1, -64, 64, INT64_MIN, INT64_MAX};
+                for (auto const value : signed_values)
+                    ENCELADO_TEST_ASSERT(zigzag_decode(zigzag_encode(value)) == value);
+                ENCELADO_TEST_ASSERT(zigzag_encode(-1) == 1 && zigzag_encode(1) == 2);
+
+                // a padded varint has a fixed size
+                unsigned char padded[3];
+                write_padded_varint(padded, 5, sizeof(padded));
+                uint64_t result = 0;
+                ENCELADO_TEST_ASSERT(read_varint(padded, sizeof(padded), result) == 3);
+                ENCELADO_TEST_ASSERT(result == 5);
+
+                // bulk decoding, mixing single byte and longer varints
+                std::vector<uint64_t>      source;
+                std::vector<unsigned char> stream;
+                for (uint64_t index = 0; index < 1000; index++)
+                {
+                    source.push_back(index % 17 == 0 ? index * 1000 : index % 100);
+                    unsigned char buffer[max_varint_size];
+                    stream.insert(
+                      stream.end(), buffer, buffer + write_varint(buffer, source.back()));
+                }
+                std::vector<uint64_t> decoded(source.size());
+                size_t                read_size = 0;
+                auto const            count     = read_varints(
+                  stream.data(), stream.size() - 1, decoded.data(), decoded.size(), read_size);
+                ENCELADO_TEST_ASSERT(count == source.size() - 1);
+                ENCELADO_TEST_ASSERT(read_size == stream.size() - 1);
+                ENCELADO_TEST_ASSERT(std::equal(source.begin(), source.end() - 1, decoded.begin()));
+            }
+
+            void compact_test(size_t i_page_size)
+            {
+                // not decreasing integers are delta encoded
+                NumericClass object;
+                object.m_byte = 7;
+                for (int32_t index = 0; index < 100 * 1000; index++)
+                {
+                    object.m_ints.push_back(index * 3 - 5000);
+                    object.m_doubles.push_back(index / 4.);
+                }
+                type_registry registry;
+                auto const    fixed = write_pages(registry, raw_ptr(&object), i_page_size);
+                auto const    compact =
+                  write_pages(registry, raw_ptr(&object), i_page_size, wire_format::compact);
+                ENCELADO_TEST_ASSERT(compact.size() < fixed.size());
+
+                NumericClass result;
+                result.m_ints.resize(3, 1);
+                read_pages(registry, compact, raw_ptr(&result), wire_format::compact);
+                ENCELADO_TEST_ASSERT(result.m_ints == object.m_ints);
+                ENCELADO_TEST_ASSERT(result.m_byte == object.m_byte);
+                ENCELADO_TEST_ASSERT(result.m_doubles == object.m_doubles);
+
+                // not monotonic integers
+                for (size_t index = 0; index < object.m_ints.size(); index++)
+                    object.m_ints[index] = (index % 2 == 0 ? -1 : 1) * static_cast<int32_t>(index);
+                object.m_ints.push_back(INT32_MIN);
+                object.m_ints.push_back(INT32_MAX);
+                auto const pages =
+                  write_pages(registry, raw_ptr(&object), i_page_size, wire_format::compact);
+                read_pages(registry, pages, raw_ptr(&result), wire_format::compact);
+                ENCELADO_TEST_ASSERT(result.m_ints == object.m_ints);
+
+                // nested containers, base classes, and properties with a getter
+                TestClass test_object;
+                edit_serialization_test_data(test_object, 3);
+                TestClass test_result;
+                read_pages(
+                  registry,
+                  write_pages(registry, raw_ptr(&test_object), i_page_size, wire_format::compact),
+                  raw_ptr(&test_result),
+                  wire_format::compact);
+                ENCELADO_TEST_ASSERT(equals(test_object, test_result));
+
+                PlanClass plan_object;
+                plan_object.m_first = -3;
+                plan_object.m_id    = -123456;
+                plan_object.m_point = {1, -1};
+                plan_object.m_points.resize(300, PlainPoint{-2, 2});
+                plan_object.set_hidden(-77);
+                PlanClass plan_result;
+                read_pages(
+                  registry,
+                  write_pages(registry, raw_ptr(&plan_object), i_page_size, wire_format::compact),
+                  raw_ptr(&plan_result),
+                  wire_format::compact);
+                ENCELADO_TEST_ASSERT(plan_result.m_first == plan_object.m_first);
+                ENCELADO_TEST_ASSERT(plan_result.m_id == plan_object.m_id);
+                ENCELADO_TEST_ASSERT(plan_result.m_point.m_y == plan_object.m_point.m_y);
+                ENCELADO_TEST_ASSERT(plan_result.m_points.size() == plan_object.m_points.size());
+                ENCELADO_TEST_ASSERT(plan_result.m_points.back().m_x == -2);
+                ENCELADO_TEST_ASSERT(plan_result.get_hidden() == plan_object.get_hidden());
+            }
+
+            void flat_test()
+            {
+                PlanClass object;
+                object.m_first  = -3;
+                object.m_second = 4;
+                object.m_id     = 42;
+                object.m_point  = {5, 6};
+                object.m_value  = 1.5;
+                for (int32_t index = 0; index < 100; index++)
+                    object.m_points.push_back({index, -index});
+                object.set_hidden(77);
+
+                // the buffer is moved to an aligned page, as if it was mapped
+                type_registry registry;
+                auto const    buffer = write_flat(registry, raw_ptr(&object));
+                std::vector<std::max_align_t> page(buffer.size() / sizeof(std::max_align_t) + 1);
+                memcpy(page.data(), buffer.data(), buffer.size());
+
+                flat_view const view(registry, get_class_type<PlanClass>(), page.data());
+                ENCELADO_TEST_ASSERT(view["id"].get<int32_t>() == 42);
+                ENCELADO_TEST_ASSERT(view["point"]["y"].get<int32_t>() == 6);
+                ENCELADO_TEST_ASSERT(view["value"].get<double>() == 1.5);
+                ENCELADO_TEST_ASSERT(view["hidden"].get<int32_t>() == 77);
+                ENCELADO_TEST_ASSERT(view["first"].get<int16_t>() == -3);
+                ENCELADO_TEST_ASSERT(view["second"].get<int16_t>() == 4);
+                ENCELADO_TEST_ASSERT(view.size() == 0);
+                auto const points = view["points"];
+                ENCELADO_TEST_ASSERT(points.size() == 100);
+                ENCELADO_TEST_ASSERT(points.element(99)["x"].get<int32_t>() == 99);
+                ENCELADO_TEST_ASSERT(points.element(37)["y"].get<int32_t>() == -37);
+
+                // the flat object can be inspected without deserializing it
+                size_t property_count = 0;
+                for (auto const & prop : inspect_properties(view.object()))
+                {
+                    if (prop.name() == "id")
+                    {
+                        auto const value = prop.get_value();
+                        ENCELADO_TEST_ASSERT(*static_cast<const int32_t *>(value.object()) == 42);
+                    }
+                    property_count++;
+                }
+                ENCELADO_TEST_ASSERT(property_count == 7);
+
+                // nested containers
+                TestClass test_object;
+                edit_serialization_test_data(test_object, 3);
+                auto const test_buffer = write_flat(registry, raw_ptr(&test_object));
+                std::vector<std::max_align_t> test_page(
+                  test_buffer.size() / sizeof(std::max_align_t) + 1);
+                memcpy(test_page.data(), test_buffer.data(), test_buffer.size());
+                flat_view const test_view(registry, get_class_type<TestClass>(), test_page.data());
+                ENCELADO_TEST_ASSERT(test_view["int"].get<int32_t>() == test_object.m_int);
+                auto const objects = test_view["objects_2"];
+                ENCELADO_TEST_ASSERT(objects.size() == test_object.m_objects_2.size());
+                for (size_t index = 0; index < objects.size(); index++)
+                {
+                    auto const & source = test_object.m_objects_2[index];
+                    auto const   element = objects.element(index);
+                    ENCELADO_TEST_ASSERT(element["double"].get<double>() == source.m_double);
+                    ENCELADO_TEST_ASSERT(element["objects_1"].size() == source.m_objects_1.size());
+                }
+
+                bool thrown = false;
+                try
+                {
+                    (void)view["missing"];
+                }
+                catch (const std::invalid_argument &)
+                {
+                    thrown = true;
+                }
+                ENCELADO_TEST_ASSERT(thrown);
+            }
+
+            void parallel_test(size_t i_thread_count, size_t i_page_size)
+            {
+                std::vector<PlanClass> objects(20 * 1000);
+                for (size_t index = 0; index < objects.size(); index++)
+                {
+                    objects[index].m_id    = static_cast<int32_t>(index);
+                    objects[index].m_first = static_cast<int16_t>(index % 1000);
+                    objects[index].m_points.resize(index % 3, PlainPoint{1, 2});
+                    objects[index].set_hidden(static_cast<int32_t>(index * 2));
+                }
+
+                type_registry registry;
+                auto const    pages =
+                  write_parallel(registry, raw_ptr(&objects), i_page_size, i_thread_count);
+                for (auto const & page : pages)
+                    ENCELADO_TEST_ASSERT(!page.empty() && page.size() <= i_page_size);
+
+                // the pages of the partitions are read as a single stream
+                type_registry          read_registry;
+                std::vector<PlanClass> result(3);
+                read_pages(read_registry, pages, raw_ptr(&result));
+                ENCELADO_TEST_ASSERT(result.size() == objects.size());
+                for (size_t index = 0; index < objects.size(); index++)
+                {
+                    ENCELADO_TEST_ASSERT(result[index].m_id == objects[index].m_id);
+                    ENCELADO_TEST_ASSERT(result[index].m_first == objects[index].m_first);
+                    ENCELADO_TEST_ASSERT(
+                      result[index].m_points.size() == objects[index].m_points.size());
+                    ENCELADO_TEST_ASSERT(result[index].get_hidden() == objects[index].get_hidden());
+                }
+
+                std::vector<int32_t> values(300 * 1000);
+                for (size_t index = 0; index < values.size(); index++)
+                    values[index] = static_cast<int32_t>(index * 5);
+                auto const compact_pages = write_parallel(
+                  registry, raw_ptr(&values), i_page_size, i_thread_count, wire_format::compact);
+                std::vector<int32_t> values_result;
+                read_pages(registry, compact_pages, raw_ptr(&values_result), wire_format::compact);
+                ENCELADO_TEST_ASSERT(values_result == values);
+
+                // empty container
+                std::vector<int32_t> empty;
+                auto const           empty_pages =
+                  write_parallel(registry, raw_ptr(&empty), i_page_size, i_thread_count);
+                read_pages(registry, empty_pages, raw_ptr(&values_result));
+                ENCELADO_TEST_ASSERT(values_result.empty());
+
+                // a partition requires a contiguous container
+                bool thrown = false;
+                try
+                {
+                    PlainPoint point;
+                    binary_writer(registry, raw_ptr(&point), binary_writer::partition{0, 1});
+                }
+                catch (const std::invalid_argument &)
+                {
+                    thrown = true;
+                }
+                ENCELADO_TEST_ASSERT(thrown);
             }
 
-            int g = 0;
+            void page_chain_test(page_size i_page_size)
+            {
+                memory_device device(i_page_size);
+                auto const    initial_page_count = device.page_count();
+
+                TestClass object;
+                edit_serialization_test_data(object, 4);
+                type_registry registry;
+                binary_writer writer(registry, raw_ptr(&object), wire_format::compact);
+                auto const    first_page = write_page_chain(device, writer);
+                auto const    length     = page_chain_length(device, first_page);
+                ENCELADO_TEST_ASSERT(device.page_count() == initial_page_count + length);
+
+                TestClass     result;
+                binary_reader reader(registry, raw_ptr(&result), wire_format::compact);
+                read_page_chain(device, first_page, reader);
+                ENCELADO_TEST_ASSERT(equals(object, result));
+
+                free_page_chain(device, first_page);
+                ENCELADO_TEST_ASSERT(device.page_count() == initial_page_count);
+
+                // on failure the pages are deallocated
+                TestClass deep;
+                auto *    last = &deep;
+                for (size_t depth = 0; depth < binary_writer::max_depth; depth++)
+                {
+                    last->m_objects_1.resize(1);
+                    last = &last->m_objects_1.front();
+                }
+                binary_writer deep_writer(registry, raw_ptr(&deep));
+                bool          thrown = false;
+                try
+                {
+                    (void)write_page_chain(device, deep_writer);
+                }
+                catch (const std::runtime_error &)
+                {
+                    thrown = true;
+                }
+                ENCELADO_TEST_ASSERT(thrown);
+                ENCELADO_TEST_ASSERT(device.page_count() == initial_page_count);
+            }
+
+            void schema_test(page_size i_page_size)
+            {
+                memory_device device(i_page_size);
+                auto const    initial_page_count = device.page_count();
+
+                type_registry registry;
+                registry.get_type_data(get_class_type<NumericClass>());
+                registry.get_type_data(get_class_type<PlanClass>());
+                registry.get_type_data(get_class_type<PlanBase>());
+                auto const test_data  = registry.get_type_data(get_class_type<TestClass>());
+                auto const first_page = write_schema(device, registry);
+
+                auto const registered = registry.registered_classes();
+                {
+                    schema_view schema(device, first_page);
+                    ENCELADO_TEST_ASSERT(schema.classes().size() == registered.size());
+                    for (auto const & class_data : registered)
+                    {
+                        auto const entry = schema.find_class(schema_name(class_data.m_active_type));
+                        ENCELADO_TEST_ASSERT(entry != nullptr);
+                        ENCELADO_TEST_ASSERT(entry->id() == class_data.m_id);
+                        ENCELADO_TEST_ASSERT(entry->same_layout(class_data));
+                        ENCELADO_TEST_ASSERT(entry->id() < schema.next_type_id());
+                    }
+                    ENCELADO_TEST_ASSERT(schema.find_class("cambrian_test::Missing") == nullptr);
+
+                    // the layouts of the classes can be read without the source classes
+                    auto const plan_entry = schema.find_class("cambrian_test::PlanClass");
+                    auto const plan_data  = registry.get_type_data(get_class_type<PlanClass>());
+                    auto const id_index   = plan_entry->find_property("id");
+                    ENCELADO_TEST_ASSERT(id_index < plan_entry->property_count());
+                    auto const id_property = plan_entry->get_property(id_index);
+                    ENCELADO_TEST_ASSERT(
+                      id_property.m_type_name == string_view(schema_name(get_type<int32_t>())));
+                    ENCELADO_TEST_ASSERT(id_property.m_size == sizeof(int32_t));
+                    ENCELADO_TEST_ASSERT(
+                      id_property.m_offset == plan_data.m_layout->m_fields[id_index].m_offset);
+                    ENCELADO_TEST_ASSERT(
+                      plan_entry->find_property("missing") == plan_entry->property_count());
+                    ENCELADO_TEST_ASSERT(plan_entry->base_count() == 1);
+                    ENCELADO_TEST_ASSERT(plan_entry->base_name(0) == "cambrian_test::PlanBase");
+                    ENCELADO_TEST_ASSERT(!plan_entry->is_container());
+                    ENCELADO_TEST_ASSERT(!plan_entry->same_layout(test_data));
+
+                    auto const vector_name = schema_name(get_class_type<std::vector<TestClass>>());
+                    ENCELADO_TEST_ASSERT(vector_name == "std::vector<cambrian_test::TestClass>");
+                    auto const vector_entry = schema.find_class(vector_name);
+                    ENCELADO_TEST_ASSERT(vector_entry != nullptr && vector_entry->is_container());
+                    ENCELADO_TEST_ASSERT(
+                      vector_entry->element_type_name() == "cambrian_test::TestClass");
+
+                    /* a registry loaded from the schema gives the same ids to the classes,
+                       whatever the order of registration, and new ids to the other classes */
+                    type_registry loaded_registry(schema);
+                    ENCELADO_TEST_ASSERT(
+                      loaded_registry.get_type_data(get_class_type<GraphNode>()).m_id >=
+                      schema.next_type_id());
+                    ENCELADO_TEST_ASSERT(
+                      loaded_registry.get_type_data(get_class_type<TestClass>()).m_id ==
+                      test_data.m_id);
+
+                    TestClass object;
+                    edit_serialization_test_data(object, 3);
+                    auto const pages = write_pages(registry, raw_ptr(&object), 256);
+                    TestClass  result;
+                    read_pages(loaded_registry, pages, raw_ptr(&result));
+                    ENCELADO_TEST_ASSERT(equals(object, result));
+
+                    // a class whose layout has changed since the schema was written
+                    bool thrown = false;
+                    try
+                    {
+                        loaded_registry.get_type_data(get_class_type<PlanBaseV2>());
+                    }
+                    catch (const std::runtime_error &)
+                    {
+                        thrown = true;
+                    }
+                    ENCELADO_TEST_ASSERT(thrown);
+                    ENCELADO_TEST_ASSERT(
+                      loaded_registry.get_type_data(get_class_type<PlanBase>()).m_id ==
+                      registry.get_type_data(get_class_type<PlanBase>()).m_id);
+                }
+
+                free_schema(device, first_page);
+                ENCELADO_TEST_ASSERT(device.page_count() == initial_page_count);
+
+                // a class that does not fit in a page
+                memory_device small_device(256);
+                auto const    small_page_count = small_device.page_count();
+                bool          thrown           = false;
+                try
+                {
+                    (void)write_schema(small_device, registry);
+                }
+                catch (const std::runtime_error &)
+                {
+                    thrown = true;
+                }
+                ENCELADO_TEST_ASSERT(thrown);
+                ENCELADO_TEST_ASSERT(small_device.page_count() == small_page_count);
+            }
+
+            void pointer_test(size_t i_page_size, wire_format i_format)
+            {
+                /* the nodes are pointed by the root and by the previous two nodes, the weights
+                   are shared by many nodes, and the last node points back to the root */
+                int32_t const          weights[3] = {10, 20, 30};
+                std::vector<GraphNode> nodes(10);
+                GraphNode              root;
+                root.m_id = 100;
+                for (size_t index = 0; index < nodes.size(); index++)
+                {
+                    auto & node   = nodes[index];
+                    node.m_id     = static_cast<int32_t>(index);
+                    node.m_weight = index % 4 != 3 ? &weights[index % 4] : nullptr;
+                    node.m_next   = index + 1 < nodes.size() ? &nodes[index + 1] : &root;
+                    auto const last_child = std::min(index + 3, nodes.size());
+                    for (size_t child = index + 1; child < last_child; child++)
+                        node.m_children.push_back(&nodes[child]);
+                    root.m_children.push_back(&node);
+                }
+
+                type_registry registry;
+                auto const    pages = write_pages(registry, raw_ptr(&root), i_page_size, i_format);
+
+                GraphNode     result;
+                binary_reader reader(registry, raw_ptr(&result), i_format);
+                auto          read_result = binary_reader::more_data;
+                for (auto const & page : pages)
+                {
+                    byte_reader source(page.data(), page.size());
+                    read_result = reader.step(source);
+                }
+                ENCELADO_TEST_ASSERT(read_result == binary_reader::finished);
+
+                // every shared object is created once
+                auto const created = reader.created_objects();
+                ENCELADO_TEST_ASSERT(created.size() == nodes.size() + 3);
+
+                ENCELADO_TEST_ASSERT(result.m_id == root.m_id && result.m_next == nullptr);
+                ENCELADO_TEST_ASSERT(result.m_children.size() == nodes.size());
+                for (size_t index = 0; index < nodes.size(); index++)
+                {
+                    auto const & node = *result.m_children[index];
+                    ENCELADO_TEST_ASSERT(node.m_id == nodes[index].m_id);
+                    ENCELADO_TEST_ASSERT(node.m_children.size() == nodes[index].m_children.size());
+                    for (size_t child = 0; child < node.m_children.size(); child++)
+                    {
+                        ENCELADO_TEST_ASSERT(
+                          node.m_children[child] == result.m_children[index + 1 + child]);
+                    }
+                    auto const next =
+                      index + 1 < nodes.size() ? result.m_children[index + 1] : &result;
+                    ENCELADO_TEST_ASSERT(node.m_next == next);
+                    if (index % 4 == 3)
+                    {
+                        ENCELADO_TEST_ASSERT(node.m_weight == nullptr);
+                    }
+                    else
+                    {
+                        ENCELADO_TEST_ASSERT(*node.m_weight == weights[index % 4]);
+                        if (index >= 4)
+                        {
+                            ENCELADO_TEST_ASSERT(
+                              node.m_weight == result.m_children[index - 4]->m_weight);
+                        }
+                    }
+                }
+
+                // the created objects are owned by the caller
+                for (auto const & object : created)
+                {
+                    if (object.qualified_type().final_type() == &get_type<GraphNode>())
+                        delete static_cast<GraphNode *>(const_cast<void *>(object.object()));
+                    else
+                        delete static_cast<int32_t *>(const_cast<void *>(object.object()));
+                }
+
+                // the ids of the objects would depend on the other partitions
+                std::vector<GraphNode *> pointers(2, &root);
+                bool                     thrown = false;
+                try
+                {
+                    binary_writer writer(
+                      registry, raw_ptr(&pointers), binary_writer::partition{0, 2}, i_format);
+                    unsigned char buffer[256];
+                    byte_writer   dest(buffer, sizeof(buffer));
+                    (void)writer.step(dest);
+                }
+                catch (const std::runtime_error &)
+                {
+                    thrown = true;
+                }
+                ENCELADO_TEST_ASSERT(thrown);
+            }
+
+            void interning_test(size_t i_page_size, wire_format i_format)
+            {
+                // few repeated tags, a tag too long to be interned, and empty tags
+                using Tag           = std::vector<char>;
+                auto const make_tag = [](const char * i_string) {
+                    return Tag(i_string, i_string + std::strlen(i_string));
+                };
+                std::vector<Tag> const tags = {make_tag("material/stone/granite"),
+                                               make_tag("material/wood/oak-light"),
+                                               make_tag("material/metal/steel"),
+                                               Tag(300, 'x'),
+                                               Tag()};
+                std::vector<Tag>       source;
+                for (size_t index = 0; index < 1000; index++)
+                    source.push_back(tags[index % 50 == 0 ? 3 + index % 2 : index % 3]);
+
+                type_registry registry;
+                auto const    plain_pages =
+                  write_pages(registry, raw_ptr(&source), i_page_size, i_format);
+                auto const pages =
+                  write_pages(registry, raw_ptr(&source), i_page_size, i_format, 256);
+                auto const stream_size = [](const Pages & i_pages) {
+                    size_t size = 0;
+                    for (auto const & page : i_pages)
+                        size += page.size();
+                    return size;
+                };
+                ENCELADO_TEST_ASSERT(stream_size(pages) * 2 < stream_size(plain_pages));
+
+                // the content of the destination is replaced
+                std::vector<Tag> result = {make_tag("old")};
+                read_pages(registry, pages, raw_ptr(&result), i_format, 256);
+                ENCELADO_TEST_ASSERT(result == source);
+
+                // the ids would depend on the other partitions
+                bool thrown = false;
+                try
+                {
+                    binary_writer writer(
+                      registry, raw_ptr(&source), binary_writer::partition{0, 2}, i_format);
+                    writer.enable_interning();
+                }
+                catch (const std::invalid_argument &)
+                {
+                    thrown = true;
+                }
+                ENCELADO_TEST_ASSERT(thrown);
+            }
+
+            void profile_test(wire_format i_format)
+            {
+                TestClass object;
+                edit_serialization_test_data(object, 3);
+
+                type_registry         registry;
+                serialization_profile profile;
+                size_t                stream_size = 0;
+                {
+                    binary_writer writer(registry, raw_ptr(&object), i_format);
+                    writer.set_profile(&profile);
+                    bool finished = false;
+                    while (!finished)
+                    {
+                        unsigned char buffer[100];
+                        byte_writer   dest(buffer, sizeof(buffer));
+                        finished = writer.step(dest) == binary_writer::finished;
+                        stream_size += sizeof(buffer) - static_cast<size_t>(dest.remaining_size());
+                    }
+                }
+                ENCELADO_TEST_ASSERT(profile.total_bytes() == stream_size);
+
+                // every byte belongs to exactly one object
+                auto const types = profile.types();
+                ENCELADO_TEST_ASSERT(types.size() == 2);
+                uint64_t object_bytes = 0;
+                for (auto const & entry : types)
+                    object_bytes += entry.m_bytes;
+                ENCELADO_TEST_ASSERT(object_bytes == stream_size);
+
+                // 1 + 5 + 5 * 5 + 5 * 5 * 5 objects, and two vectors in each of them
+                auto const & root = types[0].m_type == &get_type<TestClass>() ? types[0] : types[1];
+                ENCELADO_TEST_ASSERT(root.m_object_count == 156);
+                ENCELADO_TEST_ASSERT(root.m_total_bytes > stream_size); // the root contains all
+                auto const containers = profile.containers();
+                ENCELADO_TEST_ASSERT(containers.size() == 1);
+                ENCELADO_TEST_ASSERT(containers[0].m_container_count == 2 * 156);
+                ENCELADO_TEST_ASSERT(containers[0].m_element_count == 155);
+                ENCELADO_TEST_ASSERT(profile.marker_count() == containers[0].m_marker_count);
+                if (i_format == wire_format::fixed)
+                {
+                    ENCELADO_TEST_ASSERT(
+                      profile.marker_bytes() == profile.marker_count() * sizeof(data_marker));
+                }
+
+                // the properties are sorted by size
+                auto const properties = profile.properties();
+                ENCELADO_TEST_ASSERT(properties.size() == 4);
+                ENCELADO_TEST_ASSERT(properties[0].m_name == "objects_1");
+                ENCELADO_TEST_ASSERT(properties[3].m_name == "int");
+                ENCELADO_TEST_ASSERT(properties[3].m_value_count == 156);
+                ENCELADO_TEST_ASSERT(
+                  profile.report().find("cambrian_test::TestClass") != std::string::npos);
+            }
+
+            void delta_test(wire_format i_format)
+            {
+                TestClass object;
+                edit_serialization_test_data(object, 5);
+                TestClass      replica = object;
+                type_registry  registry;
+                change_tracker tracker;
+                tracker.track(raw_ptr(&object));
+
+                // changes through the reflection
+                auto & nested = object.m_objects_1[1].m_objects_2[0];
+                set_property_value(raw_ptr(&nested), "double", "5.5");
+                set_property_value(raw_ptr(&object), "int", "-3");
+                auto replacement = object.m_objects_1[2].m_objects_1[0].m_objects_1;
+                set_property_value(
+                  raw_ptr(&object.m_objects_2[0]), "objects_1", raw_ptr(&replacement));
+
+                // changes to be reported
+                object.m_objects_2[1].m_objects_1[2].m_int = 77;
+                tracker.mark_dirty(&object.m_objects_2[1].m_objects_1[2], mak_props[0]);
+
+                // objects that are not reachable from a tracked root are not recorded
+                auto const change_count = tracker.change_count();
+                TestClass  other;
+                set_property_value(raw_ptr(&other), "int", "5");
+                PlanClass  read_object;
+                auto const plan_pages = write_pages(registry, raw_ptr(&read_object), 4096);
+                read_pages(registry, plan_pages, raw_ptr(&read_object));
+                ENCELADO_TEST_ASSERT(tracker.change_count() == change_count);
+
+                auto const delta = write_delta(registry, raw_ptr(&object), tracker, i_format);
+                ENCELADO_TEST_ASSERT(tracker.change_count() == 0);
+                ENCELADO_TEST_ASSERT(
+                  delta.size() * 10 < write_to_pages(registry, raw_ptr(&object), 4096).size());
+                ENCELADO_TEST_ASSERT(!equals(object, replica));
+                apply_delta(registry, raw_ptr(&replica), delta.data(), delta.size(), i_format);
+                ENCELADO_TEST_ASSERT(equals(object, replica));
+
+                // no changes since the last checkpoint
+                ENCELADO_TEST_ASSERT(write_delta(registry, raw_ptr(&object), tracker).empty());
+
+                // the replaced objects are indexed again
+                set_property_value(
+                  raw_ptr(&object.m_objects_2[0].m_objects_1[1]), "double", "7.5");
+                auto const replaced_delta = write_delta(registry, raw_ptr(&object), tracker);
+                apply_delta(
+                  registry, raw_ptr(&replica), replaced_delta.data(), replaced_delta.size());
+                ENCELADO_TEST_ASSERT(equals(object, replica));
+
+                // properties of base classes and with a setter
+                std::vector<PlanClass> plan_objects(5), plan_replica(5);
+                tracker.track(raw_ptr(&plan_objects));
+                set_property_value(raw_ptr(&plan_objects[2]), "first", "12");
+                set_property_value(raw_ptr(&plan_objects[3]), "hidden", "34");
+                auto const plan_delta =
+                  write_delta(registry, raw_ptr(&plan_objects), tracker, i_format);
+                apply_delta(
+                  registry, raw_ptr(&plan_replica), plan_delta.data(), plan_delta.size(), i_format);
+                ENCELADO_TEST_ASSERT(plan_replica[2].m_first == 12);
+                ENCELADO_TEST_ASSERT(plan_replica[3].get_hidden() == 34);
+
+                // a root that is not tracked
+                bool untracked_thrown = false;
+                try
+                {
+                    (void)write_delta(registry, raw_ptr(&plan_replica), tracker);
+                }
+                catch (const std::invalid_argument &)
+                {
+                    untracked_thrown = true;
+                }
+                ENCELADO_TEST_ASSERT(untracked_thrown);
+
+                // a delta that does not match the base
+                std::vector<PlanClass> short_replica(2);
+                bool                   thrown = false;
+                try
+                {
+                    apply_delta(
+                      registry,
+                      raw_ptr(&short_replica),
+                      plan_delta.data(),
+                      plan_delta.size(),
+                      i_format);
+                }
+                catch (const std::runtime_error &)
+                {
+                    thrown = true;
+                }
+                ENCELADO_TEST_ASSERT(thrown);
+            }
+
+            void lazy_test(wire_format i_format)
+            {
+                TestClass source;
+                edit_serialization_test_data(source, 4);
+                type_registry              registry;
+                std::vector<unsigned char> stream;
+                for (auto const & page : write_pages(registry, raw_ptr(&source), 4096, i_format))
+                    stream.insert(stream.end(), page.begin(), page.end());
+
+                TestClass result;
+                {
+                    lazy_reader reader(
+                      registry, raw_ptr(&result), stream.data(), stream.size(), i_format);
+
+                    // only the top-level fields are read
+                    ENCELADO_TEST_ASSERT(result.m_int == 4 && result.m_double == 4.);
+                    ENCELADO_TEST_ASSERT(result.m_objects_1.empty() && result.m_objects_2.empty());
+                    ENCELADO_TEST_ASSERT(reader.stub_count() == 2);
+
+                    // a stub is loaded when the property is accessed
+                    auto const objects_2 = get_property_value(raw_ptr(&result), "objects_2");
+                    ENCELADO_TEST_ASSERT(reader.stub_count() == 1 && result.m_objects_1.empty());
+                    ENCELADO_TEST_ASSERT(
+                      static_cast<const std::vector<TestClass> *>(objects_2.object())->size() == 2);
+                    for (auto const & prop : inspect_properties(raw_ptr(&result)))
+                        (void)prop.get_value();
+                    ENCELADO_TEST_ASSERT(reader.stub_count() == 0);
+                }
+                ENCELADO_TEST_ASSERT(equals(result, source));
+
+                // accessing a property with a getter loads all the stubs
+                PlanClass plan_source;
+                plan_source.m_first      = 3;
+                plan_source.m_point.m_x  = 5;
+                plan_source.m_points     = {PlainPoint{1, 2}, PlainPoint{3, 4}};
+                plan_source.set_hidden(7);
+                stream.clear();
+                for (auto const & page :
+                     write_pages(registry, raw_ptr(&plan_source), 4096, i_format))
+                {
+                    stream.insert(stream.end(), page.begin(), page.end());
+                }
+                PlanClass   plan_result;
+                lazy_reader reader(
+                  registry, raw_ptr(&plan_result), stream.data(), stream.size(), i_format);
+                ENCELADO_TEST_ASSERT(plan_result.m_first == 3 && plan_result.get_hidden() == 7);
+                (void)get_property_value(raw_ptr(&plan_result), "point");
+                ENCELADO_TEST_ASSERT(plan_result.m_point.m_x == 5 && reader.stub_count() == 1);
+                (void)get_property_value(raw_ptr(&plan_result), "hidden");
+                ENCELADO_TEST_ASSERT(reader.stub_count() == 0);
+                ENCELADO_TEST_ASSERT(plan_result.m_points.size() == 2);
+                ENCELADO_TEST_ASSERT(plan_result.m_points[1].m_y == 4);
+
+                // the roots of two readers can't overlap
+                bool thrown = false;
+                try
+                {
+                    lazy_reader overlapping(
+                      registry, raw_ptr(&plan_result), stream.data(), stream.size(), i_format);
+                }
+                catch (const std::invalid_argument &)
+                {
+                    thrown = true;
+                }
+                ENCELADO_TEST_ASSERT(thrown);
+
+                // a setter called while loading can access the other properties of the root
+                ReentrantClass reentrant_source;
+                reentrant_source.m_items = {1, 2, 3};
+                reentrant_source.set_point(PlainPoint{8, 9});
+                stream.clear();
+                for (auto const & page :
+                     write_pages(registry, raw_ptr(&reentrant_source), 4096, i_format))
+                {
+                    stream.insert(stream.end(), page.begin(), page.end());
+                }
+                ReentrantClass reentrant_result;
+                {
+                    lazy_reader reentrant_reader(
+                      registry, raw_ptr(&reentrant_result), stream.data(), stream.size(), i_format);
+                    (void)get_property_value(raw_ptr(&reentrant_result), "point");
+                    ENCELADO_TEST_ASSERT(reentrant_reader.stub_count() == 0);
+                }
+                ENCELADO_TEST_ASSERT(reentrant_result.m_items_seen == 3);
+                ENCELADO_TEST_ASSERT(reentrant_result.get_point().m_y == 9);
+
+                // readers of different roots load concurrently
+                std::vector<TestClass>                    results(4);
+                std::vector<std::unique_ptr<lazy_reader>> readers;
+                stream.clear();
+                for (auto const & page : write_pages(registry, raw_ptr(&source), 4096, i_format))
+                    stream.insert(stream.end(), page.begin(), page.end());
+                for (auto & concurrent_result : results)
+                {
+                    readers.push_back(std::make_unique<lazy_reader>(
+                      registry,
+                      raw_ptr(&concurrent_result),
+                      stream.data(),
+                      stream.size(),
+                      i_format));
+                }
+                std::vector<std::thread> threads;
+                for (auto & concurrent_result : results)
+                {
+                    threads.emplace_back([&concurrent_result] {
+                        for (auto const & prop : inspect_properties(raw_ptr(&concurrent_result)))
+                            (void)prop.get_value();
+                    });
+                }
+                for (auto & thread : threads)
+                    thread.join();
+                for (size_t index = 0; index < results.size(); index++)
+                {
+                    ENCELADO_TEST_ASSERT(readers[index]->stub_count() == 0);
+                    ENCELADO_TEST_ASSERT(equals(results[index], source));
+                }
+            }
+
+            void tagged_test(wire_format i_format)
+            {
+                PlanClass source;
+                source.m_first     = 3;
+                source.m_second    = -4;
+                source.m_id        = 11;
+                source.m_point.m_x = 5;
+                source.m_point.m_y = 6;
+                source.m_value     = 2.5;
+                source.m_points    = {PlainPoint{1, 2}, PlainPoint{3, 4}};
+                source.set_hidden(7);
+
+                type_registry registry;
+                auto const    stream = write_tagged(registry, raw_ptr(&source), i_format);
+
+                // a property is found by name, and a nested object is read without the others
+                tagged_view const view(stream.data(), stream.size());
+                ENCELADO_TEST_ASSERT(view.property_count() == 7);
+                auto const point_index = view.find_property("point");
+                ENCELADO_TEST_ASSERT(point_index < view.property_count());
+                ENCELADO_TEST_ASSERT(view.is_object(point_index));
+                auto const point = view.get_object(point_index);
+                int32_t    y     = 0;
+                point.read_value(registry, point.find_property("y"), raw_ptr(&y), i_format);
+                ENCELADO_TEST_ASSERT(y == 6);
+                double value = 0;
+                view.read_value(registry, view.find_property("value"), raw_ptr(&value), i_format);
+                ENCELADO_TEST_ASSERT(value == 2.5);
+                ENCELADO_TEST_ASSERT(view.find_property("missing") == view.property_count());
+
+                PlanClass result;
+                read_tagged(registry, stream.data(), stream.size(), raw_ptr(&result), i_format);
+                ENCELADO_TEST_ASSERT(result.m_first == 3 && result.m_second == -4);
+                ENCELADO_TEST_ASSERT(result.m_id == 11 && result.m_value == 2.5);
+                ENCELADO_TEST_ASSERT(result.m_point.m_x == 5 && result.m_point.m_y == 6);
+                ENCELADO_TEST_ASSERT(result.m_points.size() == 2);
+                ENCELADO_TEST_ASSERT(result.m_points[1].m_y == 4 && result.get_hidden() == 7);
+
+                // the properties unknown to the destination are skipped
+                PlanBase base;
+                read_tagged(registry, stream.data(), stream.size(), raw_ptr(&base), i_format);
+                ENCELADO_TEST_ASSERT(base.m_first == 3 && base.m_second == -4);
+
+                // the properties missing in the stream are left unchanged
+                base.m_first       = 8;
+                auto const partial = write_tagged(registry, raw_ptr(&base), i_format);
+                read_tagged(registry, partial.data(), partial.size(), raw_ptr(&result), i_format);
+                ENCELADO_TEST_ASSERT(result.m_first == 8 && result.m_second == -4);
+                ENCELADO_TEST_ASSERT(result.m_id == 11 && result.get_hidden() == 7);
+
+                // the elements of a container of classes are objects
+                auto const points = view.get_sequence(view.find_property("points"));
+                ENCELADO_TEST_ASSERT(points.property_count() == 2 && points.is_object(1));
+                auto const second_point = points.get_object(1);
+                ENCELADO_TEST_ASSERT(
+                  second_point.property_class(0) == "cambrian_test::PlainPoint" &&
+                  second_point.property_name(0) == "x");
+
+                // a property is matched by the class that declares it
+                Shadowing shadowing;
+                shadowing.ShadowBase::m_value = 1;
+                shadowing.m_value             = 2;
+                auto const shadowing_stream =
+                  write_tagged(registry, raw_ptr(&shadowing), i_format);
+                Shadowing shadowing_result;
+                read_tagged(
+                  registry,
+                  shadowing_stream.data(),
+                  shadowing_stream.size(),
+                  raw_ptr(&shadowing_result),
+                  i_format);
+                ENCELADO_TEST_ASSERT(shadowing_result.ShadowBase::m_value == 1);
+                ENCELADO_TEST_ASSERT(shadowing_result.m_value == 2);
+
+                // the elements of a container can gain or lose properties
+                type_registry v2_registry;
+                BaseListV2    list_v2;
+                list_v2.m_items.resize(3);
+                list_v2.m_items[2].m_first = 5;
+                list_v2.m_items[2].m_third = 6;
+                auto const list_stream     = write_tagged(v2_registry, raw_ptr(&list_v2), i_format);
+                BaseList   list;
+                read_tagged(
+                  registry, list_stream.data(), list_stream.size(), raw_ptr(&list), i_format);
+                ENCELADO_TEST_ASSERT(list.m_items.size() == 3 && list.m_items[2].m_first == 5);
+                list.m_items.resize(1);
+                list.m_items[0].m_second = 7;
+                auto const old_stream    = write_tagged(registry, raw_ptr(&list), i_format);
+                read_tagged(
+                  v2_registry, old_stream.data(), old_stream.size(), raw_ptr(&list_v2), i_format);
+                ENCELADO_TEST_ASSERT(list_v2.m_items.size() == 1);
+                ENCELADO_TEST_ASSERT(list_v2.m_items[0].m_second == 7);
+                ENCELADO_TEST_ASSERT(list_v2.m_items[0].m_third == 0);
+
+                bool thrown = false;
+                try
+                {
+                    tagged_view const truncated(stream.data(), stream.size() - 1);
+                }
+                catch (const std::runtime_error &)
+                {
+                    thrown = true;
+                }
+                ENCELADO_TEST_ASSERT(thrown);
+            }
+
+            // run-length encoding, as (count, byte) pairs
+            void rle_compress(
+              const unsigned char * i_page, size_t i_page_size, std::vector<unsigned char> & o_dest)
+            {
+                o_dest.clear();
+                for (size_t index = 0; index < i_page_size;)
+                {
+                    size_t count = 1;
+                    while (count < 255 && index + count < i_page_size &&
+                           i_page[index + count] == i_page[index])
+                    {
+                        count++;
+                    }
+                    o_dest.push_back(static_cast<unsigned char>(count));
+                    o_dest.push_back(i_page[index]);
+                    index += count;
+                }
+            }
+
+            std::vector<unsigned char> rle_decompress(const std::vector<unsigned char> & i_source)
+            {
+                std::vector<unsigned char> result;
+                for (size_t index = 0; index + 1 < i_source.size(); index += 2)
+                    result.insert(result.end(), i_source[index], i_source[index + 1]);
+                return result;
+            }
+
+            void pipelined_test(size_t i_page_size, size_t i_queue_capacity)
+            {
+                TestClass source;
+                edit_serialization_test_data(source, 5);
+                type_registry registry;
+                binary_writer writer(registry, raw_ptr(&source));
+
+                Pages pages;
+                write_pipelined(
+                  writer,
+                  i_page_size,
+                  rle_compress,
+                  [&](const unsigned char * i_page, size_t i_size) {
+                      std::vector<unsigned char> const compressed(i_page, i_page + i_size);
+                      pages.push_back(rle_decompress(compressed));
+                  },
+                  i_queue_capacity);
+                ENCELADO_TEST_ASSERT(pages.size() > 2);
+                for (auto const & page : pages)
+                    ENCELADO_TEST_ASSERT(!page.empty() && page.size() <= i_page_size);
+
+                TestClass result;
+                read_pages(registry, pages, raw_ptr(&result));
+                ENCELADO_TEST_ASSERT(equals(result, source));
+
+                // an exception thrown by a stage stops the pipeline and reaches the caller
+                binary_writer failing_writer(registry, raw_ptr(&source));
+                size_t        sunk_pages = 0;
+                bool          thrown     = false;
+                try
+                {
+                    write_pipelined(
+                      failing_writer,
+                      i_page_size,
+                      rle_compress,
+                      [&](const unsigned char *, size_t) {
+                          if (++sunk_pages == 2)
+                              throw std::runtime_error("sink failure");
+                      },
+                      i_queue_capacity);
+                }
+                catch (const std::runtime_error &)
+                {
+                    thrown = true;
+                }
+                ENCELADO_TEST_ASSERT(thrown && sunk_pages == 2);
+            }
+
+            void columnar_test(size_t i_count)
+            {
+                std::vector<PlanClass> objects(i_count);
+                for (size_t index = 0; index < objects.size(); index++)
+                {
+                    objects[index].m_id        = static_cast<int32_t>(index);
+                    objects[index].m_second    = static_cast<int16_t>(index % 100);
+                    objects[index].m_point.m_y = static_cast<int32_t>(index * 3);
+                    objects[index].m_value     = static_cast<double>(index) / 4;
+                    objects[index].m_points.resize(index % 3, PlainPoint{1, 2});
+                    objects[index].set_hidden(static_cast<int32_t>(index * 2));
+                }
+
+                type_registry registry;
+                auto const    buffer = write_columnar(registry, raw_ptr(&objects));
+
+                // a single column is read in place
+                columnar_view const view(buffer.data(), buffer.size());
+                ENCELADO_TEST_ASSERT(view.row_count() == objects.size());
+                ENCELADO_TEST_ASSERT(view.find_column("points") < view.column_count());
+                auto const ids    = view.values<int32_t>("id");
+                auto const ys     = view.values<int32_t>("point.y");
+                auto const hidden = view.values<int32_t>("hidden");
+                auto const second = view.values<int16_t>("second");
+                ENCELADO_TEST_ASSERT(ids.size() == objects.size());
+                for (size_t index = 0; index < objects.size(); index++)
+                {
+                    ENCELADO_TEST_ASSERT(ids[index] == objects[index].m_id);
+                    ENCELADO_TEST_ASSERT(ys[index] == objects[index].m_point.m_y);
+                    ENCELADO_TEST_ASSERT(hidden[index] == objects[index].get_hidden());
+                    ENCELADO_TEST_ASSERT(second[index] == objects[index].m_second);
+                }
+
+                bool thrown = false;
+                try
+                {
+                    (void)view.values<double>("id");
+                }
+                catch (const std::invalid_argument &)
+                {
+                    thrown = true;
+                }
+                ENCELADO_TEST_ASSERT(thrown);
+
+                std::vector<PlanClass> result(2);
+                read_columnar(registry, buffer.data(), buffer.size(), raw_ptr(&result));
+                ENCELADO_TEST_ASSERT(result.size() == objects.size());
+                for (size_t index = 0; index < objects.size(); index++)
+                {
+                    auto const & object = objects[index];
+                    ENCELADO_TEST_ASSERT(result[index].m_id == object.m_id);
+                    ENCELADO_TEST_ASSERT(result[index].m_second == object.m_second);
+                    ENCELADO_TEST_ASSERT(result[index].m_point.m_y == object.m_point.m_y);
+                    ENCELADO_TEST_ASSERT(result[index].m_value == object.m_value);
+                    ENCELADO_TEST_ASSERT(result[index].m_points.size() == object.m_points.size());
+                    ENCELADO_TEST_ASSERT(result[index].get_hidden() == object.get_hidden());
+                }
+            }
+
+            void write_errors_test()
+            {
+                type_registry registry;
+
+                // a buffer that can't store a single value (the marker after the int)
+                TestClass     object;
+                binary_writer writer(registry, raw_ptr(&object));
+                unsigned char buffer[sizeof(data_marker) - 1];
+                byte_writer   int_dest(buffer, sizeof(int32_t));
+                ENCELADO_TEST_ASSERT(writer.step(int_dest) == binary_writer::more_space);
+                byte_writer small_dest(buffer, sizeof(buffer));
+                bool        thrown = false;
+                try
+                {
+                    (void)writer.step(small_dest);
+                }
+                catch (const std::invalid_argument &)
+                {
+                    thrown = true;
+                }
+                ENCELADO_TEST_ASSERT(thrown);
+
+                // an object nested deeper than max_depth
+                TestClass deep;
+                auto *    last = &deep;
+                for (size_t depth = 0; depth < binary_writer::max_depth; depth++)
+                {
+                    last->m_objects_1.resize(1);
+                    last = &last->m_objects_1.front();
+                }
+                thrown = false;
+                try
+                {
+                    write_to_pages(registry, raw_ptr(&deep), 4096);
+                }
+                catch (const std::runtime_error &)
+                {
+                    thrown = true;
+                }
+                ENCELADO_TEST_ASSERT(thrown);
+            }
+
+        } // namespace
+
+        void tests()
+        {
+            dyn_value data = make_serialization_test_data();
+
+            type_registry registry;
+            auto const    stream = write_to_pages(registry, data, 512);
+            ENCELADO_TEST_ASSERT(!stream.empty());
+
+            write_test(0, 64);
+            write_test(3, 32);
+            write_test(3, 512);
+            write_test(6, 256);
+            write_test(6, 64 * 1024);
+            write_errors_test();
+
+            read_test(0, 64);
+            read_test(3, 32);
+            read_test(3, 512);
+            read_test(6, 256);
+            read_test(6, 64 * 1024);
+            read_errors_test();
+
+            bulk_test(0, 64);
+            bulk_test(1000, 64);
+            bulk_test(200 * 1000, 4093);
+            bulk_test(200 * 1000, 4 * 1024 * 1024);
+
+            plan_test();
+            virtual_base_test();
+            registry_test();
+            concurrent_registry_test(1);
+            concurrent_registry_test(8);
+            static_test();
+
+            varint_test();
+            compact_test(64);
+            compact_test(4093);
+
+            flat_test();
+
+            parallel_test(1, 4096);
+            parallel_test(4, 4096);
+            parallel_test(7, 333);
+
+            pointer_test(64, wire_format::fixed);
+            pointer_test(4096, wire_format::fixed);
+            pointer_test(64, wire_format::compact);
+
+            interning_test(64, wire_format::fixed);
+            interning_test(4096, wire_format::compact);
+
+            profile_test(wire_format::fixed);
+            profile_test(wire_format::compact);
+
+            delta_test(wire_format::fixed);
+            delta_test(wire_format::compact);
+
+            lazy_test(wire_format::fixed);
+            lazy_test(wire_format::compact);
+
+            tagged_test(wire_format::fixed);
+            tagged_test(wire_format::compact);
+
+            pipelined_test(64, 1);
+            pipelined_test(4096, 4);
+
+            columnar_test(0);
+            columnar_test(1000);
+
+            page_chain_test(256);
+            page_chain_test(4096);
+
+            schema_test(1024);
+            schema_test(4096);
         }
 
     } // namespace serialization
@@ -31,6 +31,9 @@ namespace ediacaran_test
 namespace cambrian_test
 {
     void common_tests();
+    void directory_tests();
+    void btree_tests();
+    void path_cache_tests();
 
     namespace serialization
     {
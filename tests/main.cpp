@@ -55,6 +55,9 @@ int main()
     {
         using namespace cambrian_test;
         common_tests();
+        directory_tests();
+        btree_tests();
+        path_cache_tests();
         serialization::tests();
     }
 